@@ -0,0 +1,257 @@
+/**
+ * @file
+ * BatchPreparation class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osg/Timer>
+#include <cstring>
+#include <iostream>
+#include <QAtomicInt>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QTextStream>
+#include <QThread>
+#include <QThreadPool>
+#include "BatchPreparation.h"
+#include "Lexolights.h"
+#include "LexolightsDocument.h"
+#include "utils/CadworkReaderWriter.h"
+#include "utils/SceneCache.h"
+
+using namespace std;
+using namespace osg;
+
+
+// serializes the progress output of the worker threads
+static QMutex outputMutex;
+
+
+/**
+ * Task of the worker pool. It takes the models one by one
+ * and opens them by LexolightsDocument::OpenOperation.
+ */
+class BatchPreparation::PrepareTask : public QRunnable
+{
+public:
+
+   PrepareTask( const QStringList &models, vector< Result > *results, QAtomicInt *nextModel )
+      : _models( models ), _results( results ), _nextModel( nextModel )  {}
+
+   virtual void run()
+   {
+      while( true ) {
+         int i = _nextModel->fetchAndAddOrdered( 1 );
+         if( i >= _models.size() )
+            break;
+
+         ref_ptr< LexolightsDocument::OpenOperation > openOp = new LexolightsDocument::OpenOperation;
+         openOp->fileName = _models[i];
+         Timer time;
+         bool success = openOp->run();
+
+         // the model is prepared only if its scene is stored in the cache
+         ContentHash::Value key;
+         if( success && !openOp->getCacheKey( key ) )
+            success = false;
+
+         Result &r = (*_results)[i];
+         r.fileName = _models[i];
+         r.success = success;
+         r.cacheHit = openOp->getCacheHit();
+         r.time = time.time_m();
+         for( unsigned int j=0; j<openOp->getNumStages(); j++ )
+            r.stages += QString( "%1%2 %3ms" ).arg( j == 0 ? "" : ", " )
+                                             .arg( openOp->getStageName( j ) )
+                                             .arg( openOp->getStageTime( j ), 0, 'f', 0 );
+
+         QMutexLocker lock( &outputMutex );
+         cout << QString( "[%1/%2] %3 %4" ).arg( i + 1 ).arg( _models.size() )
+                                            .arg( success ? "Prepared" : "Failed" )
+                                            .arg( _models[i] ).toLocal8Bit().constData() << endl;
+      }
+   }
+
+protected:
+
+   const QStringList &_models;
+   vector< Result > *_results;
+   QAtomicInt *_nextModel;
+
+};
+
+
+/**
+ * Returns true if --batch is given on the command line.
+ * It is checked before the application object is created
+ * as the batch preparation does not create any GUI.
+ */
+bool BatchPreparation::isRequested( int argc, char* argv[] )
+{
+   for( int i=1; i<argc; i++ )
+      if( strcmp( argv[i], "--batch" ) == 0 )
+         return true;
+   return false;
+}
+
+
+/**
+ * Prepares the models listed in the file given by --batch
+ * and prints the report.
+ *
+ * @return Exit code of the application: 0 if all the models were prepared,
+ * 1 if any of them failed and 99 for command line errors.
+ */
+int BatchPreparation::run( int &argc, char* argv[] )
+{
+   QCoreApplication app( argc, argv );
+
+   // the same names as used by Lexolights
+   // (the scene cache location is derived from them)
+   app.setOrganizationName( "Cadwork Informatik" );
+   app.setOrganizationDomain( "www.cadwork.com" );
+   app.setApplicationName( "Lexolights" );
+
+   // options
+   Options *options = new Options( argc, argv );
+   Lexolights::g_options = options;
+   if( options->exitTime == Options::AFTER_PARSING_CMDLINE ||
+       options->reportRemainingOptionsAsUnrecognized() )
+      return 99;
+   if( options->noSceneCache ) {
+      cerr << "--batch stores the prepared scenes in the scene cache. "
+              "It can not be used together with --no-scene-cache." << endl;
+      return 99;
+   }
+   if( options->exportScene ) {
+      cerr << "--batch prepares many models in parallel. "
+              "It can not be used together with --export-scene." << endl;
+      return 99;
+   }
+
+   // KdTrees and converted scenes are not stored in the scene cache,
+   // so there is no point in building them
+   options->lazyKdTree = true;
+   options->no_conversion = true;
+
+   // readers
+   CadworkReaderWriter::createAliases();
+   if( options->nativeIvx )
+      Lexolights::setupNativeIvx();
+
+   // list of models
+   QStringList models;
+   if( !readModelList( options->batchListFile, models ) )
+      return 99;
+
+   // number of threads
+   int numThreads = options->batchThreads;
+   if( numThreads <= 0 )
+      numThreads = QThread::idealThreadCount();
+   if( numThreads > models.size() )
+      numThreads = models.size();
+   if( numThreads < 1 )
+      numThreads = 1;
+
+   cout << "Preparing " << models.size() << " models using " << numThreads << " threads.\n"
+           "Scene cache: " << SceneCache::getDirectory() << endl;
+
+   // prepare models on the worker pool
+   Timer time;
+   vector< Result > results( models.size() );
+   QAtomicInt nextModel( 0 );
+   QThreadPool pool;
+   pool.setMaxThreadCount( numThreads );
+   for( int i=0; i<numThreads; i++ )
+      pool.start( new PrepareTask( models, &results, &nextModel ) );
+   pool.waitForDone();
+
+   // report
+   printReport( results, time.time_m(), numThreads );
+
+   Lexolights::g_options = NULL;
+   delete options;
+
+   for( unsigned int i=0; i<results.size(); i++ )
+      if( !results[i].success )
+         return 1;
+   return 0;
+}
+
+
+/**
+ * Reads the list of models, one file name per line.
+ * Empty lines and lines starting by # are ignored.
+ * Relative file names are relative to the directory of the list file.
+ */
+bool BatchPreparation::readModelList( const QString &listFileName, QStringList &models )
+{
+   QFile file( listFileName );
+   if( !file.open( QIODevice::ReadOnly | QIODevice::Text ) ) {
+      cerr << "Can not open model list " << listFileName.toLocal8Bit().constData() << "." << endl;
+      return false;
+   }
+
+   QDir listDir = QFileInfo( listFileName ).absoluteDir();
+   QTextStream stream( &file );
+   stream.setCodec( "UTF-8" );
+   while( !stream.atEnd() ) {
+      QString line = stream.readLine().trimmed();
+      if( line.isEmpty() || line.startsWith( '#' ) )
+         continue;
+      models.append( QDir::cleanPath( listDir.absoluteFilePath( line ) ) );
+   }
+
+   if( models.isEmpty() ) {
+      cerr << "No models listed in " << listFileName.toLocal8Bit().constData() << "." << endl;
+      return false;
+   }
+
+   return true;
+}
+
+
+/**
+ * Prints the time of each model and the times of its open stages
+ * (measured from the start of the model's open operation).
+ */
+void BatchPreparation::printReport( const vector< Result > &results, double totalTime, int numThreads )
+{
+   int numPrepared = 0;
+   int numCacheHits = 0;
+   int numFailed = 0;
+   double sumTime = 0.;
+
+   cout << "\nBatch preparation report:" << endl;
+   for( unsigned int i=0; i<results.size(); i++ )
+   {
+      const Result &r = results[i];
+      const char *status = !r.success ? "FAILED" : r.cacheHit ? "CACHED" : "OK";
+      cout << QString( "   %1 %2ms  %3" ).arg( status, -6 ).arg( r.time, 10, 'f', 2 )
+                                         .arg( r.fileName ).toLocal8Bit().constData() << endl;
+      if( !r.stages.isEmpty() )
+         cout << "                        (" << r.stages.toLocal8Bit().constData() << ")" << endl;
+
+      if( !r.success )
+         numFailed++;
+      else if( r.cacheHit )
+         numCacheHits++;
+      else
+         numPrepared++;
+      sumTime += r.time;
+   }
+
+   cout << QString( "%1 models prepared, %2 already in the cache, %3 failed.\n"
+                    "Total time %4ms (%5 threads, serial time %6ms, speedup %7x)." )
+                    .arg( numPrepared ).arg( numCacheHits ).arg( numFailed )
+                    .arg( totalTime, 0, 'f', 2 ).arg( numThreads )
+                    .arg( sumTime, 0, 'f', 2 )
+                    .arg( totalTime > 0. ? sumTime / totalTime : 1., 0, 'f', 2 )
+                    .toLocal8Bit().constData() << endl;
+}
@@ -0,0 +1,54 @@
+/**
+ * @file
+ * BatchPreparation class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef BATCH_PREPARATION_H
+#define BATCH_PREPARATION_H
+
+#include <QString>
+#include <QStringList>
+#include <vector>
+
+
+/**
+ * Headless preparation of many models.
+ *
+ * The models listed in the file given by --batch are opened
+ * by the same pipeline as in the application (see LexolightsDocument::OpenOperation)
+ * on the pool of worker threads. The prepared scenes are stored in the scene cache,
+ * so the models are opened instantly by the application later.
+ * No GUI and no OpenGL context is created.
+ *
+ * When all models are processed, the report with the times
+ * of the open stages of each model is printed to the standard output.
+ */
+class BatchPreparation
+{
+public:
+
+   static bool isRequested( int argc, char* argv[] );
+   static int run( int &argc, char* argv[] );
+
+protected:
+
+   struct Result {
+      QString fileName;
+      bool success;
+      bool cacheHit;
+      double time;
+      QString stages;
+      Result() : success( false ), cacheHit( false ), time( 0. )  {}
+   };
+
+   class PrepareTask;
+
+   static bool readModelList( const QString &listFileName, QStringList &models );
+   static void printReport( const std::vector< Result > &results, double totalTime, int numThreads );
+
+};
+
+
+#endif /* BATCH_PREPARATION_H */
@@ -6,11 +6,18 @@
  * @author PCJohn (Jan Pečiva)
  */
 
+#include <osg/Program>
 #include <osgViewer/ViewerEventHandlers>
+#include <set>
 #include "CadworkViewer.h"
 #include "gui/CadworkOrbitManipulator.h"
 #include "gui/CadworkFirstPersonManipulator.h"
+#include "lighting/AdaptiveQualityController.h"
+#include "lighting/ShadowMapManager.h"
 #include "lighting/ShadowVolume.h"
+#include "utils/LoadProfiler.h"
+#include "utils/ProgressiveRefinement.h"
+#include "utils/StateSetVisitor.h"
 
 using namespace osg;
 
@@ -52,6 +59,28 @@ struct MyFinalDrawCallback : public Camera::DrawCallback
 
 OpenThreads::Mutex MyInitialDrawCallback::mutex;
 
+/** Compiles shader programs of the scene. Used by the load profiling
+ *  to measure the shader compilation separately from the first frame drawing. */
+class ProgramCompileVisitor : public StateSetVisitor
+{
+public:
+
+    ProgramCompileVisitor( osg::State &state ) : _state( state ) {}
+
+    virtual void apply( osg::StateSet& stateSet )
+    {
+        osg::Program *program = dynamic_cast< osg::Program* >( stateSet.getAttribute( StateAttribute::PROGRAM ) );
+        if( program && _compiled.insert( program ).second )
+            program->compileGLObjects( _state );
+    }
+
+protected:
+
+    osg::State &_state;
+    std::set< osg::Program* > _compiled;
+
+};
+
 
 
 CadworkViewer::CadworkViewer()
@@ -89,6 +118,18 @@ void CadworkViewer::commonConstructor()
 
    setCameraManipulator( currentManipulator, false ); // non-virtual method of osgViewer::View
 
+   // lower the rendering quality while the manipulators move the camera
+   // (disabled until the frame time budget is set)
+   qualityController = new AdaptiveQualityController();
+   this->addEventHandler( qualityController );
+
+   // accumulate anti-aliased image while the camera is still
+   // (disabled by default; it wraps the final draw callback set above)
+   progressiveRefinement = new ProgressiveRefinement();
+   progressiveRefinement->install( getCamera() );
+   progressiveRefinement->setQualityController( qualityController );
+   this->addEventHandler( progressiveRefinement );
+
    // initialize shadow volumes
    osgShadow::ShadowVolume::setupDisplaySettings( this );
 
@@ -97,6 +138,10 @@ void CadworkViewer::commonConstructor()
    osgViewer::StatsHandler *eh = new osgViewer::StatsHandler();
    this->addEventHandler( eh );
 
+   // per-light shadow map statistics
+   ShadowMapManager::instance()->setViewerStats( getViewerStats() );
+   ShadowMapManager::instance()->addStatsLines( eh );
+
    // show stats handler in debug
 #if 0 //ifndef NDEBUG
    osg::ref_ptr< osgGA::GUIEventAdapter > keyEvent = this->getEventQueue()->createEvent();
@@ -256,6 +301,15 @@ void MyInitialDrawCallback::operator () (osg::RenderInfo& renderInfo) const
                                  .arg( pos.x() ).arg( pos.y() ).arg( pos.z() ) << Log::endm;
 #endif
 
+   // compile shaders of the loaded model before its first frame
+   // when profiling the load (they would be compiled during the drawing otherwise)
+   if( LoadProfiler::frameStarted() )
+   {
+      LoadProfiler::Scope profile( "shader compilation", "shaders" );
+      ProgramCompileVisitor compileVisitor( *renderInfo.getState() );
+      renderInfo.getCurrentCamera()->accept( compileVisitor );
+   }
+
    // record the start frame time
    _frameStartTime.setStartTick();
 
@@ -279,6 +333,13 @@ void MyFinalDrawCallback::operator () (osg::RenderInfo& renderInfo) const
    // get frame number
    unsigned int frameNumber = renderInfo.getState()->getFrameStamp()->getFrameNumber();
 
+   // frame time for shadow map resolution control
+   ShadowMapManager::instance()->reportFrameCompleted( frameNumber );
+
+   // the first frame of the loaded model finishes the load profile
+   if( _initialCallback.valid() )
+      LoadProfiler::frameCompleted( _initialCallback->_frameStartTime.time_m() );
+
    // put message to log for first few frames
    if( frameNumber <= 3)
    {
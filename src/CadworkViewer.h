@@ -16,6 +16,8 @@ namespace osgGA {
    class OrbitManipulator;
    class FirstPersonManipulator;
 };
+class AdaptiveQualityController;
+class ProgressiveRefinement;
 
 
 /**
@@ -49,6 +51,12 @@ public:
    inline bool isOrbitManipulatorActive() const;
    inline bool isFirstPersonManipulatorActive() const;
 
+   // rendering quality during the camera motion
+   inline AdaptiveQualityController* getQualityController();
+
+   // anti-aliasing while the camera is still
+   inline ProgressiveRefinement* getProgressiveRefinement();
+
    // background color
    void setBackgroundColor(const osg::Vec4 &color);
    void setBackgroundColor(const float &red, const float &green,
@@ -63,6 +71,8 @@ protected:
    osgGA::StandardManipulator* currentManipulator;
    osg::ref_ptr< osgGA::OrbitManipulator > orbitManipulator;
    osg::ref_ptr< osgGA::FirstPersonManipulator > firstPersonManipulator;
+   osg::ref_ptr< AdaptiveQualityController > qualityController;
+   osg::ref_ptr< ProgressiveRefinement > progressiveRefinement;
 
 };
 
@@ -75,6 +85,8 @@ inline osg::Camera* CadworkViewer::getSceneWithCamera()  { return this->getCamer
 inline const osg::Camera* CadworkViewer::getSceneWithCamera() const  { return this->getCamera(); }
 inline bool CadworkViewer::isOrbitManipulatorActive() const  { return getCameraManipulator() == (const osgGA::CameraManipulator*)orbitManipulator.get(); }
 inline bool CadworkViewer::isFirstPersonManipulatorActive() const  { return getCameraManipulator() == (const osgGA::CameraManipulator*)firstPersonManipulator.get(); }
+inline AdaptiveQualityController* CadworkViewer::getQualityController()  { return qualityController.get(); }
+inline ProgressiveRefinement* CadworkViewer::getProgressiveRefinement()  { return progressiveRefinement.get(); }
 
 
 #endif /* CADWORK_VIEWER_H */
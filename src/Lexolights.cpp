@@ -8,6 +8,7 @@
 
 #include <osg/Timer>
 #include <osgDB/ReadFile>
+#include <osgDB/Registry>
 #include <osgGA/FirstPersonManipulator>
 #include <osgGA/OrbitManipulator>
 #include <osgQt/GraphicsWindowQt>
@@ -22,8 +23,12 @@
 #include "CadworkViewer.h"
 #include "gui/MainWindow.h"
 #include "gui/CentralContainer.h"
+#include "lighting/AdaptiveQualityController.h"
+#include "lighting/ShadowMapManager.h"
 #include "lighting/ShadowVolume.h"
 #include "utils/Log.h"
+#include "utils/LoadProfiler.h"
+#include "utils/ProgressiveRefinement.h"
 #include "utils/CadworkReaderWriter.h"
 #include "utils/WinRegistry.h"
 
@@ -71,10 +76,13 @@ Lexolights::Lexolights( int &argc, char* argv[], bool initialize )
 
    // Options (cmd-line,...)
    if( !options() ) {
+      LoadProfiler::Scope profile( "argument parsing", "args" );
       g_options = new Options( argc, argv );
       if( options()->exitTime == Options::AFTER_PARSING_CMDLINE )
          std::exit( 99 );
    }
+   LoadProfiler::setOutput( options()->loadProfileFile, options()->loadProfileSummaryFile );
+   LoadProfiler::setModelName( options()->startUpModelName );
 
    // call init
    if( initialize )
@@ -92,6 +100,28 @@ void Lexolights::init()
    // time of initialization start
    osg::Timer time;
 
+   // benchmark model reading and exit
+   if( options()->benchmarkReader ) {
+      if( options()->startUpModelName.isEmpty() ) {
+         Log::fatal() << "No model given for --benchmark-reader." << Log::endm;
+         std::exit( 99 );
+      }
+      std::exit( CadworkReaderWriter::benchmark( options()->startUpModelName.toUtf8().constData() ) ? 0 : 1 );
+   }
+
+   // compare native ivx parser with Inventor plugin and exit
+   if( options()->compareIvxParser ) {
+      if( options()->startUpModelName.isEmpty() ) {
+         Log::fatal() << "No model given for --compare-ivx-parser." << Log::endm;
+         std::exit( 99 );
+      }
+      std::exit( CadworkReaderWriter::compareParsers( options()->startUpModelName.toUtf8().constData() ) ? 0 : 1 );
+   }
+
+   // native ivx parser
+   if( options()->nativeIvx )
+      setupNativeIvx();
+
    // open model asynchronously on background thread
    LexolightsDocument *startUpModel = NULL;
    if( !options()->startUpModelName.isEmpty() &&
@@ -120,6 +150,7 @@ void Lexolights::init()
 
    // create Viewer
    Log::info() << "GUI building started..." << std::endl;
+   double guiStartTime = LoadProfiler::getTime();
    g_viewer = new CadworkViewer( *options()->argumentParser );
 
    // set Viewer's threading model
@@ -139,6 +170,16 @@ void Lexolights::init()
    // set Viewer's run scheme (defaults to ON_DEMAND)
    g_viewer->setRunFrameScheme( options()->continuousUpdate ? osgViewer::ViewerBase::CONTINUOUS : osgViewer::ViewerBase::ON_DEMAND );
 
+   // shadow map frame time budget
+   ShadowMapManager::instance()->setFrameTimeBudget( options()->shadowMapBudget );
+
+   // interactive frame time budget
+   g_viewer->getQualityController()->setFrameTimeBudget( options()->interactiveBudget );
+
+   // progressive refinement
+   g_viewer->getProgressiveRefinement()->setNumSamples( options()->progressiveSamples );
+   g_viewer->getProgressiveRefinement()->setEnabled( options()->progressiveRefinement );
+
    // report errors of command line
    if( options()->reportRemainingOptionsAsUnrecognized() )
        std::exit( 99 );
@@ -154,6 +195,7 @@ void Lexolights::init()
    // (the time includes parsing of command line options and updating of file associations)
    Log::notice() << QString( "GUI building completed in %1ms."
                            ).arg( time.time_m(), 0, 'f', 2 ) << Log::endm;
+   LoadProfiler::record( "GUI build", "gui", guiStartTime );
 
    if( options()->no_threads )
    {
@@ -168,6 +210,20 @@ void Lexolights::init()
 }
 
 
+/**
+ * Makes ivx and ivl files to be read by the native parser (see IvxParser).
+ * The parser is selected by the option string of the default reading options.
+ */
+void Lexolights::setupNativeIvx()
+{
+   osgDB::Registry *registry = osgDB::Registry::instance();
+   ref_ptr< osgDB::Options > readOptions = registry->getOptions() ?
+         new osgDB::Options( *registry->getOptions() ) : new osgDB::Options;
+   readOptions->setOptionString( readOptions->getOptionString() + " NativeIvx" );
+   registry->setOptions( readOptions.get() );
+}
+
+
 void Lexolights::realize()
 {
    viewer()->realize();
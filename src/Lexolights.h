@@ -57,6 +57,8 @@ public:
    static void unregisterFileAssociations();
 
 protected:
+   static void setupNativeIvx();
+
    static bool _initialized;
    static osg::ref_ptr< LexolightsDocument > g_activeDocument;
    static Options *g_options;
@@ -64,6 +66,9 @@ protected:
 private:
    static MainWindow *g_mainWindow;
    static osg::ref_ptr< CadworkViewer > g_viewer;
+
+   friend class BatchPreparation;
+   friend class RenderBenchmark;
 };
 
 
@@ -12,11 +12,12 @@
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
 #include <osgDB/ConvertUTF>
+#include <OpenThreads/ScopedLock>
+#include <algorithm>
 #include <QDir>
 #include <QCoreApplication>
 #include <QEvent>
 #include <QFileInfo>
-#include <QFileSystemWatcher>
 #if defined(__WIN32__) || defined(_WIN32)
 # include <windows.h>
 # include <process.h>
@@ -32,12 +33,25 @@
 #endif
 #include "LexolightsDocument.h"
 #include "Lexolights.h"
+#include "ReloadScheduler.h"
+#include "CadworkViewer.h"
 #include "gui/MainWindow.h"
+#include "utils/BuildTime.h"
+#include "utils/CadworkReaderWriter.h"
+#include "utils/GeometryDeduplicator.h"
+#include "utils/LoadProfiler.h"
+#include "utils/LodGenerator.h"
 #include "utils/Log.h"
-#include "utils/minizip/unzip.h"
+#include "utils/OcclusionQueryInserter.h"
+#include "utils/ParallelKdTreeBuilder.h"
+#include "utils/SceneCache.h"
+#include "utils/SceneOptimizer.h"
 #include "utils/SetAnisotropicFilteringVisitor.h"
+#include "utils/SysInfo.h"
+#include "utils/StateSetVisitorPipeline.h"
 #include "utils/TextureUnitsUsageVisitor.h"
 #include "utils/TextureUnitMoverVisitor.h"
+#include "utils/ZipArchive.h"
 
 using namespace osg;
 using namespace osgDB;
@@ -55,11 +69,15 @@ static bool removeDirRecursively( const std::wstring &dirName );
 LexolightsDocument::LexolightsDocument()
    : _openOpThread( NULL ),
      _asyncSuccess( false ),
-     _openFileDescriptor( INVALID_HANDLE_VALUE )
+     _openFileDescriptor( INVALID_HANDLE_VALUE ),
+     _originalSceneReleased( false ),
+     _sceneInCache( false ),
+     _hasContentHash( false )
 {
-   _watcher = new QFileSystemWatcher;
-   connect( _watcher, SIGNAL( fileChanged( const QString& ) ),
-            this, SLOT( fileChanged( const QString& ) ), Qt::QueuedConnection );
+   _reloadScheduler = new ReloadScheduler( this );
+   _reloadScheduler->setSettleTime( Lexolights::options()->reloadDelay );
+   connect( _reloadScheduler, SIGNAL( reloadRequested( const QString& ) ),
+            this, SLOT( fileChanged( const QString& ) ) );
 }
 
 
@@ -69,7 +87,6 @@ LexolightsDocument::LexolightsDocument()
 LexolightsDocument::~LexolightsDocument()
 {
    close();
-   delete _watcher;
    if( _openFileDescriptor != INVALID_HANDLE_VALUE ) {
       Log::warn() << "LexolightsDocument::~LexolightsDocument: Closing trailig locking file descriptor." << Log::endm;
 #if defined(__WIN32__) || defined(_WIN32)
@@ -86,8 +103,13 @@ void LexolightsDocument::fileChanged( const QString &fileName )
 {
    Log::notice() << "LexolightsDocument: Reloading file '" << fileName
                  << "' as it has been modified on the disk." << endl;
-   openFile( fileName );
-   emit sceneChanged();
+
+   // reload in the background
+   // (ReloadScheduler requests the reload when the file settled and its content changed;
+   // the next request cancels the reload in progress, sceneChanged() is emitted
+   // when the reload completes; conversion results of the unchanged parts
+   // are reused, see openFile())
+   openFile( fileName, true, false, false );
 }
 
 
@@ -115,6 +137,29 @@ bool LexolightsDocument::isOpenInProgress()
 }
 
 
+/**
+ * Cancels the open operation running in the background, if any.
+ *
+ * The operation stops at its next check of the cancellation token
+ * (between the open stages and inside of the long traversals)
+ * and nothing of it is displayed. The function does not wait
+ * for the operation to finish, use waitForOpenCompleted() for that.
+ */
+void LexolightsDocument::cancelOpen()
+{
+   if( !_openOpThread )
+      return;
+
+   OpenOperation *openOp = _openOpThread->getOpenOperation();
+   if( openOp->cancellationToken.valid() && !openOp->isCanceled() ) {
+      openOp->cancellationToken->cancel();
+      Log::notice() << QString( "LexolightsDocument: Canceling the loading of %1 (running for %2ms)." )
+                       .arg( openOp->fileName )
+                       .arg( openOp->getElapsedTime(), 0, 'f', 2 ) << Log::endm;
+   }
+}
+
+
 bool LexolightsDocument::waitForOpenCompleted()
 {
    if( _openOpThread )
@@ -133,6 +178,13 @@ bool LexolightsDocument::waitForOpenCompleted()
 
 bool LexolightsDocument::openFile( const QString &fileName, bool background, bool openInMainWindow, bool resetViewSettings )
 {
+   // conversion results are reused only when the same file is opened again
+   if( !canReuseConversion( fileName ) )
+      _conversionCache = NULL;
+   else
+      if( !_conversionCache )
+         _conversionCache = new PerPixelLighting::ConversionCache;
+
    // close previous document (if any)
    close();
 
@@ -174,8 +226,8 @@ bool LexolightsDocument::openFile( const QString &fileName, bool background, boo
    }
 #endif
 
-   // set watcher
-   _watcher->addPath( _fileName );
+   // watch the file for changes
+   _reloadScheduler->watch( _fileName );
 
    // get time stamp
    _sceneTimeStamp.set( _fileName.toStdString() );
@@ -183,6 +235,13 @@ bool LexolightsDocument::openFile( const QString &fileName, bool background, boo
    // prepare OpenOperation
    ref_ptr< OpenOperation > openOperation = new OpenOperation;
    openOperation->fileName = _fileName;
+   openOperation->cancellationToken = new CancellationToken;
+
+   // conversion cache
+   // (the nodes of the displayed scenes reused by the new scenes are spliced
+   // into them by the main thread when the open completes,
+   // see PerPixelLighting::ConversionCache::commit())
+   openOperation->conversionCache = _conversionCache;
 
    // set variables
    _asyncSuccess = false;
@@ -201,8 +260,20 @@ bool LexolightsDocument::openFile( const QString &fileName, bool background, boo
    {
       // run operation
       bool r = openOperation->run();
+      if( r && openOperation->conversionCache.valid() )
+         openOperation->conversionCache->commit();
       _originalScene = openOperation->getOriginalScene();
       _pplScene = openOperation->getPPLScene();
+      _hasContentHash = openOperation->getContentHash( _contentHash );
+      if( _hasContentHash )
+         _reloadScheduler->setContentHash( _contentHash );
+      _sceneInCache = openOperation->getCacheKey( _cacheKey );
+      if( r ) {
+         scheduleKdTreeBuild();
+         releaseOriginalScene();
+         logResidentMemory();
+      }
+      LoadProfiler::loadCompleted( r );
 
       // close locking file
       if( _openFileDescriptor != INVALID_HANDLE_VALUE )
@@ -221,18 +292,44 @@ bool LexolightsDocument::openFile( const QString &fileName, bool background, boo
 }
 
 
+/**
+ * Returns true if the conversion results of the current scene can be reused
+ * when the file is opened (see PerPixelLighting::ConversionCache).
+ *
+ * The results are reused only when the same file is opened again.
+ * The cache keeps the original scene alive, so it is not used in lean memory mode.
+ */
+bool LexolightsDocument::canReuseConversion( const QString &fileName ) const
+{
+   return fileName == _fileName && !Lexolights::options()->no_conversion &&
+          !Lexolights::options()->leanMemory;
+}
+
+
 void LexolightsDocument::close()
 {
-   // finish async open
+   // cancel async open and wait for it
+   // (the newer open request supersedes the older one)
+   cancelOpen();
    waitForOpenCompleted();
 
+   // stop lazy KdTree building
+   if( _kdTreeBuilder.valid() ) {
+      _kdTreeBuilder->cancel();
+      _kdTreeBuilder->waitForDone();
+      _kdTreeBuilder = NULL;
+   }
+
    // purge scene graph
    _originalScene = NULL;
+   _releasedOriginalScene = NULL;
+   _originalSceneReleased = false;
+   _sceneInCache = false;
    _pplScene = NULL;
+   _hasContentHash = false;
 
    // empty file name and watcher
-   if( !_fileName.isEmpty() )
-      _watcher->removePath( _fileName );
+   _reloadScheduler->unwatch();
    _fileName.clear();
 
    // remove temporary directory
@@ -253,20 +350,53 @@ void LexolightsDocument::close()
 }
 
 
+/**
+ * Opens the model given by _modelFileName.
+ *
+ * The model is read and prepared by readModel().
+ * The rest of the processing is performed by prepareScene().
+ */
 bool LexolightsDocument::OpenOperation::openModel()
+{
+   // read the model
+   if( !readModel() )
+      return false;
+   stageCompleted( "scene read" );
+   if( isCanceled() )
+      return false;
+
+   // finish the scene
+   return prepareScene();
+}
+
+
+/**
+ * Reads the model given by _modelFileName, optimizes it
+ * (if requested by --optimize), shares identical geometries
+ * and performs the texture setup on the loaded scene.
+ */
+bool LexolightsDocument::OpenOperation::readModel()
 {
    // clear result variables (just for sure)
    _unzipDir = "";
    _originalScene = NULL;
    _pplScene = NULL;
+   _kdTreeBuilder = NULL;
 
 
    // load the model
    Timer time;
+   double profileTime = LoadProfiler::getTime();
    QByteArray fna( _modelFileName.toUtf8() );
    const char *fn = fna.data();
-   _originalScene = osgDB::readNodeFile( fn );
+   if( osgDB::getLowerCaseFileExtension( fn ) == "iv" ) {
+      // Inventor plugin is not thread-safe (see CadworkReaderWriter::getInventorMutex())
+      OpenThreads::ScopedLock< OpenThreads::Mutex > lock( *CadworkReaderWriter::getInventorMutex() );
+      _originalScene = osgDB::readNodeFile( fn );
+   } else
+      _originalScene = osgDB::readNodeFile( fn );
    double loadingTime = time.time_m();
+   LoadProfiler::record( "file read", "read", profileTime );
 
    if( !_originalScene.valid() ) {
 
@@ -281,67 +411,345 @@ bool LexolightsDocument::OpenOperation::openModel()
    Log::notice() << QString( "Model %1 loading completed successfully "
                              "in %2ms." ).arg( _modelFileName )
                                          .arg( loadingTime, 0, 'f', 2 ) << Log::endm;
+   if( isCanceled() )
+      return false;
 
 
-   // build KdTree
-   time.setStartTick();
-   osg::ref_ptr< KdTreeBuilder > builder = new KdTreeBuilder;
-   _originalScene->accept( *builder );
-   builder = NULL;
-   Log::info() << QString( "KdTree built in %1ms (model %2)." )
-                          .arg( time.time_m() )
-                          .arg( _modelFileName ) << Log::endm;
+   // optimize the scene
+   // (before the rest of the preparation, so it works on the final geometries)
+   if( Lexolights::options()->optimizePreset != SceneOptimizer::NONE ) {
+      profileTime = LoadProfiler::getTime();
+      SceneOptimizer optimizer( Lexolights::options()->optimizePreset );
+      optimizer.optimize( _originalScene );
+      LoadProfiler::record( "scene optimization", "visitors", profileTime );
+      Log::info() << QString( "Scene optimization (preset %1) performed in %2ms (model %3): "
+                              "draw calls %4 -> %5, triangles %6 -> %7." )
+                             .arg( SceneOptimizer::getPresetName( optimizer.getPreset() ) )
+                             .arg( optimizer.getTime(), 0, 'f', 2 )
+                             .arg( _modelFileName )
+                             .arg( optimizer.getDrawCallsBefore() )
+                             .arg( optimizer.getDrawCallsAfter() )
+                             .arg( optimizer.getTrianglesBefore() )
+                             .arg( optimizer.getTrianglesAfter() ) << Log::endm;
+      stageCompleted( "scene optimized" );
+      if( isCanceled() )
+         return false;
+   }
 
 
-   // reset time
-   time.setStartTick();
+   // share identical geometries
+   // (CAD models contain the same parts many times, each one with its own copy of the geometry)
+   if( !Lexolights::options()->noDeduplication ) {
+      Timer dedupTime;
+      profileTime = LoadProfiler::getTime();
+      GeometryDeduplicator deduplicator;
+      deduplicator.setCancellationToken( cancellationToken );
+      _originalScene->accept( deduplicator );
+      LoadProfiler::record( "geometry deduplication", "visitors", profileTime );
+      if( isCanceled() )
+         return false;
+      Log::info() << QString( "Geometry deduplication performed in %1ms (model %2): "
+                              "%3 of %4 geometries replaced by shared instances, %5KiB saved." )
+                             .arg( dedupTime.time_m(), 0, 'f', 2 )
+                             .arg( _modelFileName )
+                             .arg( deduplicator.getNumReplaced() )
+                             .arg( deduplicator.getNumGeometries() )
+                             .arg( ( deduplicator.getMemorySaved() + 1023 ) / 1024 ) << Log::endm;
+   }
 
 
-   // set anisotropy filtering for textures
-   SetAnisotropicFilteringVisitor safv( 32.f );
-   _originalScene->accept( safv );
+   // replace heavy parts by LODs with simplified geometry
+   // (before the occlusion queries, so the queries are placed above the LODs)
+   if( Lexolights::options()->lodMinTriangles > 0 ) {
+      Timer lodTime;
+      profileTime = LoadProfiler::getTime();
+      LodGenerator generator( Lexolights::options()->lodMinTriangles, Lexolights::options()->lodPixelSize );
+      generator.setCancellationToken( cancellationToken );
+      generator.setUseDiskCache( !Lexolights::options()->noSceneCache );
+      _originalScene->accept( generator );
+      generator.generate();
+      LoadProfiler::record( "LOD generation", "visitors", profileTime );
+      if( isCanceled() )
+         return false;
+      Log::info() << QString( "LOD generation performed in %1ms (model %2, %3 threads, "
+                              "serial time %4ms): %5 LODs, %6 simplified geometries "
+                              "(%7 from the cache), triangles %8 -> %9 at the coarsest level." )
+                             .arg( lodTime.time_m(), 0, 'f', 2 )
+                             .arg( _modelFileName )
+                             .arg( generator.getNumThreads() )
+                             .arg( generator.getSerialTime(), 0, 'f', 2 )
+                             .arg( generator.getNumLods() )
+                             .arg( generator.getNumSimplified() )
+                             .arg( generator.getNumCacheHits() )
+                             .arg( generator.getTrianglesBefore() )
+                             .arg( generator.getTrianglesAfter() ) << Log::endm;
+      stageCompleted( "LODs generated" );
+   }
+
+   // insert occlusion queries
+   // (after the optimization and deduplication, so the subgraphs are final)
+   if( Lexolights::options()->occlusionCulling > 0 ) {
+      Timer queryTime;
+      profileTime = LoadProfiler::getTime();
+      OcclusionQueryInserter inserter( Lexolights::options()->occlusionCulling );
+      inserter.setCancellationToken( cancellationToken );
+      _originalScene->accept( inserter );
+      LoadProfiler::record( "occlusion query insertion", "visitors", profileTime );
+      if( isCanceled() )
+         return false;
+      Log::info() << QString( "Occlusion queries inserted in %1ms (model %2): "
+                              "%3 query nodes, %4 vertices, at least %5 vertices per query." )
+                             .arg( queryTime.time_m(), 0, 'f', 2 )
+                             .arg( _modelFileName )
+                             .arg( inserter.getNumQueryNodes() )
+                             .arg( inserter.getNumVertices() )
+                             .arg( inserter.getMinVertices() ) << Log::endm;
+   }
+
 
+   // reset time
+   time.setStartTick();
+   profileTime = LoadProfiler::getTime();
+
+
+   // prepare the scene in a single traversal:
+   // set anisotropy filtering for textures, detect texture units usage
+   // and collect geometries for KdTree building (unless KdTree building is lazy)
+   ref_ptr< TextureUnitsUsageVisitor > tuuv = new TextureUnitsUsageVisitor;
+   StateSetVisitorPipeline pipeline;
+   pipeline.setCancellationToken( cancellationToken );
+   pipeline.addStep( new SetAnisotropicFilteringVisitor( 32.f ), "AnisotropicFiltering setup" );
+   pipeline.addStep( tuuv, "TextureUnit usage check" );
+   if( !Lexolights::options()->lazyKdTree ) {
+      _kdTreeBuilder = new ParallelKdTreeBuilder;
+      if( cancellationToken.valid() )
+         _kdTreeBuilder->setCancellationToken( cancellationToken );
+      pipeline.addStep( new KdTreeGeometryCollector( _kdTreeBuilder ), "KdTree geometry collection" );
+   }
+   _originalScene->accept( pipeline );
+   double traversalTime = time.time_m();
+   if( isCanceled() )
+      return false;
 
-   // detect texture units usage
-   TextureUnitsUsageVisitor tuuv;
-   _originalScene->accept( tuuv );
    OSG_INFO << "TextureUnitUsageVisitor results:" << endl;
-   for( unsigned int i=0; i<tuuv._attributesFound.size(); i++ )
-      OSG_INFO << "   Texture unit " << i << " attribute " << (tuuv._attributesFound[i] ? "found" : "not found") << endl;
-   for( unsigned int i=0; i<tuuv._modeOn.size(); i++ )
-      OSG_INFO << "   Texture unit " << i << " mode " << (tuuv._modeOn[i] ? "on" : "off") << endl;
-   if( tuuv._attributesFound.size() == 0 && tuuv._modeOn.size() == 0 )
+   for( unsigned int i=0; i<tuuv->_attributesFound.size(); i++ )
+      OSG_INFO << "   Texture unit " << i << " attribute " << (tuuv->_attributesFound[i] ? "found" : "not found") << endl;
+   for( unsigned int i=0; i<tuuv->_modeOn.size(); i++ )
+      OSG_INFO << "   Texture unit " << i << " mode " << (tuuv->_modeOn[i] ? "on" : "off") << endl;
+   if( tuuv->_attributesFound.size() == 0 && tuuv->_modeOn.size() == 0 )
       OSG_INFO << "   No texture units used." << endl;
 
    // if texture unit 0 is empty and other units are used,
    // move content of the unit 1 to the unit 0
-   if( tuuv._attributesFound.size() >= 2 )
+   // (the move depends on the usage of all the texture units,
+   // so it is performed by the second, deferred traversal)
+   StateSetVisitorPipeline moverPipeline;
+   Timer moverTime;
+   if( tuuv->_attributesFound.size() >= 2 )
    {
-      if( tuuv._modeOn.size() <= 0 || tuuv._modeOn[0] == false )
+      if( tuuv->_modeOn.size() <= 0 || tuuv->_modeOn[0] == false )
       {
-         OSG_NOTICE << "Model uses " << osg::maximum( tuuv._attributesFound.size(), tuuv._modeOn.size() )
+         OSG_NOTICE << "Model uses " << osg::maximum( tuuv->_attributesFound.size(), tuuv->_modeOn.size() )
                     << " texturing units while the unit 0 is not used.\n"
                        "    Moving texture unit 1 content to texture unit 0." << endl;
 
          // move content of the texturing unit 1 to the unit 0
-         TextureUnitMoverVisitor tumv( 1, 0 );
-         _originalScene->accept( tumv );
+         moverPipeline.addStep( new TextureUnitMoverVisitor( 1, 0 ), "TextureUnit move" );
+         _originalScene->accept( moverPipeline );
       }
       else
-         OSG_INFO << "Model uses " << osg::maximum( tuuv._attributesFound.size(), tuuv._modeOn.size() )
+         OSG_INFO << "Model uses " << osg::maximum( tuuv->_attributesFound.size(), tuuv->_modeOn.size() )
                   << " texturing units and texturing unit 0\n"
                      "   seems to be used. No content move is performed." << endl;
 
    }
    else
-      OSG_INFO << "Model uses " << osg::maximum( tuuv._attributesFound.size(), tuuv._modeOn.size() )
+      OSG_INFO << "Model uses " << osg::maximum( tuuv->_attributesFound.size(), tuuv->_modeOn.size() )
                << " texturing units." << endl;
+   double moverTraversalTime = moverPipeline.getNumSteps() > 0 ? moverTime.time_m() : 0.;
 
 
    // report time
-   Log::info() << QString( "AnisotropicFiltering setup and TextureUnit usage check performed in %1ms (model %2)." )
-                          .arg( time.time_m() )
-                          .arg( _modelFileName ) << Log::endm;
+   // (time of each step and the traversal overhead)
+   QString steps;
+   for( unsigned int i=0; i<pipeline.getNumSteps(); i++ )
+      steps += QString( "%1 %2ms, " ).arg( pipeline.getStepName( i ).c_str() )
+                                     .arg( pipeline.getStepTime( i ), 0, 'f', 2 );
+   steps += QString( "traversal %1ms" ).arg( traversalTime - pipeline.getTotalStepTime(), 0, 'f', 2 );
+   for( unsigned int i=0; i<moverPipeline.getNumSteps(); i++ )
+      steps += QString( ", %1 %2ms (traversal %3ms)" )
+                  .arg( moverPipeline.getStepName( i ).c_str() )
+                  .arg( moverPipeline.getStepTime( i ), 0, 'f', 2 )
+                  .arg( moverTraversalTime - moverPipeline.getTotalStepTime(), 0, 'f', 2 );
+   LoadProfiler::record( "scene preparation", "visitors", profileTime );
+   Log::info() << QString( "Scene preparation performed in %1ms (model %2, %3 traversals): %4." )
+                          .arg( time.time_m(), 0, 'f', 2 )
+                          .arg( _modelFileName )
+                          .arg( moverPipeline.getNumSteps() > 0 ? 2 : 1 )
+                          .arg( steps ) << Log::endm;
+
+   return true;
+}
+
+
+/**
+ * CopyOp creating the preview of the scene displayed during the conversion.
+ *
+ * Nodes, Drawables and StateSets are copied, so the conversion (whose clones
+ * are added as parents of the original nodes, Drawables and StateSets)
+ * does not modify the parent lists read by the main thread. Arrays, primitive sets
+ * and state attributes are shared. Objects shared by several parents
+ * stay shared in the copy.
+ */
+class PreviewCopyOp : public CopyOp
+{
+public:
+
+   PreviewCopyOp() : CopyOp( CopyOp::DEEP_COPY_NODES | CopyOp::DEEP_COPY_DRAWABLES |
+                             CopyOp::DEEP_COPY_STATESETS )  {}
+
+   virtual Node* operator()( const Node *node ) const
+   {
+      if( !node )
+         return NULL;
+      map< const Node*, ref_ptr< Node > >::iterator it = _nodes.find( node );
+      if( it != _nodes.end() )
+         return it->second.get();
+      Node *copy = CopyOp::operator()( node );
+      _nodes[ node ] = copy;
+      return copy;
+   }
+
+   virtual Drawable* operator()( const Drawable *drawable ) const
+   {
+      if( !drawable )
+         return NULL;
+      map< const Drawable*, ref_ptr< Drawable > >::iterator it = _drawables.find( drawable );
+      if( it != _drawables.end() )
+         return it->second.get();
+      Drawable *copy = CopyOp::operator()( drawable );
+      _drawables[ drawable ] = copy;
+      return copy;
+   }
+
+   virtual StateSet* operator()( const StateSet *stateSet ) const
+   {
+      if( !stateSet )
+         return NULL;
+      map< const StateSet*, ref_ptr< StateSet > >::iterator it = _stateSets.find( stateSet );
+      if( it != _stateSets.end() )
+         return it->second.get();
+      StateSet *copy = CopyOp::operator()( stateSet );
+      _stateSets[ stateSet ] = copy;
+      return copy;
+   }
+
+protected:
+   mutable map< const Node*, ref_ptr< Node > > _nodes;
+   mutable map< const Drawable*, ref_ptr< Drawable > > _drawables;
+   mutable map< const StateSet*, ref_ptr< StateSet > > _stateSets;
+};
+
+
+/**
+ * Finishes the original scene and performs the shader conversion.
+ *
+ * The method is run on the freshly read scene as well as on the scene
+ * loaded from the scene cache. As soon as the original scene is complete,
+ * its copy is made and stageReceiver is notified, so the copy can be displayed
+ * while the rest of the processing continues (see getPreviewScene()).
+ * The scene is stored in the scene cache, if enabled, KdTree is built
+ * and the scene is converted.
+ *
+ * KdTrees are not stored in the cache as there is
+ * no osgDB serializer for them. The converted scene contains runtime objects
+ * (light uniform callbacks, shadow techniques and their management)
+ * that have no serializers either. Thus, it is always created by the conversion.
+ */
+bool LexolightsDocument::OpenOperation::prepareScene()
+{
+   // find unchanged parts of the previously loaded version of the scene
+   // (conversion results of these parts are reused; neither the scene
+   // nor the previous scene is modified, the unchanged parts are replaced
+   // by the main thread when the open completes, see LexolightsDocument::asyncOpenCompleted())
+   if( conversionCache.valid() )
+      conversionCache->shareUnchangedSubgraphs( _originalScene );
+
+   // the original scene is complete
+   // (the conversion adds its clones to the parent lists of the scene objects
+   // while the main thread reads them during update traversal, bound computation
+   // and picking and KdTree build sets the shapes of the drawables,
+   // so the main thread displays the copy of the scene in the mean time)
+   stageCompleted( "original scene ready" );
+   if( stageReceiver ) {
+      _previewScene = static_cast< Node* >( _originalScene->clone( PreviewCopyOp() ) );
+      QCoreApplication::postEvent( stageReceiver, new QEvent( (QEvent::Type)originalSceneReadyEventId ) );
+   }
+
+   // the rest of the processing is skipped when the operation is canceled
+   // (the stages are checked before they start, the KdTree build and the conversion
+   // check the cancellation token themselves)
+   if( isCanceled() )
+      return false;
+
+   // store the scene in the scene cache
+   // (KdTree and converted scene are not stored, see above)
+   // (scenes using image files not covered by the key are not stored)
+   if( _useSceneCache && _zipFileName.isEmpty() &&
+       !SceneCache::checkImageFiles( _originalScene, _modelFileName.toUtf8().data(), _referencedFiles ) ) {
+      _useSceneCache = false;
+      Log::info() << QString( "SceneCache: Scene of %1 not stored in the cache as it uses "
+                              "image files not referenced by the model file." )
+                     .arg( _modelFileName ) << Log::endm;
+   }
+   if( _useSceneCache ) {
+      Timer time;
+      LoadProfiler::Scope profile( "scene cache write", "cache" );
+      if( SceneCache::write( _cacheKey, _originalScene ) ) {
+         _sceneInCache = true;
+         Log::info() << QString( "SceneCache: Scene of %1 stored in the cache in %2ms (key %3)." )
+                        .arg( _modelFileName ).arg( time.time_m(), 0, 'f', 2 )
+                        .arg( SceneCache::getKeyString( _cacheKey ).c_str() ) << Log::endm;
+      } else
+         Log::warn() << QString( "SceneCache: Failed to store scene of %1 in the cache (key %2)." )
+                        .arg( _modelFileName )
+                        .arg( SceneCache::getKeyString( _cacheKey ).c_str() ) << Log::endm;
+   }
+
+   Timer time;
+
+   // build KdTree
+   // (KdTrees of geometries are built in parallel, serial time is the sum of times spent by workers;
+   // lazy KdTree building postpones it after the first frame, see LexolightsDocument::scheduleKdTreeBuild())
+   if( !Lexolights::options()->lazyKdTree ) {
+
+      double profileTime = LoadProfiler::getTime();
+
+      // use the geometries collected by readModel()
+      // (the scene from the cache requires the traversal)
+      ref_ptr< ParallelKdTreeBuilder > kdTreeBuilder = _kdTreeBuilder;
+      _kdTreeBuilder = NULL;
+      if( !kdTreeBuilder.valid() ) {
+         kdTreeBuilder = new ParallelKdTreeBuilder;
+         if( cancellationToken.valid() )
+            kdTreeBuilder->setCancellationToken( cancellationToken );
+         _originalScene->accept( *kdTreeBuilder );
+      }
+      kdTreeBuilder->build();
+      if( isCanceled() )
+         return false;
+      LoadProfiler::record( "KdTree build", "kdtree", profileTime );
+      Log::info() << QString( "KdTree built in %1ms (model %2, %3 geometries, %4 threads, "
+                              "serial build time %5ms, speedup %6x, memory %7KiB)." )
+                             .arg( time.time_m() )
+                             .arg( _modelFileName )
+                             .arg( kdTreeBuilder->getNumGeometries() )
+                             .arg( kdTreeBuilder->getNumThreads() )
+                             .arg( kdTreeBuilder->getSerialTime(), 0, 'f', 2 )
+                             .arg( kdTreeBuilder->getSpeedup(), 0, 'f', 2 )
+                             .arg( ( kdTreeBuilder->getMemoryUsage() + 1023 ) / 1024 ) << Log::endm;
+      stageCompleted( "KdTree built" );
+   }
 
 
    // shader conversion
@@ -357,9 +765,16 @@ bool LexolightsDocument::OpenOperation::openModel()
          shadowTechnique = PerPixelLighting::NO_SHADOWS;
 
       // convert to per-pixel-lit scene
+      double profileTime = LoadProfiler::getTime();
       PerPixelLighting ppl;
+      ppl.setConversionCache( conversionCache );
+      ppl.setCancellationToken( cancellationToken );
       ppl.convert( _originalScene, shadowTechnique );
+      if( isCanceled() )
+         return false;
       _pplScene = ppl.getScene();
+      LoadProfiler::record( "conversion", "conversion", profileTime );
+      stageCompleted( "scene converted" );
 
    }
 
@@ -368,7 +783,8 @@ bool LexolightsDocument::OpenOperation::openModel()
 
       // save scene for debugging purposes
       osgDB::writeNodeFile( *_originalScene, "originalScene.osgt" );
-      osgDB::writeNodeFile( *_pplScene, "pplScene.osgt" );
+      if( _pplScene.valid() )
+         osgDB::writeNodeFile( *_pplScene, "pplScene.osgt" );
 
    }
 
@@ -376,11 +792,87 @@ bool LexolightsDocument::OpenOperation::openModel()
 }
 
 
+/**
+ * Opens the model from the zip file.
+ *
+ * The archive is mounted to osgDB (see ZipArchive) and the model and textures
+ * are read directly from the archive. Archives smaller than --zip-preload-limit
+ * are decompressed into memory by parallel worker threads first, larger archives
+ * are decompressed on demand when the files are read. No temporary files are created.
+ * If --unzip-to-temp option is given, the archive is extracted to temporary directory
+ * instead (see extractZip()).
+ */
 bool LexolightsDocument::OpenOperation::openZip()
+{
+   if( Lexolights::options()->unzipToTemp )
+      return extractZip();
+
+   osg::Timer time;
+   double profileTime = LoadProfiler::getTime();
+   _modelFileName = "";
+
+   // read zip central directory
+   ref_ptr< ZipArchive > archive = new ZipArchive;
+   if( !archive->open( _zipFileName.toUtf8().data(), password.toUtf8().data() ) ) {
+      Log::fatal() << "OpenZip: Can not open file: '" << _zipFileName << "'" << Log::endm;
+      return false;
+   }
+
+   // get file name to open
+   const ZipArchive::EntryMap &entries = archive->getEntries();
+   for( ZipArchive::EntryMap::const_iterator it = entries.begin(); it != entries.end(); it++ ) {
+      std::string extension = osgDB::getLowerCaseFileExtension( it->second.name );
+      if( extension == "iv" || extension == "ivx" || extension == "ivl" )
+         _modelFileName = QString::fromUtf8( archive->getVirtualPath( it->second ).c_str() );
+   }
+   if( _modelFileName.isEmpty() ) {
+      Log::fatal() << "OpenZip: No model file to open inside the zip file '" << fileName
+                   << "'." << Log::endm;
+      return false;
+   }
+
+   // log
+   Log::info() << "OpenZip: File '" << fileName << "' with " << int( entries.size() )
+               << " entries opened in " << int( time.time_m() + .5 ) << "ms." << Log::endm;
+
+   // decompress all entries in parallel into memory if they fit into the preload limit,
+   // otherwise they are decompressed on demand when read
+   unsigned long long size = archive->getUncompressedSize();
+   if( size <= (unsigned long long)( Lexolights::options()->zipPreloadLimit ) * 1024 * 1024 ) {
+      time.setStartTick();
+      if( !archive->loadToMemory( Lexolights::options()->zipThreads ) ) {
+         Log::fatal() << (password.isEmpty() ? "OpenZip: Error when decompressing files from zip file: '"
+                                             : "OpenZip: Error when decompressing files from zip file with password: '" )
+                      << _zipFileName << "'" << Log::endm;
+         return false;
+      }
+      Log::info() << QString( "OpenZip: %1 entries (%2MB) decompressed into memory in %3ms." )
+                     .arg( entries.size() ).arg( double( size ) / ( 1024 * 1024 ), 0, 'f', 1 )
+                     .arg( time.time_m(), 0, 'f', 2 ) << Log::endm;
+   }
+   LoadProfiler::record( "zip decompression", "unzip", profileTime );
+
+   // open the model from the archive
+   if( isCanceled() )
+      return false;
+   archive->mount();
+   bool r = openModel();
+   archive->unmount();
+
+   // error message provided by openModel()
+   return r;
+}
+
+
+/**
+ * Extracts the zip file into temporary directory and opens the model from there.
+ * The files are extracted by parallel worker threads.
+ */
+bool LexolightsDocument::OpenOperation::extractZip()
 {
    osg::Timer time;
+   double profileTime = LoadProfiler::getTime();
    _modelFileName = "";
-   bool retValue = true;
 
    // create temp path
 #if (defined(__WIN32__) || defined(_WIN32)) && !defined(__CYGWIN__)
@@ -402,197 +894,41 @@ bool LexolightsDocument::OpenOperation::openZip()
       return false;
    }
 
-
-   //
-   //  open zip and go to the first file
-   //
-   unz_file_info fileInfo;
-   char *bufferski = NULL;
-   unzFile handle;
-
-   // open zip file
-   handle = unzOpen( _zipFileName.toLocal8Bit().data() );
-   if( !handle ) {
+   // read zip central directory
+   ref_ptr< ZipArchive > archive = new ZipArchive;
+   if( !archive->open( _zipFileName.toUtf8().data(), password.toUtf8().data() ) ) {
       Log::fatal() << "OpenZip: Can not open file: '" << _zipFileName << "'" << Log::endm;
       return false;
    }
 
-   // go to the first file
-   int e = unzGoToFirstFile( handle );
-   if( e != UNZ_OK ) {
-      Log::fatal() << "OpenZip: Can not go to first file inside zip file: '"
+   // extract all files
+   // (entries are distributed among worker threads, each having its own zip file handle)
+   if( !archive->extractTo( QDir::fromNativeSeparators( _unzipDir ).toUtf8().data(),
+                            Lexolights::options()->zipThreads ) ) {
+      Log::fatal() << (password.isEmpty() ? "OpenZip: Error when extracting files from zip file: '"
+                                          : "OpenZip: Error when extracting files from zip file with password: '" )
                    << _zipFileName << "'" << Log::endm;
-      unzClose( handle );
       return false;
    }
 
-
-   //
-   //  go through the all files in the archive
-   //
-   do {
-
-      // get filename size and alocate mem for it
-      e = unzGetCurrentFileInfo( handle, &fileInfo, NULL, 0, NULL, 0, NULL, 0 );
-      if( e != UNZ_OK ) {
-         Log::fatal() << "OpenZip: Can not get current file info inside zip file: '"
-                      << _zipFileName << "'" << Log::endm;
-         unzClose( handle );
-         return false;
-      }
-
-      uint fileNameBufSize = fileInfo.size_filename + 1;    // +1 because of terminating character '\0'
-      char *fileNameBuf = new char[fileNameBufSize];
-
-      // get the filename
-      e = unzGetCurrentFileInfo( handle, &fileInfo, fileNameBuf, fileNameBufSize, NULL, 0, NULL, 0 );
-      if( e != UNZ_OK ) {
-         Log::fatal() << "OpenZip: Can not get current file name inside zip file: '"
-                      << _zipFileName << "'" << Log::endm;
-         unzClose( handle );
-         delete[] fileNameBuf;
-         return false;
-      }
-
-      // open file
-      if( password.isEmpty() )
-         e = unzOpenCurrentFile( handle );
-      else
-         e = unzOpenCurrentFilePassword( handle, password.toUtf8().data() );
-
-      if( e != UNZ_OK ) {
-         Log::fatal() << (password.isEmpty() ? "OpenZip: Can not open a file inside the zip file: '"
-                                             : "OpenZip: Can not open a file inside the zip file with password: '" )
-                      << _zipFileName << "'" << Log::endm;
-         unzClose( handle );
-         delete[] fileNameBuf;
-         return false;
-      }
-
-
-      //
-      // filename decoding and path conversion
-      //
-      QString unicodeFileName;
-      if( fileInfo.flag & 2048 ) {
-         // if bit 11 (dec value 2048) of general purpose flag is set, filenames are in UTF-8 encoding
-         std::string nativeFileName = osgDB::convertFileNameToNativeStyle( std::string( fileNameBuf ) );
-         unicodeFileName = QString::fromUtf8( nativeFileName.c_str() );
-      }
-      else {
-         // else use local char set
-         unicodeFileName = QString::fromLocal8Bit( fileNameBuf );
-      }
-
-      // log
-      Log::info() << "OpenZip: Extracting '" << unicodeFileName << "'" << Log::endm;
-
-      // alloc memory for read buffer
-      bufferski = new char[fileInfo.uncompressed_size];
-      if( !bufferski ) {
-         Log::fatal() << "OpenZip: Can not allocate memory (" << fileInfo.uncompressed_size
-                      << " bytes) to extract file '" << unicodeFileName
-                      << "' inside zip file: '" << _zipFileName << "'" << Log::endm;
-         unzCloseCurrentFile( handle );
-         unzClose( handle );
-         delete[] fileNameBuf;
-         delete[] bufferski;
-         return false;
-      }
-
-      // read to buffer
-      while( !unzeof( handle ) ) {
-         e = unzReadCurrentFile( handle, bufferski, fileInfo.uncompressed_size );
-         if( e < 0 ) {
-            Log::fatal() << "OpenZip: Error when extracting file '" << unicodeFileName
-                         << "' from zip file: '" << _zipFileName << "'" << Log::endm;
-            unzCloseCurrentFile( handle );
-            unzClose( handle );
-            delete[] fileNameBuf;
-            delete[] bufferski;
-            return false;
-         }
-      }
-
-      // create directory structure
-      if( unicodeFileName.contains( QDir::separator() ) ) {
-         QString dir_path = unicodeFileName.section( QDir::separator(), 0, -2, QString::SectionSkipEmpty ); // without last section (without filename)
-         if( !dir_path.isEmpty() )
-            dir.mkpath( dir_path );
-      }
-
-      // open output file
-      QString file_path = _unzipDir + QDir::separator() + unicodeFileName;
-      QFile unzippedFile( file_path.replace( "\\", "/" ) );  // According to documentation: "QFile expects the file separator
-                                             // to be '/' regardless of operating system. The use of other
-                                             // separators (e.g., '\') is not supported."
-
-      if( !unzippedFile.open( QIODevice::WriteOnly | QIODevice::Unbuffered ) ) {
-         Log::fatal() << "OpenZip: Error while opening destination file '" << file_path
-                        << "' extracted from zip file: '" << _zipFileName << "'" << Log::endm;
-         unzCloseCurrentFile( handle );
-         unzClose( handle );
-         delete[] fileNameBuf;
-         delete[] bufferski;
-         return false;
-      }
-
-      // write decompressed data to output file
-      qint64 writtenBytes = unzippedFile.write( bufferski, (qint64)fileInfo.uncompressed_size );
-      if( writtenBytes < 0) {
-         Log::fatal() << "OpenZip: Error while opening destination file '" << file_path
-                        << "' extracted from zip file: '" << _zipFileName << "'" << Log::endm;
-         unzCloseCurrentFile( handle );
-         unzClose( handle );
-         delete[] fileNameBuf;
-         delete[] bufferski;
-         return false;
-      }
-
-
-      // get file name to open
-      std::string extension = osgDB::getFileExtension( unicodeFileName.toUtf8().data() );
+   // get file name to open
+   const ZipArchive::EntryMap &entries = archive->getEntries();
+   for( ZipArchive::EntryMap::const_iterator it = entries.begin(); it != entries.end(); it++ ) {
+      std::string extension = osgDB::getLowerCaseFileExtension( it->second.name );
       if( extension == "iv" || extension == "ivx" || extension == "ivl" )
-         _modelFileName = unicodeFileName;
-
-
-      // close output file
-      unzippedFile.close();
-
-      // close file in zip
-      unzCloseCurrentFile( handle );
-
-      // free read buffer
-      delete[] bufferski;
-
-      // free filename
-      delete[] fileNameBuf;
-
-      // go to next file in zip if there is one
-      e = unzGoToNextFile( handle );
-   } while( e != UNZ_END_OF_LIST_OF_FILE );
-
-
-   // error check
-   if( e != UNZ_END_OF_LIST_OF_FILE ) {
-      Log::fatal() << "OpenZip: Can not move to the next file inside the zip file: '"
-                   << fileName << "'" << Log::endm;
-      unzClose( handle );
-      return false;
+         _modelFileName = QString::fromUtf8( osgDB::convertFileNameToNativeStyle( it->second.name ).c_str() );
    }
 
-   // close zip file
-   unzClose( handle );
-
    // log unzip success
    Log::info() << "OpenZip: File '" << fileName << "' unzipped to temporary folder '"
       << _unzipDir << "' in " << int( time.time_m() + .5 ) << "ms." << Log::endm;
+   LoadProfiler::record( "zip extraction", "unzip", profileTime );
 
    // open file
    if( !_modelFileName.isEmpty() )
    {
       _modelFileName = _unzipDir + _modelFileName;
-      if( !openModel() ) {
+      if( isCanceled() || !openModel() ) {
          // error message provided by openModel()
          return false;
       }
@@ -612,18 +948,103 @@ bool LexolightsDocument::OpenOperation::run()
    Log::info() << "LexolightsDocument::OpenOperation: Open operation started for file:\n"
                   "   " << fileName << Log::endm;
    Timer time;
+   _openTime.setStartTick();
 
    // load file
    _success = true;
    QByteArray fna( fileName.toUtf8() );
    const char *fn = fna.data();
    std::string extension = osgDB::getFileExtension( fn );
+
+   // look for the scene in the scene cache
+   // (the key is given by the file content, application build and scene processing options)
+   _useSceneCache = false;
+   _sceneInCache = false;
+   _hasContentHash = false;
+   _cacheHit = false;
+   _stages.clear();
+   if( !Lexolights::options()->noSceneCache )
+   {
+      Timer hashTime;
+      double profileTime = LoadProfiler::getTime();
+      _hasContentHash = ContentHash::hashFile( fn, _contentHash );
+      double hashingTime = hashTime.time_m();
+      LoadProfiler::record( "content hashing", "read", profileTime );
+      // models outside of zip archives may refer to other files,
+      // their names and time stamps become part of the key
+      // (the scene cache is not used if the references can not be found)
+      _referencedFiles.clear();
+      bool isZip = extension == "ivz" || extension == "ivzl" || extension == "zip";
+      bool hasReferences = isZip || SceneCache::findReferencedFiles( fn, _referencedFiles );
+      if( !hasReferences )
+         Log::info() << QString( "SceneCache: Not used for %1 as its referenced files "
+                                 "can not be determined." ).arg( fileName ) << Log::endm;
+      if( _hasContentHash && hasReferences && !isCanceled() )
+      {
+         ContentHash key( _contentHash );
+         for( std::set< std::string >::iterator it = _referencedFiles.begin();
+              it != _referencedFiles.end(); it++ ) {
+            key.add( *it );
+            key.add( FileTimeStamp( *it ).getTimeStampAsString() );
+         }
+         key.add( buildDate );
+         key.add( buildTime );
+         key.add( Lexolights::options()->nativeIvx );
+         key.add( int( Lexolights::options()->optimizePreset ) );
+         key.add( Lexolights::options()->noDeduplication );
+         key.add( Lexolights::options()->lodMinTriangles );
+         key.add( Lexolights::options()->lodPixelSize );
+         key.add( Lexolights::options()->occlusionCulling );
+         _cacheKey = key.get();
+         _useSceneCache = true;
+
+         Timer readTime;
+         profileTime = LoadProfiler::getTime();
+         _originalScene = SceneCache::read( _cacheKey );
+         LoadProfiler::record( "scene cache read", "read", profileTime );
+         if( _originalScene.valid() ) {
+            _cacheHit = true;
+            _sceneInCache = true;
+            Log::notice() << QString( "SceneCache: Cache hit for %1 (key %2). Hashing took %3ms, "
+                                      "scene loading %4ms." ).arg( fileName )
+                                      .arg( SceneCache::getKeyString( _cacheKey ).c_str() )
+                                      .arg( hashingTime, 0, 'f', 2 )
+                                      .arg( readTime.time_m(), 0, 'f', 2 ) << Log::endm;
+         }
+         else
+            Log::info() << QString( "SceneCache: Cache miss for %1 (key %2). Hashing took %3ms." )
+                                      .arg( fileName )
+                                      .arg( SceneCache::getKeyString( _cacheKey ).c_str() )
+                                      .arg( hashingTime, 0, 'f', 2 ) << Log::endm;
+      }
+   }
+
+   if( isCanceled() )
+   {
+      // canceled during the hashing
+      _success = false;
+   }
+   else
+   if( _cacheHit )
+   {
+      // scene from the cache requires KdTree and conversion only
+      _modelFileName = fileName;
+      _useSceneCache = false;
+      stageCompleted( "scene read from the cache" );
+      if( !prepareScene() ) {
+         if( !isCanceled() )
+            Log::fatal() << "Error when opening file '" << fileName << "'." << Log::endm;
+         _success = false;
+      }
+   }
+   else
    if( extension == "ivz" || extension == "ivzl" || extension == "zip" )
    {
       // decompress zip and look for iv, ivx, or ivl file to open it
       _zipFileName = fileName;
       if( !openZip() ) {
-         Log::fatal() << "Error when opening file '" << fileName << "'." << Log::endm;
+         if( !isCanceled() )
+            Log::fatal() << "Error when opening file '" << fileName << "'." << Log::endm;
          _success = false;
       }
    }
@@ -632,14 +1053,23 @@ bool LexolightsDocument::OpenOperation::run()
       // iv, ivx, ivl, and any extension supported by OSG
       _modelFileName = fileName;
       if( !openModel() ) {
-         Log::fatal() << "Error when opening file '" << fileName << "'." << Log::endm;
+         if( !isCanceled() )
+            Log::fatal() << "Error when opening file '" << fileName << "'." << Log::endm;
          _success = false;
       }
    }
 
+   // canceled operation never succeeds
+   // (its results may be incomplete)
+   if( isCanceled() )
+      _success = false;
+
    // log message
    if( _success )
       Log::info() << "LexolightsDocument::OpenOperation: Model " << fileName << " loaded in " << time.time_m() << "ms." << Log::endm;
+   else
+   if( isCanceled() )
+      Log::notice() << "LexolightsDocument::OpenOperation: Loading of model " << fileName << " canceled (operation took " << time.time_m() << "ms)." << Log::endm;
    else
       Log::info() << "LexolightsDocument::OpenOperation: Failed to load model " << fileName << " (operation took " << time.time_m() << "ms)." << Log::endm;
 
@@ -647,10 +1077,30 @@ bool LexolightsDocument::OpenOperation::run()
 }
 
 
+const int LexolightsDocument::OpenOperation::originalSceneReadyEventId = QEvent::registerEventType();
+
+
+/**
+ * Logs the completion of the open stage together with the time elapsed
+ * since the open operation started. The stage is recorded,
+ * see getNumStages(), getStageName() and getStageTime().
+ */
+void LexolightsDocument::OpenOperation::stageCompleted( const QString &stage )
+{
+   double t = getElapsedTime();
+   _stages.push_back( std::make_pair( stage, t ) );
+   Log::info() << QString( "Open stage \"%1\" of %2 completed at %3ms." )
+                  .arg( stage ).arg( fileName )
+                  .arg( t, 0, 'f', 2 ) << Log::endm;
+}
+
+
 LexolightsDocument::OpenOpThread::OpenOpThread( LexolightsDocument *parent, OpenOperation *openOp )
    : inherited( parent ),
      _openOp( openOp )
 {
+   // receive the events of open stages in the main thread
+   _openOp->stageReceiver = this;
 }
 
 
@@ -688,6 +1138,40 @@ void LexolightsDocument::OpenOpThread::customEvent( QEvent *event )
 {
    if( event->type() == asyncOpenCompletedEventId )
       dynamic_cast< LexolightsDocument* >( parent() )->asyncOpenCompleted();
+   else
+   if( event->type() == OpenOperation::originalSceneReadyEventId )
+      dynamic_cast< LexolightsDocument* >( parent() )->asyncOriginalSceneReady();
+}
+
+
+/**
+ * Displays the original scene while the open operation continues
+ * with the conversion in the background.
+ *
+ * The original scene is shown with the default viewer lighting.
+ * The converted scene replaces it in asyncOpenCompleted()
+ * without resetting the camera.
+ */
+void LexolightsDocument::asyncOriginalSceneReady()
+{
+   OpenOperation *openOp = _openOpThread->getOpenOperation();
+
+   // canceled operation is not displayed
+   if( openOp->isCanceled() )
+      return;
+
+   // show the copy of the original scene
+   // (the original scene is being converted, it is taken by asyncOpenCompleted())
+   _originalScene = openOp->getPreviewScene();
+   _pplScene = NULL;
+   if( _openInMainWindow )
+      Lexolights::mainWindow()->openDocument( this, _resetViewSettings );
+   emit sceneChanged();
+   LoadProfiler::instant( "original scene displayed" );
+
+   Log::info() << QString( "Open stage \"original scene displayed\" of %1 completed at %2ms." )
+                  .arg( openOp->fileName )
+                  .arg( openOp->getElapsedTime(), 0, 'f', 2 ) << Log::endm;
 }
 
 
@@ -697,11 +1181,38 @@ void LexolightsDocument::asyncOpenCompleted()
 
    Log::notice() << "Background loading of file " << openOp->fileName << " performs final processing and synchronizing in the main thread." << std::endl;
 
+   // canceled operation is dropped
+   // (the original scene might have been displayed already)
+   if( openOp->isCanceled() ) {
+      Log::notice() << QString( "LexolightsDocument: Loading of %1 canceled after %2ms." )
+                       .arg( openOp->fileName )
+                       .arg( openOp->getElapsedTime(), 0, 'f', 2 ) << Log::endm;
+      _asyncSuccess = false;
+      _originalScene = NULL;
+      _pplScene = NULL;
+      _unzipDir = openOp->getUnzipDir();
+      delete _openOpThread;
+      _openOpThread = NULL;
+      return;
+   }
+
    // copy data from OpenOpThread
+   // (the reused parts of the previous scenes are spliced into the new scenes first)
    _asyncSuccess = openOp->getSuccess();
+   if( _asyncSuccess && openOp->conversionCache.valid() )
+      openOp->conversionCache->commit();
    _originalScene = openOp->getOriginalScene();
    _pplScene = openOp->getPPLScene();
    _unzipDir = openOp->getUnzipDir();
+   _hasContentHash = openOp->getContentHash( _contentHash );
+   if( _hasContentHash )
+      _reloadScheduler->setContentHash( _contentHash );
+   _sceneInCache = openOp->getCacheKey( _cacheKey );
+   if( _asyncSuccess )
+      scheduleKdTreeBuild();
+   Log::info() << QString( "Open stage \"open completed\" of %1 completed at %2ms." )
+                  .arg( openOp->fileName )
+                  .arg( openOp->getElapsedTime(), 0, 'f', 2 ) << Log::endm;
 
    // delete OpenOpThread
    //_openOpThread->deleteLater();
@@ -709,8 +1220,227 @@ void LexolightsDocument::asyncOpenCompleted()
    _openOpThread = NULL;
 
    // open in MainWindow if requested
-   if( _openInMainWindow && _asyncSuccess )
-      Lexolights::mainWindow()->openDocument( this, _resetViewSettings );
+   // (if the original scene is already displayed, switch to the converted scene
+   // keeping the camera position; failed open keeps the views as they are)
+   if( _asyncSuccess ) {
+      if( _openInMainWindow && Lexolights::activeDocument() != this )
+         Lexolights::mainWindow()->openDocument( this, _resetViewSettings );
+      else
+         emit sceneChanged();
+   }
+
+   // the first frame of the scene finishes the load profile
+   LoadProfiler::loadCompleted( _asyncSuccess );
+
+   // release the original scene in lean memory mode
+   // (after the converted scene replaced it in the viewer)
+   if( _asyncSuccess ) {
+      releaseOriginalScene();
+      logResidentMemory();
+   }
+}
+
+
+/**
+ * Returns the original scene.
+ *
+ * In lean memory mode, the original scene is released after the conversion
+ * (see releaseOriginalScene()). It is reconstructed from the scene cache
+ * on the first request and kept until it is released again. The reconstructed
+ * scene shares its geometries with the converted scene, so it takes
+ * about the same memory as in the normal mode, and KdTrees of the geometries
+ * that are not shared are built in the background.
+ */
+Node* LexolightsDocument::getOriginalScene()
+{
+   if( _originalScene.valid() || !_originalSceneReleased )
+      return _originalScene;
+
+   // the scene may still be alive, referenced by the viewer for instance
+   _releasedOriginalScene.lock( _originalScene );
+   if( _originalScene.valid() ) {
+      _originalSceneReleased = false;
+      return _originalScene;
+   }
+
+   // read the scene from the cache
+   _originalScene = readOriginalScene();
+   if( !_originalScene.valid() )
+      return NULL;
+   _originalSceneReleased = false;
+
+   // share the geometries with the converted scene
+   Timer time;
+   GeometryDeduplicator deduplicator;
+   if( _pplScene.valid() )
+      deduplicator.addReferenceScene( _pplScene );
+   _originalScene->accept( deduplicator );
+   Log::info() << QString( "LexolightsDocument: Reconstructed scene of %1 shares geometries "
+                           "with the converted scene (%2 geometries replaced, %3KiB saved, %4ms)." )
+                  .arg( _fileName )
+                  .arg( deduplicator.getNumReplaced() )
+                  .arg( ( deduplicator.getMemorySaved() + 1023 ) / 1024 )
+                  .arg( time.time_m(), 0, 'f', 2 ) << Log::endm;
+
+   // build the missing KdTrees
+   if( createKdTreeBuilder() )
+      _kdTreeBuilder->startInBackground();
+
+   return _originalScene;
+}
+
+
+/**
+ * Returns the original scene without keeping it in the document.
+ *
+ * The released original scene (see releaseOriginalScene()) is read
+ * from the scene cache and it is freed when the caller drops it.
+ * It is meant for short inspections, e.g. scene statistics,
+ * that should not cancel the memory savings of lean memory mode.
+ */
+ref_ptr< Node > LexolightsDocument::readOriginalScene() const
+{
+   ref_ptr< Node > scene = _originalScene;
+   if( scene.valid() || !_originalSceneReleased )
+      return scene;
+
+   // the scene may still be alive, referenced by the viewer for instance
+   _releasedOriginalScene.lock( scene );
+   if( scene.valid() )
+      return scene;
+
+   // read the scene from the cache
+   Timer time;
+   scene = SceneCache::read( _cacheKey );
+   if( !scene.valid() ) {
+      Log::warn() << QString( "LexolightsDocument: Failed to reconstruct the original scene of %1 "
+                              "from the scene cache (key %2)." )
+                     .arg( _fileName )
+                     .arg( SceneCache::getKeyString( _cacheKey ).c_str() ) << Log::endm;
+      return NULL;
+   }
+   Log::info() << QString( "LexolightsDocument: Original scene of %1 reconstructed from the scene cache "
+                           "in %2ms, resident memory %3MiB." )
+                  .arg( _fileName )
+                  .arg( time.time_m(), 0, 'f', 2 )
+                  .arg( double( SysInfo::getResidentMemory() ) / ( 1024*1024 ), 0, 'f', 1 ) << Log::endm;
+   return scene;
+}
+
+
+/**
+ * Releases the original scene in lean memory mode.
+ *
+ * The original scene is released only if the converted scene exists
+ * and the original scene is stored in the scene cache, so it can be
+ * reconstructed by getOriginalScene(). Otherwise, nothing is done.
+ * The nodes shared by the converted scene (Drawables and their data)
+ * stay in the memory.
+ */
+void LexolightsDocument::releaseOriginalScene()
+{
+   if( !Lexolights::options()->leanMemory || !_originalScene.valid() )
+      return;
+
+   if( !_pplScene.valid() || !_sceneInCache ) {
+      Log::info() << QString( "LexolightsDocument: Original scene of %1 kept in the memory "
+                              "as %2." ).arg( _fileName )
+                     .arg( !_pplScene.valid() ? "there is no converted scene"
+                                              : "it is not stored in the scene cache" ) << Log::endm;
+      return;
+   }
+
+   _releasedOriginalScene = _originalScene.get();
+   _originalScene = NULL;
+   _originalSceneReleased = true;
+   Log::info() << QString( "LexolightsDocument: Original scene of %1 released (lean memory mode)." )
+                  .arg( _fileName ) << Log::endm;
+}
+
+
+/**
+ * Logs the resident memory of the process.
+ */
+void LexolightsDocument::logResidentMemory() const
+{
+   unsigned long long m = SysInfo::getResidentMemory();
+   if( m == 0 )
+      return;
+   Log::info() << QString( "Resident memory after opening %1: %2MiB (lean memory mode %3)." )
+                  .arg( _fileName )
+                  .arg( double( m ) / ( 1024*1024 ), 0, 'f', 1 )
+                  .arg( Lexolights::options()->leanMemory ? "on" : "off" ) << Log::endm;
+}
+
+
+/**
+ * Creates the background KdTree builder collecting the geometries
+ * of the original and the converted scene that have no KdTree.
+ * The build in progress, if any, is canceled. Returns false if there
+ * is nothing to build. The build is started by the caller.
+ */
+bool LexolightsDocument::createKdTreeBuilder()
+{
+   if( _kdTreeBuilder.valid() ) {
+      _kdTreeBuilder->cancel();
+      _kdTreeBuilder->waitForDone();
+   }
+
+   // (geometries shared by both scenes are collected once)
+   _kdTreeBuilder = new ParallelKdTreeBuilder( max( QThread::idealThreadCount() - 1, 1 ) );
+   if( _originalScene.valid() )
+      _originalScene->accept( *_kdTreeBuilder );
+   if( _pplScene.valid() )
+      _pplScene->accept( *_kdTreeBuilder );
+   if( _kdTreeBuilder->getNumGeometries() == 0 ) {
+      _kdTreeBuilder = NULL;
+      return false;
+   }
+   return true;
+}
+
+
+static void startKdTreeBuild( void *data )
+{
+   ParallelKdTreeBuilder *builder = static_cast< ParallelKdTreeBuilder* >( data );
+   builder->startInBackground();
+   builder->unref();
+}
+
+
+static void startKdTreeBuildAfterFirstFrame( void *data )
+{
+   // called at the beginning of the first frame, postpone the build to the next one
+   Lexolights::viewer()->appendOneTimeOpenGLCallback( &startKdTreeBuild, data );
+}
+
+
+/**
+ * Schedules KdTree building when lazy KdTree building is enabled.
+ *
+ * The geometries of the original and the converted scene are collected
+ * immediately, but the trees are built in the background after the first frame
+ * is rendered, so the build does not delay the displaying of the model.
+ * One CPU core is left for the rendering. Intersections with the geometries
+ * whose trees are not built yet build them on demand (see LazyKdTreeIntersector).
+ */
+void LexolightsDocument::scheduleKdTreeBuild()
+{
+   if( !Lexolights::options()->lazyKdTree || !_originalScene.valid() )
+      return;
+
+   // collect geometries
+   if( !createKdTreeBuilder() )
+      return;
+
+   // start build after the first frame
+   // (the builder is referenced until the callback is called)
+   if( Lexolights::viewer() ) {
+      _kdTreeBuilder->ref();
+      Lexolights::viewer()->appendOneTimeOpenGLCallback( &startKdTreeBuildAfterFirstFrame, _kdTreeBuilder.get() );
+   }
+   else
+      _kdTreeBuilder->startInBackground();
 }
 
 
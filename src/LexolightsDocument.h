@@ -8,13 +8,23 @@
 #ifndef LEXOLIGHTS_DOCUMENT_H
 #define LEXOLIGHTS_DOCUMENT_H
 
+#include <osg/observer_ptr>
 #include <osg/Referenced>
 #include <osg/ref_ptr>
+#include <osg/Timer>
 #include <QString>
 #include <QThread>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include "utils/CancellationToken.h"
+#include "utils/ContentHash.h"
 #include "utils/FileTimeStamp.h"
+#include "lighting/PerPixelLighting.h"
 
-class QFileSystemWatcher;
+class ReloadScheduler;
+class ParallelKdTreeBuilder;
 namespace osg {
    class Node;
 }
@@ -44,9 +54,12 @@ public:
    virtual bool openFileAsync( const QString &fileName, bool openInMainWindow, bool resetViewSettings );
    virtual bool isOpenInProgress();
    virtual bool waitForOpenCompleted();
+   virtual void cancelOpen();
 
-   inline osg::Node* getOriginalScene();
+   osg::Node* getOriginalScene();
+   osg::ref_ptr< osg::Node > readOriginalScene() const;
    inline osg::Node* getPPLScene();
+   void releaseOriginalScene();
 
    inline const QString& getFileName() const;  // as it was given to openFile()
    QString getStrippedName() const;   // only name
@@ -55,6 +68,7 @@ public:
    QString getCanonicalName() const;  // pathWithoutLinks + name + extension
 
    inline FileTimeStamp getSceneTimeStamp() const;
+   inline bool getContentHash( ContentHash::Value &hash ) const;
 
 signals:
 
@@ -66,20 +80,49 @@ protected:
    public:
       QString fileName;
       QString password;
+      osg::ref_ptr< PerPixelLighting::ConversionCache > conversionCache;
+      osg::ref_ptr< CancellationToken > cancellationToken;  // may be NULL
+      QObject *stageReceiver;  // receives originalSceneReadyEventId event, may be NULL
+      inline OpenOperation();
       virtual bool openModel();
+      virtual bool readModel();
+      virtual bool prepareScene();
       virtual bool openZip();
+      virtual bool extractZip();
       virtual bool run();
       inline osg::Node* getOriginalScene() const;
+      inline osg::Node* getPreviewScene() const;
       inline osg::Node* getPPLScene() const;
       inline QString getUnzipDir() const;
       inline bool getSuccess() const;
+      inline bool isCanceled() const;
+      inline bool getContentHash( ContentHash::Value &hash ) const;
+      inline bool getCacheKey( ContentHash::Value &key ) const;
+      inline bool getCacheHit() const;
+      inline double getElapsedTime() const;
+      inline unsigned int getNumStages() const;
+      inline const QString& getStageName( unsigned int i ) const;
+      inline double getStageTime( unsigned int i ) const;
+      static const int originalSceneReadyEventId;
    protected:
+      void stageCompleted( const QString &stage );
+      osg::Timer _openTime;
       QString _unzipDir;
       QString _zipFileName;
       QString _modelFileName;
       bool _success;
+      ContentHash::Value _contentHash;
+      bool _hasContentHash;
+      ContentHash::Value _cacheKey;
+      bool _useSceneCache;
+      std::set< std::string > _referencedFiles;  // files referenced by the model, part of _cacheKey
+      bool _sceneInCache;  // the original scene is stored in the scene cache under _cacheKey
+      bool _cacheHit;
+      std::vector< std::pair< QString, double > > _stages;  // completed stages and their times
       osg::ref_ptr< osg::Node > _originalScene;
+      osg::ref_ptr< osg::Node > _previewScene;  // copy of _originalScene displayed during the conversion
       osg::ref_ptr< osg::Node > _pplScene;
+      osg::ref_ptr< ParallelKdTreeBuilder > _kdTreeBuilder;  // geometries collected by readModel()
    };
 
    class OpenOpThread : public QThread {
@@ -98,7 +141,7 @@ protected:
    bool _asyncSuccess;
    bool _openInMainWindow;
    bool _resetViewSettings;
-   QFileSystemWatcher *_watcher;
+   ReloadScheduler *_reloadScheduler;
 #if defined(__WIN32__) || defined(_WIN32)
    void* _openFileDescriptor;
 #else
@@ -107,27 +150,53 @@ protected:
    OpenOpThread *_openOpThread;
 
    osg::ref_ptr< osg::Node > _originalScene;
+   osg::observer_ptr< osg::Node > _releasedOriginalScene;
+   bool _originalSceneReleased;
+   ContentHash::Value _cacheKey;
+   bool _sceneInCache;
    osg::ref_ptr< osg::Node > _pplScene;
+   osg::ref_ptr< PerPixelLighting::ConversionCache > _conversionCache;
+   osg::ref_ptr< ParallelKdTreeBuilder > _kdTreeBuilder;
+   virtual void scheduleKdTreeBuild();
+   bool createKdTreeBuilder();
+   bool canReuseConversion( const QString &fileName ) const;
+   void logResidentMemory() const;
 
    FileTimeStamp _sceneTimeStamp;
+   ContentHash::Value _contentHash;
+   bool _hasContentHash;
 
 private slots:
 
    virtual void fileChanged( const QString &path );
+   virtual void asyncOriginalSceneReady();
    virtual void asyncOpenCompleted();
 
+   friend class BatchPreparation;
+   friend class RenderBenchmark;
+
 };
 
 
-inline osg::Node* LexolightsDocument::getOriginalScene()  { return _originalScene; }
 inline osg::Node* LexolightsDocument::getPPLScene()  { return _pplScene; }
 inline const QString& LexolightsDocument::getFileName() const  { return _fileName; }
 inline QString LexolightsDocument::OpenOperation::getUnzipDir() const  { return _unzipDir; }
 inline osg::Node* LexolightsDocument::OpenOperation::getOriginalScene() const  { return _originalScene; }
+inline osg::Node* LexolightsDocument::OpenOperation::getPreviewScene() const  { return _previewScene; }
 inline osg::Node* LexolightsDocument::OpenOperation::getPPLScene() const  { return _pplScene; }
 inline bool LexolightsDocument::OpenOperation::getSuccess() const  { return _success; }
+inline bool LexolightsDocument::OpenOperation::isCanceled() const  { return cancellationToken.valid() && cancellationToken->isCanceled(); }
+inline LexolightsDocument::OpenOperation::OpenOperation() : stageReceiver( NULL ), _success( false ), _hasContentHash( false ), _useSceneCache( false ), _sceneInCache( false ), _cacheHit( false )  {}
+inline bool LexolightsDocument::OpenOperation::getContentHash( ContentHash::Value &hash ) const  { hash = _contentHash; return _hasContentHash; }
+inline bool LexolightsDocument::OpenOperation::getCacheKey( ContentHash::Value &key ) const  { key = _cacheKey; return _sceneInCache; }
+inline bool LexolightsDocument::OpenOperation::getCacheHit() const  { return _cacheHit; }
+inline double LexolightsDocument::OpenOperation::getElapsedTime() const  { return _openTime.time_m(); }
+inline unsigned int LexolightsDocument::OpenOperation::getNumStages() const  { return (unsigned int)_stages.size(); }
+inline const QString& LexolightsDocument::OpenOperation::getStageName( unsigned int i ) const  { return _stages[i].first; }
+inline double LexolightsDocument::OpenOperation::getStageTime( unsigned int i ) const  { return _stages[i].second; }
 inline LexolightsDocument::OpenOperation* LexolightsDocument::OpenOpThread::getOpenOperation() const  { return _openOp; }
 inline FileTimeStamp LexolightsDocument::getSceneTimeStamp() const  { return _sceneTimeStamp; }
+inline bool LexolightsDocument::getContentHash( ContentHash::Value &hash ) const  { hash = _contentHash; return _hasContentHash; }
 
 
 #endif /* LEXOLIGHTS_DOCUMENT_H */
@@ -37,6 +37,77 @@ Options::Options( int &argc, char* argv[] )
    au.addCommandLineOption( "--uninstall", "Remove file associations." );
    au.addCommandLineOption( "--povray", "Render the model using POV-Ray." );
    au.addCommandLineOption( "--export-scene", "Saves the visualized scene to scene.osg for debugging purposes." );
+   au.addCommandLineOption( "--unzip-to-temp", "Extracts zip files (ivz, ivzl, zip) to temporary directory "
+         "before opening instead of reading them directly from the archive." );
+   au.addCommandLineOption( "--zip-threads <n>", "Number of threads decompressing zip files "
+         "(default: number of CPU cores)." );
+   au.addCommandLineOption( "--zip-preload-limit <MB>", "Zip files up to the given uncompressed size "
+         "are decompressed into memory in parallel before opening (default: 512). "
+         "Larger files are decompressed on demand." );
+   au.addCommandLineOption( "--no-scene-cache", "Disables the cache of prepared scenes "
+         "that speeds up opening of previously opened models." );
+   au.addCommandLineOption( "--lazy-kdtree", "Postpones building of KdTrees used for picking "
+         "after the first frame is rendered. The trees are built in the background "
+         "or on the first intersection with the geometry." );
+   au.addCommandLineOption( "--benchmark-reader", "Compares the reading of the given ivx or ivl file "
+         "through ifstream and through the memory mapping and exits." );
+   au.addCommandLineOption( "--native-ivx", "Reads ivx and ivl files by the built-in parser "
+         "of the Inventor subset used by Cadwork. Files using other Inventor features "
+         "are read by the Inventor plugin." );
+   au.addCommandLineOption( "--compare-ivx-parser", "Reads the given ivx or ivl file by the built-in "
+         "parser and by the Inventor plugin, compares the results and exits." );
+   au.addCommandLineOption( "--optimize <preset>", "Optimizes the loaded scene before the conversion. "
+         "Presets: none (default), fast (merges geodes and geometries sharing the state), "
+         "full (fast + flattens static transforms, builds indexed geometry "
+         "and reorders vertices for the vertex cache)." );
+   au.addCommandLineOption( "--no-deduplication", "Disables sharing of identical geometries "
+         "of the loaded scene." );
+   au.addCommandLineOption( "--lod <minTriangles>", "Replaces the parts of the loaded scene having "
+         "at least the given number of triangles by LOD nodes with simplified geometry "
+         "rendered when the part is small on the screen (disabled by default). "
+         "The simplified geometries are stored in the scene cache directory." );
+   au.addCommandLineOption( "--lod-pixel-size <pixels>", "Screen size of the part below which "
+         "the simplified geometry generated by --lod is rendered (default: 200). The coarsest "
+         "geometry is rendered below a quarter of the size." );
+   au.addCommandLineOption( "--occlusion-culling <vertices>", "Inserts occlusion queries above "
+         "the subgraphs of the loaded scene having at least the given number of vertices, "
+         "so the subgraphs hidden behind other geometry are not rendered. The query results "
+         "of the first lighting pass are reused by the other passes (disabled by default)." );
+   au.addCommandLineOption( "--lean-memory", "Releases the original scene after the conversion. "
+         "It is reconstructed from the scene cache when per-pixel lighting is switched off." );
+   au.addCommandLineOption( "--reload-delay <ms>", "Time the modified model file has to stay "
+         "unchanged before it is reloaded (default: 1000). Files with unchanged content "
+         "are not reloaded." );
+   au.addCommandLineOption( "--load-profile <file>", "Records the stages of the application start "
+         "and of the model loading up to the first frame of the model and writes them "
+         "to the given file in Chrome trace format (chrome://tracing)." );
+   au.addCommandLineOption( "--load-profile-summary <file>", "Appends one-line summary "
+         "of the load profile (time of each stage category and the time of the first frame) "
+         "to the given file." );
+   au.addCommandLineOption( "--benchmark <cameraPath>", "Renders the model offscreen along the given "
+         "camera path (osg::AnimationPath .path file, .ivv view or a file listing .ivv views), "
+         "prints frame, cull, draw and GPU time statistics and exits. No window is created." );
+   au.addCommandLineOption( "--benchmark-frames <n>", "Number of frames rendered by --benchmark (default: 300)." );
+   au.addCommandLineOption( "--benchmark-size <w> <h>", "Size of the image rendered by --benchmark "
+         "(default: 1280 720)." );
+   au.addCommandLineOption( "--benchmark-report <file>", "Writes the times of each frame "
+         "rendered by --benchmark to the given CSV file." );
+   au.addCommandLineOption( "--refinement-check <referenceImage>", "Renders the first view "
+         "of the --benchmark camera path with the progressive refinement of --progressive-samples "
+         "jittered samples and compares the accumulated image with the given reference image "
+         "instead of the benchmark. The reference image is created if it does not exist." );
+   au.addCommandLineOption( "--refinement-check-tolerance <t>", "Maximum mean absolute difference "
+         "of the color channels (0-255) accepted by --refinement-check (default: 2)." );
+   au.addCommandLineOption( "--frame-stats <file>", "Writes the statistics of each rendered frame "
+         "(event, update, cull, draw and GPU time, draw calls, triangles, state changes "
+         "and rendering subsystem counters) to the given CSV file." );
+   au.addCommandLineOption( "--frame-stats-interval <n>", "Writes only every n-th frame "
+         "by --frame-stats (default: 1)." );
+   au.addCommandLineOption( "--batch <listFile>", "Prepares the models listed in the given file "
+         "(one file name per line) without creating any GUI and stores the prepared scenes "
+         "in the scene cache, so they are opened instantly later. Prints the timing report and exits." );
+   au.addCommandLineOption( "--batch-threads <n>", "Number of models prepared in parallel "
+         "by --batch (default: number of CPU cores)." );
    au.addCommandLineOption( "--sv",  "Use ShadowVolume technique for shadows." );
    au.addCommandLineOption( "--sm",  "Use ShadowMap technique for shadows." );
    au.addCommandLineOption( "--ssm", "Use StandardShadowMap technique for shadows (default)." );
@@ -44,6 +115,17 @@ Options::Options( int &argc, char* argv[] )
    au.addCommandLineOption( "--lspsmvb", "Use LightSpacePerspectiveShadowMapVB (View Bounds) technique for shadows." );
    au.addCommandLineOption( "--lspsmcb", "Use LightSpacePerspectiveShadowMapCB (Cull Bounds) technique for shadows." );
    au.addCommandLineOption( "--lspsmdb", "Use LightSpacePerspectiveShadowMapDB (Draw Bounds) technique for shadows." );
+   au.addCommandLineOption( "--shadow-budget <ms>", "Frame time budget in milliseconds. "
+         "Shadow map resolution is lowered when frames take longer (disabled by default)." );
+   au.addCommandLineOption( "--interactive-budget <ms>", "Frame time budget in milliseconds "
+         "during the camera motion. When moving frames take longer, shadow map resolution "
+         "is lowered, then only the first lighting passes are rendered and finally the scene "
+         "without per-pixel lighting is rendered. Full quality is restored when the camera "
+         "stops (disabled by default)." );
+   au.addCommandLineOption( "--progressive-refinement", "Anti-aliases the image while the camera "
+         "does not move by accumulating frames rendered with subpixel offsets." );
+   au.addCommandLineOption( "--progressive-samples <n>", "Number of frames accumulated "
+         "by the progressive refinement (default: 16)." );
    au.addCommandLineOption( "--continuous-update", "Make screen updated on maximum FPS." );
 
    // print help
@@ -63,8 +145,33 @@ Options::Options( int &argc, char* argv[] )
    recreateFileAssociations = false;
    removeFileAssociations = false;
    exportScene = false;
+   unzipToTemp = false;
+   zipThreads = 0;
+   zipPreloadLimit = 512;
+   noSceneCache = false;
+   lazyKdTree = false;
+   benchmarkReader = false;
+   nativeIvx = false;
+   compareIvxParser = false;
+   optimizePreset = SceneOptimizer::NONE;
+   noDeduplication = false;
+   lodMinTriangles = 0;
+   lodPixelSize = 200.f;
+   occlusionCulling = 0;
+   leanMemory = false;
+   batchThreads = 0;
+   benchmarkFrames = 300;
+   benchmarkWidth = 1280;
+   benchmarkHeight = 720;
+   refinementCheckTolerance = 2.;
+   frameStatsInterval = 1;
+   reloadDelay = 1000;
    elevatedProcess = false;
    shadowTechnique = PerPixelLighting::SHADOW_VOLUMES;
+   shadowMapBudget = 0.;
+   interactiveBudget = 0.;
+   progressiveRefinement = false;
+   progressiveSamples = 16;
    continuousUpdate = false;
 
    // read options
@@ -76,6 +183,55 @@ Options::Options( int &argc, char* argv[] )
       renderInPovray = true;
    while( argumentParser->read( "--export-scene" ) )
       exportScene = true;
+   while( argumentParser->read( "--unzip-to-temp" ) )
+      unzipToTemp = true;
+   while( argumentParser->read( "--zip-threads", zipThreads ) );
+   while( argumentParser->read( "--zip-preload-limit", zipPreloadLimit ) );
+   while( argumentParser->read( "--no-scene-cache" ) )
+      noSceneCache = true;
+   while( argumentParser->read( "--lazy-kdtree" ) )
+      lazyKdTree = true;
+   while( argumentParser->read( "--benchmark-reader" ) )
+      benchmarkReader = true;
+   while( argumentParser->read( "--native-ivx" ) )
+      nativeIvx = true;
+   while( argumentParser->read( "--compare-ivx-parser" ) )
+      compareIvxParser = true;
+   std::string optimize;
+   while( argumentParser->read( "--optimize", optimize ) )
+      if( !SceneOptimizer::parsePreset( optimize, optimizePreset ) )
+         argumentParser->reportError( "Unknown --optimize preset \"" + optimize + "\"." );
+   while( argumentParser->read( "--no-deduplication" ) )
+      noDeduplication = true;
+   while( argumentParser->read( "--lod", lodMinTriangles ) );
+   while( argumentParser->read( "--lod-pixel-size", lodPixelSize ) );
+   while( argumentParser->read( "--occlusion-culling", occlusionCulling ) );
+   while( argumentParser->read( "--lean-memory" ) )
+      leanMemory = true;
+   while( argumentParser->read( "--reload-delay", reloadDelay ) );
+   std::string loadProfile;
+   while( argumentParser->read( "--load-profile", loadProfile ) )
+      loadProfileFile = loadProfile.c_str();
+   while( argumentParser->read( "--load-profile-summary", loadProfile ) )
+      loadProfileSummaryFile = loadProfile.c_str();
+   std::string benchmark;
+   while( argumentParser->read( "--benchmark", benchmark ) )
+      benchmarkPath = benchmark.c_str();
+   while( argumentParser->read( "--benchmark-frames", benchmarkFrames ) );
+   while( argumentParser->read( "--benchmark-size", benchmarkWidth, benchmarkHeight ) );
+   while( argumentParser->read( "--benchmark-report", benchmark ) )
+      benchmarkReport = benchmark.c_str();
+   while( argumentParser->read( "--refinement-check", benchmark ) )
+      refinementCheckReference = benchmark.c_str();
+   while( argumentParser->read( "--refinement-check-tolerance", refinementCheckTolerance ) );
+   std::string frameStats;
+   while( argumentParser->read( "--frame-stats", frameStats ) )
+      frameStatsFile = frameStats.c_str();
+   while( argumentParser->read( "--frame-stats-interval", frameStatsInterval ) );
+   std::string batch;
+   while( argumentParser->read( "--batch", batch ) )
+      batchListFile = batch.c_str();
+   while( argumentParser->read( "--batch-threads", batchThreads ) );
    while( argumentParser->read( "--install" ) ) {
       recreateFileAssociations = true;
       exitTime = BEFORE_GUI_CREATION;
@@ -110,6 +266,11 @@ Options::Options( int &argc, char* argv[] )
       shadowTechnique = PerPixelLighting::LSP_SHADOW_MAP_CULL_BOUNDS;
    while( argumentParser->read( "--lspsmdb" ) )
       shadowTechnique = PerPixelLighting::LSP_SHADOW_MAP_DRAW_BOUNDS;
+   while( argumentParser->read( "--shadow-budget", shadowMapBudget ) );
+   while( argumentParser->read( "--interactive-budget", interactiveBudget ) );
+   while( argumentParser->read( "--progressive-refinement" ) )
+      progressiveRefinement = true;
+   while( argumentParser->read( "--progressive-samples", progressiveSamples ) );
    while( argumentParser->read( "--continuous-update" ) )
       continuousUpdate = true;
    while( argumentParser->read( "--run-continuous" ) ) // compatibility with osgviewer
@@ -11,6 +11,7 @@
 
 #include <QString>
 #include "lighting/PerPixelLighting.h"
+#include "utils/SceneOptimizer.h"
 
 
 /**
@@ -39,7 +40,39 @@ public:
    bool recreateFileAssociations;
    bool removeFileAssociations;
    bool exportScene;
+   bool unzipToTemp;
+   int zipThreads;
+   int zipPreloadLimit;
+   bool noSceneCache;
+   bool lazyKdTree;
+   bool benchmarkReader;
+   bool nativeIvx;
+   bool compareIvxParser;
+   SceneOptimizer::Preset optimizePreset;
+   bool noDeduplication;
+   int lodMinTriangles;
+   float lodPixelSize;
+   int occlusionCulling;
+   bool leanMemory;
+   QString batchListFile;
+   int batchThreads;
+   int reloadDelay;
+   QString loadProfileFile;
+   QString loadProfileSummaryFile;
+   QString benchmarkPath;
+   int benchmarkFrames;
+   int benchmarkWidth;
+   int benchmarkHeight;
+   QString benchmarkReport;
+   QString refinementCheckReference;
+   double refinementCheckTolerance;
+   QString frameStatsFile;
+   int frameStatsInterval;
    PerPixelLighting::ShadowTechnique shadowTechnique;
+   double shadowMapBudget;
+   double interactiveBudget;
+   bool progressiveRefinement;
+   int progressiveSamples;
    bool continuousUpdate;
 
    /** slaveElevatedProcess is set to true by some cmd-line parameters that tells the application
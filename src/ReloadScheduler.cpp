@@ -0,0 +1,164 @@
+/**
+ * @file
+ * ReloadScheduler class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osg/Timer>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include "ReloadScheduler.h"
+#include "utils/Log.h"
+
+using namespace osg;
+
+
+/**
+ * Constructor.
+ */
+ReloadScheduler::ReloadScheduler( QObject *parent )
+   : QObject( parent ),
+     _settleTime( 1000 ),
+     _fileSize( 0 ),
+     _fileExists( false ),
+     _contentHash( 0 ),
+     _hasContentHash( false ),
+     _numEvents( 0 )
+{
+   _watcher = new QFileSystemWatcher( this );
+   connect( _watcher, SIGNAL( fileChanged( const QString& ) ),
+            this, SLOT( fileChanged( const QString& ) ), Qt::QueuedConnection );
+
+   _timer.setSingleShot( true );
+   connect( &_timer, SIGNAL( timeout() ), this, SLOT( checkFile() ) );
+}
+
+
+/**
+ * Destructor.
+ */
+ReloadScheduler::~ReloadScheduler()
+{
+}
+
+
+/**
+ * Starts watching the file.
+ *
+ * The content hash of the previously watched file is forgotten
+ * if a different file is given. Otherwise, it is kept
+ * until it is updated by setContentHash() or by the next check.
+ */
+void ReloadScheduler::watch( const QString &fileName )
+{
+   unwatch();
+
+   if( fileName != _fileName ) {
+      _fileName = fileName;
+      _hasContentHash = false;
+   }
+   if( _fileName.isEmpty() )
+      return;
+
+   _watcher->addPath( _fileName );
+   recordFileState();
+}
+
+
+/**
+ * Stops watching the file. The pending reload decision is dropped.
+ */
+void ReloadScheduler::unwatch()
+{
+   _timer.stop();
+   _numEvents = 0;
+   if( !_fileName.isEmpty() && _watcher->files().contains( _fileName ) )
+      _watcher->removePath( _fileName );
+}
+
+
+/**
+ * Sets the hash of the loaded content. The file is reloaded only
+ * if its content hash differs from this one.
+ */
+void ReloadScheduler::setContentHash( ContentHash::Value hash )
+{
+   _contentHash = hash;
+   _hasContentHash = true;
+}
+
+
+/**
+ * Handles the change notification by (re)starting the settle timer.
+ */
+void ReloadScheduler::fileChanged( const QString &fileName )
+{
+   if( fileName != _fileName )
+      return;
+
+   _numEvents++;
+   recordFileState();
+   _timer.start( _settleTime );
+}
+
+
+/**
+ * Checks whether the file settled, compares its content
+ * and emits reloadRequested() if the content changed.
+ */
+void ReloadScheduler::checkFile()
+{
+   // the file is still being written (or it does not exist at the moment)
+   // (wait for another settle time)
+   if( fileStateChanged() || !_fileExists ) {
+      recordFileState();
+      _timer.start( _settleTime );
+      return;
+   }
+
+   // watch the file again if it was replaced
+   if( !_watcher->files().contains( _fileName ) )
+      _watcher->addPath( _fileName );
+
+   // compare the content
+   Timer time;
+   ContentHash::Value hash;
+   bool hashed = ContentHash::hashFile( _fileName.toUtf8().constData(), hash );
+   double hashingTime = time.time_m();
+   int numEvents = _numEvents;
+   _numEvents = 0;
+   if( hashed && _hasContentHash && hash == _contentHash ) {
+      Log::notice() << QString( "ReloadScheduler: Content of %1 did not change "
+                                "(%2 change notifications, hashing took %3ms). Reload skipped." )
+                       .arg( _fileName ).arg( numEvents )
+                       .arg( hashingTime, 0, 'f', 2 ) << Log::endm;
+      return;
+   }
+
+   // reload
+   if( hashed )
+      setContentHash( hash );
+   Log::info() << QString( "ReloadScheduler: File %1 settled after %2 change notifications "
+                           "(hashing took %3ms). Requesting reload." )
+                  .arg( _fileName ).arg( numEvents )
+                  .arg( hashingTime, 0, 'f', 2 ) << Log::endm;
+   emit reloadRequested( _fileName );
+}
+
+
+void ReloadScheduler::recordFileState()
+{
+   QFileInfo fi( _fileName );
+   _fileExists = fi.exists();
+   _fileSize = fi.size();
+   _timeStamp.set( _fileName.toStdString() );
+}
+
+
+bool ReloadScheduler::fileStateChanged() const
+{
+   QFileInfo fi( _fileName );
+   return fi.exists() != _fileExists || fi.size() != _fileSize ||
+          FileTimeStamp( _fileName.toStdString() ) != _timeStamp;
+}
@@ -0,0 +1,89 @@
+/**
+ * @file
+ * ReloadScheduler class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef RELOAD_SCHEDULER_H
+#define RELOAD_SCHEDULER_H
+
+#include <QObject>
+#include <QString>
+#include <QTimer>
+#include "utils/ContentHash.h"
+#include "utils/FileTimeStamp.h"
+
+class QFileSystemWatcher;
+
+
+/**
+ * ReloadScheduler watches the file of the document and decides when
+ * the document should be reloaded.
+ *
+ * The change notifications are not acted upon immediately. Files are often
+ * written in several chunks, so the scheduler waits until the file size
+ * and its FileTimeStamp do not change for the settle time. Then, the content
+ * hash of the file is compared with the hash of the loaded content
+ * and reloadRequested() is emitted only if the content differs.
+ * Touched or rewritten files with the same content are not reloaded.
+ *
+ * The file is watched again after it has been replaced
+ * (QFileSystemWatcher stops watching the files that were removed,
+ * such as when the file is saved through a temporary file and renamed).
+ */
+class ReloadScheduler : public QObject
+{
+   Q_OBJECT
+
+public:
+
+   ReloadScheduler( QObject *parent = NULL );
+   virtual ~ReloadScheduler();
+
+   void watch( const QString &fileName );
+   void unwatch();
+   void setContentHash( ContentHash::Value hash );
+
+   inline const QString& getFileName() const;
+   inline int getSettleTime() const;
+   inline void setSettleTime( int ms );
+
+signals:
+
+   void reloadRequested( const QString &fileName );
+
+protected slots:
+
+   void fileChanged( const QString &fileName );
+   void checkFile();
+
+protected:
+
+   void recordFileState();
+   bool fileStateChanged() const;
+
+   QFileSystemWatcher *_watcher;
+   QTimer _timer;
+   int _settleTime;
+   QString _fileName;
+   qint64 _fileSize;
+   bool _fileExists;
+   FileTimeStamp _timeStamp;
+   ContentHash::Value _contentHash;
+   bool _hasContentHash;
+   int _numEvents;  // change notifications since the last reload decision
+
+};
+
+
+//
+//  inline methods
+//
+
+inline const QString& ReloadScheduler::getFileName() const  { return _fileName; }
+inline int ReloadScheduler::getSettleTime() const  { return _settleTime; }
+inline void ReloadScheduler::setSettleTime( int ms )  { _settleTime = ms; }
+
+
+#endif /* RELOAD_SCHEDULER_H */
@@ -0,0 +1,550 @@
+/**
+ * @file
+ * RenderBenchmark class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osg/AnimationPath>
+#include <osg/GraphicsContext>
+#include <osg/Image>
+#include <osg/Math>
+#include <osg/Stats>
+#include <osg/Timer>
+#include <osg/Viewport>
+#include <osgDB/FileNameUtils>
+#include <osgDB/ReadFile>
+#include <osgDB/WriteFile>
+#include <osgGA/StandardManipulator>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include "RenderBenchmark.h"
+#include "CadworkViewer.h"
+#include "Lexolights.h"
+#include "LexolightsDocument.h"
+#include "utils/CadworkReaderWriter.h"
+#include "utils/ProgressiveRefinement.h"
+#include "utils/ViewLoadSave.h"
+
+using namespace std;
+using namespace osg;
+
+
+// frames rendered before the measurement
+// (the first frames include the compilation of shaders and the upload of textures and geometry)
+static const int numWarmUpFrames = 10;
+
+// frames rendered after the measurement
+// (GPU times are available with a delay of a few frames)
+static const int numTrailingFrames = 4;
+
+
+/**
+ * Returns true if --benchmark is given on the command line.
+ */
+bool RenderBenchmark::isRequested( int argc, char* argv[] )
+{
+   for( int i=1; i<argc; i++ )
+      if( strcmp( argv[i], "--benchmark" ) == 0 )
+         return true;
+   return false;
+}
+
+
+/**
+ * Opens the model, renders it offscreen along the camera path
+ * and prints the report.
+ *
+ * @return Exit code of the application: 0 if the benchmark completed
+ * (or the refinement check passed), 1 if the model or the camera path could
+ * not be opened, the offscreen context could not be created or the refinement
+ * check failed and 99 for command line errors.
+ */
+int RenderBenchmark::run( int &argc, char* argv[] )
+{
+   QCoreApplication app( argc, argv );
+
+   // the same names as used by Lexolights
+   // (the scene cache location is derived from them)
+   app.setOrganizationName( "Cadwork Informatik" );
+   app.setOrganizationDomain( "www.cadwork.com" );
+   app.setApplicationName( "Lexolights" );
+
+   // options
+   Options *options = new Options( argc, argv );
+   Lexolights::g_options = options;
+   if( options->exitTime == Options::AFTER_PARSING_CMDLINE )
+      return 99;
+   if( options->startUpModelName.isEmpty() ) {
+      cerr << "No model given for --benchmark." << endl;
+      return 99;
+   }
+   if( options->benchmarkFrames <= 0 || options->benchmarkWidth <= 0 || options->benchmarkHeight <= 0 ) {
+      cerr << "Invalid --benchmark-frames or --benchmark-size." << endl;
+      return 99;
+   }
+   if( !options->refinementCheckReference.isEmpty() && options->progressiveSamples < 2 ) {
+      cerr << "--refinement-check requires at least two --progressive-samples." << endl;
+      return 99;
+   }
+
+   // picking is not used
+   options->lazyKdTree = true;
+
+   // readers
+   CadworkReaderWriter::createAliases();
+   if( options->nativeIvx )
+      Lexolights::setupNativeIvx();
+
+   // viewer
+   ref_ptr< CadworkViewer > viewer = new CadworkViewer( *options->argumentParser );
+   viewer->setThreadingModel( osgViewer::ViewerBase::SingleThreaded );
+   if( options->reportRemainingOptionsAsUnrecognized() )
+      return 99;
+
+   // offscreen context
+   // (pbuffer works with Mesa llvmpipe as well, no window is created)
+   int width = options->benchmarkWidth;
+   int height = options->benchmarkHeight;
+   ref_ptr< GraphicsContext::Traits > traits = new GraphicsContext::Traits;
+   traits->x = 0;
+   traits->y = 0;
+   traits->width = width;
+   traits->height = height;
+   traits->red = 8;
+   traits->green = 8;
+   traits->blue = 8;
+   traits->alpha = 8;
+   traits->depth = 24;
+   traits->stencil = 8;
+   traits->windowDecoration = false;
+   traits->doubleBuffer = false;
+   traits->pbuffer = true;
+   traits->readDISPLAY();
+   traits->setUndefinedScreenDetailsToDefaultScreen();
+   ref_ptr< GraphicsContext > gc = GraphicsContext::createGraphicsContext( traits.get() );
+   if( !gc.valid() ) {
+      cerr << "Can not create offscreen rendering context (pbuffer).\n"
+              "On machines without GPU, run the benchmark under Xvfb "
+              "with Mesa software rendering (LIBGL_ALWAYS_SOFTWARE=1)." << endl;
+      return 1;
+   }
+   Camera *camera = viewer->getCamera();
+   camera->setGraphicsContext( gc.get() );
+   camera->setViewport( new Viewport( 0, 0, width, height ) );
+   camera->setProjectionMatrixAsPerspective( 30., double( width ) / double( height ), 1., 1000. );
+   camera->setDrawBuffer( GL_FRONT );
+   camera->setReadBuffer( GL_FRONT );
+
+   // camera stats for all the frames
+   int numFrames = options->benchmarkFrames;
+   camera->setStats( new Stats( "Camera", numWarmUpFrames + numFrames + numTrailingFrames ) );
+   camera->getStats()->collectStats( "rendering", true );
+   camera->getStats()->collectStats( "gpu", true );
+
+   // open model
+   Timer time;
+   ref_ptr< LexolightsDocument::OpenOperation > openOp = new LexolightsDocument::OpenOperation;
+   openOp->fileName = options->startUpModelName;
+   if( !openOp->run() ) {
+      cerr << "Can not open model " << options->startUpModelName.toLocal8Bit().constData() << "." << endl;
+      return 1;
+   }
+   double loadTime = time.time_m();
+   viewer->setSceneData( openOp->getPPLScene() ? openOp->getPPLScene() : openOp->getOriginalScene(), true );
+
+   // camera path
+   vector< View > views;
+   if( !readCameraPath( options->benchmarkPath, numFrames, viewer, views ) )
+      return 1;
+
+   viewer->realize();
+   if( !viewer->isRealized() ) {
+      cerr << "Can not realize the viewer." << endl;
+      return 1;
+   }
+
+   // progressive refinement check instead of the benchmark
+   if( !options->refinementCheckReference.isEmpty() ) {
+      cout << QString( "Progressive refinement check of %1 (%2x%3, %4 samples, reference %5)." )
+              .arg( options->startUpModelName ).arg( width ).arg( height )
+              .arg( options->progressiveSamples ).arg( options->refinementCheckReference )
+              .toLocal8Bit().constData() << endl;
+      bool passed = checkRefinement( viewer, views[0], options->progressiveSamples,
+                                     options->refinementCheckReference,
+                                     options->refinementCheckTolerance );
+      viewer = NULL;
+      openOp = NULL;
+      Lexolights::g_options = NULL;
+      delete options;
+      return passed ? 0 : 1;
+   }
+
+   cout << QString( "Benchmark of %1 (%2x%3, %4 frames, camera path %5).\n"
+                    "Model opened in %6ms." )
+           .arg( options->startUpModelName ).arg( width ).arg( height ).arg( numFrames )
+           .arg( options->benchmarkPath ).arg( loadTime, 0, 'f', 2 )
+           .toLocal8Bit().constData() << endl;
+
+   // render
+   osgGA::StandardManipulator *manipulator = dynamic_cast< osgGA::StandardManipulator* >( viewer->getCameraManipulator() );
+   vector< FrameTimes > times( numFrames );
+   vector< unsigned int > frameNumbers( numFrames );
+   double totalTime = 0.;
+   for( int i=-numWarmUpFrames; i<numFrames+numTrailingFrames; i++ )
+   {
+      // set view
+      const View &view = views[ osg::clampBetween( i, 0, numFrames-1 ) ];
+      manipulator->setByInverseMatrix( view.viewMatrix );
+      double fovy, ratio, zNear, zFar;
+      camera->getProjectionMatrixAsPerspective( fovy, ratio, zNear, zFar );
+      camera->setProjectionMatrixAsPerspective( view.fovy, ratio, zNear, zFar );
+
+      // frame
+      // (single threaded viewer, the frame is completed on the return)
+      time.setStartTick();
+      viewer->frame();
+      double t = time.time_m();
+      if( i >= 0 && i < numFrames ) {
+         times[i].frame = t;
+         frameNumbers[i] = viewer->getFrameStamp()->getFrameNumber();
+         totalTime += t;
+      }
+   }
+
+   // collect stats (times are given in seconds)
+   Stats *stats = camera->getStats();
+   for( int i=0; i<numFrames; i++ ) {
+      double v;
+      if( stats->getAttribute( frameNumbers[i], "Cull traversal time taken", v ) )
+         times[i].cull = v * 1000.;
+      if( stats->getAttribute( frameNumbers[i], "Draw traversal time taken", v ) )
+         times[i].draw = v * 1000.;
+      if( stats->getAttribute( frameNumbers[i], "GPU draw time taken", v ) )
+         times[i].gpu = v * 1000.;
+   }
+
+   // report
+   printReport( times, totalTime );
+   bool ok = true;
+   if( !options->benchmarkReport.isEmpty() )
+      if( !writeFrameTimes( options->benchmarkReport, times ) ) {
+         cerr << "Can not write " << options->benchmarkReport.toLocal8Bit().constData() << "." << endl;
+         ok = false;
+      }
+
+   viewer = NULL;
+   openOp = NULL;
+   Lexolights::g_options = NULL;
+   delete options;
+
+   return ok ? 0 : 1;
+}
+
+
+/**
+ * Reads the camera path and returns the view of each frame.
+ *
+ * The view (camera transformation and vertical field of view) is read
+ * from osg::AnimationPath file (.path), ivv file or the list of ivv files.
+ * The ivv files are applied to the camera and the manipulator of the viewer.
+ */
+bool RenderBenchmark::readCameraPath( const QString &fileName, int numFrames, CadworkViewer *viewer,
+                                      vector< View > &views )
+{
+   double fovy, ratio, zNear, zFar;
+   viewer->getCamera()->getProjectionMatrixAsPerspective( fovy, ratio, zNear, zFar );
+   string extension = osgDB::getLowerCaseFileExtension( fileName.toLocal8Bit().constData() );
+
+   // animation path
+   if( extension == "path" ) {
+
+      ifstream in( fileName.toLocal8Bit().constData() );
+      ref_ptr< AnimationPath > path = new AnimationPath;
+      if( in )
+         path->read( in );
+      if( path->empty() ) {
+         cerr << "Can not read camera path " << fileName.toLocal8Bit().constData() << "." << endl;
+         return false;
+      }
+
+      // sample the path uniformly
+      double t0 = path->getFirstTime();
+      double t1 = path->getLastTime();
+      for( int i=0; i<numFrames; i++ ) {
+         AnimationPath::ControlPoint cp;
+         path->getInterpolatedControlPoint( numFrames > 1 ? t0 + ( t1 - t0 ) * i / ( numFrames - 1 ) : t0, cp );
+         Matrixd m;
+         cp.getInverse( m );
+         views.push_back( View( m, fovy ) );
+      }
+      return true;
+   }
+
+   // ivv file or list of ivv files
+   QStringList ivvFiles;
+   if( extension == "ivv" )
+      ivvFiles.append( fileName );
+   else {
+      QFile file( fileName );
+      if( !file.open( QIODevice::ReadOnly | QIODevice::Text ) ) {
+         cerr << "Can not open camera path " << fileName.toLocal8Bit().constData() << "." << endl;
+         return false;
+      }
+      QDir listDir = QFileInfo( fileName ).absoluteDir();
+      QTextStream stream( &file );
+      stream.setCodec( "UTF-8" );
+      while( !stream.atEnd() ) {
+         QString line = stream.readLine().trimmed();
+         if( line.isEmpty() || line.startsWith( '#' ) )
+            continue;
+         ivvFiles.append( QDir::cleanPath( listDir.absoluteFilePath( line ) ) );
+      }
+   }
+   if( ivvFiles.isEmpty() ) {
+      cerr << "No views listed in " << fileName.toLocal8Bit().constData() << "." << endl;
+      return false;
+   }
+
+   // read views
+   osgGA::StandardManipulator *manipulator = dynamic_cast< osgGA::StandardManipulator* >( viewer->getCameraManipulator() );
+   vector< View > ivvViews;
+   for( int i=0; i<ivvFiles.size(); i++ ) {
+      if( loadIVV( ivvFiles[i], *viewer->getCamera(), *manipulator ) <= 0 ) {
+         cerr << "Can not read view " << ivvFiles[i].toLocal8Bit().constData() << "." << endl;
+         return false;
+      }
+      viewer->getCamera()->getProjectionMatrixAsPerspective( fovy, ratio, zNear, zFar );
+      ivvViews.push_back( View( manipulator->getInverseMatrix(), fovy ) );
+   }
+
+   // each view is rendered for the same number of frames
+   for( int i=0; i<numFrames; i++ )
+      views.push_back( ivvViews[ i * ivvViews.size() / numFrames ] );
+   return true;
+}
+
+
+// returns the value at the given percentile of sorted values
+static double percentile( const vector< double > &sortedValues, double p )
+{
+   if( sortedValues.empty() )
+      return 0.;
+   unsigned int i = (unsigned int)( p * ( sortedValues.size() - 1 ) + 0.5 );
+   return sortedValues[i];
+}
+
+
+// returns the row of the report
+static QString reportRow( const char *name, vector< double > values )
+{
+   if( values.empty() )
+      return QString( "   %1  not available" ).arg( name, -6 );
+
+   double sum = 0.;
+   for( unsigned int i=0; i<values.size(); i++ )
+      sum += values[i];
+   sort( values.begin(), values.end() );
+
+   return QString( "   %1 %2 %3 %4 %5 %6 %7" ).arg( name, -6 )
+          .arg( sum / values.size(), 9, 'f', 2 )
+          .arg( percentile( values, 0.5 ), 9, 'f', 2 )
+          .arg( percentile( values, 0.9 ), 9, 'f', 2 )
+          .arg( percentile( values, 0.95 ), 9, 'f', 2 )
+          .arg( percentile( values, 0.99 ), 9, 'f', 2 )
+          .arg( values.back(), 9, 'f', 2 );
+}
+
+
+/**
+ * Prints mean, percentiles and maximum of the frame, cull, draw and GPU times
+ * (in milliseconds) and the average FPS.
+ */
+void RenderBenchmark::printReport( const vector< FrameTimes > &times, double totalTime )
+{
+   vector< double > frame, cull, draw, gpu;
+   for( unsigned int i=0; i<times.size(); i++ ) {
+      frame.push_back( times[i].frame );
+      cull.push_back( times[i].cull );
+      draw.push_back( times[i].draw );
+      if( times[i].gpu >= 0. )
+         gpu.push_back( times[i].gpu );
+   }
+
+   cout << "\nRender benchmark report (times in ms):\n"
+           "               mean       p50       p90       p95       p99       max\n"
+        << reportRow( "frame", frame ).toLocal8Bit().constData() << "\n"
+        << reportRow( "cull", cull ).toLocal8Bit().constData() << "\n"
+        << reportRow( "draw", draw ).toLocal8Bit().constData() << "\n"
+        << reportRow( "gpu", gpu ).toLocal8Bit().constData() << "\n"
+        << QString( "Average FPS %1 (%2 frames in %3ms)." )
+           .arg( totalTime > 0. ? times.size() * 1000. / totalTime : 0., 0, 'f', 2 )
+           .arg( times.size() ).arg( totalTime, 0, 'f', 2 ).toLocal8Bit().constData() << endl;
+}
+
+
+/**
+ * Writes the times of each frame to CSV file.
+ */
+bool RenderBenchmark::writeFrameTimes( const QString &fileName, const vector< FrameTimes > &times )
+{
+   QFile file( fileName );
+   if( !file.open( QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text ) )
+      return false;
+
+   QTextStream stream( &file );
+   stream << "frame,frameTime,cullTime,drawTime,gpuTime\n";
+   for( unsigned int i=0; i<times.size(); i++ )
+      stream << QString( "%1,%2,%3,%4,%5\n" ).arg( i )
+                .arg( times[i].frame, 0, 'f', 3 ).arg( times[i].cull, 0, 'f', 3 )
+                .arg( times[i].draw, 0, 'f', 3 )
+                .arg( times[i].gpu >= 0. ? QString::number( times[i].gpu, 'f', 3 ) : QString() );
+
+   stream.flush();
+   return file.error() == QFile::NoError;
+}
+
+
+/**
+ * Final draw callback that reads the image of the frame when requested.
+ *
+ * It wraps the final draw callback of ProgressiveRefinement,
+ * so the image includes the accumulated samples.
+ */
+class CaptureCallback : public Camera::DrawCallback
+{
+public:
+
+   CaptureCallback( Camera::DrawCallback *nested ) : capture( false ), _nested( nested )  {}
+
+   virtual void operator()( RenderInfo &renderInfo ) const
+   {
+      if( _nested.valid() )
+         (*_nested)( renderInfo );
+
+      if( capture ) {
+         Camera *camera = renderInfo.getCurrentCamera();
+         const Viewport *viewport = camera->getViewport();
+         glReadBuffer( camera->getReadBuffer() );
+         image = new Image;
+         image->readPixels( int( viewport->x() ), int( viewport->y() ),
+                            int( viewport->width() ), int( viewport->height() ),
+                            GL_RGB, GL_UNSIGNED_BYTE );
+      }
+   }
+
+   bool capture;
+   mutable ref_ptr< Image > image;
+
+protected:
+   ref_ptr< Camera::DrawCallback > _nested;
+};
+
+
+// returns the mean absolute difference of the color channels (0-255)
+// of two images of the same size
+static double meanDifference( const Image *image1, const Image *image2 )
+{
+   double sum = 0.;
+   for( int t=0; t<image1->t(); t++ )
+      for( int s=0; s<image1->s(); s++ ) {
+         Vec4 c1 = image1->getColor( s, t );
+         Vec4 c2 = image2->getColor( s, t );
+         sum += fabs( c1.r() - c2.r() ) + fabs( c1.g() - c2.g() ) + fabs( c1.b() - c2.b() );
+      }
+   return sum * 255. / ( 3. * image1->s() * image1->t() );
+}
+
+
+/**
+ * Renders the view with the progressive refinement until numSamples jittered samples
+ * are accumulated and compares the accumulated image with the reference image.
+ *
+ * The check passes if the mean absolute difference of the color channels
+ * does not exceed the tolerance. If the reference image does not exist,
+ * it is created from the accumulated image and the check fails, so the new
+ * reference is never accepted without notice. The image of the failed check
+ * is written next to the reference image for inspection.
+ */
+bool RenderBenchmark::checkRefinement( CadworkViewer *viewer, const View &view, int numSamples,
+                                       const QString &referenceFileName, double tolerance )
+{
+   Camera *camera = viewer->getCamera();
+   ref_ptr< CaptureCallback > capture = new CaptureCallback( camera->getFinalDrawCallback() );
+   camera->setFinalDrawCallback( capture.get() );
+
+   // the camera stays still, so each frame after the first one
+   // accumulates one jittered sample
+   osgGA::StandardManipulator *manipulator = dynamic_cast< osgGA::StandardManipulator* >( viewer->getCameraManipulator() );
+   manipulator->setByInverseMatrix( view.viewMatrix );
+   double fovy, ratio, zNear, zFar;
+   camera->getProjectionMatrixAsPerspective( fovy, ratio, zNear, zFar );
+   camera->setProjectionMatrixAsPerspective( view.fovy, ratio, zNear, zFar );
+   ProgressiveRefinement *refinement = viewer->getProgressiveRefinement();
+   refinement->setNumSamples( numSamples );
+   refinement->setEnabled( true );
+   for( int i=0; i<numWarmUpFrames+numSamples && refinement->getNumAccumulatedSamples() < numSamples; i++ )
+      viewer->frame();
+   if( refinement->getNumAccumulatedSamples() < numSamples ) {
+      cerr << "Progressive refinement accumulated " << refinement->getNumAccumulatedSamples()
+           << " of " << numSamples << " samples." << endl;
+      return false;
+   }
+
+   // frame displaying the accumulated image
+   capture->capture = true;
+   viewer->frame();
+   ref_ptr< Image > image = capture->image;
+   if( !image.valid() ) {
+      cerr << "Can not read the rendered image." << endl;
+      return false;
+   }
+
+   // create missing reference
+   QByteArray referenceName = referenceFileName.toLocal8Bit();
+   if( !QFile::exists( referenceFileName ) ) {
+      if( !osgDB::writeImageFile( *image, referenceName.constData() ) )
+         cerr << "Can not write reference image " << referenceName.constData() << "." << endl;
+      else
+         cerr << "Reference image " << referenceName.constData() << " created. "
+                 "Verify it and run the check again." << endl;
+      return false;
+   }
+
+   // compare
+   ref_ptr< Image > reference = osgDB::readImageFile( referenceName.constData() );
+   if( !reference.valid() ) {
+      cerr << "Can not read reference image " << referenceName.constData() << "." << endl;
+      return false;
+   }
+   bool passed = false;
+   if( reference->s() != image->s() || reference->t() != image->t() )
+      cerr << QString( "Reference image size %1x%2 differs from the rendered image size %3x%4." )
+              .arg( reference->s() ).arg( reference->t() ).arg( image->s() ).arg( image->t() )
+              .toLocal8Bit().constData() << endl;
+   else {
+      double difference = meanDifference( image.get(), reference.get() );
+      passed = difference <= tolerance;
+      cout << QString( "Mean difference from the reference image %1 (tolerance %2): %3." )
+              .arg( difference, 0, 'f', 3 ).arg( tolerance, 0, 'f', 3 )
+              .arg( passed ? "passed" : "FAILED" ).toLocal8Bit().constData() << endl;
+   }
+
+   // keep the failed image for inspection
+   if( !passed ) {
+      QFileInfo info( referenceFileName );
+      QString resultName = info.absoluteDir().filePath( info.completeBaseName() + "-result." + info.suffix() );
+      if( osgDB::writeImageFile( *image, resultName.toLocal8Bit().constData() ) )
+         cerr << "Rendered image written to " << resultName.toLocal8Bit().constData() << "." << endl;
+   }
+
+   return passed;
+}
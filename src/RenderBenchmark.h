@@ -0,0 +1,72 @@
+/**
+ * @file
+ * RenderBenchmark class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef RENDER_BENCHMARK_H
+#define RENDER_BENCHMARK_H
+
+#include <osg/Matrixd>
+#include <QString>
+#include <vector>
+
+
+/**
+ * Headless rendering benchmark.
+ *
+ * The model given on the command line is opened by the same pipeline
+ * as in the application (see LexolightsDocument::OpenOperation) and rendered
+ * by CadworkViewer into an offscreen pbuffer along the camera path given by
+ * --benchmark. No window is created, so the benchmark can run on the build servers
+ * without GPU using Mesa software rendering (llvmpipe), for example under Xvfb.
+ *
+ * The camera path is either osg::AnimationPath file (.path, as recorded
+ * by osgViewer's RecordCameraPathHandler), a single view (.ivv, see ViewLoadSave)
+ * or a text file listing ivv files, one per line. The animation path is sampled
+ * uniformly, the views are rendered one after another for the same number of frames.
+ *
+ * Frame, cull, draw and GPU times of each frame are collected from the camera stats.
+ * Their mean, percentiles and the average FPS are printed to the standard output,
+ * per-frame times can be written to CSV file given by --benchmark-report.
+ *
+ * With --refinement-check, the benchmark is replaced by the check
+ * of ProgressiveRefinement: the first view of the camera path is rendered
+ * until the given number of jittered samples is accumulated and the accumulated
+ * image is compared with the reference image within the given tolerance.
+ */
+class RenderBenchmark
+{
+public:
+
+   static bool isRequested( int argc, char* argv[] );
+   static int run( int &argc, char* argv[] );
+
+protected:
+
+   struct View {
+      osg::Matrixd viewMatrix;
+      double fovy;
+      View( const osg::Matrixd &m, double f ) : viewMatrix( m ), fovy( f )  {}
+   };
+
+   struct FrameTimes {
+      double frame;
+      double cull;
+      double draw;
+      double gpu;  // negative if not available
+      FrameTimes() : frame( 0. ), cull( 0. ), draw( 0. ), gpu( -1. )  {}
+   };
+
+   static bool readCameraPath( const QString &fileName, int numFrames, class CadworkViewer *viewer,
+                               std::vector< View > &views );
+   static void printReport( const std::vector< FrameTimes > &times, double totalTime );
+   static bool writeFrameTimes( const QString &fileName, const std::vector< FrameTimes > &times );
+   static bool checkRefinement( class CadworkViewer *viewer, const View &view, int numSamples,
+                                const QString &referenceFileName, double tolerance );
+
+};
+
+
+#endif /* RENDER_BENCHMARK_H */
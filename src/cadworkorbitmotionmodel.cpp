@@ -16,6 +16,7 @@
 #include <osg/Camera>
 
 #include "Log.h"
+#include "LazyKdTreeIntersector.h"
 #include <osg/io_utils>
 #include <osgUtil/LineSegmentIntersector>
 #include <osgUtil/IntersectionVisitor>
@@ -583,13 +584,21 @@ void CadworkOrbitMotionModel::SSPick(float x, float y)
         y *= vp->height();
     } else
         cf = osgUtil::Intersector::PROJECTION;
-   mLineIntersector = new osgUtil::LineSegmentIntersector(cf, win_x, win_y);
+   //(KdTrees missing due to lazy KdTree building are built by the intersector on demand)
+   osg::ref_ptr<LazyKdTreeIntersector> intersector = new LazyKdTreeIntersector(cf, win_x, win_y);
+   mLineIntersector = intersector;
    mIntersectionVisitor->setIntersector(mLineIntersector);
    //mLineIntersector->setStart(nearPoint);
    //mLineIntersector->setEnd(farPoint);
    
    //run intersection visitor
    camera->GetOSGCamera()->accept(*mIntersectionVisitor);
+
+   if(intersector->getNumBuiltTrees() > 0)
+      Log::info() << QString("KdTree built on demand for %1 geometries in %2ms (%3KiB).")
+                     .arg(intersector->getNumBuiltTrees())
+                     .arg(intersector->getBuildTime(), 0, 'f', 2)
+                     .arg((intersector->getMemoryUsage() + 1023) / 1024) << Log::endm;
 }
 
 /***********CadworkMotionModelInterface**************/
@@ -7,10 +7,14 @@
  */
 
 
+#include <osgUtil/IntersectionVisitor>
 #include "CadworkOrbitManipulator.h"
+#include "utils/LazyKdTreeIntersector.h"
 #include "utils/Log.h"
 
 using namespace osg;
+using namespace osgGA;
+using namespace osgUtil;
 
 static const double homeRotation = 0.7;
 static const double homeElevation = 0.61;
@@ -48,3 +52,64 @@ void CadworkOrbitManipulator::computeHomePosition( const Camera *camera, bool us
                     Quat( homeElevation, Vec3d( -1., 0., 0. ) ) * _homeUp,
                     _autoComputeHomePosition);
 }
+
+
+bool CadworkOrbitManipulator::setCenterByMousePointerIntersection( const GUIEventAdapter& ea, GUIActionAdapter& us )
+{
+   osg::View* view = us.asView();
+   if( !view )
+      return false;
+
+   Camera *camera = view->getCamera();
+   if( !camera )
+      return false;
+
+   // prepare variables
+   float x = ( ea.getX() - ea.getXmin() ) / ( ea.getXmax() - ea.getXmin() );
+   float y = ( ea.getY() - ea.getYmin() ) / ( ea.getYmax() - ea.getYmin() );
+   LineSegmentIntersector::CoordinateFrame cf;
+   Viewport *vp = camera->getViewport();
+   if( vp ) {
+      cf = Intersector::WINDOW;
+      x *= vp->width();
+      y *= vp->height();
+   } else
+      cf = Intersector::PROJECTION;
+
+   // perform intersection computation
+   // (KdTrees missing due to lazy KdTree building are built by the intersector on demand)
+   ref_ptr< LazyKdTreeIntersector > picker = new LazyKdTreeIntersector( cf, x, y );
+   IntersectionVisitor iv( picker.get() );
+   camera->accept( iv );
+
+   if( picker->getNumBuiltTrees() > 0 )
+      Log::info() << QString( "KdTree built on demand for %1 geometries in %2ms (%3KiB)." )
+                             .arg( picker->getNumBuiltTrees() )
+                             .arg( picker->getBuildTime(), 0, 'f', 2 )
+                             .arg( ( picker->getMemoryUsage() + 1023 ) / 1024 ) << Log::endm;
+
+   // return on no intersections
+   if( !picker->containsIntersections() )
+      return false;
+
+   // get current transformation
+   Vec3d eye, oldCenter, up;
+   getTransformation( eye, oldCenter, up );
+
+   // new center
+   Vec3d newCenter = picker->getFirstIntersection().getWorldIntersectPoint();
+
+   // make vertical axis correction
+   if( getVerticalAxisFixed() )
+   {
+      CoordinateFrame coordinateFrame = getCoordinateFrame( newCenter );
+      Vec3d localUp = getUpVector( coordinateFrame );
+      fixVerticalAxis( newCenter - eye, up, localUp );
+   }
+
+   // set the new center and warp the pointer to it
+   setTransformation( eye, newCenter, up );
+   centerMousePointer( ea, us );
+
+   return true;
+}
@@ -40,6 +40,14 @@ public:
     *
     *  CadworkManipulator overrides the method to perform the same as left mouse button. */
    virtual bool performMovementRightMouseButton( const double eventTimeDelta, const double dx, const double dy );
+
+protected:
+
+   /** Set the center to the intersection of the mouse pointer ray with the scene.
+    *
+    *  CadworkManipulator overrides the method to use LazyKdTreeIntersector
+    *  that builds the KdTrees not yet built by lazy KdTree building. */
+   virtual bool setCenterByMousePointerIntersection( const osgGA::GUIEventAdapter& ea, osgGA::GUIActionAdapter& us );
 };
 
 
@@ -283,9 +283,7 @@ void LexoanimMainWindow::loadModel(QString fileName, bool resetViewSettings )
          /*dtCore::RefPtr<dtCore::Object> sceneObject = new dtCore::Object("Model");
          sceneObject->LoadFile(fileName.toStdString());
          getDeltaApp()->AddDrawable(sceneObject);*/
-         DeltaSceneGroup->addChild(actionPPL->isChecked() ?
-                                                newDocument->getPPLScene() :
-                                                newDocument->getOriginalScene());
+         setDocumentScene(actionPPL->isChecked());
          //DeltaSceneGroup->addChild(newDocument->getOriginalScene());
          //DeltaSceneGroup = NULL;
 
@@ -318,6 +316,7 @@ void LexoanimMainWindow::loadModel(QString fileName, bool resetViewSettings )
              * is always the same. So we could compute it only once.
              */
             dtCore::Camera *cam = lexoAnimApp->GetCamera();
+
             if(lexoAnimApp->GetFlyMotionModel()->GetAutoComputeHomePosition())
                lexoAnimApp->GetFlyMotionModel()->ComputeHomePosition(cam);
 
@@ -384,6 +383,54 @@ void LexoanimMainWindow::reloadModel()
       loadModel( LexoanimQtApp::activeDocument()->getFileName(), false );
 }
 
+
+/**
+ * Shows the scene of the active document in the Delta3D scene
+ * and gives it to the adaptive quality controller that degrades
+ * it during the camera motion (see MainWindow::setControlledScene()).
+ */
+void LexoanimMainWindow::setDocumentScene( bool ppl )
+{
+   LexolightsDocument *document = LexoanimQtApp::activeDocument();
+   ref_ptr<osg::Group> DeltaSceneGroup = getDeltaApp()->GetScene()->GetSceneNode();
+   getDeltaApp()->GetScene()->RemoveAllDrawables();
+   DeltaSceneGroup->removeChildren(0, DeltaSceneGroup->getNumChildren());
+   if(document)
+      DeltaSceneGroup->addChild(ppl && document->getPPLScene() ?
+                                document->getPPLScene() :
+                                document->getOriginalScene());
+
+   // the controller degrades the converted scene only
+   // (the original scene is released while the converted one is shown in lean memory mode)
+   LexoanimApp *app = GetLexoanimApp();
+   if(app && app->GetQualityController())
+   {
+      if(document && ppl && document->getPPLScene())
+         app->GetQualityController()->setScene(document->getPPLScene(),
+               Lexolights::options()->leanMemory ? NULL : document->getOriginalScene());
+      else
+         app->GetQualityController()->setScene(NULL, NULL);
+   }
+}
+
+
+void LexoanimMainWindow::activeDocumentSceneChanged()
+{
+   setDocumentScene(actionPPL->isChecked());
+}
+
+
+void LexoanimMainWindow::setPerPixelLighting( bool on )
+{
+   if( LexoanimQtApp::activeDocument() ) {
+      setDocumentScene( on );
+
+      // lean memory mode: the original scene is not needed while the converted one is shown
+      if( on )
+         LexoanimQtApp::activeDocument()->releaseOriginalScene();
+   }
+}
+
 /**
  * Set the orbit manipulator.
  *
@@ -592,6 +639,17 @@ void LexoanimMainWindow::selectCustomColor()
 }
 
 
+/**
+ * Enables/disables the accumulation of anti-aliased image while the camera is still.
+ */
+void LexoanimMainWindow::setProgressiveRefinement( bool on )
+{
+   LexoanimApp *app = GetLexoanimApp();
+   if(app && app->GetProgressiveRefinement())
+      app->GetProgressiveRefinement()->setEnabled( on );
+}
+
+
 void LexoanimMainWindow::renderUsingPovray()
 {
    // if no active document, do nothing
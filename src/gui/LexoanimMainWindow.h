@@ -39,6 +39,7 @@ protected:
    
    //util
    virtual LexoanimApp *GetLexoanimApp(){ return dynamic_cast<LexoanimApp *> (getDeltaApp()); }
+   void setDocumentScene( bool ppl );
    
    ///Delta3D application
    dtABC::Application *_deltaApp;
@@ -48,7 +49,7 @@ public slots:
    //void openModel( QString fileName = "" );
    virtual void reloadModel();
    virtual void loadModel( QString fileName, bool resetViewSettings );
-   //void activeDocumentSceneChanged();
+   virtual void activeDocumentSceneChanged();
    virtual void defaultView();
    virtual void loadView();
    virtual void saveView();
@@ -60,9 +61,10 @@ public slots:
    virtual void setOrbitManipulator();
    virtual void setFirstPersonManipulator();
    //void setAxisVisible( bool visible );
-   //void setPerPixelLighting( bool on );
+   virtual void setPerPixelLighting( bool on );
    virtual void renderUsingPovray();
    //void setStereoscopicRendering( bool on );
+   virtual void setProgressiveRefinement( bool on );
    //void showAboutDlg();
    //void showLog( bool visible );
 };
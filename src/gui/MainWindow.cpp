@@ -40,6 +40,7 @@
 #include "Lexolights.h"
 #include "LexolightsDocument.h"
 #include "CadworkViewer.h"
+#include "lighting/AdaptiveQualityController.h"
 #include "lighting/PerPixelLighting.h"
 #include "lighting/ShadowVolume.h"
 #include "gui/CadworkOrbitManipulator.h"
@@ -49,6 +50,7 @@
 #include "gui/SystemInfoDialog.h"
 #include "threading/ExternalApplicationWorker.h"
 #include "utils/Log.h"
+#include "utils/ProgressiveRefinement.h"
 #include "utils/ViewLoadSave.h"
 #include "utils/WinRegistry.h"
 #include "utils/BuildTime.h"
@@ -404,6 +406,13 @@ void MainWindow::createActions()
    actionStereo->setCheckable( true );
    connect( actionStereo, SIGNAL( triggered(bool) ), this, SLOT( setStereoscopicRendering(bool) ) );
 
+   // Scene->Progressive refinement
+   actionProgressiveRefinement = new QAction( this );
+   actionProgressiveRefinement->setText( "Progressive refinement" );
+   actionProgressiveRefinement->setCheckable( true );
+   actionProgressiveRefinement->setChecked( Lexolights::options()->progressiveRefinement );
+   connect( actionProgressiveRefinement, SIGNAL( triggered(bool) ), this, SLOT( setProgressiveRefinement(bool) ) );
+
    // Help->About
    this->actionAbout = new QAction( this );
    this->actionAbout->setText( "About" );
@@ -506,6 +515,7 @@ void MainWindow::createMenu()
    this->menuView->addSeparator();
    this->menuView->addAction( this->actionPovrayRendering );
    this->menuView->addAction( this->actionStereo );
+   this->menuView->addAction( this->actionProgressiveRefinement );
 
       // "Background" submenu
       menuBackground->setTitle( "&Background" );
@@ -703,6 +713,41 @@ void MainWindow::loadModel(QString fileName, bool resetViewSettings )
 }
 
 
+/**
+ * Returns the scene of the document that should be displayed.
+ *
+ * The converted (per-pixel-lit) scene is returned if ppl is true and the scene exists.
+ * Otherwise the original scene is returned. The converted scene does not exist
+ * while it is still being converted by the staged document open or when
+ * the conversion is disabled.
+ */
+static Node* getDocumentScene( LexolightsDocument *document, bool ppl )
+{
+   if( ppl && document->getPPLScene() )
+      return document->getPPLScene();
+   else
+      return document->getOriginalScene();
+}
+
+
+/**
+ * Gives the displayed scene of the document to the adaptive quality controller.
+ *
+ * The controller degrades the converted scene only. In lean memory mode,
+ * it does not keep the original scene, as it is released while the converted
+ * one is shown.
+ */
+static void setControlledScene( AdaptiveQualityController *controller,
+                                LexolightsDocument *document, bool ppl )
+{
+   if( document && ppl && document->getPPLScene() )
+      controller->setScene( document->getPPLScene(),
+                            Lexolights::options()->leanMemory ? NULL : document->getOriginalScene() );
+   else
+      controller->setScene( NULL, NULL );
+}
+
+
 /**
  * The method opens the model given by document parameter.
  *
@@ -739,21 +784,23 @@ void MainWindow::openDocument( LexolightsDocument *document, bool resetViewSetti
    // set the new scene
    // and reset view if requested
    if( Lexolights::activeDocument() )
-      Lexolights::viewer()->setSceneData( actionPPL->isChecked() ?
-                                             Lexolights::activeDocument()->getPPLScene() :
-                                             Lexolights::activeDocument()->getOriginalScene(),
+      Lexolights::viewer()->setSceneData( getDocumentScene( Lexolights::activeDocument(),
+                                                            actionPPL->isChecked() ),
                                           resetViewSettings );
    else
       Lexolights::viewer()->setSceneData( NULL, resetViewSettings );
+   setControlledScene( Lexolights::viewer()->getQualityController(),
+                       Lexolights::activeDocument(), actionPPL->isChecked() );
 }
 
 
 void MainWindow::activeDocumentSceneChanged()
 {
-   Lexolights::viewer()->setSceneData( actionPPL->isChecked() ?
-                                          Lexolights::activeDocument()->getPPLScene() :
-                                          Lexolights::activeDocument()->getOriginalScene(),
+   Lexolights::viewer()->setSceneData( getDocumentScene( Lexolights::activeDocument(),
+                                                         actionPPL->isChecked() ),
                                        false );
+   setControlledScene( Lexolights::viewer()->getQualityController(),
+                       Lexolights::activeDocument(), actionPPL->isChecked() );
 }
 
 
@@ -1183,10 +1230,17 @@ void MainWindow::switchToLastGLWidget()
  */
 void MainWindow::setPerPixelLighting( bool on )
 {
-   if( Lexolights::activeDocument() )
-      Lexolights::viewer()->setSceneData( on ? Lexolights::activeDocument()->getPPLScene()
-                                             : Lexolights::activeDocument()->getOriginalScene(),
+   if( Lexolights::activeDocument() ) {
+      Lexolights::viewer()->setSceneData( getDocumentScene( Lexolights::activeDocument(), on ),
                                           false );
+      setControlledScene( Lexolights::viewer()->getQualityController(),
+                          Lexolights::activeDocument(), on );
+
+      // lean memory mode: the original scene is not needed while the converted one is shown
+      // (it is reconstructed from the scene cache when switched back)
+      if( on )
+         Lexolights::activeDocument()->releaseOriginalScene();
+   }
 }
 
 
@@ -1789,3 +1843,12 @@ void MainWindow::setStereoscopicRendering( bool on )
          setActiveCentralWidget( _glStereoWidget );
    }
 }
+
+
+/**
+ * Enables/disables the accumulation of anti-aliased image while the camera is still.
+ */
+void MainWindow::setProgressiveRefinement( bool on )
+{
+   Lexolights::viewer()->getProgressiveRefinement()->setEnabled( on );
+}
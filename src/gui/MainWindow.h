@@ -152,6 +152,7 @@ protected:
    QAction* actionPPL;              // enable/disable per-pixel lighting (in GUI: shadow mode)
    QAction* actionPovrayRendering;  // Povray rendering
    QAction* actionStereo;           // enable/disable stereo (QUAD_BUFFER)
+   QAction* actionProgressiveRefinement; // enable/disable anti-aliasing of still image
 
    // Help actions
    QAction* actionShowLog;          // show log
@@ -184,7 +185,7 @@ public slots:
    void openModel( QString fileName = "" );
    virtual void reloadModel();
    virtual void loadModel( QString fileName, bool resetViewSettings );
-   void activeDocumentSceneChanged();
+   virtual void activeDocumentSceneChanged();
    virtual void defaultView();
    virtual void loadView();
    virtual void saveView();
@@ -196,9 +197,10 @@ public slots:
    virtual void setOrbitManipulator();
    virtual void setFirstPersonManipulator();
    void setAxisVisible( bool visible );
-   void setPerPixelLighting( bool on );
+   virtual void setPerPixelLighting( bool on );
    virtual void renderUsingPovray();
    void setStereoscopicRendering( bool on );
+   virtual void setProgressiveRefinement( bool on );
    void showAboutDlg();
    void showSceneInfo();
    void showSystemInfo();
@@ -14,6 +14,8 @@
 #include "gui/SceneInfoDialog.h"
 #include "ui_SystemInfoDialog.h"
 #include "utils/Log.h"
+#include "utils/SceneStatsVisitor.h"
+#include "utils/SysInfo.h"
 
 using namespace osg;
 using namespace osgUtil;
@@ -127,74 +129,7 @@ static inline void putRow2_tryMerge( QString &info, const QString &descr, int va
 }
 
 
-class MyStatsVisitor : public StatsVisitor
-{
-   typedef StatsVisitor inherited;
-
-public:
-
-   MyStatsVisitor() : _numInstancedLightSources( 0 ), _numInstancedTextures( 0 ),
-                      _numInstancedShaderPrograms( 0 )  {}
-
-   virtual void reset()
-   {
-      inherited::reset();
-
-      _numInstancedLightSources = 0;
-      _numInstancedTextures = 0;
-      _numInstancedShaderPrograms = 0;
-      _lightSourceSet.clear();
-      _textureSet.clear();
-      _shaderProgramSet.clear();
-   }
-
-   virtual void apply( StateSet &ss )
-   {
-      inherited::apply( ss );
-
-      // Textures
-      int c = ss.getNumTextureAttributeLists();
-      for( int i=0; i<c; i++ )
-      {
-         Texture *t = dynamic_cast< Texture* >( ss.getTextureAttribute( i, StateAttribute::TEXTURE ) );
-         if( t )
-         {
-            ++_numInstancedTextures;
-            _textureSet.insert( t );
-         }
-      }
-
-      // shader programs
-      Program *p = dynamic_cast< Program* >( ss.getAttribute( StateAttribute::PROGRAM ) );
-      if( p )
-      {
-         ++_numInstancedShaderPrograms;
-         _shaderProgramSet.insert( p );
-      }
-   }
-
-   virtual void apply( LightSource &node )
-   {
-      if( node.getStateSet() )
-      {
-         apply( *node.getStateSet() );
-      }
-
-      ++_numInstancedLightSources;
-      _lightSourceSet.insert( &node );
-      traverse( node );
-   }
-
-   unsigned int _numInstancedLightSources;
-   unsigned int _numInstancedTextures;
-   unsigned int _numInstancedShaderPrograms;
-   NodeSet _lightSourceSet;
-   std::set< Texture* > _textureSet;
-   std::set< Program* > _shaderProgramSet;
-};
-
-
-static void putSceneGraphInfo( QString &info, MyStatsVisitor &visitor )
+static void putSceneGraphInfo( QString &info, SceneStatsVisitor &visitor )
 {
    putRow2_tryMerge( info, "Triangles (separated)", visitor._instancedStats.getPrimitiveCountMap()[GL_TRIANGLES],      visitor._uniqueStats.getPrimitiveCountMap()[GL_TRIANGLES] );
    putRow2_tryMerge( info, "Triangles in strips",   visitor._instancedStats.getPrimitiveCountMap()[GL_TRIANGLE_STRIP], visitor._uniqueStats.getPrimitiveCountMap()[GL_TRIANGLE_STRIP] );
@@ -223,9 +158,14 @@ static void putSceneGraphInfo( QString &info, MyStatsVisitor &visitor )
 void SceneInfoDialog::refreshInfo()
 {
    // collect stats
-   MyStatsVisitor visitor;
-   if( LexoanimQtApp::activeDocument() )
-      LexoanimQtApp::activeDocument()->getOriginalScene()->accept( visitor );
+   // (in lean memory mode, the released original scene is read from the scene cache
+   // and freed after the stats are collected)
+   SceneStatsVisitor visitor;
+   if( LexoanimQtApp::activeDocument() ) {
+      ref_ptr< Node > originalScene = LexoanimQtApp::activeDocument()->readOriginalScene();
+      if( originalScene.valid() )
+         originalScene->accept( visitor );
+   }
    visitor.totalUpStats();
 
    // start table
@@ -235,9 +175,7 @@ void SceneInfoDialog::refreshInfo()
 
    // summary
    putRow( info, "Vertices", visitor._instancedStats._vertexCount );
-   putRow( info, "Triangles", visitor._instancedStats.getPrimitiveCountMap()[GL_TRIANGLES] +
-                              visitor._instancedStats.getPrimitiveCountMap()[GL_TRIANGLE_STRIP] +
-                              visitor._instancedStats.getPrimitiveCountMap()[GL_TRIANGLE_FAN] );
+   putRow( info, "Triangles", visitor.getNumTriangles() );
    putRow( info, "Lines", visitor._instancedStats.getPrimitiveCountMap()[GL_LINES] +
                           visitor._instancedStats.getPrimitiveCountMap()[GL_LINE_STRIP] );
    putRow( info, "Others", visitor._instancedStats.getPrimitiveCountMap()[GL_POINTS] +
@@ -245,8 +183,14 @@ void SceneInfoDialog::refreshInfo()
                            visitor._instancedStats.getPrimitiveCountMap()[GL_QUAD_STRIP] +
                            visitor._instancedStats.getPrimitiveCountMap()[GL_POLYGON] );
    putRow( info, "Drawables", visitor._numInstancedDrawable );
+   putRow( info, "Draw calls", visitor.getNumDrawCalls() );
+   putRow( info, "Shared drawables", visitor.getNumSharedDrawables() );
+   putRow( info, "Memory saved by sharing", QString( "%1 KiB" ).arg( ( visitor.getMemorySavedBySharing() + 1023 ) / 1024 ) );
    putRow( info, "Textures", visitor._textureSet.size() );
    putRow( info, "Lights", visitor._numInstancedLightSources );
+   putRow( info, "KdTrees", visitor._kdTreeSet.size() );
+   putRow( info, "KdTree memory", QString( "%1 KiB" ).arg( ( visitor._kdTreeMemory + 1023 ) / 1024 ) );
+   putRow( info, "Resident memory", QString( "%1 MiB" ).arg( ( SysInfo::getResidentMemory() + 512*1024 ) / ( 1024*1024 ) ) );
 
    // detailed model info
    putRow( info, "", "" );
@@ -259,7 +203,8 @@ void SceneInfoDialog::refreshInfo()
    putCaption( info, "Rendering Data Details" );
    putRow2( info, "", "Instanced", "   Unique   " );
    visitor.reset();
-   if( LexoanimQtApp::activeDocument() )
+   // (the converted scene does not exist during the staged open or with --no-conversion)
+   if( LexoanimQtApp::activeDocument() && LexoanimQtApp::activeDocument()->getPPLScene() )
       LexoanimQtApp::activeDocument()->getPPLScene()->accept( visitor );
    putSceneGraphInfo( info, visitor );
 
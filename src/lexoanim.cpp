@@ -2,6 +2,7 @@
 
 #include <dtCore/deltawin.h>
 #include <dtCore/transform.h>
+#include <osgViewer/CompositeViewer>
 #include <osgViewer/View>
 #include <osgGA/GUIEventAdapter>
 #include "lighting/ShadowVolume.h"
@@ -34,6 +35,17 @@ void LexoanimApp::Config(){
    if(view)
    {
       view->requestContinuousUpdate(false);
+
+      // lower the rendering quality while the motion models move the camera
+      // (disabled until the frame time budget is set)
+      mQualityController = new AdaptiveQualityController();
+      view->addEventHandler(mQualityController.get());
+
+      // accumulate anti-aliased image while the camera is still (disabled by default)
+      mProgressiveRefinement = new ProgressiveRefinement();
+      mProgressiveRefinement->install(GetCamera()->GetOSGCamera());
+      mProgressiveRefinement->setQualityController(mQualityController.get());
+      view->addEventHandler(mProgressiveRefinement.get());
    }
 
    /*mTerrainObject = new dtCore::Object("Model");
@@ -94,4 +106,13 @@ bool LexoanimApp::KeyPressed(const dtCore::Keyboard * keyboard, int kc)
       break;
    }
    return false;
-}
\ No newline at end of file
+}
+
+void LexoanimApp::PostFrame(const double deltaSimTime)
+{
+   Application::PostFrame(deltaSimTime);
+
+   // per-frame statistics (the frame was already rendered)
+   if(mFrameStatsWriter.valid())
+      mFrameStatsWriter->frameCompleted(GetCompositeViewer()->getFrameStamp()->getFrameNumber());
+}
@@ -7,6 +7,9 @@
 //#include <dtCore/orbitmotionmodel.h>
 #include "cadworkorbitmotionmodel.h"
 #include "cadworkflymotionmodel.h"
+#include "lighting/AdaptiveQualityController.h"
+#include "utils/FrameStatsWriter.h"
+#include "utils/ProgressiveRefinement.h"
 
 
 
@@ -22,14 +25,23 @@ public:
    inline dtCore::CadworkFlyMotionModel *GetFlyMotionModel() { return mCadworkFlyMotionModel.get();}
    inline dtCore::CadworkOrbitMotionModel *GetOrbitMotionModel() { return mCadworkOrbitMotionModel.get();}
 
+   inline AdaptiveQualityController *GetQualityController() { return mQualityController.get();}
+   inline ProgressiveRefinement *GetProgressiveRefinement() { return mProgressiveRefinement.get();}
+   inline FrameStatsWriter *GetFrameStatsWriter() { return mFrameStatsWriter.get();}
+   inline void SetFrameStatsWriter(FrameStatsWriter *writer) { mFrameStatsWriter = writer;}
+
 protected:
    virtual ~LexoanimApp();
    virtual bool KeyPressed(const dtCore::Keyboard * keyboard, int kc);
+   virtual void PostFrame(const double deltaSimTime);
 
 private:
    dtCore::RefPtr<dtCore::MotionModel> mActualMotionModel;
    dtCore::RefPtr<dtCore::CadworkFlyMotionModel> mCadworkFlyMotionModel;
    dtCore::RefPtr<dtCore::CadworkOrbitMotionModel> mCadworkOrbitMotionModel;
+   dtCore::RefPtr<AdaptiveQualityController> mQualityController;
+   dtCore::RefPtr<ProgressiveRefinement> mProgressiveRefinement;
+   dtCore::RefPtr<FrameStatsWriter> mFrameStatsWriter;
 };
 
 #endif
\ No newline at end of file
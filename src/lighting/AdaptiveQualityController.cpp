@@ -0,0 +1,234 @@
+/**
+ * @file
+ * AdaptiveQualityController class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osg/Notify>
+#include <osg/View>
+#include "AdaptiveQualityController.h"
+#include "PerPixelLighting.h"
+#include "ShadowMapManager.h"
+
+using namespace osg;
+using namespace osgGA;
+
+
+// frames given to the frame time to reflect the change of the quality level
+static const int settleFrames = 5;
+
+// frames between the quality level increases after the camera stopped
+static const int restoreFrames = 3;
+
+// longer frame intervals (in milliseconds) are not frames rendered continuously
+// during the motion (e.g. the first frame after a pause of on-demand rendering)
+static const double maxFrameInterval = 1000.;
+
+
+
+/**
+ * Cull callback of the per-pixel-lit scene.
+ *
+ * Based on the quality level, it traverses all the passes of the scene,
+ * only the first passes, or the original scene instead of the per-pixel-lit one.
+ */
+class AdaptiveQualityController::SceneCullCallback : public NodeCallback
+{
+public:
+
+   SceneCullCallback( Node *originalScene ) : originalScene( originalScene ), level( FULL_QUALITY )  {}
+
+   virtual void operator()( Node *node, NodeVisitor *nv )
+   {
+      Level l = level;
+
+      // original scene
+      if( l >= ORIGINAL_SCENE && originalScene.valid() ) {
+         originalScene->accept( *nv );
+         return;
+      }
+
+      // first passes only
+      if( l >= FEW_PASSES && PerPixelLighting::isMultipassRoot( node ) ) {
+         Group *group = node->asGroup();
+         unsigned int n = group->getNumChildren();
+         if( n > numInteractivePasses )
+            n = numInteractivePasses;
+         for( unsigned int i=0; i<n; i++ )
+            group->getChild( i )->accept( *nv );
+         return;
+      }
+
+      traverse( node, nv );
+   }
+
+   ref_ptr< Node > originalScene;
+   volatile Level level;
+};
+
+
+
+AdaptiveQualityController::AdaptiveQualityController()
+   : _frameTimeBudget( 0. ),
+     _level( FULL_QUALITY ),
+     _motionLevel( FULL_QUALITY ),
+     _averageFrameTime( 0. ),
+     _averageFrameTimeValid( false ),
+     _framesSinceChange( 0 ),
+     _stillFrames( 0 ),
+     _moving( false ),
+     _lastTime( -1. )
+{
+}
+
+
+AdaptiveQualityController::~AdaptiveQualityController()
+{
+   setScene( NULL, NULL );
+}
+
+
+/**
+ * Sets the controlled scene.
+ *
+ * pplScene is the displayed per-pixel-lit scene and originalScene
+ * is rendered instead of it at the lowest quality level. NULL pplScene
+ * releases the previous scene, e.g. when the original scene is displayed.
+ */
+void AdaptiveQualityController::setScene( Node *pplScene, Node *originalScene )
+{
+   ref_ptr< Node > prevScene;
+   if( _pplScene.lock( prevScene ) && _cullCallback.valid() )
+      prevScene->removeCullCallback( _cullCallback );
+   _pplScene = NULL;
+   _cullCallback = NULL;
+
+   if( pplScene ) {
+      _pplScene = pplScene;
+      _cullCallback = new SceneCullCallback( originalScene );
+      _cullCallback->level = _level;
+      pplScene->addCullCallback( _cullCallback );
+   }
+}
+
+
+/**
+ * Sets the frame time budget in milliseconds.
+ * Zero or negative value disables the controller and restores full quality.
+ */
+void AdaptiveQualityController::setFrameTimeBudget( double milliseconds )
+{
+   _frameTimeBudget = milliseconds;
+   _motionLevel = FULL_QUALITY;
+   if( _frameTimeBudget <= 0. )
+      setLevel( FULL_QUALITY );
+}
+
+
+const char* AdaptiveQualityController::getLevelName( Level level )
+{
+   switch( level ) {
+      case FULL_QUALITY:          return "full quality";
+      case LOW_SHADOW_RESOLUTION: return "low shadow resolution";
+      case FEW_PASSES:            return "few passes";
+      case ORIGINAL_SCENE:        return "original scene";
+      default:                    return "unknown";
+   }
+}
+
+
+/**
+ * Changes the quality level. The frame time is measured again
+ * for the new level.
+ */
+void AdaptiveQualityController::setLevel( Level level )
+{
+   if( level == _level )
+      return;
+
+   notify( INFO ) << "AdaptiveQualityController: Frame time " << _averageFrameTime << "ms (budget "
+                  << _frameTimeBudget << "ms), quality changed from " << getLevelName( _level )
+                  << " to " << getLevelName( level ) << "." << std::endl;
+
+   _level = level;
+   _framesSinceChange = 0;
+   _averageFrameTimeValid = false;
+
+   ShadowMapManager *smm = ShadowMapManager::instance();
+   smm->setResolutionLimit( level >= LOW_SHADOW_RESOLUTION ? smm->getMinResolution() : 0 );
+   if( _cullCallback.valid() )
+      _cullCallback->level = level;
+}
+
+
+/**
+ * Per-frame processing of the controller.
+ *
+ * The quality level is changed during the event traversal,
+ * before the update and cull traversals of the frame.
+ */
+bool AdaptiveQualityController::handle( const GUIEventAdapter &ea, GUIActionAdapter &aa )
+{
+   if( ea.getEventType() != GUIEventAdapter::FRAME || _frameTimeBudget <= 0. )
+      return false;
+
+   osg::View *view = aa.asView();
+   if( !view || !view->getCamera() )
+      return false;
+
+   // detect the camera motion
+   double time = ea.getTime();
+   Matrixd viewMatrix = view->getCamera()->getViewMatrix();
+   bool moving = _lastTime >= 0. && viewMatrix != _lastViewMatrix;
+
+   if( moving ) {
+
+      // average frame time of the continuously rendered frames
+      double t = ( time - _lastTime ) * 1000.;
+      if( _moving && t < maxFrameInterval ) {
+         if( _averageFrameTimeValid )
+            _averageFrameTime = 0.7 * _averageFrameTime + 0.3 * t;
+         else {
+            _averageFrameTime = t;
+            _averageFrameTimeValid = true;
+         }
+         _framesSinceChange++;
+      }
+      _stillFrames = 0;
+
+      // start the motion with the quality of the previous motion
+      if( !_moving && _level < _motionLevel )
+         setLevel( _motionLevel );
+
+      // lower the quality if the frame time is over the budget
+      // and raise it if the frame time is well below the budget
+      if( _averageFrameTimeValid && _framesSinceChange >= settleFrames ) {
+         if( _averageFrameTime > _frameTimeBudget && _level < ORIGINAL_SCENE )
+            setLevel( Level( _level + 1 ) );
+         else
+            if( _averageFrameTime < 0.5 * _frameTimeBudget && _level > FULL_QUALITY )
+               setLevel( Level( _level - 1 ) );
+         _motionLevel = _level;
+      }
+
+   } else {
+
+      // restore the quality gradually when the camera stopped
+      if( _level > FULL_QUALITY && ++_stillFrames >= restoreFrames ) {
+         setLevel( Level( _level - 1 ) );
+         _stillFrames = 0;
+      }
+
+   }
+
+   _moving = moving;
+   _lastTime = time;
+   _lastViewMatrix = viewMatrix;
+
+   // keep rendering until full quality is restored
+   if( _level != FULL_QUALITY )
+      aa.requestRedraw();
+
+   return false;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file
+ * AdaptiveQualityController class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef ADAPTIVE_QUALITY_CONTROLLER_H
+#define ADAPTIVE_QUALITY_CONTROLLER_H
+
+#include <osg/Matrixd>
+#include <osg/observer_ptr>
+#include <osgGA/GUIEventHandler>
+
+
+
+/**
+ * AdaptiveQualityController lowers the rendering quality while the camera moves
+ * and restores it when the camera stops.
+ *
+ * The camera motion is detected by the change of the view matrix, so it works
+ * with any camera manipulator or motion model. While the camera moves and
+ * the average frame time is over the frame time budget, the quality is lowered
+ * by one level: shadow maps are limited to the minimal resolution of ShadowMapManager,
+ * then only the first passes of the per-pixel-lit scene are rendered and finally
+ * the original (unconverted) scene is rendered instead of the per-pixel-lit one.
+ * When the frame time is well below the budget, the quality is raised by one level.
+ * The level reached during the motion is used from the beginning of the next motion.
+ * When the camera stops, full quality is restored one level per a few frames.
+ *
+ * The controller is installed as event handler of the view
+ * and the controlled scene is given by setScene().
+ */
+class AdaptiveQualityController : public osgGA::GUIEventHandler
+{
+   typedef osgGA::GUIEventHandler inherited;
+
+public:
+
+   enum Level {
+      FULL_QUALITY = 0,
+      LOW_SHADOW_RESOLUTION,
+      FEW_PASSES,
+      ORIGINAL_SCENE
+   };
+
+   AdaptiveQualityController();
+
+   virtual bool handle( const osgGA::GUIEventAdapter &ea, osgGA::GUIActionAdapter &aa );
+
+   void setScene( osg::Node *pplScene, osg::Node *originalScene );
+   void setFrameTimeBudget( double milliseconds );
+   inline double getFrameTimeBudget() const;
+   inline Level getLevel() const;
+
+   static const char* getLevelName( Level level );
+
+   static const unsigned int numInteractivePasses = 2;
+
+protected:
+
+   virtual ~AdaptiveQualityController();
+
+   void setLevel( Level level );
+
+   class SceneCullCallback;
+
+   osg::observer_ptr< osg::Node > _pplScene;
+   osg::ref_ptr< SceneCullCallback > _cullCallback;
+   double _frameTimeBudget;
+   Level _level;
+   Level _motionLevel;
+   double _averageFrameTime;
+   bool _averageFrameTimeValid;
+   int _framesSinceChange;
+   int _stillFrames;
+   bool _moving;
+   double _lastTime;
+   osg::Matrixd _lastViewMatrix;
+
+};
+
+
+//
+//  inline methods
+//
+
+inline double AdaptiveQualityController::getFrameTimeBudget() const  { return _frameTimeBudget; }
+inline AdaptiveQualityController::Level AdaptiveQualityController::getLevel() const  { return _level; }
+
+
+#endif /* ADAPTIVE_QUALITY_CONTROLLER_H */
@@ -9,22 +9,34 @@
 #include <osg/BlendFunc>
 #include <osg/Depth>
 #include <osg/Geode>
+#include <osg/Geometry>
 #include <osg/LightSource>
+#include <osg/LOD>
 #include <osg/Notify>
+#include <osg/OcclusionQueryNode>
 #include <osg/Program>
 #include <osg/StateSet>
+#include <osg/Switch>
 #include <osg/TexEnv>
 #include <osg/Timer>
+#include <osg/Transform>
 #include <osg/ValueObject>
 #include <osgDB/WriteFile> // for debugging purposes
 #include <osgShadow/LightSpacePerspectiveShadowMap>
 #include <osgShadow/ShadowMap>
+#include <osgUtil/CullVisitor>
 #include <sstream>
 #include <cassert>
+#include <cstring>
 #include "PerPixelLighting.h"
 #include "ShadowVolume.h"
+#include "ShadowMapManager.h"
 #include "PhotorealismData.h"
+#include "utils/FrameCounters.h"
+#include "utils/GeometryDeduplicator.h"
 #include "utils/Log.h"
+#include "utils/OcclusionQueryInserter.h"
+#include "utils/SceneHashVisitor.h"
 
 using namespace std;
 using namespace osg;
@@ -66,14 +78,15 @@ PerPixelLighting::~PerPixelLighting()
  */
 PerPixelLighting::ConvertVisitor::ConvertVisitor()
       : NodeVisitor( NodeVisitor::TRAVERSE_ALL_CHILDREN ),
-        shadowTechnique( NO_SHADOWS )
+        shadowTechnique( NO_SHADOWS ),
+        passKey( 0 )
 {
    // there must be always state set in the state stack
    stateStack.push_back( new StateSet() );
 
-   // default light index is 0 and shadowMapTexUnit 1
-   mpData.lightBaseIndex = 0;
+   // default shadowMapTexUnit is 1
    mpData.shadowMapTexUnit = 1;
+   mpData.activeLightShared = false;
 }
 
 
@@ -87,6 +100,129 @@ PerPixelLighting::ConvertVisitor::~ConvertVisitor()
 }
 
 
+// name of the root of the multipass scene
+static const char *multipassRootName = "PerPixelLighting multipass root";
+
+
+// counts the culled passes (see FrameCounters)
+class PassCounterCallback : public NodeCallback
+{
+public:
+   virtual void operator()( Node *node, NodeVisitor *nv )
+   {
+      if( FrameCounters::isActive() && nv->getFrameStamp() )
+         FrameCounters::add( nv->getFrameStamp()->getFrameNumber(), FrameCounters::PPL_PASSES );
+      traverse( node, nv );
+   }
+};
+
+
+// culls the subgraph of the occlusion query node by the query result
+// of the given query node and counts the occluded nodes (see FrameCounters)
+class OcclusionCullCallback : public NodeCallback
+{
+public:
+   OcclusionCullCallback( OcclusionQueryNode *queryNode ) : queryNode( queryNode )  {}
+
+   virtual void operator()( Node *node, NodeVisitor *nv )
+   {
+      // render-to-texture cameras (shadow maps) are not handled
+      // as the query nodes of the per-light passes do not issue their queries
+      osgUtil::CullVisitor *cv = dynamic_cast< osgUtil::CullVisitor* >( nv );
+      Camera *camera = cv ? cv->getCurrentCamera() : NULL;
+      ref_ptr< OcclusionQueryNode > qn;
+      if( camera && !camera->isRenderToTextureCamera() && queryNode.lock( qn ) &&
+          qn->getQueriesEnabled() && !qn->getPassed( camera, *nv ) )
+      {
+         if( FrameCounters::isActive() && nv->getFrameStamp() )
+            FrameCounters::add( nv->getFrameStamp()->getFrameNumber(), FrameCounters::OCCLUDED_NODES );
+
+         // the query node culls its subgraph itself
+         if( qn.get() != node )
+            return;
+      }
+      traverse( node, nv );
+   }
+
+   observer_ptr< OcclusionQueryNode > queryNode;
+};
+
+
+// collects the query nodes inserted by OcclusionQueryInserter
+class CollectQueryNodesVisitor : public NodeVisitor
+{
+public:
+   CollectQueryNodesVisitor() : NodeVisitor( NodeVisitor::TRAVERSE_ALL_CHILDREN )  {}
+
+   virtual void apply( Group &group )
+   {
+      OcclusionQueryNode *qn = dynamic_cast< OcclusionQueryNode* >( &group );
+      if( qn && OcclusionQueryInserter::isQueryNodeName( qn->getName() ) )
+         queryNodes.push_back( qn );
+      traverse( group );
+   }
+
+   std::vector< OcclusionQueryNode* > queryNodes;
+};
+
+
+static void setOcclusionCullCallback( OcclusionQueryNode *node, OcclusionQueryNode *queryNode )
+{
+   // the node may be reused from the previous conversion (see ConversionCache)
+   OcclusionCullCallback *cb = dynamic_cast< OcclusionCullCallback* >( node->getCullCallback() );
+   if( cb )
+      cb->queryNode = queryNode;
+   else
+      node->addCullCallback( new OcclusionCullCallback( queryNode ) );
+}
+
+
+// Query nodes cloned into each pass would issue their own queries,
+// although the visibility is the same in all the passes. The query nodes
+// of the first pass (ambient pass or the first light pass) keep their queries
+// while their clones in the following passes are culled by their results.
+// The clones are matched by the unique names given by OcclusionQueryInserter.
+static void shareOcclusionQueries( Group *multipassRoot, Node *originalScene )
+{
+   if( multipassRoot->getNumChildren() == 0 )
+      return;
+
+   // query nodes of the first pass
+   CollectQueryNodesVisitor first;
+   multipassRoot->getChild( 0 )->accept( first );
+   if( first.queryNodes.empty() )
+      return;
+   std::map< std::string, OcclusionQueryNode* > leaders;
+   for( unsigned int i=0; i<first.queryNodes.size(); i++ ) {
+      OcclusionQueryNode *qn = first.queryNodes[i];
+      leaders[ qn->getName() ] = qn;
+      setOcclusionCullCallback( qn, qn );
+   }
+
+   // query nodes of the original scene
+   // (they are shared by the passes when not cloned and their queries must stay enabled)
+   CollectQueryNodesVisitor original;
+   originalScene->accept( original );
+   std::set< OcclusionQueryNode* > originalNodes( original.queryNodes.begin(), original.queryNodes.end() );
+
+   // query nodes of the following passes
+   for( unsigned int i=1, c=multipassRoot->getNumChildren(); i<c; i++ ) {
+      CollectQueryNodesVisitor pass;
+      multipassRoot->getChild( i )->accept( pass );
+      for( unsigned int j=0; j<pass.queryNodes.size(); j++ ) {
+         OcclusionQueryNode *qn = pass.queryNodes[j];
+         std::map< std::string, OcclusionQueryNode* >::iterator it = leaders.find( qn->getName() );
+         if( it == leaders.end() || it->second == qn || originalNodes.count( qn ) ) {
+            setOcclusionCullCallback( qn, qn );
+            continue;
+         }
+         qn->setQueriesEnabled( false );
+         setOcclusionCullCallback( qn, it->second );
+      }
+   }
+}
+
+
 static Node* createPassData( int passNum, Node *scene )
 {
    // make sure the root is without state set
@@ -116,6 +252,9 @@ static Node* createPassData( int passNum, Node *scene )
    // append the state set
    scene->setStateSet( ss );
 
+   // per-frame pass counting
+   scene->addCullCallback( new PassCounterCallback );
+
    // return (possibly new) scene
    return scene;
 }
@@ -161,9 +300,17 @@ void PerPixelLighting::convert( Node *scene, ShadowTechnique shadowTechnique )
    // use multipass
    convertVisitor->setMultipass( true );
 
+   // incremental conversion
+   if( conversionCache.valid() ) {
+      conversionCache->beginConversion();
+      convertVisitor->setConversionCache( conversionCache );
+   }
+
    // collect all lights in the scene
    ref_ptr< CollectLightVisitor > clv = this->createCollectLightVisitor();
    scene->accept( *clv );
+   if( checkCanceled() )
+      return;
 
    // pass number and number of lights
    int passNum = 1;
@@ -193,6 +340,7 @@ void PerPixelLighting::convert( Node *scene, ShadowTechnique shadowTechnique )
 
       // create converted scene root
       Group *multipassRoot = new Group;
+      multipassRoot->setName( multipassRootName );
       multipassRoot->getOrCreateStateSet()->setBinNumber( 0 );
       newScene = multipassRoot;
 
@@ -215,16 +363,22 @@ void PerPixelLighting::convert( Node *scene, ShadowTechnique shadowTechnique )
             it != lightIt->second.end();
             it++, passNum++, numLights++ ) {
 
+            // abandon the conversion if canceled
+            if( checkCanceled() )
+               return;
+
             // select the light for multi-pass
             ConvertVisitor::MultipassData &mp = convertVisitor->getMultipassData();
             mp.activeLightSourcePath = it->get();
             LightSource *ls = dynamic_cast< LightSource* >( (*it)->back() );
             assert( ls->getLight() && "No light!" );
             mp.activeLight = ls->getLight();
+            mp.activeLightShared = lightIt->second.size() > 1;
 
             // setup multipass struct
             mp.globalAmbient = ambientScene.valid() ? false : passNum == 1;
             mp.newLight = NULL;
+            mp.newLightUniforms = NULL;
 
             // convert the scene
             scene->accept( *convertVisitor );
@@ -236,13 +390,17 @@ void PerPixelLighting::convert( Node *scene, ShadowTechnique shadowTechnique )
             if( !renderPassRoot ) {
                passNum--;
                numLights--;
+               mp.newLightUniforms = NULL;
                continue;
             }
 
             if( shadowTechnique != NO_SHADOWS && mp.newLight ) {
 
                // setup shadows
+               // (shadow map resolution is controlled by ShadowMapManager
+               // that starts with its maximum resolution)
                osgShadow::ShadowedScene *shadowedScene = new osgShadow::ShadowedScene();
+               int shadowMapSize = ShadowMapManager::instance()->getMaxResolution();
                switch( shadowTechnique ) {
 
                   case SHADOW_VOLUMES: {
@@ -265,11 +423,13 @@ void PerPixelLighting::convert( Node *scene, ShadowTechnique shadowTechnique )
                   case SHADOW_MAPS: {
 
                      // setup ShadowMap
-                     osgShadow::ShadowMap *sm = new osgShadow::ShadowMap();
+                     // (ManagedShadowMap skips the rendering of unchanged shadow maps)
+                     ManagedShadowMap *sm = new ManagedShadowMap();
                      sm->setLight( mp.newLight );
                      sm->setTextureUnit( mp.shadowMapTexUnit );
-                     sm->setTextureSize( Vec2s( 2048, 2048 ) );
+                     sm->setTextureSize( Vec2s( shadowMapSize, shadowMapSize ) );
                      shadowedScene->setShadowTechnique( sm );
+                     ShadowMapManager::instance()->manage( shadowedScene );
                      break;
                   }
 
@@ -294,7 +454,7 @@ void PerPixelLighting::convert( Node *scene, ShadowTechnique shadowTechnique )
                      sm->setBaseTextureCoordIndex( 0 );
                      sm->setShadowTextureUnit( mp.shadowMapTexUnit );
                      sm->setShadowTextureCoordIndex( mp.shadowMapTexUnit );
-                     sm->setTextureSize( Vec2s( 2048, 2048 ) );
+                     sm->setTextureSize( Vec2s( shadowMapSize, shadowMapSize ) );
                      if( mp.newLightCubeShadowMap ) {
                         //sm->setCubeMap( true );
                         //sm->setDebugDraw( true );
@@ -305,6 +465,7 @@ void PerPixelLighting::convert( Node *scene, ShadowTechnique shadowTechnique )
                         //msm->setMaxFarPlane( 10.f );
                      }
                      shadowedScene->setShadowTechnique( sm );
+                     ShadowMapManager::instance()->manage( shadowedScene );
                      break;
                   }
 
@@ -319,41 +480,88 @@ void PerPixelLighting::convert( Node *scene, ShadowTechnique shadowTechnique )
             // create pass data (blending, renderBinDetails, depth test,...)
             renderPassRoot = createPassData( passNum, renderPassRoot );
 
+            // light parameters are given to the shaders through uniforms
+            // shared by the whole pass
+            if( mp.newLightUniforms ) {
+               mp.newLightUniforms->addTo( renderPassRoot->getStateSet() );
+               mp.newLightUniforms = NULL;
+            }
+
             // append the pass to the scene
             multipassRoot->addChild( renderPassRoot );
 
-   #if 1 // this is temporary workaround for light index
-         // until a solution is developed for handling the same indices in PositionalStateContainer.
-         // Limitations: only 8 lights supported.
-         // PCJohn-2010-04-12
-            mp.lightBaseIndex++;
+            // Shaders do not read OpenGL light state any more, so light indices
+            // may be the same in all the passes. TexGens of shadow maps still
+            // share PositionalStateContainer, so they use different texture units.
             mp.shadowMapTexUnit++;
-   #endif
          }
 
       }
+
+      // share occlusion queries among the passes
+      shareOcclusionQueries( multipassRoot, scene );
    }
 
 #if 0 // debug: write converted scene to file
    osgDB::writeNodeFile( *newScene.get(), "PerPixelLighting.osg" );
 #endif
 
+   // report conversion cache usage
+   if( conversionCache.valid() ) {
+      Log::info() << QString( "PerPixelLighting: Conversion cache reused %1 converted subgraphs "
+                              "(%2 subgraphs converted)." )
+                              .arg( conversionCache->getNumHits() )
+                              .arg( conversionCache->getNumMisses() ) << Log::endm;
+   }
+
    Log::notice() << QString( "PerPixelLighting: Converted %1 lights. Operation completed "
                              "in %2ms.").arg( numLights ).arg( time.time_m(), 0, 'f', 2 ) << Log::endm;
 }
 
 
+bool PerPixelLighting::isMultipassRoot( const Node *node )
+{
+   return node && node->getName() == multipassRootName && node->asGroup();
+}
+
+
+/**
+ * Returns true if the conversion was canceled through the cancellation token.
+ * The converted scene is released in that case, so getScene() returns NULL.
+ *
+ * The conversion is checked between the passes only, as the traversal
+ * of ConvertVisitor can not be interrupted without storing incomplete
+ * results in the conversion cache.
+ */
+bool PerPixelLighting::checkCanceled()
+{
+   if( !cancellationToken.valid() || !cancellationToken->isCanceled() )
+      return false;
+
+   newScene = NULL;
+   Log::info() << "PerPixelLighting: Conversion canceled." << Log::endm;
+   return true;
+}
+
+
 /**
  * Processes a node in the scene graph.
  */
 void PerPixelLighting::ConvertVisitor::apply( Node &node )
 {
+   // reuse previous conversion result, if available
+   if( cacheEnter( node ) )
+      return;
+
    // process node's state set
    processState( node.getStateSet() );
 
    // traverse children
    traverse( node );
 
+   // store conversion result
+   cacheLeave( node );
+
    // unprocess node's state set
    unprocessState();
 }
@@ -365,6 +573,10 @@ void PerPixelLighting::ConvertVisitor::apply( Node &node )
  */
 void PerPixelLighting::ConvertVisitor::apply( Geode &geode )
 {
+   // reuse previous conversion result, if available
+   if( cacheEnter( geode ) )
+      return;
+
    // process geode's state set
    Geode *newGeode = dynamic_cast< Geode* >( processState( geode.getStateSet() ) );
 
@@ -470,6 +682,9 @@ void PerPixelLighting::ConvertVisitor::apply( Geode &geode )
          Node *oldNode = getNodePath()[i];
          Node *newNode = clonePathUpToIndex( i );
 
+         // conversion result of the nodes bellow i depends on the change of node i
+         markUncacheableBelow( i );
+
          // clone state set, if not cloned already
          StateSet *oldS = oldNode->getStateSet();
          newS = newNode->getOrCreateStateSet();
@@ -498,10 +713,12 @@ void PerPixelLighting::ConvertVisitor::apply( Geode &geode )
          // with one exception when renderig transparent drawables;
          // transparent drawables are rendered with all lights off (no lighting now
          // until more sophisticated algorithms for transparent drawables are developed)
+         // note: the light is always GL_LIGHT0 as its parameters
+         // are given to the shader by ppl_LightSource uniforms
          if( mpData.activeLight.get() != NULL &&
              cumulatedStateSet->getRenderingHint() != StateSet::TRANSPARENT_BIN )
          {
-            ss->setMode( GL_LIGHT0 + mpData.lightBaseIndex, StateAttribute::ON );
+            ss->setMode( GL_LIGHT0, StateAttribute::ON );
          }
       }
 
@@ -537,6 +754,9 @@ void PerPixelLighting::ConvertVisitor::apply( Geode &geode )
    // traverse node
    traverse( geode );
 
+   // store conversion result
+   cacheLeave( geode );
+
    // unprocess geode
    unprocessState();
 }
@@ -594,8 +814,114 @@ void PerPixelLighting::ConvertVisitor::purgeEmptyNodes( Group &parent )
 }
 
 
+/**
+ * Looks up the conversion result of the node in the conversion cache.
+ * If found, the result is spliced into the converted scene
+ * and true is returned, meaning that the node should not be traversed.
+ *
+ * The method maintains the hash of the state inherited along the visitor's
+ * path, so it has to be paired with cacheLeave() unless it returned true.
+ */
+bool PerPixelLighting::ConvertVisitor::cacheEnter( Node &node )
+{
+   if( !conversionCache )
+      return false;
+
+   // pass key is computed on the root of the scene
+   // (the active light is identified by its parameters and its position
+   // in the scene, so the results are not reused for another light
+   // when the lights are reordered or edited)
+   int depth = int( getNodePath().size() ) - 1;
+   if( depth == 0 ) {
+      ContentHash h;
+      h.add( mpData.globalAmbient );
+      h.add( mpData.activeLight.valid() );
+      h.add( mpData.shadowMapTexUnit );
+      h.add( shadowTechnique );
+      if( mpData.activeLight.valid() ) {
+         h.add( conversionCache->getObjectHash( mpData.activeLight.get() ) );
+         h.add( mpData.activeLightShared );
+         const LightSource *ls = dynamic_cast< const LightSource* >( mpData.activeLightSourcePath->back() );
+         h.add( ls ? ls->getReferenceFrame() : LightSource::RELATIVE_RF );
+         h.add( computeLocalToWorld( *mpData.activeLightSourcePath ) );
+      }
+      passKey = h.get();
+      pathStateStack.clear();
+   }
+
+   // state inherited from parents
+   ContentHash::Value parentState = pathStateStack.empty() ? 0 : pathStateStack.back();
+   pathStateStack.push_back( ContentHash::combine( parentState,
+                             conversionCache->getStateSetHash( node.getStateSet() ) ) );
+
+   // the root and subgraphs with lights are never cached
+   // (unchanged subgraphs are cached under their previous versions)
+   const Node *source = conversionCache->getSource( &node );
+   cacheableStack.resize( depth+1 );
+   cacheableStack[depth] = depth > 0 && conversionCache->isCacheable( source );
+   if( !cacheableStack[depth] )
+      return false;
+
+   // look up the previous result
+   Node *result;
+   if( !conversionCache->find( ConversionCache::Key( source, parentState, passKey ), result ) )
+      return false;
+
+   // splice the result into the converted scene
+   // (the result belongs to the displayed scene, so it is spliced by ConversionCache::commit();
+   // NULL result means that the subgraph was not modified by the conversion)
+   if( result ) {
+      Group *clonedParent = dynamic_cast< Group* >( cloneCurrentPathUpToParent() );
+      assert( clonedParent && "cloneCurrentPathUpToParent did not returned Group." );
+      conversionCache->splice( clonedParent, &node, result );
+   }
+
+   pathStateStack.pop_back();
+   return true;
+}
+
+
+/**
+ * Stores the conversion result of the node in the conversion cache.
+ * It is expected to be called before unprocessState(), when
+ * the clone of the node (if any) is on the top of cloneStack.
+ */
+void PerPixelLighting::ConvertVisitor::cacheLeave( Node &node )
+{
+   if( !conversionCache )
+      return;
+
+   pathStateStack.pop_back();
+
+   int depth = int( getNodePath().size() ) - 1;
+   if( cacheableStack[depth] ) {
+      ContentHash::Value parentState = pathStateStack.empty() ? 0 : pathStateStack.back();
+      Node *source = conversionCache->getSource( &node );
+      conversionCache->insert( ConversionCache::Key( source, parentState, passKey ),
+                               source, cloneStack.back() );
+   }
+}
+
+
+/**
+ * Marks the nodes on the visitor's path bellow pathIndex as not cacheable.
+ * This is required when the conversion of a node modifies a node above it
+ * (for example, when a shader is inserted to a parent's StateSet) as
+ * the conversion result of the node would not be complete.
+ */
+void PerPixelLighting::ConvertVisitor::markUncacheableBelow( int pathIndex )
+{
+   for( int i=pathIndex+1; i<int( cacheableStack.size() ); i++ )
+      cacheableStack[i] = false;
+}
+
+
 void PerPixelLighting::ConvertVisitor::apply( Group &group )
 {
+   // reuse previous conversion result, if available
+   if( cacheEnter( group ) )
+      return;
+
    // process group's state set
    processState( group.getStateSet() );
 
@@ -605,6 +931,9 @@ void PerPixelLighting::ConvertVisitor::apply( Group &group )
    // remove empty groups and geodes in the subgraph
    purgeEmptyNodes( group );
 
+   // store conversion result
+   cacheLeave( group );
+
    // unprocess group's state set
    unprocessState();
 }
@@ -642,8 +971,168 @@ static string getUserData( const string &domain, const string &name,
 }
 
 
+/**
+ * Constructor.
+ *
+ * light is the light whose parameters are given to the shaders.
+ * shadowLight, if not NULL, is the clone of the light used by the shadow technique
+ * of the pass. It is kept in sync with the light on each update.
+ * beamWidthAngle (in radians) is the inner cone angle of DirectX style spotlight.
+ * Negative value means that it is derived from the spot cutoff.
+ * spotExponent overrides the spot exponent of the light, unless it is negative.
+ */
+PerPixelLighting::LightUniforms::LightUniforms( Light *light, Light *shadowLight,
+                                                double beamWidthAngle, double spotExponent )
+   : _light( light ),
+     _shadowLight( shadowLight ),
+     _beamWidthAngle( beamWidthAngle ),
+     _spotExponent( spotExponent )
+{
+   _ambient = new Uniform( Uniform::FLOAT_VEC4, "ppl_LightSource.ambient" );
+   _diffuse = new Uniform( Uniform::FLOAT_VEC4, "ppl_LightSource.diffuse" );
+   _specular = new Uniform( Uniform::FLOAT_VEC4, "ppl_LightSource.specular" );
+   _position = new Uniform( Uniform::FLOAT_VEC4, "ppl_LightSource.position" );
+   _spotDirection = new Uniform( Uniform::FLOAT_VEC3, "ppl_LightSource.spotDirection" );
+   _spotExponentUniform = new Uniform( Uniform::FLOAT, "ppl_LightSource.spotExponent" );
+   _spotCosOuterAngle = new Uniform( Uniform::FLOAT, "ppl_LightSource.spotCosOuterAngle" );
+   _spotCosInnerAngle = new Uniform( Uniform::FLOAT, "ppl_LightSource.spotCosInnerAngle" );
+   _constantAttenuation = new Uniform( Uniform::FLOAT, "ppl_LightSource.constantAttenuation" );
+   _linearAttenuation = new Uniform( Uniform::FLOAT, "ppl_LightSource.linearAttenuation" );
+   _quadraticAttenuation = new Uniform( Uniform::FLOAT, "ppl_LightSource.quadraticAttenuation" );
+   _eyeSpace = new Uniform( Uniform::BOOL, "ppl_LightSource.eyeSpace" );
+
+   // uniforms are updated each frame, possibly while the previous frame is drawn
+   Uniform *uniforms[] = { _ambient, _diffuse, _specular, _position, _spotDirection,
+         _spotExponentUniform, _spotCosOuterAngle, _spotCosInnerAngle,
+         _constantAttenuation, _linearAttenuation, _quadraticAttenuation, _eyeSpace };
+   for( unsigned int i=0; i<sizeof(uniforms)/sizeof(Uniform*); i++ )
+      uniforms[i]->setDataVariance( Object::DYNAMIC );
+}
+
+
+PerPixelLighting::LightUniforms::LightUniforms( const LightUniforms &other, const CopyOp &copyop )
+   : NodeCallback( other, copyop ),
+     _light( other._light ),
+     _shadowLight( other._shadowLight ),
+     _beamWidthAngle( other._beamWidthAngle ),
+     _spotExponent( other._spotExponent ),
+     _ambient( other._ambient ),
+     _diffuse( other._diffuse ),
+     _specular( other._specular ),
+     _position( other._position ),
+     _spotDirection( other._spotDirection ),
+     _spotExponentUniform( other._spotExponentUniform ),
+     _spotCosOuterAngle( other._spotCosOuterAngle ),
+     _spotCosInnerAngle( other._spotCosInnerAngle ),
+     _constantAttenuation( other._constantAttenuation ),
+     _linearAttenuation( other._linearAttenuation ),
+     _quadraticAttenuation( other._quadraticAttenuation ),
+     _eyeSpace( other._eyeSpace )
+{
+}
+
+
+/**
+ * Appends all the light uniforms to the StateSet.
+ * Usually, the StateSet is the root StateSet of the render pass.
+ */
+void PerPixelLighting::LightUniforms::addTo( StateSet *ss ) const
+{
+   ss->addUniform( _ambient );
+   ss->addUniform( _diffuse );
+   ss->addUniform( _specular );
+   ss->addUniform( _position );
+   ss->addUniform( _spotDirection );
+   ss->addUniform( _spotExponentUniform );
+   ss->addUniform( _spotCosOuterAngle );
+   ss->addUniform( _spotCosInnerAngle );
+   ss->addUniform( _constantAttenuation );
+   ss->addUniform( _linearAttenuation );
+   ss->addUniform( _quadraticAttenuation );
+   ss->addUniform( _eyeSpace );
+}
+
+
+/**
+ * Updates uniforms from the current light parameters.
+ * localToWorld is the matrix of the LightSource. Position and direction
+ * are given to the shader in world coordinates, or in eye coordinates
+ * when eyeSpace is true (LightSource with ABSOLUTE_RF reference frame).
+ */
+void PerPixelLighting::LightUniforms::update( const Matrix &localToWorld, bool eyeSpace )
+{
+   const Light *l = _light.get();
+
+   // keep shadow light in sync
+   if( _shadowLight.valid() ) {
+      _shadowLight->setAmbient( l->getAmbient() );
+      _shadowLight->setDiffuse( l->getDiffuse() );
+      _shadowLight->setSpecular( l->getSpecular() );
+      _shadowLight->setPosition( l->getPosition() );
+      _shadowLight->setDirection( l->getDirection() );
+      _shadowLight->setSpotExponent( l->getSpotExponent() );
+      _shadowLight->setSpotCutoff( l->getSpotCutoff() );
+      _shadowLight->setConstantAttenuation( l->getConstantAttenuation() );
+      _shadowLight->setLinearAttenuation( l->getLinearAttenuation() );
+      _shadowLight->setQuadraticAttenuation( l->getQuadraticAttenuation() );
+   }
+
+   // colors
+   _ambient->set( l->getAmbient() );
+   _diffuse->set( l->getDiffuse() );
+   _specular->set( l->getSpecular() );
+
+   // position and direction
+   if( eyeSpace ) {
+      _position->set( l->getPosition() );
+      _spotDirection->set( l->getDirection() );
+   } else {
+      _position->set( l->getPosition() * localToWorld );
+      Vec3 dir = Matrix::transform3x3( l->getDirection(), localToWorld );
+      dir.normalize();
+      _spotDirection->set( dir );
+   }
+   _eyeSpace->set( eyeSpace );
+
+   // spotlight
+   // (outer cone is given by spot cutoff, inner cone by beamWidthAngle)
+   float cutoff = l->getSpotCutoff();
+   _spotCosOuterAngle->set( cutoff >= 180.f ? -1.f : float( cos( cutoff / 180. * PI ) ) );
+   double beamWidthAngleCos;
+   if( _beamWidthAngle < 0. )
+      //beamWidthAngleCos = ( 1. + cos( cutoff / 180. * PI ) ) / 2.;
+      beamWidthAngleCos = cos( cutoff / 180. * PI / 2. );
+   else
+      beamWidthAngleCos = cos( _beamWidthAngle );
+   _spotCosInnerAngle->set( float( beamWidthAngleCos ) );
+   _spotExponentUniform->set( float( _spotExponent < 0. ? l->getSpotExponent() : _spotExponent ) );
+
+   // attenuation
+   _constantAttenuation->set( l->getConstantAttenuation() );
+   _linearAttenuation->set( l->getLinearAttenuation() );
+   _quadraticAttenuation->set( l->getQuadraticAttenuation() );
+}
+
+
+/**
+ * Update traversal callback of the LightSource.
+ */
+void PerPixelLighting::LightUniforms::operator()( Node *node, NodeVisitor *nv )
+{
+   LightSource *ls = static_cast< LightSource* >( node );
+   if( _light.valid() )
+      update( computeLocalToWorld( nv->getNodePath() ),
+              ls->getReferenceFrame() == LightSource::ABSOLUTE_RF );
+
+   traverse( node, nv );
+}
+
+
 void PerPixelLighting::ConvertVisitor::apply( LightSource &lightSource )
 {
+   // LightSources are never cached, but path state is maintained
+   cacheEnter( lightSource );
+
    // process node's state set
    ref_ptr< LightSource > newLightSource =
          dynamic_cast< LightSource*>( processState( lightSource.getStateSet() ) );
@@ -662,46 +1151,44 @@ void PerPixelLighting::ConvertVisitor::apply( LightSource &lightSource )
          string beamWidthString = ::getUserData( "Photorealism", "LightSource.beamWidthAngle", latestLS->getLight(), latestLS->getStateSet(), latestLS );
          string concentrationExponentString = ::getUserData( "Photorealism", "LightSource.concentrationExponent", latestLS->getLight(), latestLS->getStateSet(), latestLS );
 
-         // clone if required
-         // (there are two reasons for cloning: setting of beamWidthAngle and
-         //  when latestLS->getLight()->getLightNum() != mpData.lightBaseIndex.
-         //  When cloning did not happen (in old code), we used to set mpData.newLight = latestLS->getLight().)
-
          // clone LightSource
+         // (the clone receives the update callback that feeds the light uniforms)
          LightSource *ls = dynamic_cast< LightSource* >( cloneCurrentPath() );
+         Light *light = ls->getLight();
+
+         // Shadow techniques find their light in PositionalStateContainer
+         // by the pointer, so the light that is used by more LightSources
+         // has to be cloned for each pass. The clone is kept in sync
+         // with the original light by LightUniforms.
+         Light *shadowLight = NULL;
+         if( mpData.activeLightShared ) {
+            shadowLight = dynamic_cast< Light* > ( light->clone( CopyOp::SHALLOW_COPY ) );
+            ls->setLight( shadowLight );
+         }
+         mpData.newLight = shadowLight ? shadowLight : light;
 
-         // clone Light
-         mpData.newLight = dynamic_cast< Light* > ( ls->getLight()->clone( CopyOp::SHALLOW_COPY ) );
-         ls->setLight( mpData.newLight );
-
-         // set light num
-         mpData.newLight->setLightNum( mpData.lightBaseIndex );
-
-         // compute beamWidthAngle if not set
+         // beamWidthAngle, if not set, is computed by LightUniforms from spot cutoff
          // (do not use -1. as it would activate OpenGL-style spotlight and
          // we prefer DirectX style spotlight)
-         double beamWidthAngleCos;
-         if( beamWidthString.empty() )
-            //beamWidthAngleCos = ( 1. + cos( mpData.newLight->getSpotCutoff() / 180. * PI ) ) / 2.;
-            beamWidthAngleCos = cos( mpData.newLight->getSpotCutoff() / 180. * PI / 2. );
+         double beamWidthAngle = -1.;
+         if( !beamWidthString.empty() )
+            beamWidthAngle = atof( beamWidthString.c_str() );
+
+         // concentrationExponent
+         // (set exponent to 1. if using DirectX spotlight and
+         // concentrationExponent/beamWidthString was not given)
+         double spotExponent = -1.;
+         if( !concentrationExponentString.empty() )
+            spotExponent = atof( concentrationExponentString.c_str() );
          else
-            beamWidthAngleCos = cos( atof( beamWidthString.c_str() ) );
-
-         // set beamWidthAngle (use specular alpha as a hack because
-         // there is no beamWidthAngle variable in light structure
-         Vec4 specular = mpData.newLight->getSpecular();
-         specular.w() = beamWidthAngleCos;
-         mpData.newLight->setSpecular( specular );
-
-         // set concentrationExponent
-         if( concentrationExponentString.empty() )
-         {
-            // set exponent to 1. if using DirectX spotlight and concentrationExponent/beamWidthString was not given
             if( beamWidthString.empty() )
-               mpData.newLight->setSpotExponent( 1. );
-         }
-         else
-            mpData.newLight->setSpotExponent( atof( concentrationExponentString.c_str() ) );
+               spotExponent = 1.;
+
+         // create light uniforms
+         mpData.newLightUniforms = new LightUniforms( light, shadowLight, beamWidthAngle, spotExponent );
+         mpData.newLightUniforms->update( computeLocalToWorld( getNodePath() ),
+                                          ls->getReferenceFrame() == LightSource::ABSOLUTE_RF );
+         ls->addUpdateCallback( mpData.newLightUniforms );
 
       } else {
 
@@ -725,6 +1212,9 @@ void PerPixelLighting::ConvertVisitor::apply( LightSource &lightSource )
    // remove empty groups and geodes in the subgraph
    purgeEmptyNodes( lightSource );
 
+   // maintain path state
+   cacheLeave( lightSource );
+
    // unprocess node's state set
    unprocessState();
 }
@@ -1244,6 +1734,47 @@ static void createFragmentShaderHeader( stringstream &fs,
 }
 
 
+/**
+ * The function appends declaration of the uniforms holding
+ * the light parameters (see PerPixelLighting::LightUniforms).
+ * The uniforms replace gl_LightSource in the generated code.
+ * Light i is given by ppl_LightSource uniform for the first light and
+ * by ppl_LightSource<i> for the others. osg_ViewMatrix (maintained
+ * by osgUtil::SceneView) is used to transform light position
+ * and direction from world coordinates to eye coordinates.
+ */
+static void createFragmentShaderLightUniforms( stringstream &fs,
+          const vector< bool >& lights )
+{
+   fs << "struct PPLLightSourceParameters {" << endl;
+   fs << "   vec4 ambient;" << endl;
+   fs << "   vec4 diffuse;" << endl;
+   fs << "   vec4 specular;" << endl;
+   fs << "   vec4 position;" << endl;
+   fs << "   vec3 spotDirection;" << endl;
+   fs << "   float spotExponent;" << endl;
+   fs << "   float spotCosOuterAngle;" << endl;
+   fs << "   float spotCosInnerAngle;" << endl;
+   fs << "   float constantAttenuation;" << endl;
+   fs << "   float linearAttenuation;" << endl;
+   fs << "   float quadraticAttenuation;" << endl;
+   fs << "   bool eyeSpace;" << endl;
+   fs << "};" << endl;
+   fs << endl;
+   bool first = true;
+   for( unsigned int i=0; i<lights.size(); i++ ) {
+      if( !lights[i] )
+         continue;
+      fs << "uniform PPLLightSourceParameters ppl_LightSource";
+      if( !first )  fs << i;
+      fs << ";" << endl;
+      first = false;
+   }
+   fs << "uniform mat4 osg_ViewMatrix;" << endl;
+   fs << endl;
+}
+
+
 /**
  * The method creates the shader code for one light computation.
  * The result is either a piece of inline code or a function for
@@ -1489,7 +2020,8 @@ static void createFragmentShaderBody( stringstream &fs,
           const vector< string >& shadowTextureUniform = vector< string >(),
 //          const vector< int >& shadowTexCoordIndex = vector< int >(),
           bool appendGlobalAmbient = true,
-          bool compatibilityParams = true )
+          bool compatibilityParams = true,
+          bool lightUniforms = false )
 {
    // Floating numbers issue
    //
@@ -1547,12 +2079,35 @@ static void createFragmentShaderBody( stringstream &fs,
    fs << endl;
 
    // lights and shadows
+   bool firstLight = true;
    for( unsigned int i=0; i<lights.size(); i++ ) {
 
       // ignore lights that are switched off
       if( lights[i] == false )
          continue;
 
+      // names of light parameters
+      // (gl_LightSource or uniforms declared by createFragmentShaderLightUniforms)
+      stringstream ls;
+      string position, spotDirection, spotCosOuterAngle, spotCosInnerAngle;
+      if( lightUniforms ) {
+         ls << "ppl_LightSource";
+         if( !firstLight )  ls << i;
+         position = "(" + ls.str() + ".eyeSpace ? " + ls.str() + ".position : osg_ViewMatrix * " +
+                    ls.str() + ".position)";
+         spotDirection = "(" + ls.str() + ".eyeSpace ? " + ls.str() + ".spotDirection : (osg_ViewMatrix * vec4( " +
+                         ls.str() + ".spotDirection, 0. )).xyz)";
+         spotCosOuterAngle = ls.str() + ".spotCosOuterAngle";
+         spotCosInnerAngle = ls.str() + ".spotCosInnerAngle";
+      } else {
+         ls << "gl_LightSource[" << i << "]";
+         position = ls.str() + ".position";
+         spotDirection = ls.str() + ".spotDirection";
+         spotCosOuterAngle = ls.str() + ".spotCosCutoff";
+         spotCosInnerAngle = ls.str() + ".specular.w";
+      }
+      firstLight = false;
+
       // has the light shadowMap?
       const string& shadowTexture = ( i < shadowTextureUniform.size() ?
                                       shadowTextureUniform[i] : "" );
@@ -1564,7 +2119,7 @@ static void createFragmentShaderBody( stringstream &fs,
          if( !cubeShadowMap )
          {
          fs << "   vec4 " << shadowVar << " = shadow" << (cubeShadowMap ? "Cube" : "2D") << "Proj( " << shadowTexture << ", ";
-         if( cubeShadowMap )  fs << "vertex.xyz - gl_LightSource[" << i << "].position.xyz";
+         if( cubeShadowMap )  fs << "vertex.xyz - " << position << ".xyz";
          else  fs << "gl_TexCoord[" << shadowMapTexUnit << "]";
          fs << " );" << endl;
          }
@@ -1579,29 +2134,31 @@ static void createFragmentShaderBody( stringstream &fs,
       // note on compatibilityParams: some old drivers has problems with
       // gl_LightSource as a parameter. For more details, see comments in
       // createFragmentShaderLightingCode function.
+      // Light uniforms are not of gl_LightSourceParameters type,
+      // so they are always passed as separate arguments.
       //
-      if( !compatibilityParams )
-         fs << "   gl_FragColor.rgb += processLight( gl_LightSource[" << i
-            << "], v, n, false ).rgb";
+      if( !compatibilityParams && !lightUniforms )
+         fs << "   gl_FragColor.rgb += processLight( " << ls.str()
+            << ", v, n, false ).rgb";
       else
          fs << "   gl_FragColor.rgb += processLight(" << endl
-            << "          gl_LightSource[" << i << "].ambient," << endl
-            << "          gl_LightSource[" << i << "].diffuse," << endl
-            << "          vec4(gl_LightSource[" << i << "].specular.xyz, gl_LightSource[" << i << "].diffuse.w)," << endl
-            << "          gl_LightSource[" << i << "].position," << endl
-            << "          gl_LightSource[" << i << "].spotDirection," << endl
+            << "          " << ls.str() << ".ambient," << endl
+            << "          " << ls.str() << ".diffuse," << endl
+            << "          vec4(" << ls.str() << ".specular.xyz, " << ls.str() << ".diffuse.w)," << endl
+            << "          " << position << "," << endl
+            << "          " << spotDirection << "," << endl
 #if 0 // Switch between OpenGL spotlight (first code) and DirectX spotlight (second code).
-            << "          gl_LightSource[" << i << "].spotExponent," << endl
-            << "          gl_LightSource[" << i << "].spotCosCutoff," << endl
+            << "          " << ls.str() << ".spotExponent," << endl
+            << "          " << spotCosOuterAngle << "," << endl
             << "          -1," << endl
 #else
-            << "          gl_LightSource[" << i << "].spotExponent," << endl
-            << "          gl_LightSource[" << i << "].spotCosCutoff, // outer cone" << endl // Outer cone radius
-            << "          gl_LightSource[" << i << "].specular.w, // inner cone" << endl // Inner cone radius
+            << "          " << ls.str() << ".spotExponent," << endl
+            << "          " << spotCosOuterAngle << ", // outer cone" << endl // Outer cone radius
+            << "          " << spotCosInnerAngle << ", // inner cone" << endl // Inner cone radius
 #endif
-            << "          gl_LightSource[" << i << "].constantAttenuation," << endl
-            << "          gl_LightSource[" << i << "].linearAttenuation," << endl
-            << "          gl_LightSource[" << i << "].quadraticAttenuation," << endl
+            << "          " << ls.str() << ".constantAttenuation," << endl
+            << "          " << ls.str() << ".linearAttenuation," << endl
+            << "          " << ls.str() << ".quadraticAttenuation," << endl
             << "          v, n ).rgb";
 
       // apply shadow
@@ -1669,6 +2226,8 @@ static void createFragmentShaderBody( stringstream &fs,
  * compatibilityParams determines whether safe way of passing parameters
  * to the light computation function should be used. See details in comments
  * of createFragmentShaderLightingCode function.
+ * lightUniforms makes the shader to take light parameters from ppl_LightSource
+ * uniforms (see PerPixelLighting::LightUniforms) instead of gl_LightSource.
  */
 Shader* PerPixelLighting::ShaderGenerator::createFragmentShader(
           const FragmentShaderParams &fsp )
@@ -1686,6 +2245,9 @@ Shader* PerPixelLighting::ShaderGenerator::createFragmentShader(
           fsp.shadowTextureUniforms,
           fsp.cubeShadowMap );
 
+   if( fsp.lightUniforms && fsp.lights.size() > 0 )
+      createFragmentShaderLightUniforms( code, fsp.lights );
+
 #if 1
    if( fsp.lights.size() > 0 )
       createFragmentShaderLightingCode( code,
@@ -1704,7 +2266,8 @@ Shader* PerPixelLighting::ShaderGenerator::createFragmentShader(
           fsp.cubeShadowMap,
           fsp.shadowTextureUniforms,
           fsp.appendGlobalAmbient,
-          fsp.compatibilityParams );
+          fsp.compatibilityParams,
+          fsp.lightUniforms );
 
    // fragment shader object instance
    Shader *fragmentShader = new Shader( Shader::FRAGMENT );
@@ -1859,6 +2422,9 @@ PerPixelLighting::ShaderGenerator::FragmentShaderParams::FragmentShaderParams( c
 
    // compatibility params
    compatibilityParams = true;
+
+   // light parameters are given by uniforms
+   lightUniforms = true;
 }
 
 
@@ -1924,7 +2490,10 @@ std::ostream& operator<<( std::ostream& out,
    out << "      AppendGlobalAmbient: " << ( fsp.appendGlobalAmbient ? "y" : "n" ) << endl;
 
    // compatibilityParams
-   out << "      CompatibilityParams: " << ( fsp.compatibilityParams ? "y" : "n" );
+   out << "      CompatibilityParams: " << ( fsp.compatibilityParams ? "y" : "n" ) << endl;
+
+   // lightUniforms
+   out << "      LightUniforms: " << ( fsp.lightUniforms ? "y" : "n" );
 
    return out;
 }
@@ -1980,7 +2549,11 @@ bool PerPixelLighting::ShaderGenerator::FragmentShaderParams::operator<(
       return true;
    if( this->baseTextureMode > other.baseTextureMode )
       return false;
-   return this->compatibilityParams < other.compatibilityParams;
+   if( this->compatibilityParams < other.compatibilityParams )
+      return true;
+   if( this->compatibilityParams > other.compatibilityParams )
+      return false;
+   return this->lightUniforms < other.lightUniforms;
 }
 
 
@@ -2051,6 +2624,347 @@ PerPixelLighting::CollectLightVisitor::CollectLightVisitor()
 }
 
 
+/**
+ * Constructor.
+ */
+PerPixelLighting::ConversionCache::ConversionCache()
+   : _hits( 0 ),
+     _misses( 0 )
+{
+}
+
+
+/**
+ * Destructor.
+ */
+PerPixelLighting::ConversionCache::~ConversionCache()
+{
+}
+
+
+/**
+ * Hashes the scene and finds all its subgraphs that are identical
+ * to the subgraphs of the previously committed scene.
+ * This makes the conversion results stored in the cache applicable
+ * to the scene and avoids keeping two copies of the same data in the memory.
+ *
+ * The scene is not modified. The unchanged subgraphs are replaced
+ * by the previous ones in commit(), until then getSource() gives
+ * the previous subgraph for the unchanged one.
+ */
+void PerPixelLighting::ConversionCache::shareUnchangedSubgraphs( Node *scene )
+{
+   Timer time;
+
+   // hash the scene
+   ref_ptr< SceneHashVisitor > hv = new SceneHashVisitor;
+   scene->accept( *hv );
+   double hashTime = time.time_m();
+
+   // find unchanged subgraphs of the previous scene
+   // (the root is never replaced, so the new scene does not
+   // become a part of the displayed scene before commit())
+   _aliases.clear();
+   _splices.clear();
+   _hashVisitor = hv;
+   unsigned int numShared = 0;
+   if( !_sourcesByHash.empty() ) {
+      set< Node* > visited;
+      shareChildren( scene, visited, numShared );
+   }
+
+   // hashes of the resulting scene
+   _pendingHashes.clear();
+   _pendingLights.clear();
+   _pendingByHash.clear();
+   collectSources( scene );
+
+   Log::info() << QString( "PerPixelLighting: Scene hashed in %1ms, %2 unchanged subgraphs shared "
+                           "with the previous version of the scene (operation completed in %3ms)." )
+                           .arg( hashTime, 0, 'f', 2 )
+                           .arg( numShared )
+                           .arg( time.time_m(), 0, 'f', 2 ) << Log::endm;
+}
+
+
+/**
+ * Records the replacement of the child of the parent by the given node.
+ * The replacement is performed by commit().
+ */
+void PerPixelLighting::ConversionCache::splice( Group *parent, Node *child, Node *replacement )
+{
+   Splice s;
+   s.parent = parent;
+   s.child = child;
+   s.replacement = replacement;
+   _splices.push_back( s );
+}
+
+
+/**
+ * Replaces the unchanged subgraphs of the new scene and the placeholders
+ * of the reused conversion results in the new converted scene
+ * by the previous subgraphs and makes the new scene the source
+ * of the next reuse.
+ *
+ * It modifies the parent lists of the previous (displayed) subgraphs,
+ * so it has to be called by the thread displaying the scenes.
+ */
+void PerPixelLighting::ConversionCache::commit()
+{
+   for( vector< Splice >::iterator it = _splices.begin(); it != _splices.end(); it++ )
+      it->parent->replaceChild( it->child.get(), it->replacement.get() );
+   _splices.clear();
+   _aliases.clear();
+
+   _sourceHashes.swap( _pendingHashes );
+   _sourceLights.swap( _pendingLights );
+   _sourcesByHash.swap( _pendingByHash );
+   _pendingHashes.clear();
+   _pendingLights.clear();
+   _pendingByHash.clear();
+
+   _previous.swap( _current );
+   _current.clear();
+}
+
+
+Node* PerPixelLighting::ConversionCache::findSource( Value hash, const Node *node ) const
+{
+   map< Value, ref_ptr< Node > >::const_iterator it = _sourcesByHash.find( hash );
+   if( it == _sourcesByHash.end() || it->second == node )
+      return NULL;
+   return it->second.get();
+}
+
+
+void PerPixelLighting::ConversionCache::shareChildren( Node *node, set< Node* > &visited,
+                                                        unsigned int &numShared )
+{
+   Group *group = node->asGroup();
+   if( !group || !visited.insert( node ).second )
+      return;
+
+   for( unsigned int i=0, c=group->getNumChildren(); i<c; i++ ) {
+
+      // unchanged child is replaced by the previous one in commit()
+      // (the equal hash is verified by comparison of the subgraphs)
+      Node *child = group->getChild( i );
+      Value h;
+      if( _hashVisitor->getHash( child, h ) ) {
+         Node *previous = findSource( h, child );
+         set< pair< const Node*, const Node* > > compared;
+         if( previous && isIdenticalSubgraph( child, previous, compared ) ) {
+            _aliases[ child ] = previous;
+            splice( group, child, previous );
+            numShared++;
+            continue;
+         }
+      }
+
+      // look for unchanged subgraphs in the child
+      shareChildren( child, visited, numShared );
+   }
+}
+
+
+/**
+ * Returns true if the subgraphs have the same structure, node parameters,
+ * StateSets and Geometries (compared by their arrays and primitive sets).
+ * Drawables other than Geometry and user data are compared
+ * by their hashes only (see SceneHashVisitor).
+ */
+bool PerPixelLighting::ConversionCache::isIdenticalSubgraph( const Node *n1, const Node *n2,
+                                                             set< pair< const Node*, const Node* > > &compared ) const
+{
+   if( n1 == n2 || !compared.insert( make_pair( n1, n2 ) ).second )
+      return true;
+
+   // node type and common parameters
+   if( strcmp( n1->libraryName(), n2->libraryName() ) != 0 ||
+       strcmp( n1->className(), n2->className() ) != 0 ||
+       n1->getName() != n2->getName() ||
+       n1->getNodeMask() != n2->getNodeMask() ||
+       !GeometryDeduplicator::isIdenticalStateSet( n1->getStateSet(), n2->getStateSet() ) )
+      return false;
+
+   // Transform
+   const Transform *t1 = n1->asTransform();
+   const Transform *t2 = n2->asTransform();
+   if( t1 && t2 ) {
+      Matrix m1, m2;
+      t1->computeLocalToWorldMatrix( m1, NULL );
+      t2->computeLocalToWorldMatrix( m2, NULL );
+      if( m1 != m2 || t1->getReferenceFrame() != t2->getReferenceFrame() )
+         return false;
+   }
+
+   // LightSource
+   const LightSource *ls1 = dynamic_cast< const LightSource* >( n1 );
+   const LightSource *ls2 = dynamic_cast< const LightSource* >( n2 );
+   if( ls1 && ls2 ) {
+      const Light *l1 = ls1->getLight();
+      const Light *l2 = ls2->getLight();
+      if( ls1->getReferenceFrame() != ls2->getReferenceFrame() ||
+          ( l1 != l2 && ( !l1 || !l2 || l1->compare( *l2 ) != 0 ) ) )
+         return false;
+   }
+
+   // Switch
+   const Switch *sw1 = dynamic_cast< const Switch* >( n1 );
+   const Switch *sw2 = dynamic_cast< const Switch* >( n2 );
+   if( sw1 && sw2 && sw1->getValueList() != sw2->getValueList() )
+      return false;
+
+   // LOD
+   const LOD *lod1 = dynamic_cast< const LOD* >( n1 );
+   const LOD *lod2 = dynamic_cast< const LOD* >( n2 );
+   if( lod1 && lod2 &&
+       ( lod1->getCenterMode() != lod2->getCenterMode() || lod1->getCenter() != lod2->getCenter() ||
+         lod1->getRangeMode() != lod2->getRangeMode() || lod1->getRangeList() != lod2->getRangeList() ) )
+      return false;
+
+   // Geode
+   const Geode *geode1 = n1->asGeode();
+   const Geode *geode2 = n2->asGeode();
+   if( geode1 && geode2 ) {
+      if( geode1->getNumDrawables() != geode2->getNumDrawables() )
+         return false;
+      for( unsigned int i=0, c=geode1->getNumDrawables(); i<c; i++ ) {
+         const Drawable *d1 = geode1->getDrawable( i );
+         const Drawable *d2 = geode2->getDrawable( i );
+         if( d1 == d2 )
+            continue;
+         if( strcmp( d1->className(), d2->className() ) != 0 )
+            return false;
+         const Geometry *g1 = d1->asGeometry();
+         const Geometry *g2 = d2->asGeometry();
+         if( g1 && g2 &&
+             ( g1->getName() != g2->getName() ||
+               !GeometryDeduplicator::isIdenticalStateSet( g1->getStateSet(), g2->getStateSet() ) ||
+               !GeometryDeduplicator::isIdenticalData( g1, g2 ) ) )
+            return false;
+      }
+   }
+
+   // children
+   const Group *group1 = n1->asGroup();
+   const Group *group2 = n2->asGroup();
+   if( group1 && group2 ) {
+      if( group1->getNumChildren() != group2->getNumChildren() )
+         return false;
+      for( unsigned int i=0, c=group1->getNumChildren(); i<c; i++ )
+         if( !isIdenticalSubgraph( group1->getChild( i ), group2->getChild( i ), compared ) )
+            return false;
+   }
+
+   return true;
+}
+
+
+void PerPixelLighting::ConversionCache::collectSources( Node *node )
+{
+   // unchanged subgraph is represented by the previous one
+   node = getSource( node );
+
+   // skip already visited nodes
+   if( _pendingHashes.find( node ) != _pendingHashes.end() )
+      return;
+
+   // new nodes are hashed by the current hash visitor,
+   // nodes of the previous scene were hashed before
+   Value h;
+   bool light;
+   if( _hashVisitor->getHash( node, h ) )
+      light = _hashVisitor->containsLight( node );
+   else {
+      map< const Node*, Value >::const_iterator it = _sourceHashes.find( node );
+      if( it == _sourceHashes.end() )
+         return;
+      h = it->second;
+      light = _sourceLights.find( node ) != _sourceLights.end();
+   }
+
+   _pendingHashes[ node ] = h;
+   if( light )
+      _pendingLights.insert( node );
+   if( _pendingByHash.find( h ) == _pendingByHash.end() )
+      _pendingByHash[ h ] = node;
+
+   // children
+   Group *group = node->asGroup();
+   if( group )
+      for( unsigned int i=0, c=group->getNumChildren(); i<c; i++ )
+         collectSources( group->getChild( i ) );
+}
+
+
+/**
+ * Starts the new conversion. Results stored during the conversion
+ * of the committed scene are available until the next commit().
+ */
+void PerPixelLighting::ConversionCache::beginConversion()
+{
+   _current.clear();
+   _hits = 0;
+   _misses = 0;
+}
+
+
+bool PerPixelLighting::ConversionCache::find( const Key &key, Node* &result )
+{
+   Entries::iterator it = _current.find( key );
+   if( it == _current.end() ) {
+      it = _previous.find( key );
+      if( it == _previous.end() ) {
+         _misses++;
+         return false;
+      }
+      it = _current.insert( *it ).first;
+   }
+
+   _hits++;
+   result = it->second.result.get();
+   return true;
+}
+
+
+void PerPixelLighting::ConversionCache::insert( const Key &key, Node *source, Node *result )
+{
+   Entry &e = _current[ key ];
+   e.source = source;
+   e.result = result;
+}
+
+
+/**
+ * Returns true if the node belongs to the scene processed by
+ * shareUnchangedSubgraphs() and it does not contain any light in its subgraph.
+ * Unchanged subgraphs are given by their previous versions (see getSource()).
+ */
+bool PerPixelLighting::ConversionCache::isCacheable( const Node *node ) const
+{
+   return _pendingHashes.find( node ) != _pendingHashes.end() &&
+          _pendingLights.find( node ) == _pendingLights.end();
+}
+
+
+PerPixelLighting::ConversionCache::Value PerPixelLighting::ConversionCache::getStateSetHash( const StateSet *ss )
+{
+   if( !_hashVisitor )
+      _hashVisitor = new SceneHashVisitor;
+   return _hashVisitor->getStateSetHash( ss );
+}
+
+
+PerPixelLighting::ConversionCache::Value PerPixelLighting::ConversionCache::getObjectHash( const Object *obj )
+{
+   if( !_hashVisitor )
+      _hashVisitor = new SceneHashVisitor;
+   return _hashVisitor->getObjectHash( obj );
+}
+
+
 void PerPixelLighting::CollectLightVisitor::reset()
 {
    lightSourceList.clear();
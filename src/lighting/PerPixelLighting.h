@@ -9,10 +9,19 @@
 #define PER_PIXEL_LIGHTING_H
 
 
+#include <osg/NodeCallback>
 #include <osg/NodeVisitor>
 #include <osg/TexEnv>
+#include <osg/Uniform>
 #include <osgShadow/ShadowedScene>
+#include <map>
+#include <set>
 #include <stack>
+#include <vector>
+#include "utils/CancellationToken.h"
+#include "utils/ContentHash.h"
+
+class SceneHashVisitor;
 
 class RefNodePath : public osg::Object, public osg::NodePath
 {
@@ -55,6 +64,152 @@ public:
    virtual void convert( osg::Node *scene, ShadowTechnique shadowTechnique = NO_SHADOWS );
    inline osg::Node* getScene() const { return newScene; }
 
+   /** Returns true if the node is the root of converted multipass scene.
+    *  Its children are the render passes (ambient pass and one pass per light). */
+   static bool isMultipassRoot( const osg::Node *node );
+
+   /**
+    * Cache of the conversion results used for incremental reconversion
+    * of a scene that is loaded again after modification.
+    *
+    * shareUnchangedSubgraphs() hashes the newly loaded scene
+    * (see SceneHashVisitor) and finds subgraphs identical to the
+    * previous version of the scene (the hash matches are verified
+    * by comparison of the subgraphs). The conversion treats them as the previous
+    * subgraphs (see getSource()) and the conversion results of the previous
+    * subgraphs, stored during the previous conversion, are used instead of
+    * converting the subgraphs again. Subgraphs containing lights are always converted.
+    *
+    * The previous subgraphs and their conversion results belong to the displayed
+    * scenes, so the scene being loaded may be processed by a background thread
+    * without modifying them. The replacements are recorded only (see splice())
+    * and commit() performs them; it has to be called by the thread
+    * that displays the scenes when the new scenes are complete. Without commit(),
+    * e.g. when the loading is canceled, the cache keeps the state
+    * of the previously committed scene.
+    */
+   class ConversionCache : public osg::Referenced
+   {
+   public:
+      typedef ContentHash::Value Value;
+
+      ConversionCache();
+
+      void shareUnchangedSubgraphs( osg::Node *scene );
+      inline osg::Node* getSource( osg::Node *node ) const;
+      void splice( osg::Group *parent, osg::Node *child, osg::Node *replacement );
+      void commit();
+
+      struct Key {
+         const osg::Node *node;
+         Value pathState;
+         Value pass;
+         Key( const osg::Node *n, Value ps, Value p ) : node( n ), pathState( ps ), pass( p )  {}
+         inline bool operator<( const Key &other ) const;
+      };
+
+      void beginConversion();
+      bool find( const Key &key, osg::Node* &result );
+      void insert( const Key &key, osg::Node *source, osg::Node *result );
+
+      bool isCacheable( const osg::Node *node ) const;
+      Value getStateSetHash( const osg::StateSet *ss );
+      Value getObjectHash( const osg::Object *obj );
+
+      inline unsigned int getNumHits() const  { return _hits; }
+      inline unsigned int getNumMisses() const  { return _misses; }
+
+   protected:
+      virtual ~ConversionCache();
+
+      osg::Node* findSource( Value hash, const osg::Node *node ) const;
+      void shareChildren( osg::Node *node, std::set< osg::Node* > &visited, unsigned int &numShared );
+      bool isIdenticalSubgraph( const osg::Node *n1, const osg::Node *n2,
+                                std::set< std::pair< const osg::Node*, const osg::Node* > > &compared ) const;
+      void collectSources( osg::Node *node );
+
+      osg::ref_ptr< SceneHashVisitor > _hashVisitor;
+
+      // subgraphs of the committed scene
+      std::map< const osg::Node*, Value > _sourceHashes;
+      std::set< const osg::Node* > _sourceLights;
+      std::map< Value, osg::ref_ptr< osg::Node > > _sourcesByHash;
+
+      // subgraphs of the scene being processed, they become committed by commit()
+      std::map< const osg::Node*, Value > _pendingHashes;
+      std::set< const osg::Node* > _pendingLights;
+      std::map< Value, osg::ref_ptr< osg::Node > > _pendingByHash;
+      std::map< const osg::Node*, osg::ref_ptr< osg::Node > > _aliases;  // unchanged subgraphs and their previous versions
+
+      struct Splice {
+         osg::ref_ptr< osg::Group > parent;
+         osg::ref_ptr< osg::Node > child;
+         osg::ref_ptr< osg::Node > replacement;
+      };
+      std::vector< Splice > _splices;
+
+      struct Entry {
+         osg::ref_ptr< osg::Node > source;
+         osg::ref_ptr< osg::Node > result;
+      };
+      typedef std::map< Key, Entry > Entries;
+      Entries _previous;
+      Entries _current;
+      unsigned int _hits;
+      unsigned int _misses;
+   };
+
+   inline void setConversionCache( ConversionCache *cache )  { conversionCache = cache; }
+   inline ConversionCache* getConversionCache() const  { return conversionCache.get(); }
+
+   // the conversion is abandoned between the passes when the token is canceled
+   inline void setCancellationToken( CancellationToken *token )  { cancellationToken = token; }
+   inline CancellationToken* getCancellationToken() const  { return cancellationToken.get(); }
+
+   /**
+    * Update callback that feeds the light parameters of one render pass
+    * into the ppl_LightSource uniforms read by the generated shaders.
+    * It is attached to the LightSource of the pass and evaluates the light
+    * each frame, so moving or recolouring the light does not require
+    * the scene to be converted again.
+    */
+   class LightUniforms : public osg::NodeCallback
+   {
+   public:
+      LightUniforms( osg::Light *light, osg::Light *shadowLight = NULL,
+                     double beamWidthAngle = -1., double spotExponent = -1. );
+      META_Object( Lexolights, LightUniforms );
+
+      void addTo( osg::StateSet *ss ) const;
+      void update( const osg::Matrix &localToWorld, bool eyeSpace );
+      virtual void operator()( osg::Node *node, osg::NodeVisitor *nv );
+
+      inline osg::Light* getLight() const  { return _light.get(); }
+
+   protected:
+      LightUniforms() : _beamWidthAngle( -1. ), _spotExponent( -1. )  {}
+      LightUniforms( const LightUniforms &other, const osg::CopyOp &copyop = osg::CopyOp::SHALLOW_COPY );
+      virtual ~LightUniforms() {}
+
+      osg::ref_ptr< osg::Light > _light;
+      osg::ref_ptr< osg::Light > _shadowLight;
+      double _beamWidthAngle;
+      double _spotExponent;
+
+      osg::ref_ptr< osg::Uniform > _ambient;
+      osg::ref_ptr< osg::Uniform > _diffuse;
+      osg::ref_ptr< osg::Uniform > _specular;
+      osg::ref_ptr< osg::Uniform > _position;
+      osg::ref_ptr< osg::Uniform > _spotDirection;
+      osg::ref_ptr< osg::Uniform > _spotExponentUniform;
+      osg::ref_ptr< osg::Uniform > _spotCosOuterAngle;
+      osg::ref_ptr< osg::Uniform > _spotCosInnerAngle;
+      osg::ref_ptr< osg::Uniform > _constantAttenuation;
+      osg::ref_ptr< osg::Uniform > _linearAttenuation;
+      osg::ref_ptr< osg::Uniform > _quadraticAttenuation;
+      osg::ref_ptr< osg::Uniform > _eyeSpace;
+   };
+
    class ShaderGenerator : public osg::Referenced
    {
    public:
@@ -79,11 +234,12 @@ public:
          bool cubeShadowMap;
          bool appendGlobalAmbient;
          bool compatibilityParams;
+         bool lightUniforms;
          FragmentShaderParams( const std::string& baseTextureUniform,
                    osg::TexEnv::Mode baseTextureMode, const std::vector< bool >& lights,
                    int shadowMapTextureUnit, bool cubeShadowMap,
                    const std::vector< std::string >& shadowTextureUniforms,
-                   bool appendGlobalAmbient, bool compatibilityParams );
+                   bool appendGlobalAmbient, bool compatibilityParams, bool lightUniforms );
          FragmentShaderParams( const osg::StateSet *s, int shadowMapTextureUnit, bool cubeShadowMap,
                                ShadowTechnique shadowTechnique, bool globalAmbient );
          bool operator<( const FragmentShaderParams& other ) const;
@@ -161,11 +317,12 @@ public:
 
       struct MultipassData {
          bool globalAmbient;
-         int lightBaseIndex;
          int shadowMapTexUnit;
          osg::ref_ptr< const RefNodePath > activeLightSourcePath;
          osg::ref_ptr< const osg::Light > activeLight;
+         bool activeLightShared;
          osg::Light *newLight;
+         osg::ref_ptr< LightUniforms > newLightUniforms;
          bool newLightCubeShadowMap;
       };
       inline MultipassData& getMultipassData();
@@ -176,6 +333,9 @@ public:
       virtual class osg::Program* createShaderProgram( const osg::StateSet *s, int shadowMapTextureUnit,
                                                        bool cubeShadowMap, bool globalAmbient );
 
+      inline void setConversionCache( ConversionCache *cache )  { conversionCache = cache; }
+      inline ConversionCache* getConversionCache() const  { return conversionCache.get(); }
+
       virtual void apply( osg::Node &node );
       virtual void apply( osg::Geode &geode );
       virtual void apply( osg::Group &group );
@@ -194,6 +354,10 @@ public:
       osg::Node* clonePathUpToIndex( int i );
       void purgeEmptyNodes( osg::Group &parent );
 
+      bool cacheEnter( osg::Node &node );
+      void cacheLeave( osg::Node &node );
+      void markUncacheableBelow( int pathIndex );
+
       osg::ref_ptr< ShaderGenerator > shaderGenerator;
       virtual void recreateShaderGenerator();
 
@@ -209,11 +373,20 @@ public:
       // multipass
       bool multipassActive;
       MultipassData mpData;
+
+      // incremental conversion
+      osg::ref_ptr< ConversionCache > conversionCache;
+      ContentHash::Value passKey;
+      std::vector< ContentHash::Value > pathStateStack;
+      std::vector< bool > cacheableStack;
    };
 
 protected:
 
    osg::ref_ptr< osg::Node > newScene;
+   osg::ref_ptr< ConversionCache > conversionCache;
+   osg::ref_ptr< CancellationToken > cancellationToken;
+   bool checkCanceled();
    virtual ConvertVisitor* createConvertVisitor() const;
    virtual CollectLightVisitor* createCollectLightVisitor() const;
 };
@@ -273,6 +446,29 @@ inline bool PerPixelLighting::ShaderGenerator::ProgramShaders::operator<(
    return this->vertexShader < other.vertexShader;
 }
 
+inline bool PerPixelLighting::ConversionCache::Key::operator<( const Key &other ) const
+{
+   if( this->node < other.node )
+      return true;
+   if( this->node > other.node )
+      return false;
+   if( this->pathState < other.pathState )
+      return true;
+   if( this->pathState > other.pathState )
+      return false;
+   return this->pass < other.pass;
+}
+
+/**
+ * Returns the node of the committed scene that replaces the node
+ * of the scene being processed, or the node itself if it is not replaced.
+ */
+inline osg::Node* PerPixelLighting::ConversionCache::getSource( osg::Node *node ) const
+{
+   std::map< const osg::Node*, osg::ref_ptr< osg::Node > >::const_iterator it = _aliases.find( node );
+   return it != _aliases.end() ? it->second.get() : node;
+}
+
 inline PerPixelLighting::ConvertVisitor::MultipassData&
        PerPixelLighting::ConvertVisitor::getMultipassData()
 { return mpData; }
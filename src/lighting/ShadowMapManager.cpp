@@ -0,0 +1,647 @@
+/**
+ * @file
+ * ShadowMapManager class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/Notify>
+#include <osg/Stats>
+#include <osg/Switch>
+#include <osg/Transform>
+#include <osgShadow/ShadowedScene>
+#include <osgShadow/StandardShadowMap>
+#include <osgUtil/CullVisitor>
+#include <osgViewer/ViewerEventHandlers>
+#include <OpenThreads/ScopedLock>
+#include <algorithm>
+#include <sstream>
+#include "ShadowMapManager.h"
+
+using namespace std;
+using namespace osg;
+
+
+
+/**
+ * Cull callback of the shadow camera.
+ *
+ * It lets the original cull callback of osgShadow::ShadowMap
+ * render the shadow casters only if the shadow map is not up to date.
+ */
+class ManagedShadowMap::SkipUnchangedCallback : public NodeCallback
+{
+public:
+
+   SkipUnchangedCallback( ManagedShadowMap *shadowMap ) : _shadowMap( shadowMap )  {}
+
+   virtual void operator()( Node *node, NodeVisitor *nv )
+   {
+      osgUtil::CullVisitor *cv = dynamic_cast< osgUtil::CullVisitor* >( nv );
+      Camera *camera = static_cast< Camera* >( node );
+
+      {
+         OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _shadowMap->_mutex );
+
+         // shadow map is up to date => keep texture content,
+         // e.g. render nothing and do not clear
+         // (clear mask is set on the render stage as the stage settings
+         // were already taken from the camera at this point)
+         if( cv && !_shadowMap->_invalid &&
+             camera->getViewMatrix() == _shadowMap->_renderedViewMatrix &&
+             camera->getProjectionMatrix() == _shadowMap->_renderedProjectionMatrix )
+         {
+            cv->getCurrentRenderStage()->setClearMask( 0 );
+            return;
+         }
+
+         // the shadow casters are going to be rendered
+         _shadowMap->_invalid = false;
+         _shadowMap->_renderedViewMatrix = camera->getViewMatrix();
+         _shadowMap->_renderedProjectionMatrix = camera->getProjectionMatrix();
+         _shadowMap->_numUpdates++;
+      }
+
+      // render shadow casters
+      traverse( node, nv );
+   }
+
+protected:
+   ManagedShadowMap *_shadowMap;
+};
+
+
+/**
+ * Collects the nodes of the shadowed subgraph whose changes
+ * may change the shadows without changing the bound of the subgraph.
+ */
+class ManagedShadowMap::CasterCollector : public NodeVisitor
+{
+public:
+
+   CasterCollector( ManagedShadowMap *shadowMap )
+      : NodeVisitor( NodeVisitor::TRAVERSE_ALL_CHILDREN ), _shadowMap( shadowMap )  {}
+
+   virtual void apply( Transform &transform )
+   {
+      _shadowMap->_casterTransforms.push_back( &transform );
+      traverse( transform );
+   }
+
+   virtual void apply( Switch &sw )
+   {
+      _shadowMap->_casterSwitches.push_back( &sw );
+      traverse( sw );
+   }
+
+   virtual void apply( Geode &geode )
+   {
+      for( unsigned int i=0, c=geode.getNumDrawables(); i<c; i++ ) {
+         Geometry *g = geode.getDrawable( i )->asGeometry();
+         if( g && g->getDataVariance() == Object::DYNAMIC && g->getVertexArray() )
+            _shadowMap->_casterGeometries.push_back( g );
+      }
+   }
+
+protected:
+   ManagedShadowMap *_shadowMap;
+};
+
+
+
+ManagedShadowMap::ManagedShadowMap()
+   : inherited(),
+     _invalid( true ),
+     _numUpdates( 0 ),
+     _casterSignature( 0 ),
+     _signatureFrameNumber( ~0u )
+{
+}
+
+
+ManagedShadowMap::ManagedShadowMap( const ManagedShadowMap &msm, const CopyOp &copyop )
+   : inherited( msm, copyop ),
+     _invalid( true ),
+     _numUpdates( 0 ),
+     _casterSignature( 0 ),
+     _signatureFrameNumber( ~0u )
+{
+}
+
+
+/**
+ * Forces rendering of the shadow map in the next frame.
+ * The method may be called from any thread.
+ */
+void ManagedShadowMap::invalidate()
+{
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _mutex );
+   _invalid = true;
+}
+
+
+/**
+ * Returns the number of shadow map renderings.
+ */
+unsigned int ManagedShadowMap::getNumUpdates() const
+{
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _mutex );
+   return _numUpdates;
+}
+
+
+/**
+ * Creates shadow camera and texture by osgShadow::ShadowMap
+ * and installs SkipUnchangedCallback on the camera.
+ *
+ * The method is called by update traversal for new and dirty techniques,
+ * for instance after setTextureSize(). The shadow map is always rendered after init.
+ */
+void ManagedShadowMap::init()
+{
+   inherited::init();
+
+   if( _camera.valid() ) {
+      SkipUnchangedCallback *cb = new SkipUnchangedCallback( this );
+      cb->setNestedCallback( _camera->getCullCallback() );
+      _camera->setCullCallback( cb );
+   }
+
+   invalidate();
+}
+
+
+/**
+ * Update traversal. The shadow map is invalidated when the signature
+ * of the shadow casters changed (see computeCasterSignature()).
+ *
+ * The signature is computed after the traversal of the casters,
+ * so the changes made by their update callbacks in this frame are included.
+ */
+void ManagedShadowMap::update( NodeVisitor &nv )
+{
+   inherited::update( nv );
+
+   if( !_shadowedScene )
+      return;
+
+   // collect the casters again when the bound changed
+   // (the scene structure might change)
+   const BoundingSphere &bound = _shadowedScene->getBound();
+   if( bound != _casterBound ) {
+      _casterBound = bound;
+      _casterTransforms.clear();
+      _casterSwitches.clear();
+      _casterGeometries.clear();
+      CasterCollector collector( this );
+      for( unsigned int i=0, c=_shadowedScene->getNumChildren(); i<c; i++ )
+         _shadowedScene->getChild( i )->accept( collector );
+      invalidate();
+   }
+
+   // static casters can not change the shadows inside the bound
+   if( _casterTransforms.empty() && _casterSwitches.empty() && _casterGeometries.empty() )
+      return;
+
+   // signature is computed once per frame
+   // (the ShadowedScene may be traversed several times in the frame)
+   if( nv.getFrameStamp() ) {
+      unsigned int frameNumber = nv.getFrameStamp()->getFrameNumber();
+      if( frameNumber == _signatureFrameNumber )
+         return;
+      _signatureFrameNumber = frameNumber;
+   }
+
+   ContentHash::Value signature = computeCasterSignature();
+   if( signature != _casterSignature ) {
+      _casterSignature = signature;
+      invalidate();
+   }
+}
+
+
+/**
+ * Returns the hash of the state of the collected casters: local matrices
+ * of the Transforms, values of the Switches and modified counts
+ * of the vertex arrays of the DYNAMIC Geometries.
+ */
+ContentHash::Value ManagedShadowMap::computeCasterSignature() const
+{
+   ContentHash h;
+   for( unsigned int i=0; i<_casterTransforms.size(); i++ ) {
+      Matrix m;
+      _casterTransforms[i]->computeLocalToWorldMatrix( m, NULL );
+      h.add( m.ptr(), 16 * sizeof( Matrix::value_type ) );
+   }
+   for( unsigned int i=0; i<_casterSwitches.size(); i++ ) {
+      const Switch::ValueList &values = _casterSwitches[i]->getValueList();
+      for( unsigned int j=0; j<values.size(); j++ )
+         h.add( bool( values[j] ) );
+   }
+   for( unsigned int i=0; i<_casterGeometries.size(); i++ )
+      h.add( _casterGeometries[i]->getVertexArray()->getModifiedCount() );
+   return h.get();
+}
+
+
+
+/**
+ * Callback installed on each managed ShadowedScene.
+ *
+ * During update traversal, it gives the control to ShadowMapManager once per frame.
+ * During cull traversal, it counts shadow map renderings of the techniques
+ * that render their shadow map each frame.
+ */
+class ShadowMapManager::ShadowedSceneCallback : public NodeCallback
+{
+public:
+
+   ShadowedSceneCallback() : numCulls( 0 )  {}
+
+   virtual void operator()( Node *node, NodeVisitor *nv )
+   {
+      if( nv->getVisitorType() == NodeVisitor::UPDATE_VISITOR ) {
+         if( nv->getFrameStamp() )
+            ShadowMapManager::instance()->update( nv->getFrameStamp()->getFrameNumber() );
+      } else
+      if( nv->getVisitorType() == NodeVisitor::CULL_VISITOR )
+         numCulls++;
+
+      traverse( node, nv );
+   }
+
+   unsigned int numCulls;
+};
+
+
+
+/**
+ * Returns the application-wide instance of ShadowMapManager.
+ */
+ShadowMapManager* ShadowMapManager::instance()
+{
+   static ref_ptr< ShadowMapManager > s_instance = new ShadowMapManager;
+   return s_instance.get();
+}
+
+
+ShadowMapManager::ShadowMapManager()
+   : _frameTimeBudget( 0. ),
+     _minResolution( 256 ),
+     _maxResolution( 2048 ),
+     _resolutionLimit( 0 ),
+     _resolutionLimitChanged( false ),
+     _averageFrameTime( 0. ),
+     _averageFrameTimeValid( false ),
+     _frameStartTick( 0 ),
+     _lastFrameNumber( ~0u ),
+     _framesSinceChange( 0 )
+{
+}
+
+
+ShadowMapManager::~ShadowMapManager()
+{
+}
+
+
+/**
+ * Puts the shadow technique of the shadowedScene under the control of the manager.
+ *
+ * The shadowedScene has to have the shadow technique already assigned.
+ * The technique is expected to be osgShadow::ShadowMap or osgShadow::StandardShadowMap
+ * based. Only ManagedShadowMap skips the rendering of unchanged shadow maps.
+ * The method may be called from any thread.
+ */
+void ShadowMapManager::manage( osgShadow::ShadowedScene *shadowedScene )
+{
+   Entry e;
+   e.shadowedScene = shadowedScene;
+   e.callback = new ShadowedSceneCallback;
+   e.unlimitedSize = 0;
+   shadowedScene->addUpdateCallback( e.callback );
+   shadowedScene->addCullCallback( e.callback );
+
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _mutex );
+   _entries.push_back( e );
+   _resolutionLimitChanged = true;
+}
+
+
+/**
+ * Forces rendering of all shadow maps in the next frame.
+ *
+ * It is meant for changes of shadow casters that are not detected
+ * by ManagedShadowMap, such as nodes added inside the bounds of the casters.
+ */
+void ShadowMapManager::invalidateAll()
+{
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _mutex );
+   for( EntryList::iterator it = _entries.begin(); it != _entries.end(); it++ ) {
+      ref_ptr< osgShadow::ShadowedScene > ss;
+      if( it->shadowedScene.lock( ss ) ) {
+         ManagedShadowMap *msm = dynamic_cast< ManagedShadowMap* >( ss->getShadowTechnique() );
+         if( msm )
+            msm->invalidate();
+      }
+   }
+}
+
+
+/**
+ * Sets the frame time budget in milliseconds.
+ * Zero or negative value disables the resolution scaling.
+ */
+void ShadowMapManager::setFrameTimeBudget( double milliseconds )
+{
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _mutex );
+   _frameTimeBudget = milliseconds;
+   _framesSinceChange = 0;
+}
+
+
+/**
+ * Sets the range of shadow map resolution used by the resolution scaling.
+ * New shadow maps are created with the maximum resolution.
+ */
+void ShadowMapManager::setResolutionRange( int minSize, int maxSize )
+{
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _mutex );
+   _minResolution = minSize;
+   _maxResolution = maxSize;
+}
+
+
+/**
+ * Limits the resolution of all shadow maps to the given size.
+ *
+ * The shadow maps keep their resolution up to the limit. When the limit
+ * is removed by zero size, the original resolution of each shadow map is restored.
+ * Resolution scaling by the frame time budget is suspended while the limit is set.
+ * The change is applied in the next update traversal.
+ */
+void ShadowMapManager::setResolutionLimit( int size )
+{
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _mutex );
+   if( _resolutionLimit == size )
+      return;
+   _resolutionLimit = size;
+   _resolutionLimitChanged = true;
+}
+
+
+/**
+ * Reports the end of the frame rendering.
+ *
+ * Frame time is measured from the start of the update traversal
+ * of the frame. Thus, it includes update, cull and draw of the frame,
+ * including the rendering of shadow maps. The method is expected to be called
+ * from the camera's final draw callback, e.g. by the rendering thread.
+ */
+void ShadowMapManager::reportFrameCompleted( unsigned int frameNumber )
+{
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _mutex );
+
+   // ignore frames without managed shadow maps
+   if( frameNumber != _lastFrameNumber )
+      return;
+
+   double t = Timer::instance()->delta_m( _frameStartTick, Timer::instance()->tick() );
+   if( _averageFrameTimeValid )
+      _averageFrameTime = 0.9 * _averageFrameTime + 0.1 * t;
+   else {
+      _averageFrameTime = t;
+      _averageFrameTimeValid = true;
+   }
+}
+
+
+/**
+ * Sets the viewer stats that will receive per-light shadow map statistics.
+ */
+void ShadowMapManager::setViewerStats( Stats *stats )
+{
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _mutex );
+   _viewerStats = stats;
+}
+
+
+static string statsAttributeName( int index, const char *name )
+{
+   stringstream s;
+   s << "Shadow map " << index + 1 << " " << name;
+   return s.str();
+}
+
+
+/**
+ * Appends shadow map lines to the statsHandler.
+ *
+ * Lines for resolution and number of renderings are appended
+ * for the first maxStatsLights shadow maps.
+ */
+void ShadowMapManager::addStatsLines( osgViewer::StatsHandler *statsHandler )
+{
+   for( int i=0; i<maxStatsLights; i++ ) {
+      stringstream label;
+      label << "Light " << i + 1 << " map: ";
+      statsHandler->addUserStatsLine( label.str() + "size",
+            Vec4( 0.7f, 0.7f, 1.0f, 1.0f ), Vec4( 0.7f, 0.7f, 1.0f, 0.5f ),
+            statsAttributeName( i, "resolution" ), 1.f, false, false, "", "", 0.f );
+      statsHandler->addUserStatsLine( label.str() + "updates",
+            Vec4( 0.7f, 0.7f, 1.0f, 1.0f ), Vec4( 0.7f, 0.7f, 1.0f, 0.5f ),
+            statsAttributeName( i, "updates" ), 1.f, false, false, "", "", 0.f );
+   }
+}
+
+
+/**
+ * Returns the shadow map texture size of ShadowMap and StandardShadowMap
+ * based techniques. Zero is returned for other techniques.
+ */
+int ShadowMapManager::getTextureSize( osgShadow::ShadowTechnique *technique )
+{
+   osgShadow::ShadowMap *sm = dynamic_cast< osgShadow::ShadowMap* >( technique );
+   if( sm )
+      return sm->getTextureSize().x();
+
+   osgShadow::StandardShadowMap *ssm = dynamic_cast< osgShadow::StandardShadowMap* >( technique );
+   if( ssm )
+      return ssm->getTextureSize().x();
+
+   return 0;
+}
+
+
+/**
+ * Sets the shadow map texture size. The technique gets dirty
+ * and it will recreate its texture in the next update traversal.
+ */
+void ShadowMapManager::setTextureSize( osgShadow::ShadowTechnique *technique, int size )
+{
+   osgShadow::ShadowMap *sm = dynamic_cast< osgShadow::ShadowMap* >( technique );
+   if( sm ) {
+      sm->setTextureSize( Vec2s( size, size ) );
+      return;
+   }
+
+   osgShadow::StandardShadowMap *ssm = dynamic_cast< osgShadow::StandardShadowMap* >( technique );
+   if( ssm )
+      ssm->setTextureSize( Vec2s( size, size ) );
+}
+
+
+/**
+ * Returns number of shadow map renderings of the entry.
+ */
+unsigned int ShadowMapManager::getNumUpdates( const Entry &e )
+{
+   ref_ptr< osgShadow::ShadowedScene > ss;
+   if( !e.shadowedScene.lock( ss ) )
+      return 0;
+
+   ManagedShadowMap *msm = dynamic_cast< ManagedShadowMap* >( ss->getShadowTechnique() );
+   if( msm )
+      return msm->getNumUpdates();
+   else
+      return e.callback->numCulls;
+}
+
+
+/**
+ * Per-frame processing. Called from the update traversal
+ * of managed ShadowedScenes, once per frame.
+ */
+void ShadowMapManager::update( unsigned int frameNumber )
+{
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _mutex );
+
+   // only once per frame
+   if( frameNumber == _lastFrameNumber )
+      return;
+   _lastFrameNumber = frameNumber;
+   _frameStartTick = Timer::instance()->tick();
+
+   // remove entries of released scenes
+   for( EntryList::iterator it = _entries.begin(); it != _entries.end(); )
+      if( it->shadowedScene.valid() )
+         it++;
+      else
+         it = _entries.erase( it );
+
+   // scale shadow map resolution
+   applyResolutionLimit();
+   adjustResolution();
+
+   // update statistics
+   ref_ptr< Stats > stats;
+   if( _viewerStats.lock( stats ) ) {
+      int i = 0;
+      for( EntryList::iterator it = _entries.begin(); it != _entries.end() && i < maxStatsLights; it++, i++ ) {
+         ref_ptr< osgShadow::ShadowedScene > ss;
+         if( !it->shadowedScene.lock( ss ) )
+            continue;
+         stats->setAttribute( frameNumber, statsAttributeName( i, "resolution" ),
+                              getTextureSize( ss->getShadowTechnique() ) );
+         stats->setAttribute( frameNumber, statsAttributeName( i, "updates" ),
+                              getNumUpdates( *it ) );
+      }
+   }
+}
+
+
+/**
+ * Halves the resolution of the largest shadow map if the frame time is over the budget,
+ * or doubles the resolution of the smallest shadow map if the frame time is well below the budget.
+ *
+ * The change of resolution is doubling (or halving) the number of texels
+ * rendered. Therefore, the resolution is increased only when the frame time is
+ * below half of the budget. After each change, the frame time is given some frames
+ * to reflect the change. The method expects _mutex to be locked.
+ */
+void ShadowMapManager::adjustResolution()
+{
+   if( _frameTimeBudget <= 0. || !_averageFrameTimeValid || _resolutionLimit > 0 )
+      return;
+
+   if( ++_framesSinceChange < 10 )
+      return;
+
+   bool decrease = _averageFrameTime > _frameTimeBudget;
+   bool increase = _averageFrameTime < 0.5 * _frameTimeBudget;
+   if( !decrease && !increase )
+      return;
+
+   // select the largest (or the smallest) shadow map
+   osgShadow::ShadowTechnique *selected = NULL;
+   int selectedSize = 0;
+   for( EntryList::iterator it = _entries.begin(); it != _entries.end(); it++ ) {
+      ref_ptr< osgShadow::ShadowedScene > ss;
+      if( !it->shadowedScene.lock( ss ) )
+         continue;
+      osgShadow::ShadowTechnique *t = ss->getShadowTechnique();
+      int size = getTextureSize( t );
+      if( size == 0 )
+         continue;
+      if( decrease && size > _minResolution && size > selectedSize ) {
+         selected = t;
+         selectedSize = size;
+      }
+      if( increase && size < _maxResolution && ( selectedSize == 0 || size < selectedSize ) ) {
+         selected = t;
+         selectedSize = size;
+      }
+   }
+   if( !selected )
+      return;
+
+   // change the resolution
+   int newSize = decrease ? max( selectedSize / 2, _minResolution ) : min( selectedSize * 2, _maxResolution );
+   setTextureSize( selected, newSize );
+   _framesSinceChange = 0;
+
+   notify( INFO ) << "ShadowMapManager: Frame time " << _averageFrameTime << "ms (budget "
+                  << _frameTimeBudget << "ms), shadow map resolution changed from "
+                  << selectedSize << " to " << newSize << "." << std::endl;
+}
+
+
+/**
+ * Applies the change of the resolution limit to all shadow maps.
+ * The original resolution of the limited shadow maps is stored in their entries,
+ * so it can be restored when the limit is removed. The method expects _mutex to be locked.
+ */
+void ShadowMapManager::applyResolutionLimit()
+{
+   if( !_resolutionLimitChanged )
+      return;
+   _resolutionLimitChanged = false;
+
+   for( EntryList::iterator it = _entries.begin(); it != _entries.end(); it++ ) {
+      ref_ptr< osgShadow::ShadowedScene > ss;
+      if( !it->shadowedScene.lock( ss ) )
+         continue;
+      osgShadow::ShadowTechnique *t = ss->getShadowTechnique();
+      int size = getTextureSize( t );
+      if( size == 0 )
+         continue;
+
+      if( _resolutionLimit > 0 ) {
+         if( size > _resolutionLimit ) {
+            if( it->unlimitedSize == 0 )
+               it->unlimitedSize = size;
+            setTextureSize( t, _resolutionLimit );
+         }
+      }
+      else
+         if( it->unlimitedSize != 0 ) {
+            setTextureSize( t, it->unlimitedSize );
+            it->unlimitedSize = 0;
+         }
+   }
+
+   // give the frame time some frames to reflect the change
+   _framesSinceChange = 0;
+}
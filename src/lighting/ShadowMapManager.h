@@ -0,0 +1,178 @@
+/**
+ * @file
+ * ShadowMapManager class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef SHADOW_MAP_MANAGER_H
+#define SHADOW_MAP_MANAGER_H
+
+#include <osg/observer_ptr>
+#include <osg/Timer>
+#include <osgShadow/ShadowMap>
+#include <OpenThreads/Mutex>
+#include <vector>
+#include "utils/ContentHash.h"
+
+namespace osg {
+   class Geometry;
+   class Stats;
+   class Switch;
+   class Transform;
+}
+
+namespace osgShadow {
+   class ShadowedScene;
+}
+
+namespace osgViewer {
+   class StatsHandler;
+}
+
+
+/**
+ * ShadowMap that renders its shadow texture only when something changed.
+ *
+ * The shadow camera view and projection matrices are computed by
+ * osgShadow::ShadowMap from the light position and direction and from
+ * the bounds of shadow casters. If they are the same as in the last rendering,
+ * the texture content is still valid and rendering of the shadow casters is skipped.
+ *
+ * Changes of the casters that do not affect the light nor the caster bounds
+ * (a caster moving or animated inside the scene) are detected in the update
+ * traversal by the signature of the shadowed subgraph: its bound, local matrices
+ * of its Transforms, values of its Switches and modified counts of vertex arrays
+ * of its DYNAMIC Geometries. The nodes are collected again when the bound changes.
+ * Other changes (e.g. a node added inside the bound) have to be announced
+ * by invalidate(). The signature is computed once per frame and only if
+ * any of these nodes were collected.
+ *
+ * The state shared by the update traversal and the cull callback
+ * of the shadow camera is protected by _mutex as they may run
+ * in different threads.
+ */
+class ManagedShadowMap : public osgShadow::ShadowMap
+{
+   typedef osgShadow::ShadowMap inherited;
+
+public:
+
+   ManagedShadowMap();
+   ManagedShadowMap( const ManagedShadowMap &msm, const osg::CopyOp &copyop = osg::CopyOp::SHALLOW_COPY );
+   META_Object( Lexolights, ManagedShadowMap );
+
+   virtual void init();
+   virtual void update( osg::NodeVisitor &nv );
+
+   void invalidate();
+   unsigned int getNumUpdates() const;
+
+protected:
+
+   class SkipUnchangedCallback;
+   friend class SkipUnchangedCallback;
+   class CasterCollector;
+   friend class CasterCollector;
+
+   ContentHash::Value computeCasterSignature() const;
+
+   bool _invalid;
+   osg::Matrix _renderedViewMatrix;
+   osg::Matrix _renderedProjectionMatrix;
+   unsigned int _numUpdates;
+   std::vector< osg::ref_ptr< osg::Transform > > _casterTransforms;
+   std::vector< osg::ref_ptr< osg::Switch > > _casterSwitches;
+   std::vector< osg::ref_ptr< osg::Geometry > > _casterGeometries;
+   osg::BoundingSphere _casterBound;
+   ContentHash::Value _casterSignature;
+   unsigned int _signatureFrameNumber;
+   mutable OpenThreads::Mutex _mutex;
+
+};
+
+
+/**
+ * ShadowMapManager keeps track of all shadow maps of the displayed scene.
+ *
+ * It collects per-light statistics (texture resolution, number of shadow map
+ * renderings) and scales the shadow map resolution to keep the frame time
+ * under the frame time budget. When the frames take longer than the budget,
+ * resolution of the largest shadow map is halved. When the frames are well
+ * below the budget, resolution of the smallest shadow map is doubled up to
+ * the maximum resolution. The resolution may be temporarily limited
+ * by setResolutionLimit(), e.g. during the camera motion.
+ */
+class ShadowMapManager : public osg::Referenced
+{
+public:
+
+   static ShadowMapManager* instance();
+
+   void manage( osgShadow::ShadowedScene *shadowedScene );
+   void invalidateAll();
+
+   void setFrameTimeBudget( double milliseconds );
+   inline double getFrameTimeBudget() const;
+   void setResolutionRange( int minSize, int maxSize );
+   inline int getMinResolution() const;
+   inline int getMaxResolution() const;
+   void setResolutionLimit( int size );
+   inline int getResolutionLimit() const;
+   void reportFrameCompleted( unsigned int frameNumber );
+
+   void setViewerStats( osg::Stats *stats );
+   void addStatsLines( osgViewer::StatsHandler *statsHandler );
+
+   void update( unsigned int frameNumber );
+
+   static const int maxStatsLights = 4;
+
+protected:
+
+   ShadowMapManager();
+   virtual ~ShadowMapManager();
+
+   class ShadowedSceneCallback;
+
+   struct Entry {
+      osg::observer_ptr< osgShadow::ShadowedScene > shadowedScene;
+      osg::ref_ptr< ShadowedSceneCallback > callback;
+      int unlimitedSize;
+   };
+   typedef std::vector< Entry > EntryList;
+
+   static int getTextureSize( osgShadow::ShadowTechnique *technique );
+   static void setTextureSize( osgShadow::ShadowTechnique *technique, int size );
+   static unsigned int getNumUpdates( const Entry &e );
+   void adjustResolution();
+   void applyResolutionLimit();
+
+   EntryList _entries;
+   osg::observer_ptr< osg::Stats > _viewerStats;
+   double _frameTimeBudget;
+   int _minResolution;
+   int _maxResolution;
+   int _resolutionLimit;
+   bool _resolutionLimitChanged;
+   double _averageFrameTime;
+   bool _averageFrameTimeValid;
+   osg::Timer_t _frameStartTick;
+   unsigned int _lastFrameNumber;
+   unsigned int _framesSinceChange;
+   mutable OpenThreads::Mutex _mutex;
+
+};
+
+
+//
+//  inline methods
+//
+
+inline double ShadowMapManager::getFrameTimeBudget() const  { return _frameTimeBudget; }
+inline int ShadowMapManager::getMinResolution() const  { return _minResolution; }
+inline int ShadowMapManager::getMaxResolution() const  { return _maxResolution; }
+inline int ShadowMapManager::getResolutionLimit() const  { return _resolutionLimit; }
+
+
+#endif /* SHADOW_MAP_MANAGER_H */
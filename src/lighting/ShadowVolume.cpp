@@ -16,6 +16,7 @@
 #include <osg/StencilTwoSided>
 #include <osg/TriangleFunctor>
 #include <osg/GraphicsContext>
+#include <osg/Timer>
 #include <osgShadow/ShadowedScene>
 #include <osgViewer/ViewerBase>
 #include <osgViewer/View>
@@ -29,6 +30,7 @@
 //#include "RealizeOperation.h"
 
 #include "shader_utils.h"
+#include "utils/FrameCounters.h"
 
 using namespace osg;
 using namespace osgShadow;
@@ -482,9 +484,19 @@ void ShadowVolume::cull( osgUtil::CullVisitor& cv )
       _svgg.dirty();
 
    if(_svgg.isDirty()){
+          bool counting = FrameCounters::isActive();
+          Timer_t startTime = counting ? Timer::instance()->tick() : 0;
+
           //_svgg.clearGeometry();
           _svgg.setup(lightPos);
           _shadowedScene->Group::traverse( _svgg );
+
+          if( counting ) {
+             unsigned int frameNumber = cv.getFrameStamp()->getFrameNumber();
+             FrameCounters::add( frameNumber, FrameCounters::SHADOW_VOLUME_REBUILDS );
+             FrameCounters::add( frameNumber, FrameCounters::SHADOW_VOLUME_REBUILD_TIME,
+                                 Timer::instance()->delta_m( startTime, Timer::instance()->tick() ) );
+          }
    }
 
    if(_mode == ShadowVolumeGeometryGenerator::SILHOUETTES_ONLY){
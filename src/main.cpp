@@ -10,6 +10,8 @@
 #include <osgQt/GraphicsWindowQt>
 //#include "CadworkViewer.h"
 #include "utils/Log.h"
+#include "utils/FrameStatsWriter.h"
+#include "utils/LoadProfiler.h"
 
 #include <dtABC/application.h>
 #include <dtQt/qtguiwindowsystemwrapper.h>
@@ -21,6 +23,9 @@
 #include <dtCore/system.h>
 #include <dtQt/deltastepper.h>
 
+#include "BatchPreparation.h"
+#include "RenderBenchmark.h"
+#include "Lexolights.h"
 #include "LexoanimQtApp.h"
 #include "gui/LexoanimMainWindow.h"
 #include "Lexoanim.h"
@@ -38,7 +43,8 @@ USE_GRAPICSWINDOW_IMPLEMENTATION(Qt);
  * @param argc Number of parameters on the commandline.
  * @param argv Array that contains parameters passed from the commandline.
  *
- * @return QApplication::exec() result.
+ * @return QApplication::exec() result or the exit code of the batch preparation
+ * or of the rendering benchmark.
  */
 int main(int argc, char* argv[])
 {
@@ -54,8 +60,23 @@ int main(int argc, char* argv[])
    // including QString::fromAscii() and QString::fromStdString() functions
    QTextCodec::setCodecForCStrings( QTextCodec::codecForName( "UTF-8" ) );
 
+   // headless preparation of models
+   // (no GUI and no OpenGL context is created)
+   if( BatchPreparation::isRequested( argc, argv ) )
+      return BatchPreparation::run( argc, argv );
+
+   // headless rendering benchmark
+   // (renders into offscreen pbuffer, no window is created)
+   if( RenderBenchmark::isRequested( argc, argv ) )
+      return RenderBenchmark::run( argc, argv );
+
+   // profile the start and the model loading
+   // (stopped after the command line parsing if --load-profile is not given)
+   LoadProfiler::start();
+
    // Application object
    LexoanimQtApp lexoanimQtApp( argc, argv );
+   double guiStartTime = LoadProfiler::getTime();
 
    // set viewer used by Qt main loop
    //osgQt::setViewer( Lexolights::viewer() );
@@ -66,11 +87,33 @@ int main(int argc, char* argv[])
    LexoanimMainWindow mainWin(NULL, NULL, true);
 
    dtQt::QtGuiWindowSystemWrapper::EnableQtGUIWrapper();
-   dtCore::RefPtr<dtABC::Application> app = new LexoanimApp("neco.xml");
+   dtCore::RefPtr<LexoanimApp> app = new LexoanimApp("neco.xml");
    app->Config();
 
    mainWin.setDeltaApp(app);
 
+   // interactive frame time budget
+   const Options *options = Lexolights::options();
+   if( app->GetQualityController() )
+      app->GetQualityController()->setFrameTimeBudget( options->interactiveBudget );
+
+   // progressive refinement
+   if( app->GetProgressiveRefinement() ) {
+      app->GetProgressiveRefinement()->setNumSamples( options->progressiveSamples );
+      app->GetProgressiveRefinement()->setEnabled( options->progressiveRefinement );
+   }
+
+   // per-frame statistics
+   if( !options->frameStatsFile.isEmpty() ) {
+      osg::ref_ptr< FrameStatsWriter > frameStatsWriter = new FrameStatsWriter;
+      if( frameStatsWriter->open( options->frameStatsFile, options->frameStatsInterval,
+                                  app->GetCompositeViewer(), app->GetCamera()->GetOSGCamera() ) )
+         app->SetFrameStatsWriter( frameStatsWriter );
+      else
+         Log::warn() << "Error when opening frame statistics file '"
+                     << options->frameStatsFile << "'." << Log::endm;
+   }
+
 
    // Run GUI
    // (note: on some platforms, there is no guarantee that exec will return;
@@ -89,6 +132,7 @@ int main(int argc, char* argv[])
    //lexoanimQtApp.mainWindow()->setActiveCentralWidget(glWidget);
    glWidget->setGeometry( 0 , 0, glWidget->width(), glWidget->height());
    glWidget->setFocus();
+   LoadProfiler::record( "GUI build", "gui", guiStartTime );
 
 
    //mainWin.show();
@@ -100,6 +144,9 @@ int main(int argc, char* argv[])
    //qapp.exec();
    lexoanimQtApp.exec();
 
+   // write the load profile if it was not finished by the first frame of the model
+   LoadProfiler::finish();
+
    stepper.Stop();
    dtCore::System::GetInstance().Stop();
 
@@ -6,17 +6,33 @@
  * @author PCJohn (Jan Pečiva)
  */
 
+#include <osg/ComputeBoundsVisitor>
+#include <osg/Geode>
+#include <osg/LightSource>
+#include <osg/Timer>
+#include <osg/TriangleFunctor>
 #include <osgDB/Registry>
 #include <osgDB/FileUtils>
 #include <osgDB/FileNameUtils>
+#include <OpenThreads/ScopedLock>
+#include <cmath>
+#include <iterator>
+#include <vector>
 #include "CadworkReaderWriter.h"
+#include "IvxParser.h"
+#include "MappedFile.h"
 
+using namespace std;
 using namespace osg;
 using namespace osgDB;
 
 REGISTER_OSGPLUGIN( Cadwork, CadworkReaderWriter )
 
 
+// serializes the calls of Inventor plugin (Coin database is not thread-safe)
+static OpenThreads::Mutex inventorMutex;
+
+
 /**
  * Constructor.
  */
@@ -35,6 +51,21 @@ CadworkReaderWriter::~CadworkReaderWriter()
 }
 
 
+/**
+ * Returns the mutex serializing the reading by the Inventor plugin.
+ *
+ * Coin library used by the plugin is not thread-safe, so the models
+ * read by the plugin in parallel threads (see BatchPreparation)
+ * must be read one by one. CadworkReaderWriter locks the mutex
+ * before passing the data to the plugin, the files read
+ * by the plugin directly (iv extension) must be guarded by the caller.
+ */
+OpenThreads::Mutex* CadworkReaderWriter::getInventorMutex()
+{
+   return &inventorMutex;
+}
+
+
 void CadworkReaderWriter::createAliases()
 {
    Registry::instance()->addFileExtensionAlias( "ivx", "iv" );
@@ -96,6 +127,20 @@ ReaderWriter::ReadResult CadworkReaderWriter::readNode(
    ref_ptr< Options > myOptions = options ? new Options( *options ) : new Options;
    myOptions->getDatabasePathList().push_front( getFilePath( fileName ));
 
+   // load from memory-mapped file
+   // (the stream reads directly from the mapping, the file pages are read ahead by the system;
+   // "StreamRead" option string selects reading through ifstream)
+   if( !options || options->getOptionString().find( "StreamRead" ) == string::npos )
+   {
+      MappedFile mappedFile;
+      if( mappedFile.open( fileName ) ) {
+         MappedFile::Stream istream( mappedFile );
+         return readNode( istream, myOptions );
+      }
+      OSG_INFO << "CadworkReaderWriter: Failed to map file " << fileName
+               << " into the memory. Using ifstream instead." << endl;
+   }
+
    // load from ifstream
    osgDB::ifstream istream( fileName.c_str(), std::ios::in | std::ios::binary );
    return readNode( istream, myOptions );
@@ -116,11 +161,277 @@ ReaderWriter::ReadResult CadworkReaderWriter::readNode(
 {
    // get Inventor ReaderWriter
    ReaderWriter *rw = Registry::instance()->getReaderWriterForExtension( "iv" );
+
+   // native parser
+   if( options && options->getOptionString().find( "NativeIvx" ) != string::npos )
+   {
+      // get the data
+      // (memory-mapped stream is parsed in place, other streams are read into the buffer)
+      const char *data;
+      size_t size;
+      vector< char > buf;
+      MappedFile::StreamBuf *mappedBuf = dynamic_cast< MappedFile::StreamBuf* >( fin.rdbuf() );
+      if( mappedBuf ) {
+         data = mappedBuf->getReadPtr();
+         size = mappedBuf->getNumAvailable();
+      } else {
+         buf.assign( istreambuf_iterator< char >( fin ), istreambuf_iterator< char >() );
+         data = buf.empty() ? NULL : &buf[0];
+         size = buf.size();
+      }
+
+      IvxParser parser;
+      ref_ptr< Node > node = parser.parse( data, size );
+      if( node.valid() )
+         return node.release();
+
+      if( !parser.isUnsupported() || !rw )
+         return ReadResult( "CadworkReaderWriter: " + parser.getError() );
+
+      // fall back to Inventor plugin
+      OSG_INFO << "CadworkReaderWriter: " << parser.getError()
+               << ". Using Inventor plugin instead." << endl;
+      MappedFile::Stream stream( data, size );
+      OpenThreads::ScopedLock< OpenThreads::Mutex > lock( inventorMutex );
+      return rw->readNode( stream, options );
+   }
+
    if( !rw )
       return ReadResult( "Warning: Could not find "
             "Open Inventor plugin to handle loading of "
             "iv, ivx and ivl files." );
 
    // read the file by Inventor plugin
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( inventorMutex );
    return rw->readNode( fin, options );
 }
+
+
+/**
+ * Reads the whole stream in the same way as the Inventor plugin does
+ * and returns the number of bytes read.
+ */
+static size_t drainStream( istream &fin )
+{
+   vector< char > buf( 126*1024 );
+   size_t dataSize = 0;
+   while( !fin.eof() && fin.good() ) {
+      fin.read( &buf[0], buf.size() );
+      dataSize += size_t( fin.gcount() );
+   }
+   return dataSize;
+}
+
+
+/**
+ * Compares reading of the file through ifstream and through the memory mapping.
+ *
+ * For each of the two methods, the file is read cold (after the file is evicted
+ * from the system cache, if supported by the system) and warm (several times
+ * from the system cache). The time of reading the stream (I/O only)
+ * and the time of the whole readNode() including Inventor parsing is reported.
+ *
+ * Returns false if the file can not be read.
+ */
+bool CadworkReaderWriter::benchmark( const string &fileName, int numWarmRuns )
+{
+   ref_ptr< CadworkReaderWriter > rw = new CadworkReaderWriter;
+   const char *methodNames[2] = { "ifstream", "memory map" };
+   const char *optionStrings[2] = { "StreamRead", "" };
+
+   OSG_NOTICE << "CadworkReaderWriter benchmark of " << fileName << ":" << endl;
+   bool coldSupported = true;
+
+   for( int method=0; method<2; method++ )
+   {
+      ref_ptr< Options > options = new Options( optionStrings[method] );
+
+      // I/O only
+      Timer time;
+      bool cold = MappedFile::evictFromCache( fileName );
+      time.setStartTick();
+      size_t size;
+      if( method == 0 ) {
+         osgDB::ifstream fin( fileName.c_str(), std::ios::in | std::ios::binary );
+         size = drainStream( fin );
+      } else {
+         MappedFile mappedFile;
+         if( !mappedFile.open( fileName ) )
+            return false;
+         MappedFile::Stream fin( mappedFile );
+         size = drainStream( fin );
+      }
+      double ioTime = time.time_m();
+      coldSupported = coldSupported && cold;
+
+      // cold read
+      if( cold )
+         cold = MappedFile::evictFromCache( fileName );
+      time.setStartTick();
+      ReadResult r = rw->readNode( fileName, options );
+      double coldTime = time.time_m();
+      if( !r.success() ) {
+         OSG_WARN << "   Failed to read " << fileName << "." << endl;
+         return false;
+      }
+
+      // warm reads
+      double warmTime = 0.;
+      for( int i=0; i<numWarmRuns; i++ ) {
+         time.setStartTick();
+         rw->readNode( fileName, options );
+         warmTime += time.time_m();
+      }
+      if( numWarmRuns > 0 )
+         warmTime /= numWarmRuns;
+
+      OSG_NOTICE << "   " << methodNames[method] << ": "
+                 << "I/O " << ioTime << "ms (" << size / 1024 << "KiB, "
+                 << ( cold ? "cold" : "warm" ) << "), "
+                 << "readNode cold " << ( cold ? coldTime : -1. ) << "ms, "
+                 << "readNode warm " << warmTime << "ms (average of " << numWarmRuns << " runs)." << endl;
+   }
+
+   if( !coldSupported )
+      OSG_NOTICE << "   (cold reading is not supported on this system, -1 reported instead)" << endl;
+
+   return true;
+}
+
+
+
+namespace {
+
+struct TriangleSummary
+{
+   unsigned long long numTriangles;
+   double area;
+   TriangleSummary() : numTriangles( 0 ), area( 0. )  {}
+   inline void operator()( const Vec3 &v1, const Vec3 &v2, const Vec3 &v3, bool )
+   {
+      numTriangles++;
+      area += ( ( v2 - v1 ) ^ ( v3 - v1 ) ).length() * 0.5;
+   }
+};
+
+
+/**
+ * Collects the scene properties that should not depend on the way
+ * the scene was created. The triangle count and surface area are independent
+ * of the primitive types and of the vertex sharing, for instance.
+ */
+class SceneSummaryVisitor : public NodeVisitor
+{
+   typedef NodeVisitor inherited;
+
+public:
+
+   SceneSummaryVisitor() : inherited( TRAVERSE_ALL_CHILDREN ),
+                           numDrawables( 0 ), numLights( 0 ), numTransforms( 0 )  {}
+
+   virtual void apply( Geode &geode )
+   {
+      for( unsigned int i=0, c=geode.getNumDrawables(); i<c; i++ ) {
+         geode.getDrawable( i )->accept( triangles );
+         numDrawables++;
+      }
+      inherited::apply( geode );
+   }
+
+   virtual void apply( LightSource &node )
+   {
+      numLights++;
+      inherited::apply( node );
+   }
+
+   virtual void apply( Transform &node )
+   {
+      numTransforms++;
+      inherited::apply( node );
+   }
+
+   TriangleFunctor< TriangleSummary > triangles;
+   unsigned int numDrawables;
+   unsigned int numLights;
+   unsigned int numTransforms;
+};
+
+}
+
+
+/**
+ * Reads the file by IvxParser and by Inventor plugin and compares the results.
+ *
+ * The parse time, triangle count, surface area, number of drawables,
+ * lights and transformations and the bounding box are reported.
+ * Returns false if the file can not be read by any of the two ways
+ * or if the two scenes differ.
+ */
+bool CadworkReaderWriter::compareParsers( const string &fileName )
+{
+   ref_ptr< CadworkReaderWriter > rw = new CadworkReaderWriter;
+   const char *methodNames[2] = { "IvxParser", "Inventor plugin" };
+   SceneSummaryVisitor summary[2];
+   BoundingBox bbox[2];
+
+   OSG_NOTICE << "Comparison of IvxParser and Inventor plugin on " << fileName << ":" << endl;
+
+   MappedFile mappedFile;
+   if( !mappedFile.open( fileName ) ) {
+      OSG_WARN << "   Failed to open " << fileName << "." << endl;
+      return false;
+   }
+
+   for( int method=0; method<2; method++ )
+   {
+      Timer time;
+      ref_ptr< Node > node;
+      if( method == 0 ) {
+         IvxParser parser;
+         node = parser.parse( mappedFile.getData(), mappedFile.getSize() );
+         if( !node.valid() ) {
+            OSG_WARN << "   IvxParser failed: " << parser.getError() << "." << endl;
+            return false;
+         }
+      } else {
+         ref_ptr< Options > options = new Options;
+         options->getDatabasePathList().push_front( getFilePath( fileName ));
+         MappedFile::Stream fin( mappedFile );
+         ReadResult r = rw->readNode( fin, options );
+         node = r.getNode();
+         if( !node.valid() ) {
+            OSG_WARN << "   Inventor plugin failed to read the file." << endl;
+            return false;
+         }
+      }
+      double t = time.time_m();
+
+      node->accept( summary[method] );
+      ComputeBoundsVisitor cbv;
+      node->accept( cbv );
+      bbox[method] = cbv.getBoundingBox();
+
+      OSG_NOTICE << "   " << methodNames[method] << ": " << t << "ms, "
+                 << summary[method].triangles.numTriangles << " triangles, "
+                 << "area " << summary[method].triangles.area << ", "
+                 << summary[method].numDrawables << " drawables, "
+                 << summary[method].numLights << " lights, "
+                 << summary[method].numTransforms << " transforms, "
+                 << "bounding box (" << bbox[method]._min << ") - (" << bbox[method]._max << ")." << endl;
+   }
+
+   // compare
+   // (the area and bounding box are compared with the tolerance of float rounding)
+   double size = ( bbox[1]._max - bbox[1]._min ).length();
+   double eps = size * 1e-5;
+   bool same = summary[0].triangles.numTriangles == summary[1].triangles.numTriangles &&
+               fabs( summary[0].triangles.area - summary[1].triangles.area ) <=
+                     summary[1].triangles.area * 1e-4 &&
+               summary[0].numLights == summary[1].numLights &&
+               ( bbox[0]._min - bbox[1]._min ).length() <= eps &&
+               ( bbox[0]._max - bbox[1]._max ).length() <= eps;
+
+   OSG_NOTICE << "   " << ( same ? "The scenes match." : "The scenes DIFFER." )
+              << " (Drawable and transformation counts may differ because of different scene structure.)" << endl;
+   return same;
+}
@@ -9,6 +9,7 @@
 #define CADWORK_READER_WRITER_H
 
 #include <osgDB/ReaderWriter>
+#include <OpenThreads/Mutex>
 
 
 /**
@@ -27,6 +28,15 @@
  * This plugin helps OSG to handle Cadwork file extension
  * while the plugin just forwards all the requests
  * to the original OSG Inventor plugin.
+ *
+ * The files are memory-mapped and passed to the Inventor plugin
+ * as std::istream reading directly from the mapping (see MappedFile).
+ * "StreamRead" option string selects reading through osgDB::ifstream instead.
+ *
+ * "NativeIvx" option string makes the ASCII files to be parsed by IvxParser
+ * that handles the subset of Inventor used by Cadwork exports and builds
+ * OSG geometry directly. Files that use anything else are read
+ * by the Inventor plugin.
  */
 class CadworkReaderWriter : public osgDB::ReaderWriter
 {
@@ -39,6 +49,9 @@ public:
    virtual const char* className() const { return "Cadwork Reader/Writer"; }
 
    static void createAliases();
+   static OpenThreads::Mutex* getInventorMutex();
+   static bool benchmark( const std::string &fileName, int numWarmRuns = 3 );
+   static bool compareParsers( const std::string &fileName );
 
    virtual osgDB::ReaderWriter::ReadResult readObject(
          const std::string &file, const Options *opt ) const;
@@ -0,0 +1,47 @@
+/**
+ * @file
+ * CancellationToken class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef CANCELLATION_TOKEN_H
+#define CANCELLATION_TOKEN_H
+
+#include <osg/Referenced>
+#include <QAtomicInt>
+
+
+/**
+ * Flag for cooperative cancellation of the long running operations.
+ *
+ * The token is shared by the operation and everybody who may cancel it.
+ * cancel() may be called from any thread. The operation checks isCanceled()
+ * between its stages and inside of its long loops and traversals
+ * and finishes as soon as possible when it returns true.
+ */
+class CancellationToken : public osg::Referenced
+{
+public:
+
+   CancellationToken() : _canceled( 0 )  {}
+
+   inline void cancel();
+   inline bool isCanceled() const;
+
+protected:
+
+   QAtomicInt _canceled;
+
+};
+
+
+//
+//  inline methods
+//
+
+inline void CancellationToken::cancel()  { _canceled = 1; }
+inline bool CancellationToken::isCanceled() const  { return _canceled != 0; }
+
+
+#endif /* CANCELLATION_TOKEN_H */
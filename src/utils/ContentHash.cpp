@@ -0,0 +1,40 @@
+/**
+ * @file
+ * ContentHash class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osgDB/fstream>
+#include <vector>
+#include "ContentHash.h"
+
+using namespace std;
+
+
+
+/**
+ * Computes the hash of the whole file content.
+ * Returns false if the file can not be read.
+ */
+bool ContentHash::hashFile( const std::string &fileName, Value &hash )
+{
+   osgDB::ifstream f( fileName.c_str(), ios::in | ios::binary );
+   if( !f.is_open() )
+      return false;
+
+   ContentHash h;
+   vector< char > buffer( 1 << 20 );
+   while( f ) {
+      f.read( &buffer[0], buffer.size() );
+      streamsize n = f.gcount();
+      if( n <= 0 )
+         break;
+      h.add( &buffer[0], size_t( n ) );
+   }
+   if( f.bad() )
+      return false;
+
+   hash = h.get();
+   return true;
+}
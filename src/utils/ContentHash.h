@@ -0,0 +1,77 @@
+/**
+ * @file
+ * ContentHash class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef CONTENT_HASH_H
+#define CONTENT_HASH_H
+
+#include <string>
+#include <cstddef>
+
+
+/**
+ * 64-bit content hash (FNV-1a).
+ *
+ * The hash is not cryptographic. It serves for detection
+ * of changed data, such as scene graph parts or files.
+ */
+class ContentHash
+{
+public:
+
+   typedef unsigned long long Value;
+
+   inline ContentHash();
+   inline ContentHash( Value seed );
+
+   inline void add( const void *data, size_t size );
+   template< typename T > inline void add( const T &value );
+   inline void add( const std::string &s );
+   inline void add( const char *s );
+
+   inline Value get() const;
+   static inline Value combine( Value h1, Value h2 );
+
+   static bool hashFile( const std::string &fileName, Value &hash );
+
+protected:
+   Value _value;
+   static const Value offsetBasis = 14695981039346656037ULL;
+   static const Value prime = 1099511628211ULL;
+};
+
+
+
+inline ContentHash::ContentHash() : _value( offsetBasis )  {}
+inline ContentHash::ContentHash( Value seed ) : _value( offsetBasis )  { add( seed ); }
+inline ContentHash::Value ContentHash::get() const  { return _value; }
+
+inline void ContentHash::add( const void *data, size_t size )
+{
+   const unsigned char *p = static_cast< const unsigned char* >( data );
+   const unsigned char *e = p + size;
+   Value h = _value;
+   for( ; p != e; p++ ) {
+      h ^= *p;
+      h *= prime;
+   }
+   _value = h;
+}
+
+template< typename T >
+inline void ContentHash::add( const T &value )  { add( &value, sizeof( T ) ); }
+inline void ContentHash::add( const std::string &s )  { add( s.size() ); add( s.data(), s.size() ); }
+inline void ContentHash::add( const char *s )  { add( std::string( s ? s : "" ) ); }
+
+inline ContentHash::Value ContentHash::combine( Value h1, Value h2 )
+{
+   ContentHash h( h1 );
+   h.add( h2 );
+   return h.get();
+}
+
+
+#endif /* CONTENT_HASH_H */
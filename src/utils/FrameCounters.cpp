@@ -0,0 +1,68 @@
+/**
+ * @file
+ * FrameCounters class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osg/Stats>
+#include <OpenThreads/Mutex>
+#include <OpenThreads/ScopedLock>
+#include "FrameCounters.h"
+
+using namespace osg;
+
+
+bool FrameCounters::_active = false;
+
+static OpenThreads::Mutex mutex;
+static observer_ptr< Stats > frameStats;
+
+// stats attribute names
+static const char *counterNames[FrameCounters::NUM_COUNTERS] = {
+   "PPL passes",
+   "Shadow volume rebuilds",
+   "Shadow volume rebuild time",
+   "Occluded nodes",
+};
+
+
+/**
+ * Sets the stats that receive the counters (usually viewer stats).
+ * NULL stops the counting.
+ */
+void FrameCounters::setStats( Stats *stats )
+{
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( mutex );
+   frameStats = stats;
+   _active = stats != NULL;
+}
+
+
+/**
+ * Returns the name of the stats attribute of the counter.
+ */
+const char* FrameCounters::getName( Counter counter )
+{
+   return counterNames[counter];
+}
+
+
+/**
+ * Adds value to the counter of the frame.
+ */
+void FrameCounters::add( unsigned int frameNumber, Counter counter, double value )
+{
+   if( !_active )
+      return;
+
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( mutex );
+   ref_ptr< Stats > stats;
+   if( !frameStats.lock( stats ) )
+      return;
+
+   double v;
+   if( stats->getAttribute( frameNumber, counterNames[counter], v ) )
+      value += v;
+   stats->setAttribute( frameNumber, counterNames[counter], value );
+}
@@ -0,0 +1,57 @@
+/**
+ * @file
+ * FrameCounters class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef FRAME_COUNTERS_H
+#define FRAME_COUNTERS_H
+
+namespace osg {
+   class Stats;
+};
+
+
+/**
+ * FrameCounters is the registry of per-frame counters of the rendering subsystems
+ * (per-pixel lighting passes, shadow volume rebuilds, occluded nodes,...).
+ *
+ * The counters are summed per frame into the viewer stats, so they appear
+ * next to the frame timing (see FrameStatsWriter). Counting is active only
+ * while the stats are set by setStats(). The subsystems are expected
+ * to check isActive() before they measure anything.
+ * add() may be called from any thread, e.g. from cull traversals.
+ */
+class FrameCounters
+{
+public:
+
+   enum Counter {
+      PPL_PASSES = 0,
+      SHADOW_VOLUME_REBUILDS,
+      SHADOW_VOLUME_REBUILD_TIME,
+      OCCLUDED_NODES,
+      NUM_COUNTERS
+   };
+
+   static void setStats( osg::Stats *stats );
+   static inline bool isActive();
+   static const char* getName( Counter counter );
+   static void add( unsigned int frameNumber, Counter counter, double value = 1. );
+
+protected:
+
+   static bool _active;
+
+};
+
+
+//
+//  inline methods
+//
+
+inline bool FrameCounters::isActive()  { return _active; }
+
+
+#endif /* FRAME_COUNTERS_H */
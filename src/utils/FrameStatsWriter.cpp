@@ -0,0 +1,194 @@
+/**
+ * @file
+ * FrameStatsWriter class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osg/Camera>
+#include <osg/Stats>
+#include <osgViewer/ViewerBase>
+#include "FrameStatsWriter.h"
+#include "FrameCounters.h"
+
+using namespace osg;
+
+
+// frames between the rendering and writing of the stats
+// (GPU times are available with a delay of a few frames;
+// the value must be lower than the stats history size)
+static const unsigned int statsDelay = 3;
+
+// rows written between flushes of the file
+static const int flushInterval = 60;
+
+// triangle primitives reported by the scene stats
+static const char *triangleAttributes[] = {
+   "Visible number of GL_TRIANGLES",
+   "Visible number of GL_TRIANGLE_STRIP",
+   "Visible number of GL_TRIANGLE_FAN",
+   NULL
+};
+
+
+/**
+ * Constructor.
+ */
+FrameStatsWriter::FrameStatsWriter()
+   : _interval( 1 ),
+     _numRows( 0 )
+{
+}
+
+
+/**
+ * Destructor.
+ */
+FrameStatsWriter::~FrameStatsWriter()
+{
+   close();
+}
+
+
+/**
+ * Opens the file, writes the header and starts the counting
+ * of FrameCounters in the viewer stats.
+ */
+bool FrameStatsWriter::open( const QString &fileName, int interval,
+                             osgViewer::ViewerBase *viewer, Camera *camera )
+{
+   close();
+
+   _file.setFileName( fileName );
+   if( !_file.open( QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text ) )
+      return false;
+   _stream.setDevice( &_file );
+   _interval = interval > 0 ? interval : 1;
+   _numRows = 0;
+
+   // header (time in seconds, the other times in milliseconds)
+   _stream << "frame,time,frameTime,eventTime,updateTime,cullTime,drawTime,gpuTime,"
+              "drawCalls,triangles,stateGraphs";
+   for( int i=0; i<FrameCounters::NUM_COUNTERS; i++ )
+      _stream << ",\"" << FrameCounters::getName( FrameCounters::Counter( i ) ) << "\"";
+   _stream << "\n";
+
+   _viewerStats = viewer->getViewerStats();
+   _camera = camera;
+   enableStats();
+   FrameCounters::setStats( viewer->getViewerStats() );
+   return true;
+}
+
+
+/**
+ * Stops the counting and closes the file.
+ */
+void FrameStatsWriter::close()
+{
+   if( !_file.isOpen() )
+      return;
+
+   FrameCounters::setStats( NULL );
+   _stream.flush();
+   _stream.setDevice( NULL );
+   _file.close();
+   _viewerStats = NULL;
+   _camera = NULL;
+}
+
+
+void FrameStatsWriter::enableStats()
+{
+   ref_ptr< Stats > viewerStats;
+   if( _viewerStats.lock( viewerStats ) ) {
+      viewerStats->collectStats( "frame_rate", true );
+      viewerStats->collectStats( "event", true );
+      viewerStats->collectStats( "update", true );
+   }
+
+   ref_ptr< Camera > camera;
+   Stats *cameraStats = _camera.lock( camera ) ? camera->getStats() : NULL;
+   if( cameraStats ) {
+      cameraStats->collectStats( "rendering", true );
+      cameraStats->collectStats( "gpu", true );
+      cameraStats->collectStats( "scene", true );
+   }
+}
+
+
+// appends the value of the attribute multiplied by the scale
+// (empty value if the attribute is not available)
+static void writeAttribute( QTextStream &stream, Stats *stats, unsigned int frameNumber,
+                            const char *name, double scale, int precision )
+{
+   double v;
+   stream << ",";
+   if( stats && stats->getAttribute( frameNumber, name, v ) )
+      stream << QString::number( v * scale, 'f', precision );
+}
+
+
+/**
+ * Writes the row of the frame rendered statsDelay frames before the given frame.
+ * Called after each frame.
+ */
+void FrameStatsWriter::frameCompleted( unsigned int frameNumber )
+{
+   if( !_file.isOpen() )
+      return;
+
+   ref_ptr< Stats > viewerStats;
+   if( !_viewerStats.lock( viewerStats ) )
+      return;
+
+   if( frameNumber < statsDelay )
+      return;
+   frameNumber -= statsDelay;
+   if( frameNumber % _interval != 0 )
+      return;
+
+   // StatsHandler switches the stats collection off when the stats are hidden
+   enableStats();
+
+   ref_ptr< Camera > camera;
+   Stats *cameraStats = _camera.lock( camera ) ? camera->getStats() : NULL;
+
+   _stream << frameNumber;
+   writeAttribute( _stream, viewerStats.get(), frameNumber, "Reference time", 1., 3 );
+   writeAttribute( _stream, viewerStats.get(), frameNumber, "Frame duration", 1000., 3 );
+   writeAttribute( _stream, viewerStats.get(), frameNumber, "Event traversal time taken", 1000., 3 );
+   writeAttribute( _stream, viewerStats.get(), frameNumber, "Update traversal time taken", 1000., 3 );
+   writeAttribute( _stream, cameraStats, frameNumber, "Cull traversal time taken", 1000., 3 );
+   writeAttribute( _stream, cameraStats, frameNumber, "Draw traversal time taken", 1000., 3 );
+   writeAttribute( _stream, cameraStats, frameNumber, "GPU draw time taken", 1000., 3 );
+   writeAttribute( _stream, cameraStats, frameNumber, "Visible number of drawables", 1., 0 );
+
+   // triangles of all the triangle primitives
+   double triangles = 0.;
+   bool trianglesValid = false;
+   for( int i=0; triangleAttributes[i]; i++ ) {
+      double v;
+      if( cameraStats && cameraStats->getAttribute( frameNumber, triangleAttributes[i], v ) ) {
+         triangles += v;
+         trianglesValid = true;
+      }
+   }
+   _stream << ",";
+   if( trianglesValid )
+      _stream << QString::number( triangles, 'f', 0 );
+
+   writeAttribute( _stream, cameraStats, frameNumber, "Number of StateGraphs", 1., 0 );
+
+   // subsystem counters
+   // (missing counter means that nothing was counted in the frame)
+   for( int i=0; i<FrameCounters::NUM_COUNTERS; i++ ) {
+      double v = 0.;
+      viewerStats->getAttribute( frameNumber, FrameCounters::getName( FrameCounters::Counter( i ) ), v );
+      _stream << "," << v;
+   }
+   _stream << "\n";
+
+   if( ++_numRows % flushInterval == 0 )
+      _stream.flush();
+}
@@ -0,0 +1,74 @@
+/**
+ * @file
+ * FrameStatsWriter class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef FRAME_STATS_WRITER_H
+#define FRAME_STATS_WRITER_H
+
+#include <osg/Referenced>
+#include <osg/observer_ptr>
+#include <QFile>
+#include <QTextStream>
+
+namespace osg {
+   class Camera;
+   class Stats;
+};
+namespace osgViewer {
+   class ViewerBase;
+};
+
+
+/**
+ * FrameStatsWriter continuously writes per-frame statistics to CSV file.
+ *
+ * Each row contains the event, update, cull, draw and GPU time, the number
+ * of drawables (draw calls), triangles and state graphs (state changes)
+ * rendered by the given camera, and the counters of the rendering subsystems
+ * (see FrameCounters). The data are taken from the viewer and camera stats
+ * a few frames later, when the GPU times are available.
+ * Every interval-th frame is written. frameCompleted() is expected
+ * to be called after each frame by the code driving the viewer.
+ */
+class FrameStatsWriter : public osg::Referenced
+{
+public:
+
+   FrameStatsWriter();
+
+   bool open( const QString &fileName, int interval,
+              osgViewer::ViewerBase *viewer, osg::Camera *camera );
+   void close();
+   inline bool isOpen() const;
+   inline const QString& getFileName() const;
+
+   void frameCompleted( unsigned int frameNumber );
+
+protected:
+
+   virtual ~FrameStatsWriter();
+
+   void enableStats();
+
+   osg::observer_ptr< osg::Stats > _viewerStats;
+   osg::observer_ptr< osg::Camera > _camera;
+   QFile _file;
+   QTextStream _stream;
+   int _interval;
+   int _numRows;
+
+};
+
+
+//
+//  inline methods
+//
+
+inline bool FrameStatsWriter::isOpen() const  { return _file.isOpen(); }
+inline const QString& FrameStatsWriter::getFileName() const  { return _file.fileName(); }
+
+
+#endif /* FRAME_STATS_WRITER_H */
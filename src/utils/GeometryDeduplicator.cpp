@@ -0,0 +1,311 @@
+/**
+ * @file
+ * GeometryDeduplicator class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osg/Geode>
+#include <OpenThreads/ScopedLock>
+#include <cstring>
+#include "utils/GeometryDeduplicator.h"
+#include "utils/ParallelKdTreeBuilder.h"
+
+using namespace osg;
+
+
+
+GeometryDeduplicator::GeometryDeduplicator()
+   : inherited( NODE_VISITOR, TRAVERSE_ALL_CHILDREN ),
+     _numReplaced( 0 ),
+     _memorySaved( 0 )
+{
+}
+
+
+// collects the geometries of the reference scene
+class ReferenceCollector : public NodeVisitor
+{
+public:
+   ReferenceCollector() : NodeVisitor( NODE_VISITOR, TRAVERSE_ALL_CHILDREN )  {}
+
+   virtual void apply( Geode &geode )
+   {
+      for( unsigned int i=0, c=geode.getNumDrawables(); i<c; i++ ) {
+         Geometry *g = geode.getDrawable( i )->asGeometry();
+         if( g && g->getDataVariance() != Object::DYNAMIC )
+            geometries.insert( g );
+      }
+      traverse( geode );
+   }
+
+   std::set< Geometry* > geometries;
+};
+
+
+/**
+ * Offers the Geometries of the scene for sharing with the visited scenes.
+ * The reference scene is not modified.
+ */
+void GeometryDeduplicator::addReferenceScene( Node *scene )
+{
+   ReferenceCollector collector;
+   scene->accept( collector );
+   for( std::set< Geometry* >::iterator it = collector.geometries.begin();
+        it != collector.geometries.end(); it++ )
+      _references.insert( GeometryMap::value_type( _hasher.getGeometryDataHash( *it ), *it ) );
+}
+
+
+/**
+ * Shares the data of the Geometry with the identical Geometry of the reference scenes.
+ * Returns the reference Geometry if it can replace the Geometry as a whole.
+ * Otherwise, the arrays, primitive sets and KdTree of the reference Geometry
+ * are given to the Geometry and NULL is returned.
+ */
+Geometry* GeometryDeduplicator::shareReference( Geometry *g )
+{
+   std::pair< GeometryMap::iterator, GeometryMap::iterator > range =
+         _references.equal_range( _hasher.getGeometryDataHash( g ) );
+   GeometryMap::iterator it;
+   for( it = range.first; it != range.second; it++ )
+      if( isIdenticalData( it->second.get(), g ) )
+         break;
+   if( it == range.second )
+      return NULL;
+
+   Geometry *r = it->second.get();
+   _memorySaved += getMemoryUsage( g );
+   if( isIdentical( r, g ) )
+      return r;
+
+   // share arrays and primitive sets
+   g->setVertexArray( r->getVertexArray() );
+   g->setNormalArray( r->getNormalArray() );
+   g->setColorArray( r->getColorArray() );
+   g->setSecondaryColorArray( r->getSecondaryColorArray() );
+   g->setFogCoordArray( r->getFogCoordArray() );
+   for( unsigned int i=0, c=r->getNumTexCoordArrays(); i<c; i++ )
+      g->setTexCoordArray( i, r->getTexCoordArray( i ) );
+   for( unsigned int i=0, c=r->getNumVertexAttribArrays(); i<c; i++ )
+      g->setVertexAttribArray( i, r->getVertexAttribArray( i ) );
+   for( unsigned int i=0, c=r->getNumPrimitiveSets(); i<c; i++ )
+      g->setPrimitiveSet( i, r->getPrimitiveSet( i ) );
+
+   // KdTree is built on the same data
+   // (it may be attached by the background KdTree build in the mean time)
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( ParallelKdTreeBuilder::getShapeMutex() );
+   g->setShape( r->getShape() );
+   return NULL;
+}
+
+
+void GeometryDeduplicator::apply( Geode &geode )
+{
+   if( isCanceled() )
+      return;
+
+   for( unsigned int i=0, c=geode.getNumDrawables(); i<c; i++ )
+   {
+      Geometry *g = dynamic_cast< Geometry* >( geode.getDrawable( i ) );
+      if( !g || !canBeShared( g ) )
+         continue;
+
+      // already processed (multi-parented Geometry or the shared instance)
+      // (the replacement chosen on the first occurrence is used in all the geodes)
+      ReplacementMap::iterator vit = _visited.find( g );
+      if( vit != _visited.end() ) {
+         if( vit->second != g )
+            geode.setDrawable( i, vit->second );
+         continue;
+      }
+
+      // identical Geometry of the reference scenes
+      if( !_references.empty() ) {
+         Geometry *r = shareReference( g );
+         if( r ) {
+            _numReplaced++;
+            _visited[ g ] = r;
+            geode.setDrawable( i, r );
+            continue;
+         }
+         if( !canBeShared( g ) ) {
+            _visited[ g ] = g;
+            continue;
+         }
+      }
+
+      // look for identical Geometry
+      ContentHash::Value hash = _hasher.getDrawableHash( g );
+      std::pair< GeometryMap::iterator, GeometryMap::iterator > range = _geometries.equal_range( hash );
+      GeometryMap::iterator it;
+      for( it = range.first; it != range.second; it++ )
+         if( isIdentical( it->second.get(), g ) )
+            break;
+
+      if( it == range.second ) {
+         _geometries.insert( GeometryMap::value_type( hash, g ) );
+         _visited[ g ] = g;
+      } else {
+         _memorySaved += getMemoryUsage( g );
+         _numReplaced++;
+         _visited[ g ] = it->second.get();
+         geode.setDrawable( i, it->second.get() );
+      }
+   }
+
+   traverse( geode );
+}
+
+
+bool GeometryDeduplicator::canBeShared( const Geometry *g )
+{
+   return g->getDataVariance() != Object::DYNAMIC &&
+          g->getUpdateCallback() == NULL && g->getEventCallback() == NULL &&
+          g->getCullCallback() == NULL && g->getDrawCallback() == NULL &&
+          g->getComputeBoundingBoxCallback() == NULL &&
+          g->getUserData() == NULL && g->getUserDataContainer() == NULL &&
+          g->getShape() == NULL;
+}
+
+
+static bool isIdenticalArray( const Array *a1, const Array *a2 )
+{
+   if( a1 == a2 )
+      return true;
+   if( !a1 || !a2 )
+      return false;
+   return a1->getType() == a2->getType() &&
+          a1->getNumElements() == a2->getNumElements() &&
+          a1->getDataSize() == a2->getDataSize() &&
+          a1->getNormalize() == a2->getNormalize() &&
+          memcmp( a1->getDataPointer(), a2->getDataPointer(), a1->getTotalDataSize() ) == 0;
+}
+
+
+static bool isIdenticalPrimitiveSet( const PrimitiveSet *p1, const PrimitiveSet *p2 )
+{
+   if( p1->getType() != p2->getType() || p1->getMode() != p2->getMode() ||
+       p1->getNumInstances() != p2->getNumInstances() )
+      return false;
+
+   switch( p1->getType() ) {
+      case PrimitiveSet::DrawArraysPrimitiveType: {
+         const DrawArrays *d1 = static_cast< const DrawArrays* >( p1 );
+         const DrawArrays *d2 = static_cast< const DrawArrays* >( p2 );
+         return d1->getFirst() == d2->getFirst() && d1->getCount() == d2->getCount();
+      }
+      case PrimitiveSet::DrawArrayLengthsPrimitiveType: {
+         const DrawArrayLengths *d1 = static_cast< const DrawArrayLengths* >( p1 );
+         const DrawArrayLengths *d2 = static_cast< const DrawArrayLengths* >( p2 );
+         return d1->getFirst() == d2->getFirst() && d1->asVector() == d2->asVector();
+      }
+      default:
+         return p1->getTotalDataSize() == p2->getTotalDataSize() &&
+                memcmp( p1->getDataPointer(), p2->getDataPointer(), p1->getTotalDataSize() ) == 0;
+   }
+}
+
+
+/**
+ * Returns true if the Geometries are identical, e.g. they have the same arrays,
+ * bindings, primitive sets and equal StateSets.
+ */
+bool GeometryDeduplicator::isIdentical( const Geometry *g1, const Geometry *g2 )
+{
+   if( g1 == g2 )
+      return true;
+
+   return g1->getName() == g2->getName() &&
+          _hasher.getStateSetHash( g1->getStateSet() ) == _hasher.getStateSetHash( g2->getStateSet() ) &&
+          isIdenticalStateSet( g1->getStateSet(), g2->getStateSet() ) &&
+          isIdenticalData( g1, g2 );
+}
+
+
+/**
+ * Returns true if the StateSets have the same modes, attributes, uniforms
+ * and rendering details. The attributes and uniforms are compared by their content.
+ */
+bool GeometryDeduplicator::isIdenticalStateSet( const StateSet *ss1, const StateSet *ss2 )
+{
+   if( ss1 == ss2 )
+      return true;
+   if( !ss1 || !ss2 )
+      return false;
+   return ss1->compare( *ss2, true ) == 0;
+}
+
+
+/**
+ * Returns true if the Geometries have the same arrays, bindings, primitive sets
+ * and the same way of rendering them. Their StateSets may differ.
+ */
+bool GeometryDeduplicator::isIdenticalData( const Geometry *g1, const Geometry *g2 )
+{
+   if( g1 == g2 )
+      return true;
+
+   // general properties
+   if( g1->getUseDisplayList() != g2->getUseDisplayList() ||
+       g1->getUseVertexBufferObjects() != g2->getUseVertexBufferObjects() )
+      return false;
+
+   // arrays
+   if( !isIdenticalArray( g1->getVertexArray(), g2->getVertexArray() ) ||
+       !isIdenticalArray( g1->getNormalArray(), g2->getNormalArray() ) ||
+       g1->getNormalBinding() != g2->getNormalBinding() ||
+       !isIdenticalArray( g1->getColorArray(), g2->getColorArray() ) ||
+       g1->getColorBinding() != g2->getColorBinding() ||
+       !isIdenticalArray( g1->getSecondaryColorArray(), g2->getSecondaryColorArray() ) ||
+       g1->getSecondaryColorBinding() != g2->getSecondaryColorBinding() ||
+       !isIdenticalArray( g1->getFogCoordArray(), g2->getFogCoordArray() ) ||
+       g1->getFogCoordBinding() != g2->getFogCoordBinding() ||
+       g1->getNumTexCoordArrays() != g2->getNumTexCoordArrays() ||
+       g1->getNumVertexAttribArrays() != g2->getNumVertexAttribArrays() )
+      return false;
+   for( unsigned int i=0, c=g1->getNumTexCoordArrays(); i<c; i++ )
+      if( !isIdenticalArray( g1->getTexCoordArray( i ), g2->getTexCoordArray( i ) ) )
+         return false;
+   for( unsigned int i=0, c=g1->getNumVertexAttribArrays(); i<c; i++ )
+      if( !isIdenticalArray( g1->getVertexAttribArray( i ), g2->getVertexAttribArray( i ) ) ||
+          g1->getVertexAttribBinding( i ) != g2->getVertexAttribBinding( i ) )
+         return false;
+
+   // primitive sets
+   if( g1->getNumPrimitiveSets() != g2->getNumPrimitiveSets() )
+      return false;
+   for( unsigned int i=0, c=g1->getNumPrimitiveSets(); i<c; i++ )
+      if( !isIdenticalPrimitiveSet( g1->getPrimitiveSet( i ), g2->getPrimitiveSet( i ) ) )
+         return false;
+
+   return true;
+}
+
+
+/**
+ * Returns the memory used by the arrays and primitive sets of the Geometry in bytes.
+ */
+unsigned long long GeometryDeduplicator::getMemoryUsage( const Geometry *g )
+{
+   unsigned long long size = sizeof( Geometry );
+
+   // arrays
+   const Array *arrays[] = { g->getVertexArray(), g->getNormalArray(), g->getColorArray(),
+                             g->getSecondaryColorArray(), g->getFogCoordArray() };
+   for( unsigned int i=0; i<sizeof( arrays ) / sizeof( arrays[0] ); i++ )
+      if( arrays[i] )
+         size += arrays[i]->getTotalDataSize();
+   for( unsigned int i=0, c=g->getNumTexCoordArrays(); i<c; i++ )
+      if( g->getTexCoordArray( i ) )
+         size += g->getTexCoordArray( i )->getTotalDataSize();
+   for( unsigned int i=0, c=g->getNumVertexAttribArrays(); i<c; i++ )
+      if( g->getVertexAttribArray( i ) )
+         size += g->getVertexAttribArray( i )->getTotalDataSize();
+
+   // primitive sets
+   for( unsigned int i=0, c=g->getNumPrimitiveSets(); i<c; i++ )
+      size += g->getPrimitiveSet( i )->getTotalDataSize();
+
+   return size;
+}
@@ -0,0 +1,99 @@
+/**
+ * @file
+ * GeometryDeduplicator class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef GEOMETRY_DEDUPLICATOR_H
+#define GEOMETRY_DEDUPLICATOR_H
+
+#include <osg/Geometry>
+#include <osg/NodeVisitor>
+#include <map>
+#include <set>
+#include "utils/CancellationToken.h"
+#include "utils/SceneHashVisitor.h"
+
+
+/**
+ * GeometryDeduplicator replaces identical copies of Geometries
+ * by a single shared Geometry.
+ *
+ * CAD models often contain the same part many times, each time
+ * with its own copy of vertex arrays placed under its own transformation.
+ * The visitor hashes each Geometry (its arrays, primitive sets and StateSet,
+ * see SceneHashVisitor::getDrawableHash()) and the Geometries with
+ * the same hash are compared: arrays and primitive sets byte by byte,
+ * StateSets by StateSet::compare() including the attribute contents,
+ * so a hash collision never merges different Geometries. The identical copies
+ * are replaced in their Geodes by the first instance, so the Geometry
+ * is shared by all the Geodes and rendered under their transformations.
+ *
+ * Geometries with callbacks, user data, shapes or DYNAMIC data variance
+ * are not touched.
+ *
+ * Geometries of another scene can be offered for sharing by addReferenceScene()
+ * (e.g. the converted scene when the original scene is read again from the scene cache).
+ * Identical Geometries are replaced by them, Geometries differing only
+ * in their StateSets share their arrays, primitive sets and KdTrees.
+ *
+ * The traversal stops when the cancellation token is canceled
+ * (see setCancellationToken()).
+ */
+class GeometryDeduplicator : public osg::NodeVisitor
+{
+   typedef osg::NodeVisitor inherited;
+
+public:
+
+   GeometryDeduplicator();
+
+   META_NodeVisitor( "Lexolights", "GeometryDeduplicator" )
+
+   virtual void apply( osg::Geode &geode );
+
+   void addReferenceScene( osg::Node *scene );
+
+   inline unsigned int getNumGeometries() const;
+   inline unsigned int getNumReplaced() const;
+   inline unsigned long long getMemorySaved() const;
+
+   inline void setCancellationToken( CancellationToken *token );
+   inline bool isCanceled() const;
+
+   bool isIdentical( const osg::Geometry *g1, const osg::Geometry *g2 );
+   static bool isIdenticalData( const osg::Geometry *g1, const osg::Geometry *g2 );
+   static bool isIdenticalStateSet( const osg::StateSet *ss1, const osg::StateSet *ss2 );
+   static unsigned long long getMemoryUsage( const osg::Geometry *g );
+
+protected:
+
+   static bool canBeShared( const osg::Geometry *g );
+   osg::Geometry* shareReference( osg::Geometry *g );
+
+   SceneHashVisitor _hasher;
+   typedef std::multimap< ContentHash::Value, osg::ref_ptr< osg::Geometry > > GeometryMap;
+   GeometryMap _geometries;
+   GeometryMap _references;  // geometries of the reference scenes by their data hashes
+   typedef std::map< osg::ref_ptr< osg::Geometry >, osg::Geometry* > ReplacementMap;
+   ReplacementMap _visited;
+   unsigned int _numReplaced;
+   unsigned long long _memorySaved;
+   osg::ref_ptr< CancellationToken > _cancellationToken;
+
+};
+
+
+//
+//  inline methods
+//
+
+inline unsigned int GeometryDeduplicator::getNumGeometries() const  { return (unsigned int)( _visited.size() ); }
+inline unsigned int GeometryDeduplicator::getNumReplaced() const  { return _numReplaced; }
+inline unsigned long long GeometryDeduplicator::getMemorySaved() const  { return _memorySaved; }
+inline void GeometryDeduplicator::setCancellationToken( CancellationToken *token )  { _cancellationToken = token; }
+inline bool GeometryDeduplicator::isCanceled() const  { return _cancellationToken.valid() && _cancellationToken->isCanceled(); }
+
+
+#endif /* GEOMETRY_DEDUPLICATOR_H */
@@ -0,0 +1,1075 @@
+/**
+ * @file
+ * IvxParser class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osg/CullFace>
+#include <osg/Geode>
+#include <osg/LightModel>
+#include <osg/LightSource>
+#include <osg/Material>
+#include <osg/MatrixTransform>
+#include <osg/TriangleIndexFunctor>
+#include <osgUtil/SmoothingVisitor>
+#include <osgUtil/Tessellator>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include "IvxParser.h"
+
+using namespace std;
+using namespace osg;
+
+
+
+IvxParser::IvxParser()
+   : _begin( NULL ),
+     _p( NULL ),
+     _end( NULL ),
+     _unsupported( false ),
+     _numLights( 0 )
+{
+}
+
+
+/**
+ * Returns true if the data starts by the header of Inventor 2.x ASCII file.
+ */
+bool IvxParser::isAsciiInventor( const char *data, size_t size )
+{
+   static const char header[] = "#Inventor V2.";
+   const size_t headerLen = sizeof( header ) - 1;
+   if( size < headerLen + 7 || strncmp( data, header, headerLen ) != 0 )
+      return false;
+
+   // find " ascii" at the rest of the first line
+   const char *p = data + headerLen;
+   const char *end = data + size;
+   while( p < end && *p != '\n' && *p != '\r' ) {
+      if( end - p >= 6 && strncmp( p, " ascii", 6 ) == 0 )
+         return true;
+      p++;
+   }
+   return false;
+}
+
+
+/**
+ * Parses the file content and returns the created scene graph.
+ *
+ * Returns NULL if the file is not valid or if it uses Inventor features
+ * outside of the supported subset. The reason can be retrieved by getError()
+ * and isUnsupported() distinguishes the two cases.
+ */
+Node* IvxParser::parse( const char *data, size_t size )
+{
+   _begin = data;
+   _p = data;
+   _end = data + size;
+   _error.clear();
+   _unsupported = false;
+   _numLights = 0;
+   _defs.clear();
+
+   if( !isAsciiInventor( data, size ) ) {
+      unsupported( "file header (only Inventor V2.x ascii files are supported)" );
+      return NULL;
+   }
+
+   // skip header line
+   while( _p < _end && *_p != '\n' )
+      _p++;
+
+   // top level state
+   ref_ptr< Group > root = new Group;
+   State state;
+   state.group = root.get();
+   state.creaseAngle = 0.f;
+   state.solid = false;
+   state.convex = true;
+   state.vertexOrdering = 0;
+
+   bool ok = readChildren( state, true );
+
+   _defs.clear();
+   _remap.clear();
+
+   if( !ok )
+      return NULL;
+
+   // Inventor files usually contain a single top level Separator
+   if( root->getNumChildren() == 1 && root->getStateSet() == NULL &&
+       root->getChild( 0 )->asGroup() != NULL ) {
+      ref_ptr< Node > child = root->getChild( 0 );
+      root->removeChildren( 0, 1 );
+      return child.release();
+   }
+
+   return root.release();
+}
+
+
+bool IvxParser::error( const string &message )
+{
+   // line number for the error message
+   int line = 1;
+   for( const char *p = _begin; p < _p && p < _end; p++ )
+      if( *p == '\n' )
+         line++;
+
+   ostringstream s;
+   s << message << " (line " << line << ")";
+   _error = s.str();
+   return false;
+}
+
+
+bool IvxParser::unsupported( const string &what )
+{
+   _unsupported = true;
+   return error( "Unsupported " + what );
+}
+
+
+bool IvxParser::State::hasSameShapeState( const State &s ) const
+{
+   return material == s.material && coords == s.coords &&
+          creaseAngle == s.creaseAngle && solid == s.solid &&
+          convex == s.convex && vertexOrdering == s.vertexOrdering;
+}
+
+
+
+//
+//  tokenizer
+//
+
+/**
+ * Skips white spaces, commas and comments.
+ */
+void IvxParser::skipWhitespace()
+{
+   while( _p < _end ) {
+      char c = *_p;
+      if( c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == ',' )
+         _p++;
+      else if( c == '#' )
+         while( _p < _end && *_p != '\n' )
+            _p++;
+      else
+         break;
+   }
+}
+
+
+/**
+ * Skips white spaces and consumes the character c if it follows.
+ */
+bool IvxParser::nextIs( char c )
+{
+   skipWhitespace();
+   if( _p < _end && *_p == c ) {
+      _p++;
+      return true;
+   }
+   return false;
+}
+
+
+bool IvxParser::expect( char c )
+{
+   if( nextIs( c ) )
+      return true;
+   return error( string( "Expected '" ) + c + "'" );
+}
+
+
+bool IvxParser::readWord( string &word )
+{
+   skipWhitespace();
+   const char *start = _p;
+   while( _p < _end ) {
+      char c = *_p;
+      if( c == ' ' || c == '\n' || c == '\r' || c == '\t' || c == ',' ||
+          c == '{' || c == '}' || c == '[' || c == ']' || c == '#' || c == '"' )
+         break;
+      _p++;
+   }
+   if( _p == start )
+      return error( _p < _end ? "Expected name" : "Unexpected end of file" );
+   word.assign( start, _p );
+   return true;
+}
+
+
+bool IvxParser::readString( string &s )
+{
+   if( !expect( '"' ) )
+      return false;
+   s.clear();
+   while( _p < _end && *_p != '"' ) {
+      if( *_p == '\\' && _p+1 < _end )
+         _p++;
+      s += *_p;
+      _p++;
+   }
+   if( _p == _end )
+      return error( "Unterminated string" );
+   _p++;
+   return true;
+}
+
+
+// exact powers of ten representable by double
+static const double powersOf10[] = {
+   1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+
+/**
+ * Reads the float value.
+ *
+ * The number is parsed directly from the buffer with the mantissa accumulated
+ * in integer and scaled by the exact power of ten at the end. This is much faster
+ * than strtod() or stream extraction and it does not depend on the locale.
+ * Up to 19 significant digits are taken into account, which is still much more
+ * than the float precision.
+ */
+bool IvxParser::readFloat( float &f )
+{
+   skipWhitespace();
+   const char *p = _p;
+
+   bool negative = false;
+   if( p < _end && ( *p == '-' || *p == '+' ) ) {
+      negative = *p == '-';
+      p++;
+   }
+
+   unsigned long long mantissa = 0;
+   int exponent = 0;
+   int numDigits = 0;
+   bool hasDigits = false;
+
+   // integer part
+   for( ; p < _end && (unsigned char)( *p - '0' ) < 10; p++ ) {
+      hasDigits = true;
+      if( numDigits < 19 ) {
+         mantissa = mantissa*10 + ( *p - '0' );
+         if( mantissa != 0 )
+            numDigits++;
+      } else
+         exponent++;
+   }
+
+   // fractional part
+   if( p < _end && *p == '.' ) {
+      p++;
+      for( ; p < _end && (unsigned char)( *p - '0' ) < 10; p++ ) {
+         hasDigits = true;
+         if( numDigits < 19 ) {
+            mantissa = mantissa*10 + ( *p - '0' );
+            exponent--;
+            if( mantissa != 0 )
+               numDigits++;
+         }
+      }
+   }
+
+   if( !hasDigits )
+      return error( "Expected number" );
+
+   // exponent
+   if( p < _end && ( *p == 'e' || *p == 'E' ) ) {
+      const char *e = p + 1;
+      bool negativeExp = false;
+      if( e < _end && ( *e == '-' || *e == '+' ) ) {
+         negativeExp = *e == '-';
+         e++;
+      }
+      if( e < _end && (unsigned char)( *e - '0' ) < 10 ) {
+         int exp = 0;
+         for( ; e < _end && (unsigned char)( *e - '0' ) < 10; e++ )
+            if( exp < 10000 )
+               exp = exp*10 + ( *e - '0' );
+         exponent += negativeExp ? -exp : exp;
+         p = e;
+      }
+   }
+
+   double v = double( mantissa );
+   if( mantissa != 0 && exponent != 0 ) {
+      if( exponent > 0 && exponent <= 22 )
+         v *= powersOf10[exponent];
+      else if( exponent < 0 && exponent >= -22 )
+         v /= powersOf10[-exponent];
+      else
+         v *= pow( 10., exponent );
+   }
+
+   f = float( negative ? -v : v );
+   _p = p;
+   return true;
+}
+
+
+bool IvxParser::readInt( int &i )
+{
+   skipWhitespace();
+   const char *p = _p;
+
+   bool negative = false;
+   if( p < _end && ( *p == '-' || *p == '+' ) ) {
+      negative = *p == '-';
+      p++;
+   }
+   if( p == _end || (unsigned char)( *p - '0' ) >= 10 )
+      return error( "Expected integer" );
+
+   int v = 0;
+   for( ; p < _end && (unsigned char)( *p - '0' ) < 10; p++ )
+      v = v*10 + ( *p - '0' );
+
+   i = negative ? -v : v;
+   _p = p;
+   return true;
+}
+
+
+bool IvxParser::readBool( bool &b )
+{
+   string word;
+   if( !readWord( word ) )
+      return false;
+   if( word == "TRUE" || word == "1" )
+      b = true;
+   else if( word == "FALSE" || word == "0" )
+      b = false;
+   else
+      return error( "Expected boolean value" );
+   return true;
+}
+
+
+bool IvxParser::readVec3( Vec3 &v )
+{
+   return readFloat( v[0] ) && readFloat( v[1] ) && readFloat( v[2] );
+}
+
+
+/**
+ * Reads multiple value field of Vec3 values.
+ * It is either a single value or the list of values in brackets.
+ */
+bool IvxParser::readVec3List( vector< Vec3 > &list )
+{
+   list.clear();
+   Vec3 v;
+   if( !nextIs( '[' ) ) {
+      if( !readVec3( v ) )
+         return false;
+      list.push_back( v );
+      return true;
+   }
+   while( !nextIs( ']' ) ) {
+      if( !readVec3( v ) )
+         return false;
+      list.push_back( v );
+   }
+   return true;
+}
+
+
+bool IvxParser::readFloatList( vector< float > &list )
+{
+   list.clear();
+   float f;
+   if( !nextIs( '[' ) ) {
+      if( !readFloat( f ) )
+         return false;
+      list.push_back( f );
+      return true;
+   }
+   while( !nextIs( ']' ) ) {
+      if( !readFloat( f ) )
+         return false;
+      list.push_back( f );
+   }
+   return true;
+}
+
+
+bool IvxParser::readIntList( vector< int > &list )
+{
+   list.clear();
+   int i;
+   if( !nextIs( '[' ) ) {
+      if( !readInt( i ) )
+         return false;
+      list.push_back( i );
+      return true;
+   }
+   while( !nextIs( ']' ) ) {
+      if( !readInt( i ) )
+         return false;
+      list.push_back( i );
+   }
+   return true;
+}
+
+
+
+//
+//  nodes
+//
+
+/**
+ * Reads children nodes until the closing brace
+ * (or until the end of file for the top level).
+ */
+bool IvxParser::readChildren( State &state, bool topLevel )
+{
+   string word;
+   while( true ) {
+      skipWhitespace();
+      if( _p == _end ) {
+         if( topLevel )
+            return true;
+         return error( "Unexpected end of file" );
+      }
+      if( !topLevel && nextIs( '}' ) )
+         return true;
+
+      if( !readWord( word ) || !readChild( word, state ) )
+         return false;
+   }
+}
+
+
+/**
+ * Reads the child node starting by the word that was already read.
+ * The word is the node type, DEF or USE.
+ */
+bool IvxParser::readChild( const string &word, State &state )
+{
+   if( word == "USE" ) {
+      string name;
+      return readWord( name ) && useNode( name, state );
+   }
+
+   string name;
+   string type = word;
+   if( word == "DEF" ) {
+      if( !readWord( name ) || !readWord( type ) )
+         return false;
+   }
+
+   if( !expect( '{' ) )
+      return false;
+
+   State defState = state;
+   ref_ptr< Object > defObject;
+   if( !readNode( type, name, state, defObject ) )
+      return false;
+
+   if( !name.empty() ) {
+      DefEntry &e = _defs[name];
+      e.type = type;
+      e.object = defObject;
+      e.state = defState;
+   }
+   return true;
+}
+
+
+/**
+ * Reads the node body. The opening brace was already read.
+ */
+bool IvxParser::readNode( const string &type, const string &name, State &state,
+                          ref_ptr< Object > &defObject )
+{
+   if( type == "Separator" )
+      return readSeparator( name, state, defObject );
+   if( type == "Material" ) {
+      if( !readMaterial( state ) )
+         return false;
+      defObject = state.material;
+      return true;
+   }
+   if( type == "Coordinate3" ) {
+      if( !readCoordinate3( state ) )
+         return false;
+      defObject = state.coords;
+      return true;
+   }
+   if( type == "ShapeHints" )
+      return readShapeHints( state );
+   if( type == "IndexedFaceSet" )
+      return readIndexedFaceSet( name, state, defObject );
+   if( type == "Transform" )
+      return readTransform( false, state, defObject );
+   if( type == "MatrixTransform" )
+      return readTransform( true, state, defObject );
+   if( type == "DirectionalLight" || type == "PointLight" || type == "SpotLight" )
+      return readLight( type, state, defObject );
+   if( type == "Info" )
+      return readInfo();
+
+   return unsupported( "node " + type );
+}
+
+
+/**
+ * Instantiates the node defined by DEF.
+ *
+ * Properties (Material, Coordinate3) can be used anywhere.
+ * Shapes and Separators are shared only if they are used in the same traversal
+ * state as they were defined, otherwise the result would differ from Inventor.
+ */
+bool IvxParser::useNode( const string &name, State &state )
+{
+   DefMap::iterator it = _defs.find( name );
+   if( it == _defs.end() )
+      return error( "Unknown node name " + name );
+
+   const DefEntry &e = it->second;
+   if( e.type == "Material" ) {
+      state.material = dynamic_cast< StateSet* >( e.object.get() );
+      return true;
+   }
+   if( e.type == "Coordinate3" ) {
+      state.coords = dynamic_cast< Vec3Array* >( e.object.get() );
+      return true;
+   }
+   if( e.type == "Transform" || e.type == "MatrixTransform" ) {
+      MatrixTransform *mt = dynamic_cast< MatrixTransform* >( e.object.get() );
+      ref_ptr< Object > dummy;
+      appendTransform( mt->getMatrix(), state, dummy );
+      return true;
+   }
+   if( e.type == "Separator" || e.type == "IndexedFaceSet" ) {
+      if( !e.state.hasSameShapeState( state ) )
+         return unsupported( "USE of " + name + " in a different traversal state" );
+      if( e.object.valid() )
+         state.group->addChild( dynamic_cast< Node* >( e.object.get() ) );
+      return true;
+   }
+   return unsupported( "USE of " + e.type );
+}
+
+
+bool IvxParser::readSeparator( const string &name, State &state, ref_ptr< Object > &defObject )
+{
+   ref_ptr< Group > group = new Group;
+   group->setName( name );
+
+   // Separator saves the traversal state
+   State childState = state;
+   childState.group = group.get();
+
+   // Separator fields
+   string word;
+   while( true ) {
+      if( nextIs( '}' ) )
+         break;
+      if( !readWord( word ) )
+         return false;
+      if( word == "renderCaching" || word == "boundingBoxCaching" ||
+          word == "renderCulling" || word == "pickCulling" ) {
+         if( !readWord( word ) )
+            return false;
+         continue;
+      }
+      if( !readChild( word, childState ) || !readChildren( childState, false ) )
+         return false;
+      break;
+   }
+
+   state.group->addChild( group.get() );
+   defObject = group;
+   return true;
+}
+
+
+bool IvxParser::readMaterial( State &state )
+{
+   // Inventor defaults
+   Vec3 ambient( 0.2f, 0.2f, 0.2f );
+   Vec3 diffuse( 0.8f, 0.8f, 0.8f );
+   Vec3 specular( 0.f, 0.f, 0.f );
+   Vec3 emissive( 0.f, 0.f, 0.f );
+   float shininess = 0.2f;
+   float transparency = 0.f;
+
+   // multiple values are used only by MaterialBinding that is not supported,
+   // so the first value is used as with the default OVERALL binding
+   string field;
+   vector< Vec3 > vl;
+   vector< float > fl;
+   while( !nextIs( '}' ) ) {
+      if( !readWord( field ) )
+         return false;
+      if( field == "ambientColor" || field == "diffuseColor" ||
+          field == "specularColor" || field == "emissiveColor" ) {
+         if( !readVec3List( vl ) )
+            return false;
+         if( vl.empty() )
+            continue;
+         if( field[0] == 'a' )  ambient = vl[0];
+         else if( field[0] == 'd' )  diffuse = vl[0];
+         else if( field[0] == 's' )  specular = vl[0];
+         else  emissive = vl[0];
+      } else
+      if( field == "shininess" || field == "transparency" ) {
+         if( !readFloatList( fl ) )
+            return false;
+         if( fl.empty() )
+            continue;
+         if( field[0] == 's' )  shininess = fl[0];
+         else  transparency = fl[0];
+      } else
+         return unsupported( "Material field " + field );
+   }
+
+   float alpha = 1.f - transparency;
+   ref_ptr< Material > m = new Material;
+   m->setAmbient( Material::FRONT_AND_BACK, Vec4( ambient, alpha ) );
+   m->setDiffuse( Material::FRONT_AND_BACK, Vec4( diffuse, alpha ) );
+   m->setSpecular( Material::FRONT_AND_BACK, Vec4( specular, alpha ) );
+   m->setEmission( Material::FRONT_AND_BACK, Vec4( emissive, alpha ) );
+   m->setShininess( Material::FRONT_AND_BACK, shininess * 128.f );
+
+   StateSet *ss = new StateSet;
+   ss->setAttributeAndModes( m.get(), StateAttribute::ON );
+   if( transparency > 0.f ) {
+      ss->setMode( GL_BLEND, StateAttribute::ON );
+      ss->setRenderingHint( StateSet::TRANSPARENT_BIN );
+   }
+   state.material = ss;
+   return true;
+}
+
+
+bool IvxParser::readCoordinate3( State &state )
+{
+   string field;
+   ref_ptr< Vec3Array > coords = new Vec3Array;
+   while( !nextIs( '}' ) ) {
+      if( !readWord( field ) )
+         return false;
+      if( field != "point" )
+         return unsupported( "Coordinate3 field " + field );
+      if( !readVec3List( coords->asVector() ) )
+         return false;
+   }
+   state.coords = coords;
+   return true;
+}
+
+
+bool IvxParser::readShapeHints( State &state )
+{
+   string field, value;
+   while( !nextIs( '}' ) ) {
+      if( !readWord( field ) )
+         return false;
+      if( field == "creaseAngle" ) {
+         if( !readFloat( state.creaseAngle ) )
+            return false;
+         continue;
+      }
+      if( !readWord( value ) )
+         return false;
+      if( field == "vertexOrdering" ) {
+         if( value == "UNKNOWN_ORDERING" )  state.vertexOrdering = 0;
+         else if( value == "COUNTERCLOCKWISE" )  state.vertexOrdering = 1;
+         else if( value == "CLOCKWISE" )  state.vertexOrdering = 2;
+         else  return unsupported( "vertexOrdering value " + value );
+      } else
+      if( field == "shapeType" ) {
+         if( value == "UNKNOWN_SHAPE_TYPE" )  state.solid = false;
+         else if( value == "SOLID" )  state.solid = true;
+         else  return unsupported( "shapeType value " + value );
+      } else
+      if( field == "faceType" ) {
+         if( value == "CONVEX" )  state.convex = true;
+         else if( value == "UNKNOWN_FACE_TYPE" )  state.convex = false;
+         else  return unsupported( "faceType value " + value );
+      } else
+         return unsupported( "ShapeHints field " + field );
+   }
+   return true;
+}
+
+
+bool IvxParser::readIndexedFaceSet( const string &name, State &state, ref_ptr< Object > &defObject )
+{
+   string field;
+   vector< int > coordIndex;
+   vector< int > ignoredIndex;
+   while( !nextIs( '}' ) ) {
+      if( !readWord( field ) )
+         return false;
+      if( field == "coordIndex" ) {
+         if( !readIntList( coordIndex ) )
+            return false;
+      } else
+      // the other indices are not used without Normal, TextureCoordinate2
+      // and MaterialBinding nodes, that are not supported
+      if( field == "materialIndex" || field == "normalIndex" || field == "textureCoordIndex" ) {
+         if( !readIntList( ignoredIndex ) )
+            return false;
+      } else
+      if( field == "vertexProperty" ) {
+         if( !readWord( field ) )
+            return false;
+         if( field != "NULL" )
+            return unsupported( "IndexedFaceSet vertexProperty" );
+      } else
+         return unsupported( "IndexedFaceSet field " + field );
+   }
+
+   if( coordIndex.empty() )
+      return true;
+   if( !state.coords.valid() )
+      return error( "IndexedFaceSet without coordinates" );
+
+   ref_ptr< Geometry > geometry = createGeometry( coordIndex, state );
+   if( !geometry.valid() )
+      return _error.empty();
+
+   ref_ptr< Geode > geode = new Geode;
+   geode->setName( name );
+   geode->setStateSet( getMaterialStateSet( state ) );
+   geode->addDrawable( geometry.get() );
+   state.group->addChild( geode.get() );
+   defObject = geode;
+   return true;
+}
+
+
+namespace {
+
+struct TriangleCollector {
+   vector< GLuint > *triangles;
+   inline void operator()( unsigned int p1, unsigned int p2, unsigned int p3 )
+   {
+      triangles->push_back( p1 );
+      triangles->push_back( p2 );
+      triangles->push_back( p3 );
+   }
+};
+
+}
+
+
+/**
+ * Creates the geometry of IndexedFaceSet.
+ *
+ * Only the coordinates referenced by the coordIndex are copied to the geometry.
+ * Convex faces are triangulated as fans, the other ones are tessellated.
+ * Returns NULL if there are no valid faces or on error.
+ */
+Geometry* IvxParser::createGeometry( const vector< int > &coordIndex, const State &state )
+{
+   const Vec3Array &coords = *state.coords;
+   int numCoords = int( coords.size() );
+   for( size_t i=0, c=coordIndex.size(); i<c; i++ )
+      if( coordIndex[i] >= numCoords || coordIndex[i] < -1 ) {
+         error( "IndexedFaceSet coordIndex out of range" );
+         return NULL;
+      }
+
+   if( _remap.size() < coords.size() )
+      _remap.resize( coords.size(), -1 );
+
+   ref_ptr< Vec3Array > vertices = new Vec3Array;
+   vector< GLuint > triangles;
+   triangles.reserve( coordIndex.size() * 3 / 2 );
+   ref_ptr< Geometry > polygons;
+   vector< GLuint > face;
+   bool clockwise = state.vertexOrdering == 2;
+
+   size_t i = 0, c = coordIndex.size();
+   while( i < c ) {
+
+      // collect face indices
+      face.clear();
+      for( ; i<c && coordIndex[i] >= 0; i++ ) {
+         int &r = _remap[coordIndex[i]];
+         if( r == -1 ) {
+            r = int( vertices->size() );
+            vertices->push_back( coords[coordIndex[i]] );
+         }
+         face.push_back( r );
+      }
+      i++;
+      if( face.size() < 3 )
+         continue;
+
+      // counterclockwise ordering is used by OSG
+      if( clockwise )
+         reverse( face.begin(), face.end() );
+
+      if( face.size() == 3 || state.convex )
+         for( size_t j=2; j<face.size(); j++ ) {
+            triangles.push_back( face[0] );
+            triangles.push_back( face[j-1] );
+            triangles.push_back( face[j] );
+         }
+      else {
+         if( !polygons.valid() )
+            polygons = new Geometry;
+         polygons->addPrimitiveSet( new DrawElementsUInt( PrimitiveSet::POLYGON, face.begin(), face.end() ) );
+      }
+   }
+
+   // reset remapping table for the next IndexedFaceSet
+   for( i=0; i<c; i++ )
+      if( coordIndex[i] >= 0 )
+         _remap[coordIndex[i]] = -1;
+
+   // tessellate non-convex faces
+   // (Tessellator may append new vertices to the vertex array)
+   if( polygons.valid() ) {
+      polygons->setVertexArray( vertices.get() );
+      ref_ptr< osgUtil::Tessellator > tessellator = new osgUtil::Tessellator;
+      tessellator->setTessellationType( osgUtil::Tessellator::TESS_TYPE_POLYGONS );
+      tessellator->setWindingType( osgUtil::Tessellator::TESS_WINDING_ODD );
+      tessellator->retessellatePolygons( *polygons );
+      TriangleIndexFunctor< TriangleCollector > collector;
+      collector.triangles = &triangles;
+      polygons->accept( collector );
+   }
+
+   if( triangles.empty() )
+      return NULL;
+
+   Geometry *geometry = new Geometry;
+   geometry->setStateSet( getShapeStateSet( state ) );
+
+   if( state.creaseAngle > 0.f ) {
+
+      // smooth normals (vertices are shared, smoothing splits them at creases)
+      geometry->setVertexArray( vertices.get() );
+      geometry->addPrimitiveSet( new DrawElementsUInt( PrimitiveSet::TRIANGLES,
+                                                       triangles.begin(), triangles.end() ) );
+      osgUtil::SmoothingVisitor::smooth( *geometry, state.creaseAngle );
+
+   } else {
+
+      // flat normals (each triangle has its own vertices)
+      Vec3Array *v = new Vec3Array;
+      Vec3Array *n = new Vec3Array;
+      v->reserve( triangles.size() );
+      n->reserve( triangles.size() );
+      for( size_t j=0, tc=triangles.size(); j<tc; j+=3 ) {
+         const Vec3 &a = ( *vertices )[triangles[j]];
+         const Vec3 &b = ( *vertices )[triangles[j+1]];
+         const Vec3 &c = ( *vertices )[triangles[j+2]];
+         Vec3 normal = ( b - a ) ^ ( c - a );
+         normal.normalize();
+         v->push_back( a );
+         v->push_back( b );
+         v->push_back( c );
+         n->push_back( normal );
+         n->push_back( normal );
+         n->push_back( normal );
+      }
+      geometry->setVertexArray( v );
+      geometry->setNormalArray( n );
+      geometry->setNormalBinding( Geometry::BIND_PER_VERTEX );
+      geometry->addPrimitiveSet( new DrawArrays( PrimitiveSet::TRIANGLES, 0, GLsizei( v->size() ) ) );
+
+   }
+
+   return geometry;
+}
+
+
+/**
+ * Returns the StateSet of the current Material.
+ * If no Material node was read yet, the StateSet of the default Inventor material is returned.
+ */
+StateSet* IvxParser::getMaterialStateSet( const State &state )
+{
+   if( state.material.valid() )
+      return state.material.get();
+
+   if( !_defaultMaterial.valid() ) {
+      Material *m = new Material;
+      m->setAmbient( Material::FRONT_AND_BACK, Vec4( 0.2f, 0.2f, 0.2f, 1.f ) );
+      m->setDiffuse( Material::FRONT_AND_BACK, Vec4( 0.8f, 0.8f, 0.8f, 1.f ) );
+      m->setSpecular( Material::FRONT_AND_BACK, Vec4( 0.f, 0.f, 0.f, 1.f ) );
+      m->setEmission( Material::FRONT_AND_BACK, Vec4( 0.f, 0.f, 0.f, 1.f ) );
+      m->setShininess( Material::FRONT_AND_BACK, 0.2f * 128.f );
+      _defaultMaterial = new StateSet;
+      _defaultMaterial->setAttributeAndModes( m, StateAttribute::ON );
+   }
+   return _defaultMaterial.get();
+}
+
+
+/**
+ * Returns the StateSet of shapes given by ShapeHints.
+ * Solid shapes with known vertex ordering use back face culling,
+ * the other ones are lit from both sides, as does Inventor.
+ */
+StateSet* IvxParser::getShapeStateSet( const State &state )
+{
+   if( state.solid && state.vertexOrdering != 0 ) {
+      if( !_solidStateSet.valid() ) {
+         _solidStateSet = new StateSet;
+         _solidStateSet->setAttributeAndModes( new CullFace( CullFace::BACK ), StateAttribute::ON );
+      }
+      return _solidStateSet.get();
+   } else {
+      if( !_twoSidedStateSet.valid() ) {
+         _twoSidedStateSet = new StateSet;
+         LightModel *lm = new LightModel;
+         lm->setTwoSided( true );
+         _twoSidedStateSet->setAttribute( lm );
+      }
+      return _twoSidedStateSet.get();
+   }
+}
+
+
+/**
+ * Appends MatrixTransform to the current group. As Inventor transformations
+ * affect all the following nodes of the Separator, the MatrixTransform
+ * becomes the parent of all the following nodes.
+ */
+void IvxParser::appendTransform( const Matrix &m, State &state, ref_ptr< Object > &defObject )
+{
+   MatrixTransform *mt = new MatrixTransform( m );
+   state.group->addChild( mt );
+   state.group = mt;
+   defObject = mt;
+}
+
+
+bool IvxParser::readTransform( bool matrixTransform, State &state, ref_ptr< Object > &defObject )
+{
+   Vec3 translation( 0.f, 0.f, 0.f );
+   Vec3 scaleFactor( 1.f, 1.f, 1.f );
+   Vec3 center( 0.f, 0.f, 0.f );
+   Vec3 axis( 0.f, 0.f, 1.f ), scaleAxis( 0.f, 0.f, 1.f );
+   float angle = 0.f, scaleAngle = 0.f;
+   Matrix matrix;
+
+   string field;
+   while( !nextIs( '}' ) ) {
+      if( !readWord( field ) )
+         return false;
+      bool ok;
+      if( matrixTransform ) {
+         if( field != "matrix" )
+            return unsupported( "MatrixTransform field " + field );
+         float f[16];
+         ok = true;
+         for( int i=0; i<16 && ok; i++ )
+            ok = readFloat( f[i] );
+         if( ok )
+            matrix.set( f );
+      } else
+      if( field == "translation" )  ok = readVec3( translation );
+      else if( field == "scaleFactor" )  ok = readVec3( scaleFactor );
+      else if( field == "center" )  ok = readVec3( center );
+      else if( field == "rotation" )  ok = readVec3( axis ) && readFloat( angle );
+      else if( field == "scaleOrientation" )  ok = readVec3( scaleAxis ) && readFloat( scaleAngle );
+      else
+         return unsupported( "Transform field " + field );
+      if( !ok )
+         return false;
+   }
+
+   if( !matrixTransform ) {
+      // Inventor matrix is T*C*R*SO*S*SO^-1*C^-1 (OSG multiplies in the reverse order)
+      Quat r( angle, axis );
+      Quat so( scaleAngle, scaleAxis );
+      matrix = Matrix::translate( -center ) * Matrix::rotate( so.inverse() ) *
+               Matrix::scale( scaleFactor ) * Matrix::rotate( so ) *
+               Matrix::rotate( r ) * Matrix::translate( center ) *
+               Matrix::translate( translation );
+   }
+
+   appendTransform( matrix, state, defObject );
+   return true;
+}
+
+
+bool IvxParser::readLight( const string &type, State &state, ref_ptr< Object > &defObject )
+{
+   // Inventor defaults
+   bool on = true;
+   float intensity = 1.f;
+   Vec3 color( 1.f, 1.f, 1.f );
+   Vec3 direction( 0.f, 0.f, -1.f );
+   Vec3 location( 0.f, 0.f, 1.f );
+   float dropOffRate = 0.f;
+   float cutOffAngle = 0.785398f;
+
+   string field;
+   while( !nextIs( '}' ) ) {
+      if( !readWord( field ) )
+         return false;
+      bool ok;
+      if( field == "on" )  ok = readBool( on );
+      else if( field == "intensity" )  ok = readFloat( intensity );
+      else if( field == "color" )  ok = readVec3( color );
+      else if( field == "direction" && type != "PointLight" )  ok = readVec3( direction );
+      else if( field == "location" && type != "DirectionalLight" )  ok = readVec3( location );
+      else if( field == "dropOffRate" && type == "SpotLight" )  ok = readFloat( dropOffRate );
+      else if( field == "cutOffAngle" && type == "SpotLight" )  ok = readFloat( cutOffAngle );
+      else
+         return unsupported( type + " field " + field );
+      if( !ok )
+         return false;
+   }
+
+   if( !on )
+      return true;
+
+   Light *light = new Light( _numLights++ );
+   light->setAmbient( Vec4( 0.f, 0.f, 0.f, 1.f ) );
+   light->setDiffuse( Vec4( color * intensity, 1.f ) );
+   light->setSpecular( Vec4( color * intensity, 1.f ) );
+   if( type == "DirectionalLight" )
+      light->setPosition( Vec4( -direction, 0.f ) );
+   else {
+      light->setPosition( Vec4( location, 1.f ) );
+      if( type == "SpotLight" ) {
+         light->setDirection( direction );
+         light->setSpotCutoff( RadiansToDegrees( cutOffAngle ) );
+         light->setSpotExponent( dropOffRate * 128.f );
+      }
+   }
+
+   // Inventor lights affect the following nodes of the Separator
+   LightSource *ls = new LightSource;
+   ls->setLight( light );
+   ls->setStateSetModes( *state.group->getOrCreateStateSet(), StateAttribute::ON );
+   state.group->addChild( ls );
+   defObject = ls;
+   return true;
+}
+
+
+bool IvxParser::readInfo()
+{
+   string field, s;
+   while( !nextIs( '}' ) ) {
+      if( !readWord( field ) )
+         return false;
+      if( field != "string" )
+         return unsupported( "Info field " + field );
+      if( !readString( s ) )
+         return false;
+   }
+   return true;
+}
@@ -0,0 +1,125 @@
+/**
+ * @file
+ * IvxParser class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef IVX_PARSER_H
+#define IVX_PARSER_H
+
+#include <osg/Array>
+#include <osg/Group>
+#include <osg/StateSet>
+#include <map>
+#include <string>
+#include <vector>
+
+
+/**
+ * Parser of the subset of Open Inventor ASCII format used by Cadwork exports.
+ *
+ * The parser reads Inventor 2.x ASCII files consisting of Separator,
+ * Material, Coordinate3, IndexedFaceSet, ShapeHints, Transform,
+ * MatrixTransform, DirectionalLight, PointLight, SpotLight and Info nodes
+ * including DEF and USE. It builds osg::Geometry directly without any
+ * intermediate Inventor scene graph.
+ *
+ * Files using anything outside of the subset (other nodes, fields,
+ * binary format) are refused by parse() and isUnsupported() returns true.
+ * Such files are expected to be read by the Inventor plugin instead.
+ */
+class IvxParser
+{
+public:
+
+   IvxParser();
+
+   osg::Node* parse( const char *data, size_t size );
+
+   inline const std::string& getError() const;
+   inline bool isUnsupported() const;
+
+   static bool isAsciiInventor( const char *data, size_t size );
+
+protected:
+
+   struct State {
+      osg::Group *group;
+      osg::ref_ptr< osg::StateSet > material;
+      osg::ref_ptr< osg::Vec3Array > coords;
+      float creaseAngle;
+      bool solid;
+      bool convex;
+      int vertexOrdering;  // 0 - unknown, 1 - counterclockwise, 2 - clockwise
+      bool hasSameShapeState( const State &s ) const;
+   };
+
+   struct DefEntry {
+      std::string type;
+      osg::ref_ptr< osg::Object > object;
+      State state;  // state at the place of DEF
+   };
+   typedef std::map< std::string, DefEntry > DefMap;
+
+   // tokenizer
+   void skipWhitespace();
+   bool nextIs( char c );
+   bool expect( char c );
+   bool readWord( std::string &word );
+   bool readString( std::string &s );
+   bool readFloat( float &f );
+   bool readInt( int &i );
+   bool readBool( bool &b );
+   bool readVec3( osg::Vec3 &v );
+   bool readVec3List( std::vector< osg::Vec3 > &list );
+   bool readFloatList( std::vector< float > &list );
+   bool readIntList( std::vector< int > &list );
+
+   // nodes
+   bool readChildren( State &state, bool topLevel );
+   bool readChild( const std::string &word, State &state );
+   bool readNode( const std::string &type, const std::string &name, State &state,
+                  osg::ref_ptr< osg::Object > &defObject );
+   bool useNode( const std::string &name, State &state );
+   bool readSeparator( const std::string &name, State &state, osg::ref_ptr< osg::Object > &defObject );
+   bool readMaterial( State &state );
+   bool readCoordinate3( State &state );
+   bool readShapeHints( State &state );
+   bool readIndexedFaceSet( const std::string &name, State &state, osg::ref_ptr< osg::Object > &defObject );
+   bool readTransform( bool matrixTransform, State &state, osg::ref_ptr< osg::Object > &defObject );
+   bool readLight( const std::string &type, State &state, osg::ref_ptr< osg::Object > &defObject );
+   bool readInfo();
+
+   void appendTransform( const osg::Matrix &m, State &state, osg::ref_ptr< osg::Object > &defObject );
+   osg::Geometry* createGeometry( const std::vector< int > &coordIndex, const State &state );
+   osg::StateSet* getMaterialStateSet( const State &state );
+   osg::StateSet* getShapeStateSet( const State &state );
+
+   bool error( const std::string &message );
+   bool unsupported( const std::string &what );
+
+   const char *_begin;
+   const char *_p;
+   const char *_end;
+   std::string _error;
+   bool _unsupported;
+   int _numLights;
+   DefMap _defs;
+   osg::ref_ptr< osg::StateSet > _defaultMaterial;
+   osg::ref_ptr< osg::StateSet > _solidStateSet;
+   osg::ref_ptr< osg::StateSet > _twoSidedStateSet;
+   std::vector< int > _remap;
+
+};
+
+
+//
+//  inline methods
+//
+
+inline const std::string& IvxParser::getError() const  { return _error; }
+inline bool IvxParser::isUnsupported() const  { return _unsupported; }
+
+
+#endif /* IVX_PARSER_H */
@@ -0,0 +1,86 @@
+/**
+ * @file
+ * LazyKdTreeIntersector class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osg/Geometry>
+#include <osg/KdTree>
+#include <osg/Timer>
+#include <osgUtil/IntersectionVisitor>
+#include "LazyKdTreeIntersector.h"
+#include "ParallelKdTreeBuilder.h"
+
+using namespace osg;
+using namespace osgUtil;
+
+
+
+LazyKdTreeIntersector::LazyKdTreeIntersector( const Vec3d &start, const Vec3d &end )
+   : inherited( start, end ),
+     _top( this )
+{
+   resetStatistics();
+}
+
+
+LazyKdTreeIntersector::LazyKdTreeIntersector( CoordinateFrame cf, double x, double y )
+   : inherited( cf, x, y ),
+     _top( this )
+{
+   resetStatistics();
+}
+
+
+/**
+ * Creates the intersector for the transformed subgraph.
+ *
+ * LineSegmentIntersector::clone() computes the segment in the coordinates
+ * of the subgraph. The result is used to create LazyKdTreeIntersector,
+ * so the KdTrees are built on demand in the transformed subgraphs as well.
+ */
+Intersector* LazyKdTreeIntersector::clone( IntersectionVisitor &iv )
+{
+   ref_ptr< Intersector > base = inherited::clone( iv );
+   LineSegmentIntersector *lsi = static_cast< LineSegmentIntersector* >( base.get() );
+
+   ref_ptr< LazyKdTreeIntersector > r = new LazyKdTreeIntersector( lsi->getStart(), lsi->getEnd() );
+   r->_parent = this;
+   r->_top = _top;
+   return r.release();
+}
+
+
+void LazyKdTreeIntersector::intersect( IntersectionVisitor &iv, Drawable *drawable )
+{
+   Geometry *geom = drawable->asGeometry();
+   if( !geom || !iv.getUseKdTreeWhenAvailable() ) {
+      inherited::intersect( iv, drawable );
+      return;
+   }
+
+   // the shape may be set by the background builder
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( ParallelKdTreeBuilder::getShapeMutex() );
+
+   if( !dynamic_cast< KdTree* >( geom->getShape() ) ) {
+
+      // do not build the tree if the segment misses the geometry
+      Vec3d s( _start ), e( _end );
+      if( !intersectAndClip( s, e, drawable->getBound() ) )
+         return;
+
+      // build KdTree
+      Timer time;
+      KdTree::BuildOptions buildOptions;
+      ref_ptr< KdTree > kdTree = new KdTree;
+      if( kdTree->build( buildOptions, geom ) ) {
+         geom->setShape( kdTree.get() );
+         _top->_numBuiltTrees++;
+         _top->_memoryUsage += ParallelKdTreeBuilder::getMemoryUsage( kdTree.get() );
+      }
+      _top->_buildTime += time.time_m();
+   }
+
+   inherited::intersect( iv, drawable );
+}
@@ -0,0 +1,66 @@
+/**
+ * @file
+ * LazyKdTreeIntersector class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef LAZY_KD_TREE_INTERSECTOR_H
+#define LAZY_KD_TREE_INTERSECTOR_H
+
+#include <osgUtil/LineSegmentIntersector>
+
+
+/**
+ * LineSegmentIntersector that builds missing KdTrees on demand.
+ *
+ * When the segment hits the bounding box of a geometry without KdTree,
+ * the tree is built before the intersection test, so the following
+ * intersections with the geometry are fast. It is used together with
+ * lazy KdTree building (--lazy-kdtree) when the trees are built
+ * in the background by ParallelKdTreeBuilder and some of them may not
+ * be finished yet. The geometry shapes are accessed under
+ * ParallelKdTreeBuilder::getShapeMutex() lock.
+ *
+ * The number of trees built by the intersection, the time spent by building
+ * and their memory are accumulated in the top-level intersector
+ * (intersectors cloned for the transformed subgraphs report to their parent).
+ */
+class LazyKdTreeIntersector : public osgUtil::LineSegmentIntersector
+{
+   typedef osgUtil::LineSegmentIntersector inherited;
+
+public:
+
+   LazyKdTreeIntersector( const osg::Vec3d &start, const osg::Vec3d &end );
+   LazyKdTreeIntersector( CoordinateFrame cf, double x, double y );
+
+   virtual osgUtil::Intersector* clone( osgUtil::IntersectionVisitor &iv );
+   virtual void intersect( osgUtil::IntersectionVisitor &iv, osg::Drawable *drawable );
+
+   inline unsigned int getNumBuiltTrees() const;
+   inline double getBuildTime() const;
+   inline unsigned long long getMemoryUsage() const;
+   inline void resetStatistics();
+
+protected:
+
+   LazyKdTreeIntersector *_top;
+   unsigned int _numBuiltTrees;
+   double _buildTime;
+   unsigned long long _memoryUsage;
+
+};
+
+
+//
+//  inline methods
+//
+
+inline unsigned int LazyKdTreeIntersector::getNumBuiltTrees() const  { return _numBuiltTrees; }
+inline double LazyKdTreeIntersector::getBuildTime() const  { return _buildTime; }
+inline unsigned long long LazyKdTreeIntersector::getMemoryUsage() const  { return _memoryUsage; }
+inline void LazyKdTreeIntersector::resetStatistics()  { _numBuiltTrees = 0; _buildTime = 0.; _memoryUsage = 0; }
+
+
+#endif /* LAZY_KD_TREE_INTERSECTOR_H */
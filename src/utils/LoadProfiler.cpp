@@ -0,0 +1,374 @@
+/**
+ * @file
+ * LoadProfiler class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osg/Timer>
+#include <OpenThreads/Mutex>
+#include <OpenThreads/ScopedLock>
+#include <map>
+#include <vector>
+#include <QFile>
+#include <QTextStream>
+#include <QThread>
+#include "LoadProfiler.h"
+#include "BuildTime.h"
+#include "Log.h"
+
+using namespace std;
+using namespace osg;
+
+
+bool LoadProfiler::_active = false;
+
+
+struct ProfileEvent {
+   const char *name;
+   const char *category;
+   double startTime;
+   double duration;
+   int thread;
+   bool instant;
+   ProfileEvent( const char *n, const char *c, double s, double d, int t, bool i )
+      : name( n ), category( c ), startTime( s ), duration( d ), thread( t ), instant( i )  {}
+};
+
+enum FrameState { WAITING_FOR_LOAD, WAITING_FOR_FRAME, DRAWING_FRAME };
+
+struct ProfileData {
+   OpenThreads::Mutex mutex;
+   Timer timer;
+   double spawnTime;  // time between the process spawn and start(), if known
+   vector< ProfileEvent > events;
+   map< Qt::HANDLE, int > threads;
+   FrameState frameState;
+   bool loadSuccess;
+   QString modelName;
+   QString traceFileName;
+   QString summaryFileName;
+   ProfileData() : spawnTime( 0. ), frameState( WAITING_FOR_LOAD ), loadSuccess( false )  {}
+};
+static ProfileData profileData;
+
+
+// categories in the order of the summary
+static const char *categories[] = {
+   "args", "gui", "read", "unzip", "visitors", "kdtree", "conversion", "shaders", "draw", NULL
+};
+
+
+// returns the thread id used in the trace, the main thread (calling start()) is 1
+// (profileData.mutex must be locked)
+static int getThreadId()
+{
+   Qt::HANDLE h = QThread::currentThreadId();
+   map< Qt::HANDLE, int >::iterator it = profileData.threads.find( h );
+   if( it != profileData.threads.end() )
+      return it->second;
+   int id = int( profileData.threads.size() ) + 1;
+   profileData.threads[h] = id;
+   return id;
+}
+
+
+static QString escapeJson( const QString &s )
+{
+   QString r;
+   for( int i=0; i<s.length(); i++ ) {
+      QChar c = s[i];
+      if( c == '"' || c == '\\' )  r += '\\';
+      if( c < ' ' )  r += ' ';
+      else  r += c;
+   }
+   return r;
+}
+
+
+/**
+ * Starts the recording. The time origin is the process spawn
+ * if its time is given by START_TIME environment variable
+ * (see Log::getSpawnTime()), otherwise the call of this method.
+ */
+void LoadProfiler::start()
+{
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( profileData.mutex );
+   profileData.timer.setStartTick();
+   profileData.events.clear();
+   profileData.threads.clear();
+   profileData.frameState = WAITING_FOR_LOAD;
+   getThreadId();
+
+   double d;
+   profileData.spawnTime = Log::getSpawnTime( "START_TIME", d ) ? d * 1000. : 0.;
+   if( profileData.spawnTime > 0. )
+      profileData.events.push_back( ProfileEvent( "process spawn", "spawn",
+                                                  0., profileData.spawnTime, 1, false ) );
+   _active = true;
+}
+
+
+/**
+ * Stops the recording and drops the recorded data.
+ */
+void LoadProfiler::stop()
+{
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( profileData.mutex );
+   _active = false;
+   profileData.events.clear();
+}
+
+
+/**
+ * Sets the files written when the profile is finished. Empty name
+ * means that the output is not written. If no output is requested,
+ * the recording is stopped.
+ */
+void LoadProfiler::setOutput( const QString &traceFileName, const QString &summaryFileName )
+{
+   {
+      OpenThreads::ScopedLock< OpenThreads::Mutex > lock( profileData.mutex );
+      profileData.traceFileName = traceFileName;
+      profileData.summaryFileName = summaryFileName;
+   }
+   if( traceFileName.isEmpty() && summaryFileName.isEmpty() )
+      stop();
+}
+
+
+/**
+ * Sets the name of the profiled model. It is stored in the trace and in the summary.
+ */
+void LoadProfiler::setModelName( const QString &modelName )
+{
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( profileData.mutex );
+   profileData.modelName = modelName;
+}
+
+
+/**
+ * Returns the time in milliseconds since the time origin of the profile.
+ */
+double LoadProfiler::getTime()
+{
+   return profileData.spawnTime + profileData.timer.time_m();
+}
+
+
+/**
+ * Records the stage that started at startTime (see getTime())
+ * and ends now. The name and the category must be static strings.
+ */
+void LoadProfiler::record( const char *name, const char *category, double startTime )
+{
+   if( !_active )
+      return;
+
+   double t = getTime();
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( profileData.mutex );
+   if( !_active )
+      return;
+   profileData.events.push_back( ProfileEvent( name, category, startTime, t - startTime,
+                                               getThreadId(), false ) );
+}
+
+
+/**
+ * Records the event without duration, such as the moment when the scene is displayed.
+ */
+void LoadProfiler::instant( const char *name )
+{
+   if( !_active )
+      return;
+
+   double t = getTime();
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( profileData.mutex );
+   if( !_active )
+      return;
+   profileData.events.push_back( ProfileEvent( name, "", t, 0., getThreadId(), true ) );
+}
+
+
+/**
+ * Notifies the profiler that the model loading completed and the scene
+ * was given to the viewer. The profile is finished after the next frame
+ * is rendered or immediately if the loading failed.
+ */
+void LoadProfiler::loadCompleted( bool success )
+{
+   if( !_active )
+      return;
+
+   {
+      OpenThreads::ScopedLock< OpenThreads::Mutex > lock( profileData.mutex );
+      profileData.loadSuccess = success;
+      profileData.frameState = WAITING_FOR_FRAME;
+   }
+   if( !success )
+      finish();
+}
+
+
+/**
+ * Called by the rendering thread at the start of the frame.
+ * Returns true if the frame is the first frame of the loaded model,
+ * i.e. the frame that is profiled.
+ */
+bool LoadProfiler::frameStarted()
+{
+   if( !_active )
+      return false;
+
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( profileData.mutex );
+   if( profileData.frameState != WAITING_FOR_FRAME )
+      return false;
+   profileData.frameState = DRAWING_FRAME;
+   return true;
+}
+
+
+/**
+ * Called by the rendering thread at the end of the frame with the time
+ * spent by drawing the frame. The profile is finished when the first frame
+ * of the loaded model is completed.
+ */
+void LoadProfiler::frameCompleted( double drawTime )
+{
+   if( !_active )
+      return;
+
+   {
+      OpenThreads::ScopedLock< OpenThreads::Mutex > lock( profileData.mutex );
+      if( profileData.frameState != DRAWING_FRAME )
+         return;
+   }
+   record( "first draw", "draw", getTime() - drawTime );
+   finish();
+}
+
+
+/**
+ * Writes the trace and the summary and stops the recording.
+ * It is called automatically after the first frame of the loaded model.
+ * Calling it again has no effect.
+ */
+void LoadProfiler::finish()
+{
+   if( !_active )
+      return;
+
+   instant( "profile finished" );
+   {
+      OpenThreads::ScopedLock< OpenThreads::Mutex > lock( profileData.mutex );
+      _active = false;
+   }
+
+   // trace
+   if( !profileData.traceFileName.isEmpty() ) {
+      if( writeTrace( profileData.traceFileName ) )
+         Log::info() << "LoadProfiler: Trace written to " << profileData.traceFileName << "." << Log::endm;
+      else
+         Log::warn() << "LoadProfiler: Can not write trace to " << profileData.traceFileName << "." << Log::endm;
+   }
+
+   // summary
+   // (appended, so the file collects the summaries of many runs)
+   QString summary = getSummary();
+   Log::notice() << summary << Log::endm;
+   if( !profileData.summaryFileName.isEmpty() ) {
+      QFile file( profileData.summaryFileName );
+      if( file.open( QIODevice::WriteOnly | QIODevice::Append | QIODevice::Text ) ) {
+         QTextStream stream( &file );
+         stream.setCodec( "UTF-8" );
+         stream << summary << "\n";
+      } else
+         Log::warn() << "LoadProfiler: Can not write summary to " << profileData.summaryFileName << "." << Log::endm;
+   }
+
+   profileData.events.clear();
+}
+
+
+bool LoadProfiler::writeTrace( const QString &fileName )
+{
+   QFile file( fileName );
+   if( !file.open( QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text ) )
+      return false;
+
+   QTextStream stream( &file );
+   stream.setCodec( "UTF-8" );
+   stream << "{\"traceEvents\":[\n";
+
+   // thread names
+   for( map< Qt::HANDLE, int >::const_iterator it = profileData.threads.begin();
+        it != profileData.threads.end(); it++ )
+   {
+      QString name = it->second == 1 ? QString( "main thread" ) : QString( "thread %1" ).arg( it->second );
+      stream << QString( "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%1,"
+                         "\"args\":{\"name\":\"%2\"}},\n" ).arg( it->second ).arg( name );
+   }
+
+   // events (time in microseconds)
+   for( unsigned int i=0; i<profileData.events.size(); i++ ) {
+      const ProfileEvent &e = profileData.events[i];
+      if( e.instant )
+         stream << QString( "{\"name\":\"%1\",\"ph\":\"i\",\"s\":\"g\",\"ts\":%2,\"pid\":1,\"tid\":%3}" )
+                   .arg( e.name ).arg( e.startTime * 1000., 0, 'f', 0 ).arg( e.thread );
+      else
+         stream << QString( "{\"name\":\"%1\",\"cat\":\"%2\",\"ph\":\"X\",\"ts\":%3,\"dur\":%4,"
+                            "\"pid\":1,\"tid\":%5}" )
+                   .arg( e.name ).arg( e.category )
+                   .arg( e.startTime * 1000., 0, 'f', 0 ).arg( e.duration * 1000., 0, 'f', 0 )
+                   .arg( e.thread );
+      stream << ( i+1 < profileData.events.size() ? ",\n" : "\n" );
+   }
+
+   stream << "],\n\"otherData\":{"
+          << QString( "\"version\":\"%1.%2\",\"build\":\"%3 %4\",\"model\":\"%5\"" )
+             .arg( LEXOLIGHTS_VERSION_MAJOR ).arg( LEXOLIGHTS_VERSION_MINOR )
+             .arg( buildDate ).arg( buildTime )
+             .arg( escapeJson( profileData.modelName ) )
+          << "}}\n";
+
+   stream.flush();
+   return file.error() == QFile::NoError;
+}
+
+
+/**
+ * Returns the summary line: the version, the model, the total time of each category
+ * (the stages of different threads overlap, so the categories do not sum to the total)
+ * and the time of the first frame completion since the time origin.
+ */
+QString LoadProfiler::getSummary()
+{
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( profileData.mutex );
+
+   map< string, double > times;
+   double firstFrame = -1.;
+   for( unsigned int i=0; i<profileData.events.size(); i++ ) {
+      const ProfileEvent &e = profileData.events[i];
+      if( e.instant )
+         continue;
+      times[e.category] += e.duration;
+      if( string( e.name ) == "first draw" )
+         firstFrame = e.startTime + e.duration;
+   }
+
+   QString s = QString( "LoadProfile version=%1.%2 build=\"%3 %4\" model=\"%5\" spawn=%6" )
+               .arg( LEXOLIGHTS_VERSION_MAJOR ).arg( LEXOLIGHTS_VERSION_MINOR )
+               .arg( buildDate ).arg( buildTime )
+               .arg( profileData.modelName )
+               .arg( profileData.spawnTime, 0, 'f', 2 );
+   for( int i=0; categories[i]; i++ )
+      s += QString( " %1=%2" ).arg( categories[i] ).arg( times[categories[i]], 0, 'f', 2 );
+   if( firstFrame >= 0. )
+      s += QString( " firstFrame=%1" ).arg( firstFrame, 0, 'f', 2 );
+   else
+   if( profileData.frameState != WAITING_FOR_LOAD && !profileData.loadSuccess )
+      s += " firstFrame=failed";
+   else
+      s += " firstFrame=none";
+   return s;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file
+ * LoadProfiler class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef LOAD_PROFILER_H
+#define LOAD_PROFILER_H
+
+#include <QString>
+
+
+/**
+ * LoadProfiler records the stages of the application start and of the model
+ * loading from the process spawn up to the first completed frame
+ * of the loaded model.
+ *
+ * The stages are recorded as intervals (see Scope and record()) together
+ * with the thread that performed them. Each stage belongs to a category
+ * (args, gui, read, unzip, visitors, kdtree, conversion, shaders, draw).
+ * When the first frame of the loaded model is completed, the profile is written
+ * as Chrome trace JSON (viewable by chrome://tracing) and as one-line summary
+ * with the total time of each category, and the recording is stopped.
+ *
+ * Recording is started by start() at the very beginning of main().
+ * It is stopped, and recorded data are dropped, if no output is requested
+ * by setOutput(). All the methods are thread-safe and they do nothing
+ * while the recording is not active.
+ */
+class LoadProfiler
+{
+public:
+
+   static void start();
+   static void stop();
+   static inline bool isActive();
+   static void setOutput( const QString &traceFileName, const QString &summaryFileName );
+   static void setModelName( const QString &modelName );
+
+   static double getTime();
+   static void record( const char *name, const char *category, double startTime );
+   static void instant( const char *name );
+
+   static void loadCompleted( bool success );
+   static bool frameStarted();
+   static void frameCompleted( double drawTime );
+   static void finish();
+
+   /**
+    * Records the stage spanning the lifetime of the object.
+    */
+   class Scope {
+   public:
+      inline Scope( const char *name, const char *category );
+      inline ~Scope();
+   protected:
+      const char *_name;
+      const char *_category;
+      double _startTime;
+   };
+
+protected:
+
+   static bool _active;
+
+   static bool writeTrace( const QString &fileName );
+   static QString getSummary();
+
+};
+
+
+//
+//  inline methods
+//
+
+inline bool LoadProfiler::isActive()  { return _active; }
+inline LoadProfiler::Scope::Scope( const char *name, const char *category )
+   : _name( name ), _category( category ), _startTime( _active ? getTime() : -1. )  {}
+inline LoadProfiler::Scope::~Scope()  { if( _startTime >= 0. ) record( _name, _category, _startTime ); }
+
+
+#endif /* LOAD_PROFILER_H */
@@ -0,0 +1,306 @@
+/**
+ * @file
+ * LodGenerator class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osg/Geometry>
+#include <osg/LOD>
+#include <osg/Timer>
+#include <osgUtil/Simplifier>
+#include <osgUtil/Statistics>
+#include <algorithm>
+#include <cfloat>
+#include <map>
+#include <QAtomicInt>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include "utils/LodGenerator.h"
+#include "utils/SceneCache.h"
+#include "utils/SceneHashVisitor.h"
+
+using namespace std;
+using namespace osg;
+
+
+// ratios of the triangles kept by the simplified levels
+// (the level i is rendered for pixel sizes from pixelSize*levelPixelRatios[i]
+// up to the pixel size of the previous level)
+static const int numLevels = 2;
+static const float levelRatios[numLevels] = { 0.25f, 0.05f };
+static const float levelPixelRatios[numLevels] = { 0.25f, 0.f };
+
+// smaller geometries of the heavy geodes are not simplified
+static const unsigned int minSimplifiedTriangles = 64;
+
+// simplification that does not remove at least 10% of triangles is discarded
+static const float maxResultRatio = 0.9f;
+
+// version of the simplified geometries in the disk cache
+// (change it when the simplification changes)
+static const int cacheVersion = 1;
+
+
+
+/**
+ * Worker that takes the simplifications one by one from the shared list.
+ * The simplified geometry is read from the disk cache, or it is simplified
+ * and stored in the cache. The time spent by the worker is measured.
+ */
+class LodGenerator::SimplifyTask : public QRunnable
+{
+public:
+
+   SimplifyTask( vector< Simplification > &simplifications, bool useDiskCache,
+                 QAtomicInt *next, const CancellationToken *canceled, double *busyTime )
+      : _simplifications( simplifications ), _useDiskCache( useDiskCache ),
+        _next( next ), _canceled( canceled ), _busyTime( busyTime )  {}
+
+   virtual void run()
+   {
+      Timer_t startTick = Timer::instance()->tick();
+
+      while( !_canceled || !_canceled->isCanceled() ) {
+         int i = _next->fetchAndAddOrdered( 1 );
+         if( i >= int( _simplifications.size() ) )
+            break;
+         Simplification &s = _simplifications[i];
+
+         // look into the disk cache
+         if( _useDiskCache ) {
+            ref_ptr< Node > node = SceneCache::read( s.key );
+            Geode *geode = node.valid() ? node->asGeode() : NULL;
+            Geometry *g = geode && geode->getNumDrawables() == 1 ? geode->getDrawable( 0 )->asGeometry() : NULL;
+            if( g ) {
+               s.result = g;
+               s.cacheHit = true;
+               continue;
+            }
+         }
+
+         // simplify the copy of the geometry
+         // (the state set and KdTree are not copied, the state set
+         // is given back by insertLod(), so it is not stored in the cache)
+         ref_ptr< Geometry > g = new Geometry( *s.geometry, CopyOp::DEEP_COPY_ARRAYS |
+                                                           CopyOp::DEEP_COPY_PRIMITIVES );
+         g->setStateSet( NULL );
+         g->setShape( NULL );
+         g->setUserData( NULL );
+         osgUtil::Simplifier simplifier( s.ratio );
+         simplifier.simplify( *g );
+         if( getNumTriangles( g.get() ) > maxResultRatio * getNumTriangles( s.geometry.get() ) )
+            continue;
+         s.result = g;
+
+         if( _useDiskCache ) {
+            ref_ptr< Geode > geode = new Geode;
+            geode->addDrawable( g.get() );
+            SceneCache::write( s.key, geode.get() );
+         }
+      }
+
+      *_busyTime = Timer::instance()->delta_m( startTick, Timer::instance()->tick() );
+   }
+
+protected:
+   vector< Simplification > &_simplifications;
+   bool _useDiskCache;
+   QAtomicInt *_next;
+   const CancellationToken *_canceled;
+   double *_busyTime;
+};
+
+
+
+/**
+ * Constructor.
+ *
+ * If numThreads is zero or negative, number of threads is given by the number of CPU cores.
+ */
+LodGenerator::LodGenerator( unsigned int minTriangles, float pixelSize, int numThreads )
+   : inherited( NODE_VISITOR, TRAVERSE_ALL_CHILDREN ),
+     _minTriangles( minTriangles > 0 ? minTriangles : 1 ),
+     _pixelSize( pixelSize > 0.f ? pixelSize : 1.f ),
+     _useDiskCache( true ),
+     _numLods( 0 ),
+     _numCacheHits( 0 ),
+     _trianglesBefore( 0 ),
+     _trianglesAfter( 0 ),
+     _numThreads( numThreads > 0 ? numThreads : QThread::idealThreadCount() ),
+     _serialTime( 0. )
+{
+   if( _numThreads < 1 )
+      _numThreads = 1;
+}
+
+
+LodGenerator::~LodGenerator()
+{
+}
+
+
+/**
+ * Returns the number of triangles (separated, in strips and in fans) of the drawable.
+ */
+unsigned int LodGenerator::getNumTriangles( const Drawable *drawable )
+{
+   osgUtil::Statistics stats;
+   stats.setType( osgUtil::Statistics::STAT_PRIMS );
+   drawable->accept( stats );
+   osgUtil::Statistics::PrimitiveCountMap &m = stats.getPrimitiveCountMap();
+   return m[GL_TRIANGLES] + m[GL_TRIANGLE_STRIP] + m[GL_TRIANGLE_FAN];
+}
+
+
+void LodGenerator::apply( Geode &geode )
+{
+   if( isCanceled() )
+      return;
+
+   // skip the geodes that are already part of LOD
+   // and the geodes that may change
+   if( geode.getNumParents() == 0 || geode.getDataVariance() == Object::DYNAMIC ||
+       dynamic_cast< LOD* >( geode.getParent( 0 ) ) )
+      return;
+
+   unsigned int numTriangles = 0;
+   for( unsigned int i=0, c=geode.getNumDrawables(); i<c; i++ )
+      numTriangles += getNumTriangles( geode.getDrawable( i ) );
+
+   if( numTriangles >= _minTriangles && _geodeSet.insert( &geode ).second )
+      _geodes.push_back( &geode );
+}
+
+
+/**
+ * Simplifies the geometries of the collected geodes
+ * on the pool of worker threads and replaces the geodes by LOD nodes.
+ */
+void LodGenerator::generate()
+{
+   // the simplifications of the unique geometries
+   // (hashing is not thread-safe, so the keys are computed here)
+   SceneHashVisitor hasher;
+   set< Geometry* > geometries;
+   for( unsigned int i=0; i<_geodes.size(); i++ ) {
+      Geode *geode = _geodes[i].get();
+      for( unsigned int j=0, c=geode->getNumDrawables(); j<c; j++ ) {
+         Geometry *g = geode->getDrawable( j )->asGeometry();
+         if( !g || g->getDataVariance() == Object::DYNAMIC ||
+             getNumTriangles( g ) < minSimplifiedTriangles ||
+             !geometries.insert( g ).second )
+            continue;
+
+         ContentHash::Value hash = hasher.getDrawableHash( g );
+         for( int level=0; level<numLevels; level++ ) {
+            ContentHash key( hash );
+            key.add( "LodGenerator" );
+            key.add( cacheVersion );
+            key.add( levelRatios[level] );
+            Simplification s;
+            s.geometry = g;
+            s.ratio = levelRatios[level];
+            s.key = key.get();
+            s.cacheHit = false;
+            _simplifications.push_back( s );
+         }
+      }
+      if( isCanceled() )
+         return;
+   }
+
+   // simplify
+   int numThreads = min( _numThreads, max( int( _simplifications.size() ), 1 ) );
+   vector< double > busyTimes( numThreads, 0. );
+   QAtomicInt next( 0 );
+   QThreadPool pool;
+   pool.setMaxThreadCount( numThreads );
+   for( int i=0; i<numThreads; i++ )
+      pool.start( new SimplifyTask( _simplifications, _useDiskCache, &next,
+                                    _cancellationToken.get(), &busyTimes[i] ) );
+   pool.waitForDone();
+
+   _numThreads = numThreads;
+   _serialTime = 0.;
+   for( int i=0; i<numThreads; i++ )
+      _serialTime += busyTimes[i];
+   _numCacheHits = 0;
+   for( unsigned int i=0; i<_simplifications.size(); i++ )
+      if( _simplifications[i].cacheHit )
+         _numCacheHits++;
+   if( isCanceled() )
+      return;
+
+   // replace geodes by LODs
+   ResultMap results;
+   for( unsigned int i=0; i<_simplifications.size(); i++ ) {
+      Simplification &s = _simplifications[i];
+      if( s.result.valid() )
+         results[ make_pair( s.geometry.get(), s.ratio ) ] = s.result.get();
+   }
+   for( unsigned int i=0; i<_geodes.size(); i++ )
+      insertLod( _geodes[i].get(), results );
+   _geodes.clear();
+   _geodeSet.clear();
+}
+
+
+/**
+ * Replaces the geode by LOD node in all its parents.
+ * Levels without any simplified geometry are not created. Coarser levels
+ * are still tried and the pixel size range of the skipped level is given
+ * to the next created level, so the ranges stay contiguous.
+ */
+void LodGenerator::insertLod( Geode *geode, const ResultMap &results )
+{
+   ref_ptr< Geode > geodeRef = geode;
+   Node::ParentList parents = geode->getParents();
+   ref_ptr< LOD > lod = new LOD;
+   lod->setName( geode->getName() );
+   lod->setRangeMode( LOD::PIXEL_SIZE_ON_SCREEN );
+   lod->addChild( geode, _pixelSize, FLT_MAX );
+
+   unsigned int coarsestTriangles = 0;
+   float maxPixelSize = _pixelSize;
+   for( int level=0; level<numLevels; level++ ) {
+
+      // replace the simplified geometries
+      // (the state set of the original geometry is given to the simplified one)
+      ref_ptr< Geode > levelGeode = new Geode( *geode, CopyOp::SHALLOW_COPY );
+      bool simplified = false;
+      unsigned int numTriangles = 0;
+      for( unsigned int i=0, c=levelGeode->getNumDrawables(); i<c; i++ ) {
+         Geometry *g = levelGeode->getDrawable( i )->asGeometry();
+         ResultMap::const_iterator it = g ? results.find( make_pair( g, levelRatios[level] ) ) : results.end();
+         if( it != results.end() ) {
+            it->second->setStateSet( g->getStateSet() );
+            levelGeode->setDrawable( i, it->second );
+            simplified = true;
+         }
+         numTriangles += getNumTriangles( levelGeode->getDrawable( i ) );
+      }
+      if( !simplified )
+         continue;
+
+      float minPixelSize = _pixelSize * levelPixelRatios[level];
+      lod->addChild( levelGeode.get(), minPixelSize, maxPixelSize );
+      maxPixelSize = minPixelSize;
+      coarsestTriangles = numTriangles;
+   }
+   unsigned int n = lod->getNumChildren();
+   if( n <= 1 )
+      return;
+
+   // the coarsest level created is rendered down to zero pixel size
+   lod->setRange( n-1, 0.f, lod->getMaxRange( n-1 ) );
+
+   for( Node::ParentList::iterator it = parents.begin(); it != parents.end(); it++ )
+      (*it)->replaceChild( geode, lod.get() );
+
+   for( unsigned int i=0, c=geode->getNumDrawables(); i<c; i++ )
+      _trianglesBefore += getNumTriangles( geode->getDrawable( i ) );
+   _trianglesAfter += coarsestTriangles;
+   _numLods++;
+}
@@ -0,0 +1,133 @@
+/**
+ * @file
+ * LodGenerator class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef LOD_GENERATOR_H
+#define LOD_GENERATOR_H
+
+#include <osg/Geode>
+#include <osg/NodeVisitor>
+#include <map>
+#include <set>
+#include <vector>
+#include "utils/CancellationToken.h"
+#include "utils/ContentHash.h"
+
+namespace osg {
+   class Drawable;
+   class Geometry;
+}
+
+
+/**
+ * LodGenerator replaces heavy Geodes by osg::LOD nodes
+ * with simplified versions of their geometry.
+ *
+ * CAD assemblies contain many small parts (screws, fittings) with huge
+ * triangle counts that cover just a few pixels on the screen. The visitor collects
+ * the Geodes having at least minTriangles triangles. generate() simplifies
+ * their Geometries by osgUtil::Simplifier on the pool of worker threads
+ * and replaces each Geode by LOD node selecting the level by the pixel size
+ * of the Geode on the screen: the original Geode is rendered down to pixelSize,
+ * the coarser levels below it. Each Geometry is simplified
+ * once, even if it is shared by many Geodes.
+ *
+ * The simplified Geometries are stored in the disk cache of SceneCache
+ * under the key given by the hash of the Geometry (see SceneHashVisitor)
+ * and the level, so they are reused when a modified model containing
+ * the same parts is opened. The disk cache can be switched off
+ * by setUseDiskCache().
+ *
+ * Usage: scene->accept( generator ); generator.generate();
+ *
+ * The collection and the simplification stop when the cancellation token
+ * is canceled (see setCancellationToken()).
+ */
+class LodGenerator : public osg::NodeVisitor
+{
+   typedef osg::NodeVisitor inherited;
+
+public:
+
+   LodGenerator( unsigned int minTriangles, float pixelSize, int numThreads = 0 );
+   virtual ~LodGenerator();
+
+   META_NodeVisitor( "Lexolights", "LodGenerator" )
+
+   virtual void apply( osg::Geode &geode );
+
+   void generate();
+
+   inline unsigned int getMinTriangles() const;
+   inline float getPixelSize() const;
+   inline void setUseDiskCache( bool on );
+   inline bool getUseDiskCache() const;
+
+   inline unsigned int getNumLods() const;
+   inline unsigned int getNumSimplified() const;
+   inline unsigned int getNumCacheHits() const;
+   inline unsigned int getTrianglesBefore() const;
+   inline unsigned int getTrianglesAfter() const;
+   inline int getNumThreads() const;
+   inline double getSerialTime() const;
+
+   inline void setCancellationToken( CancellationToken *token );
+   inline bool isCanceled() const;
+
+   static unsigned int getNumTriangles( const osg::Drawable *drawable );
+
+protected:
+
+   class SimplifyTask;
+
+   struct Simplification {
+      osg::ref_ptr< osg::Geometry > geometry;
+      float ratio;
+      ContentHash::Value key;
+      osg::ref_ptr< osg::Geometry > result;
+      bool cacheHit;
+   };
+
+   typedef std::map< std::pair< osg::Geometry*, float >, osg::Geometry* > ResultMap;
+   void insertLod( osg::Geode *geode, const ResultMap &results );
+
+   std::vector< osg::ref_ptr< osg::Geode > > _geodes;
+   std::set< osg::Geode* > _geodeSet;
+   std::vector< Simplification > _simplifications;
+   unsigned int _minTriangles;
+   float _pixelSize;
+   bool _useDiskCache;
+   unsigned int _numLods;
+   unsigned int _numCacheHits;
+   unsigned int _trianglesBefore;
+   unsigned int _trianglesAfter;
+   int _numThreads;
+   double _serialTime;
+   osg::ref_ptr< CancellationToken > _cancellationToken;
+
+};
+
+
+//
+//  inline methods
+//
+
+inline unsigned int LodGenerator::getMinTriangles() const  { return _minTriangles; }
+inline float LodGenerator::getPixelSize() const  { return _pixelSize; }
+inline void LodGenerator::setUseDiskCache( bool on )  { _useDiskCache = on; }
+inline bool LodGenerator::getUseDiskCache() const  { return _useDiskCache; }
+inline unsigned int LodGenerator::getNumLods() const  { return _numLods; }
+inline unsigned int LodGenerator::getNumSimplified() const  { return (unsigned int)( _simplifications.size() ); }
+inline unsigned int LodGenerator::getNumCacheHits() const  { return _numCacheHits; }
+inline unsigned int LodGenerator::getTrianglesBefore() const  { return _trianglesBefore; }
+inline unsigned int LodGenerator::getTrianglesAfter() const  { return _trianglesAfter; }
+inline int LodGenerator::getNumThreads() const  { return _numThreads; }
+inline double LodGenerator::getSerialTime() const  { return _serialTime; }
+inline void LodGenerator::setCancellationToken( CancellationToken *token )  { _cancellationToken = token; }
+inline bool LodGenerator::isCanceled() const  { return _cancellationToken.valid() && _cancellationToken->isCanceled(); }
+
+
+#endif /* LOD_GENERATOR_H */
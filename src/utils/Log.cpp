@@ -317,54 +317,71 @@ void Log::msg( const QString &message, osg::NotifySeverity severity, double time
 }
 
 
-bool Log::spawnTimeMsg( const QString &envVar,
-                        const QString &message,
-                        const QString &failMsg,
-                        osg::NotifySeverity severity )
+/**
+ * Returns the time in seconds elapsed since the application spawn.
+ *
+ * The spawn time (UTC seconds) is expected in the environment variable
+ * that is set by the utility starting the application (see lexolights.py).
+ * Returns false if the variable is not set.
+ */
+bool Log::getSpawnTime( const QString &envVar, double &seconds )
 {
-   // make sure log data are initialized
-   getLogData();
-
    // get spawn time from environment variable
    // note: there must be, for example, an utility
    //       that sets the variable and starts
    //       the application.
    const char *value = getenv( envVar.toLocal8Bit() );
+   if( !value || value[0] == '\0' )
+      return false;
 
-   if( value && value[0] != '\0' ) {
+   // compute the time
+   double t1 = atof( value );
+   if( !t1 )
+      return false;
 
-      // compute the time
-      double t1 = atof( value );
-      if( t1 ) {
+   // convert time to QTime
+   // note: we are using modulo of 86400 (seconds per day, e.g. 24*60*60)
+   t1 = t1 - ( 86400 * int( t1 / 86400 ) );
+
+   // convert QTime to double
+   // note: we have to use QDateTime to convert local time it to UTC
+   QTime now = QDateTime::currentDateTime().toUTC().time();
+   double t2 = now.hour() * 3600 + now.minute() * 60 +
+               now.second() + now.msec() * 0.001;
+
+   // get time delta
+   // and handle possible "day" overflow
+   double d = t2 - t1;
+   if( d < 0. )  d += 86400.;
+   if( d >= 86400. )  d -= 86400.;
+#if 0 // debug
+   OSG_NOTICE << QString( "t1: %1,  t2: %2,  d: %3" ).arg( t1, t2, d ) << endl;
+#endif
 
-         // convert time to QTime
-         // note: we are using modulo of 86400 (seconds per day, e.g. 24*60*60)
-         t1 = t1 - ( 86400 * int( t1 / 86400 ) );
+   seconds = d;
+   return true;
+}
 
-         // convert QTime to double
-         // note: we have to use QDateTime to convert local time it to UTC
-         QTime now = QDateTime::currentDateTime().toUTC().time();
-         double t2 = now.hour() * 3600 + now.minute() * 60 +
-                     now.second() + now.msec() * 0.001;
 
-         // get time delta
-         // and handle possible "day" overflow
-         double d = t2 - t1;
-         if( d < 0. )  d += 86400.;
-         if( d >= 86400. )  d -= 86400.;
-#if 0 // debug
-         notify( severity ) << QString( "t1: %1,  t2: %2,  d: %3" ).arg( t1, t2, d ) << endl;
-#endif
+bool Log::spawnTimeMsg( const QString &envVar,
+                        const QString &message,
+                        const QString &failMsg,
+                        osg::NotifySeverity severity )
+{
+   // make sure log data are initialized
+   getLogData();
 
-         // print message with time information
-         Timer savedTime = logData->startTime;
-         logData->startTime.setStartTick();
-         logData->startTime.setStartTick( logData->startTime.getStartTick() -
-                                          d / logData->startTime.getSecondsPerTick() );
-         notify( severity ) << message.arg( d * 1000., 0, 'f', 2 ) << endl;
-         logData->startTime = savedTime;
-         return true;
-      }
+   double d;
+   if( getSpawnTime( envVar, d ) ) {
+
+      // print message with time information
+      Timer savedTime = logData->startTime;
+      logData->startTime.setStartTick();
+      logData->startTime.setStartTick( logData->startTime.getStartTick() -
+                                       d / logData->startTime.getSecondsPerTick() );
+      notify( severity ) << message.arg( d * 1000., 0, 'f', 2 ) << endl;
+      logData->startTime = savedTime;
+      return true;
    }
 
    // print failMsg, but only if not empty
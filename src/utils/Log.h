@@ -40,6 +40,7 @@ public:
    static void msg( const QString &message, osg::NotifySeverity severity );
    static void msg( const QString &message, osg::NotifySeverity severity, double time );
 
+   static bool getSpawnTime( const QString &envVar, double &seconds );
    static bool spawnTimeMsg( const QString &envVar,
                              const QString &message,
                              const QString &failMsg = QString(""),
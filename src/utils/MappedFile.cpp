@@ -0,0 +1,235 @@
+/**
+ * @file
+ * MappedFile class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#if defined(__WIN32__) || defined(_WIN32)
+# include <windows.h>
+# include <osgDB/ConvertUTF>
+#else
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <unistd.h>
+#endif
+#include "MappedFile.h"
+
+using namespace std;
+
+
+
+MappedFile::MappedFile()
+   : _data( NULL ),
+     _size( 0 ),
+     _isOpen( false )
+#if defined(__WIN32__) || defined(_WIN32)
+     , _fileHandle( INVALID_HANDLE_VALUE ),
+     _mappingHandle( NULL )
+#endif
+{
+}
+
+
+MappedFile::~MappedFile()
+{
+   close();
+}
+
+
+/**
+ * Maps the whole file into the memory. The file name is in UTF-8.
+ *
+ * Returns false if the file can not be opened or mapped.
+ * Empty files are opened successfully with getData() returning NULL.
+ */
+bool MappedFile::open( const string &fileName )
+{
+   close();
+
+#if defined(__WIN32__) || defined(_WIN32)
+
+   // open file
+   // (FILE_FLAG_SEQUENTIAL_SCAN makes the system cache read ahead more aggressively)
+   wstring wFileName = osgDB::convertUTF8toUTF16( fileName );
+   _fileHandle = CreateFileW( wFileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE,
+                              NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL );
+   if( _fileHandle == INVALID_HANDLE_VALUE )
+      return false;
+
+   // get size
+   LARGE_INTEGER size;
+   if( !GetFileSizeEx( _fileHandle, &size ) || ( unsigned long long )( size.QuadPart ) > size_t( -1 ) ) {
+      close();
+      return false;
+   }
+   _size = size_t( size.QuadPart );
+   if( _size == 0 ) {
+      _isOpen = true;
+      return true;
+   }
+
+   // map file
+   _mappingHandle = CreateFileMappingW( _fileHandle, NULL, PAGE_READONLY, 0, 0, NULL );
+   if( _mappingHandle == NULL ) {
+      close();
+      return false;
+   }
+   _data = ( const char* )MapViewOfFile( _mappingHandle, FILE_MAP_READ, 0, 0, 0 );
+   if( _data == NULL ) {
+      close();
+      return false;
+   }
+
+#else
+
+   // open file
+   int fd = ::open( fileName.c_str(), O_RDONLY );
+   if( fd == -1 )
+      return false;
+
+   // get size
+   struct stat st;
+   if( fstat( fd, &st ) != 0 || ( unsigned long long )( st.st_size ) > size_t( -1 ) ) {
+      ::close( fd );
+      return false;
+   }
+   _size = size_t( st.st_size );
+   if( _size == 0 ) {
+      ::close( fd );
+      _isOpen = true;
+      return true;
+   }
+
+   // map file
+   // (the mapping stays valid after the file descriptor is closed)
+   void *p = mmap( NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0 );
+   ::close( fd );
+   if( p == MAP_FAILED ) {
+      _size = 0;
+      return false;
+   }
+   _data = ( const char* )p;
+
+   // read-ahead hint
+   // (the pages are read sequentially and the whole file is going to be needed)
+   madvise( p, _size, MADV_SEQUENTIAL );
+   madvise( p, _size, MADV_WILLNEED );
+
+#endif
+
+   _isOpen = true;
+   return true;
+}
+
+
+/**
+ * Unmaps the file. The streams reading the file must not be used any more.
+ */
+void MappedFile::close()
+{
+#if defined(__WIN32__) || defined(_WIN32)
+   if( _data )
+      UnmapViewOfFile( _data );
+   if( _mappingHandle )
+      CloseHandle( _mappingHandle );
+   if( _fileHandle != INVALID_HANDLE_VALUE )
+      CloseHandle( _fileHandle );
+   _mappingHandle = NULL;
+   _fileHandle = INVALID_HANDLE_VALUE;
+#else
+   if( _data )
+      munmap( ( void* )_data, _size );
+#endif
+
+   _data = NULL;
+   _size = 0;
+   _isOpen = false;
+}
+
+
+/**
+ * Asks the operating system to drop the cached content of the file,
+ * so the next reading of the file is a cold read from the disk.
+ *
+ * It is used for benchmarking. Returns false if it is not supported
+ * (Windows and systems without posix_fadvise()) or if it failed.
+ */
+bool MappedFile::evictFromCache( const string &fileName )
+{
+#if defined(__WIN32__) || defined(_WIN32) || defined(__APPLE__)
+
+   return false;
+
+#else
+
+   int fd = ::open( fileName.c_str(), O_RDONLY );
+   if( fd == -1 )
+      return false;
+   int r = posix_fadvise( fd, 0, 0, POSIX_FADV_DONTNEED );
+   ::close( fd );
+   return r == 0;
+
+#endif
+}
+
+
+
+MappedFile::StreamBuf::StreamBuf( const char *data, size_t size )
+{
+   // std::streambuf requires non-const pointers, the buffer is never written though
+   char *p = const_cast< char* >( data );
+   setg( p, p, p + size );
+}
+
+
+MappedFile::StreamBuf::pos_type MappedFile::StreamBuf::seekoff( off_type off, ios_base::seekdir dir,
+                                                                ios_base::openmode which )
+{
+   if( ( which & ios_base::in ) == 0 )
+      return pos_type( off_type( -1 ) );
+
+   off_type pos;
+   switch( dir ) {
+      case ios_base::beg: pos = off; break;
+      case ios_base::cur: pos = ( gptr() - eback() ) + off; break;
+      case ios_base::end: pos = ( egptr() - eback() ) + off; break;
+      default: return pos_type( off_type( -1 ) );
+   }
+   if( pos < 0 || pos > egptr() - eback() )
+      return pos_type( off_type( -1 ) );
+
+   setg( eback(), eback() + pos, egptr() );
+   return pos_type( pos );
+}
+
+
+MappedFile::StreamBuf::pos_type MappedFile::StreamBuf::seekpos( pos_type pos, ios_base::openmode which )
+{
+   return seekoff( off_type( pos ), ios_base::beg, which );
+}
+
+
+streamsize MappedFile::StreamBuf::showmanyc()
+{
+   streamsize n = egptr() - gptr();
+   return n > 0 ? n : -1;
+}
+
+
+
+MappedFile::Stream::Stream( const MappedFile &file )
+   : istream( NULL ),
+     _buf( file.getData(), file.getSize() )
+{
+   init( &_buf );
+}
+
+
+MappedFile::Stream::Stream( const char *data, size_t size )
+   : istream( NULL ),
+     _buf( data, size )
+{
+   init( &_buf );
+}
@@ -0,0 +1,124 @@
+/**
+ * @file
+ * MappedFile class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <istream>
+#include <streambuf>
+#include <string>
+
+
+/**
+ * Read-only memory mapping of the whole file.
+ *
+ * The operating system is hinted that the file is going to be read
+ * sequentially, so it reads ahead the pages of the mapping.
+ * The content is accessible by getData() or through MappedFile::Stream,
+ * the std::istream that reads directly from the mapping without any
+ * intermediate buffer. The stream is constructed on the open MappedFile
+ * that has to stay open while the stream is used:
+ *
+ *    MappedFile file;
+ *    if( file.open( fileName ) ) {
+ *       MappedFile::Stream stream( file );
+ *       ...
+ *    }
+ */
+class MappedFile
+{
+public:
+
+   MappedFile();
+   ~MappedFile();
+
+   bool open( const std::string &fileName );
+   void close();
+   inline bool isOpen() const;
+
+   inline const char* getData() const;
+   inline size_t getSize() const;
+
+   class StreamBuf;
+   class Stream;
+
+   static bool evictFromCache( const std::string &fileName );
+
+protected:
+
+   const char *_data;
+   size_t _size;
+   bool _isOpen;
+#if defined(__WIN32__) || defined(_WIN32)
+   void *_fileHandle;
+   void *_mappingHandle;
+#endif
+
+private:
+   MappedFile( const MappedFile& );
+   MappedFile& operator=( const MappedFile& );
+
+};
+
+
+/**
+ * std::streambuf reading from the memory block.
+ *
+ * The get area of the buffer is the whole memory block,
+ * so no data are copied except by the reading itself.
+ */
+class MappedFile::StreamBuf : public std::streambuf
+{
+public:
+
+   StreamBuf( const char *data, size_t size );
+
+   inline const char* getReadPtr() const;
+   inline size_t getNumAvailable() const;
+
+protected:
+
+   virtual pos_type seekoff( off_type off, std::ios_base::seekdir dir,
+                             std::ios_base::openmode which = std::ios_base::in );
+   virtual pos_type seekpos( pos_type pos, std::ios_base::openmode which = std::ios_base::in );
+   virtual std::streamsize showmanyc();
+
+};
+
+
+/**
+ * std::istream reading the content of the MappedFile.
+ *
+ * The stream does not own the mapping. The MappedFile
+ * has to be kept open while the stream is used.
+ */
+class MappedFile::Stream : public std::istream
+{
+public:
+
+   Stream( const MappedFile &file );
+   Stream( const char *data, size_t size );
+
+protected:
+
+   StreamBuf _buf;
+
+};
+
+
+//
+//  inline methods
+//
+
+inline bool MappedFile::isOpen() const  { return _isOpen; }
+inline const char* MappedFile::getData() const  { return _data; }
+inline size_t MappedFile::getSize() const  { return _size; }
+inline const char* MappedFile::StreamBuf::getReadPtr() const  { return gptr(); }
+inline size_t MappedFile::StreamBuf::getNumAvailable() const  { return size_t( egptr() - gptr() ); }
+
+
+#endif /* MAPPED_FILE_H */
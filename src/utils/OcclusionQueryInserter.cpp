@@ -0,0 +1,121 @@
+/**
+ * @file
+ * OcclusionQueryInserter class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osg/Camera>
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/LightSource>
+#include <osg/OcclusionQueryNode>
+#include <sstream>
+#include "utils/OcclusionQueryInserter.h"
+
+using namespace osg;
+
+
+// prefix of the names of the inserted query nodes
+static const std::string queryNodeNamePrefix = "Lexolights occlusion query ";
+
+// pixels that have to pass the query to render the subgraph
+// (low value avoids popping of the partially visible subgraphs)
+static const unsigned int visibilityThreshold = 1;
+
+
+
+OcclusionQueryInserter::OcclusionQueryInserter( unsigned int minVertices )
+   : inherited( NODE_VISITOR, TRAVERSE_ALL_CHILDREN ),
+     _minVertices( minVertices > 0 ? minVertices : 1 ),
+     _numQueryNodes( 0 ),
+     _numVertices( 0 )
+{
+}
+
+
+/**
+ * Returns true if the name is the name of the query node
+ * inserted by OcclusionQueryInserter.
+ */
+bool OcclusionQueryInserter::isQueryNodeName( const std::string &name )
+{
+   return name.compare( 0, queryNodeNamePrefix.size(), queryNodeNamePrefix ) == 0;
+}
+
+
+void OcclusionQueryInserter::apply( Node &node )
+{
+   if( isCanceled() )
+      return;
+
+   // multi-parented node was already processed
+   // (its query nodes were inserted to all its parents)
+   if( _subgraphs.find( &node ) != _subgraphs.end() )
+      return;
+
+   SubgraphInfo info;
+   info.unsafe = dynamic_cast< LightSource* >( &node ) != NULL ||
+                 dynamic_cast< Camera* >( &node ) != NULL;
+   info.hasQuery = dynamic_cast< OcclusionQueryNode* >( &node ) != NULL;
+
+   // vertices of the geode
+   Geode *geode = node.asGeode();
+   if( geode )
+      for( unsigned int i=0, c=geode->getNumDrawables(); i<c; i++ ) {
+         const Geometry *g = geode->getDrawable( i )->asGeometry();
+         if( g && g->getVertexArray() )
+            info.numVertices += g->getVertexArray()->getNumElements();
+      }
+
+   // process children
+   // (the child may be replaced by its query node during its processing,
+   // so the reference to the child is kept)
+   Group *group = node.asGroup();
+   if( group )
+      for( unsigned int i=0, c=group->getNumChildren(); i<c; i++ ) {
+         ref_ptr< Node > child = group->getChild( i );
+         child->accept( *this );
+         if( isCanceled() )
+            return;
+         const SubgraphInfo &childInfo = _subgraphs[ child.get() ];
+         info.numVertices += childInfo.numVertices;
+         info.hasQuery |= childInfo.hasQuery;
+         info.unsafe |= childInfo.unsafe;
+      }
+
+   _numVertices += geode ? info.numVertices : 0;
+
+   // insert query node at the lowest level reaching the limit
+   // (the root of the scene is not wrapped)
+   if( !info.unsafe && !info.hasQuery && info.numVertices >= _minVertices &&
+       node.getNumParents() > 0 )
+   {
+      insertQueryNode( node );
+      info.hasQuery = true;
+   }
+
+   _subgraphs[ &node ] = info;
+}
+
+
+/**
+ * Inserts query node between the node and each of its parents.
+ */
+void OcclusionQueryInserter::insertQueryNode( Node &node )
+{
+   ref_ptr< Node > nodeRef = &node;
+   Node::ParentList parents = node.getParents();
+   for( Node::ParentList::iterator it = parents.begin(); it != parents.end(); it++ )
+   {
+      std::ostringstream name;
+      name << queryNodeNamePrefix << _numQueryNodes;
+
+      ref_ptr< OcclusionQueryNode > queryNode = new OcclusionQueryNode;
+      queryNode->setName( name.str() );
+      queryNode->setVisibilityThreshold( visibilityThreshold );
+      queryNode->addChild( &node );
+      (*it)->replaceChild( &node, queryNode.get() );
+      _numQueryNodes++;
+   }
+}
@@ -0,0 +1,89 @@
+/**
+ * @file
+ * OcclusionQueryInserter class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef OCCLUSION_QUERY_INSERTER_H
+#define OCCLUSION_QUERY_INSERTER_H
+
+#include <osg/NodeVisitor>
+#include <map>
+#include "utils/CancellationToken.h"
+
+
+/**
+ * OcclusionQueryInserter inserts osg::OcclusionQueryNodes above the subgraphs
+ * of the scene, so the subgraphs hidden behind other geometry (e.g. walls
+ * of building interiors) are not rendered.
+ *
+ * The granularity is given by the minimal number of vertices of the subgraph
+ * (see setMinVertices()). The query node is inserted at the lowest level
+ * of the scene graph where the subgraph reaches the limit, i.e. above the nodes
+ * whose subgraph has at least minVertices vertices while none of its child
+ * subgraphs got the query node. Smaller subgraphs are not worth the query.
+ * Multi-parented nodes get a query node for each parent as the query results
+ * can not be shared by the instances placed at different positions.
+ *
+ * Subgraphs containing LightSources, Cameras or OcclusionQueryNodes
+ * are not wrapped, as the occlusion would switch off the light for the rest
+ * of the scene. Each query node gets a unique name that is used
+ * to share the query results among the per-pixel lighting passes
+ * (see PerPixelLighting).
+ *
+ * The traversal stops when the cancellation token is canceled
+ * (see setCancellationToken()).
+ */
+class OcclusionQueryInserter : public osg::NodeVisitor
+{
+   typedef osg::NodeVisitor inherited;
+
+public:
+
+   OcclusionQueryInserter( unsigned int minVertices );
+
+   META_NodeVisitor( "Lexolights", "OcclusionQueryInserter" )
+
+   virtual void apply( osg::Node &node );
+
+   inline unsigned int getMinVertices() const;
+   inline unsigned int getNumQueryNodes() const;
+   inline unsigned int getNumVertices() const;
+
+   inline void setCancellationToken( CancellationToken *token );
+   inline bool isCanceled() const;
+
+   static bool isQueryNodeName( const std::string &name );
+
+protected:
+
+   void insertQueryNode( osg::Node &node );
+
+   struct SubgraphInfo {
+      unsigned int numVertices;
+      bool hasQuery;
+      bool unsafe;
+      SubgraphInfo() : numVertices( 0 ), hasQuery( false ), unsafe( false )  {}
+   };
+   std::map< osg::Node*, SubgraphInfo > _subgraphs;
+   unsigned int _minVertices;
+   unsigned int _numQueryNodes;
+   unsigned int _numVertices;
+   osg::ref_ptr< CancellationToken > _cancellationToken;
+
+};
+
+
+//
+//  inline methods
+//
+
+inline unsigned int OcclusionQueryInserter::getMinVertices() const  { return _minVertices; }
+inline unsigned int OcclusionQueryInserter::getNumQueryNodes() const  { return _numQueryNodes; }
+inline unsigned int OcclusionQueryInserter::getNumVertices() const  { return _numVertices; }
+inline void OcclusionQueryInserter::setCancellationToken( CancellationToken *token )  { _cancellationToken = token; }
+inline bool OcclusionQueryInserter::isCanceled() const  { return _cancellationToken.valid() && _cancellationToken->isCanceled(); }
+
+
+#endif /* OCCLUSION_QUERY_INSERTER_H */
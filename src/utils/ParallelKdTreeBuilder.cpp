@@ -0,0 +1,284 @@
+/**
+ * @file
+ * ParallelKdTreeBuilder class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/Notify>
+#include <osg/Timer>
+#include <algorithm>
+#include <QAtomicInt>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include "ParallelKdTreeBuilder.h"
+
+using namespace std;
+using namespace osg;
+
+static OpenThreads::Mutex shapeMutex;
+
+
+/**
+ * Worker that takes the geometries one by one from the shared list
+ * and builds their KdTrees. It measures the time spent by building
+ * that gives the time of serial build when summed over all the workers.
+ * The memory occupied by the built trees is summed as well.
+ */
+class ParallelKdTreeBuilder::BuildTask : public QRunnable
+{
+public:
+
+   BuildTask( const vector< ref_ptr< Geometry > > &geometries, const KdTree::BuildOptions &buildOptions,
+              QAtomicInt *nextGeometry, const CancellationToken *canceled,
+              double *busyTime, unsigned long long *memoryUsage )
+      : _geometries( geometries ), _buildOptions( buildOptions ),
+        _nextGeometry( nextGeometry ), _canceled( canceled ),
+        _busyTime( busyTime ), _memoryUsage( memoryUsage )  {}
+
+   virtual void run()
+   {
+      Timer_t startTick = Timer::instance()->tick();
+
+      while( !_canceled->isCanceled() ) {
+         int i = _nextGeometry->fetchAndAddOrdered( 1 );
+         if( i >= int( _geometries.size() ) )
+            break;
+
+         // build KdTree
+         // (KdTree::build() does not modify the options, but takes them as non-const)
+         Geometry *geom = _geometries[i].get();
+         KdTree::BuildOptions buildOptions( _buildOptions );
+         ref_ptr< KdTree > kdTree = new KdTree;
+         if( kdTree->build( buildOptions, geom ) ) {
+
+            // attach the tree unless it was already built on demand
+            OpenThreads::ScopedLock< OpenThreads::Mutex > lock( getShapeMutex() );
+            if( !dynamic_cast< KdTree* >( geom->getShape() ) ) {
+               geom->setShape( kdTree.get() );
+               *_memoryUsage += getMemoryUsage( kdTree.get() );
+            }
+         }
+      }
+
+      *_busyTime = Timer::instance()->delta_m( startTick, Timer::instance()->tick() );
+   }
+
+protected:
+   const vector< ref_ptr< Geometry > > &_geometries;
+   const KdTree::BuildOptions &_buildOptions;
+   QAtomicInt *_nextGeometry;
+   const CancellationToken *_canceled;
+   double *_busyTime;
+   unsigned long long *_memoryUsage;
+};
+
+
+/**
+ * Task running build() in the background thread.
+ */
+class ParallelKdTreeBuilder::BackgroundTask : public QRunnable
+{
+public:
+
+   BackgroundTask( ParallelKdTreeBuilder *builder ) : _builder( builder )  {}
+
+   virtual void run()
+   {
+      _builder->build();
+      _builder->_done = 1;
+
+      if( _builder->isCanceled() )
+         OSG_INFO << "ParallelKdTreeBuilder: Background build canceled." << endl;
+      else
+         OSG_NOTICE << "KdTree built in background in " << int( _builder->getBuildTime() + 0.5 )
+                    << "ms (" << _builder->getNumGeometries() << " geometries, "
+                    << _builder->getNumThreads() << " threads, "
+                    << ( _builder->getMemoryUsage() + 1023 ) / 1024 << "KiB)." << endl;
+   }
+
+protected:
+   ParallelKdTreeBuilder *_builder;
+};
+
+
+/**
+ * Compares geometries by the number of vertices (the largest first).
+ */
+static bool largerGeometry( const ref_ptr< Geometry > &g1, const ref_ptr< Geometry > &g2 )
+{
+   unsigned int n1 = g1->getVertexArray() ? g1->getVertexArray()->getNumElements() : 0;
+   unsigned int n2 = g2->getVertexArray() ? g2->getVertexArray()->getNumElements() : 0;
+   return n1 > n2;
+}
+
+
+/**
+ * Constructor.
+ *
+ * If numThreads is zero or negative, number of threads is given by the number of CPU cores.
+ */
+ParallelKdTreeBuilder::ParallelKdTreeBuilder( int numThreads )
+   : inherited( NodeVisitor::TRAVERSE_ALL_CHILDREN ),
+     _numThreads( numThreads > 0 ? numThreads : QThread::idealThreadCount() ),
+     _buildTime( 0. ),
+     _serialTime( 0. ),
+     _memoryUsage( 0 ),
+     _cancellationToken( new CancellationToken ),
+     _done( 0 ),
+     _backgroundPool( NULL )
+{
+   if( _numThreads < 1 )
+      _numThreads = 1;
+}
+
+
+/**
+ * Destructor. It cancels and waits for the background build.
+ * (The token is not canceled if there is no background build
+ * as it may be shared with other operations.)
+ */
+ParallelKdTreeBuilder::~ParallelKdTreeBuilder()
+{
+   if( _backgroundPool ) {
+      cancel();
+      waitForDone();
+   }
+}
+
+
+void ParallelKdTreeBuilder::apply( Geode& geode )
+{
+   if( isCanceled() )
+      return;
+
+   for( unsigned int i=0; i<geode.getNumDrawables(); i++ )
+      addGeometry( geode.getDrawable( i )->asGeometry() );
+}
+
+
+/**
+ * Adds the geometry to the list of geometries to build.
+ * NULL geometries, geometries already in the list and geometries
+ * that already have KdTree are ignored.
+ */
+void ParallelKdTreeBuilder::addGeometry( Geometry *geometry )
+{
+   if( geometry && !dynamic_cast< KdTree* >( geometry->getShape() ) )
+      if( _geometrySet.insert( geometry ).second )
+         _geometries.push_back( geometry );
+}
+
+
+void KdTreeGeometryCollector::apply( Drawable& drawable )
+{
+   _builder->addGeometry( drawable.asGeometry() );
+}
+
+
+/**
+ * Builds the KdTrees of the collected geometries.
+ *
+ * The largest geometries are built first to balance the load
+ * of the worker threads. getBuildTime() returns the wall-clock time of the build,
+ * getSerialTime() the sum of the times spent by the workers and getSpeedup()
+ * their ratio. getMemoryUsage() returns the memory occupied by the built trees.
+ */
+void ParallelKdTreeBuilder::build()
+{
+   Timer time;
+
+   sort( _geometries.begin(), _geometries.end(), largerGeometry );
+
+   int numThreads = min( _numThreads, max( int( _geometries.size() ), 1 ) );
+   vector< double > busyTimes( numThreads, 0. );
+   vector< unsigned long long > memoryUsages( numThreads, 0 );
+   QAtomicInt nextGeometry( 0 );
+   QThreadPool pool;
+   pool.setMaxThreadCount( numThreads );
+   for( int i=0; i<numThreads; i++ )
+      pool.start( new BuildTask( _geometries, _buildOptions, &nextGeometry, _cancellationToken.get(),
+                                 &busyTimes[i], &memoryUsages[i] ) );
+   pool.waitForDone();
+
+   _buildTime = time.time_m();
+   _serialTime = 0.;
+   _memoryUsage = 0;
+   for( int i=0; i<numThreads; i++ ) {
+      _serialTime += busyTimes[i];
+      _memoryUsage += memoryUsages[i];
+   }
+   _numThreads = numThreads;
+   _geometrySet.clear();
+}
+
+
+/**
+ * Starts build() in the background thread and returns immediately.
+ *
+ * The collected geometries are referenced by the builder,
+ * so the scene may be released while the build is running.
+ * Use isDone() to check for completion or waitForDone() to wait for it.
+ * Nothing is started if the builder was already canceled.
+ */
+void ParallelKdTreeBuilder::startInBackground()
+{
+   if( _backgroundPool || isCanceled() )
+      return;
+
+   _backgroundPool = new QThreadPool;
+   _backgroundPool->setMaxThreadCount( 1 );
+   _backgroundPool->start( new BackgroundTask( this ) );
+}
+
+
+/**
+ * Cancels the build. Geometries whose trees are being built
+ * are finished, the remaining ones are skipped.
+ */
+void ParallelKdTreeBuilder::cancel()
+{
+   _cancellationToken->cancel();
+}
+
+
+/**
+ * Waits until the background build is finished.
+ */
+void ParallelKdTreeBuilder::waitForDone()
+{
+   if( _backgroundPool ) {
+      _backgroundPool->waitForDone();
+      delete _backgroundPool;
+      _backgroundPool = NULL;
+   }
+}
+
+
+/**
+ * Returns the memory occupied by the KdTree.
+ *
+ * The vertices are shared with the geometry and they are not counted.
+ */
+unsigned long long ParallelKdTreeBuilder::getMemoryUsage( const KdTree *kdTree )
+{
+   if( !kdTree )
+      return 0;
+
+   return sizeof( KdTree ) +
+          kdTree->getNodes().capacity() * sizeof( KdTree::KdNode ) +
+          kdTree->getTriangles().capacity() * sizeof( KdTree::Triangle );
+}
+
+
+/**
+ * Returns the mutex guarding Geometry::setShape() of the builder
+ * against concurrent reading of the shape by the intersectors.
+ */
+OpenThreads::Mutex& ParallelKdTreeBuilder::getShapeMutex()
+{
+   return shapeMutex;
+}
@@ -0,0 +1,136 @@
+/**
+ * @file
+ * ParallelKdTreeBuilder class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef PARALLEL_KD_TREE_BUILDER_H
+#define PARALLEL_KD_TREE_BUILDER_H
+
+#include <osg/KdTree>
+#include <osg/NodeVisitor>
+#include <OpenThreads/Mutex>
+#include <QAtomicInt>
+#include <set>
+#include <vector>
+#include "utils/CancellationToken.h"
+#include "utils/StateSetVisitor.h"
+
+class QThreadPool;
+namespace osg {
+   class Geometry;
+}
+
+
+/**
+ * KdTree builder that builds the trees of multiple geometries in parallel.
+ *
+ * Unlike osg::KdTreeBuilder, the visitor only collects the geometries
+ * during the traversal. Each geometry is collected once, even if it is
+ * shared by many geodes. The trees are built by build() on the pool
+ * of worker threads. Geometries that already have KdTree are skipped.
+ *
+ * Usage: scene->accept( builder ); builder.build();
+ *
+ * The build may also run in the background while the scene is rendered
+ * and intersected, see startInBackground(). The trees are then attached
+ * to the geometries under getShapeMutex() lock that has to be held
+ * by anybody who reads the geometry shape at the same time
+ * (see LazyKdTreeIntersector).
+ *
+ * The build is canceled by cancel() or through the cancellation token
+ * shared with other operations (see setCancellationToken()).
+ * The collection of geometries stops as well when the token is canceled.
+ */
+class ParallelKdTreeBuilder : public osg::NodeVisitor
+{
+   typedef osg::NodeVisitor inherited;
+
+public:
+
+   ParallelKdTreeBuilder( int numThreads = 0 );
+   virtual ~ParallelKdTreeBuilder();
+
+   virtual void apply( osg::Geode& geode );
+   void addGeometry( osg::Geometry *geometry );
+
+   void build();
+   void startInBackground();
+   void cancel();
+   void waitForDone();
+   inline bool isCanceled() const;
+   inline void setCancellationToken( CancellationToken *token );
+   inline CancellationToken* getCancellationToken() const;
+   inline bool isDone() const;
+
+   inline unsigned int getNumGeometries() const;
+   inline int getNumThreads() const;
+   inline double getBuildTime() const;
+   inline double getSerialTime() const;
+   inline double getSpeedup() const;
+   inline unsigned long long getMemoryUsage() const;
+
+   static unsigned long long getMemoryUsage( const osg::KdTree *kdTree );
+   static OpenThreads::Mutex& getShapeMutex();
+
+   osg::KdTree::BuildOptions _buildOptions;
+
+protected:
+
+   class BuildTask;
+   class BackgroundTask;
+   friend class BackgroundTask;
+
+   std::set< osg::Geometry* > _geometrySet;
+   std::vector< osg::ref_ptr< osg::Geometry > > _geometries;
+   int _numThreads;
+   double _buildTime;
+   double _serialTime;
+   unsigned long long _memoryUsage;
+   osg::ref_ptr< CancellationToken > _cancellationToken;
+   QAtomicInt _done;
+   QThreadPool *_backgroundPool;
+
+};
+
+
+/**
+ * StateSetVisitor that collects the geometries for ParallelKdTreeBuilder.
+ *
+ * It allows the geometries to be collected by a step of StateSetVisitorPipeline
+ * instead of a separate traversal.
+ */
+class KdTreeGeometryCollector : public StateSetVisitor
+{
+public:
+
+   KdTreeGeometryCollector( ParallelKdTreeBuilder *builder ) : _builder( builder )  {}
+
+   virtual void apply( osg::StateSet& /*stateSet*/ )  {}
+   virtual void apply( osg::Drawable& drawable );
+
+protected:
+
+   osg::ref_ptr< ParallelKdTreeBuilder > _builder;
+
+};
+
+
+//
+//  inline methods
+//
+
+inline bool ParallelKdTreeBuilder::isCanceled() const  { return _cancellationToken->isCanceled(); }
+inline void ParallelKdTreeBuilder::setCancellationToken( CancellationToken *token )  { _cancellationToken = token; }
+inline CancellationToken* ParallelKdTreeBuilder::getCancellationToken() const  { return _cancellationToken.get(); }
+inline bool ParallelKdTreeBuilder::isDone() const  { return _done != 0; }
+inline unsigned int ParallelKdTreeBuilder::getNumGeometries() const  { return (unsigned int)( _geometries.size() ); }
+inline int ParallelKdTreeBuilder::getNumThreads() const  { return _numThreads; }
+inline double ParallelKdTreeBuilder::getBuildTime() const  { return _buildTime; }
+inline double ParallelKdTreeBuilder::getSerialTime() const  { return _serialTime; }
+inline double ParallelKdTreeBuilder::getSpeedup() const  { return _buildTime > 0. ? _serialTime / _buildTime : 1.; }
+inline unsigned long long ParallelKdTreeBuilder::getMemoryUsage() const  { return _memoryUsage; }
+
+
+#endif /* PARALLEL_KD_TREE_BUILDER_H */
@@ -0,0 +1,448 @@
+/**
+ * @file
+ * ProgressiveRefinement class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osg/buffered_value>
+#include <osg/Camera>
+#include <osg/FrameBufferObject>
+#include <osg/GL2Extensions>
+#include <osg/Notify>
+#include <osg/Texture>
+#include <osg/Texture3D>
+#include <osg/TextureCubeMap>
+#include <osgViewer/View>
+#include "ProgressiveRefinement.h"
+#include "lighting/AdaptiveQualityController.h"
+
+using namespace osg;
+using namespace osgGA;
+
+
+// maximum number of accumulated samples
+static const int maxSamples = 256;
+
+
+
+/**
+ * Final draw callback of the camera.
+ *
+ * It copies the rendered frame into a texture, blends it into the accumulation
+ * texture of the framebuffer object (keeping the running average of the samples)
+ * and draws the accumulated image over the rendered frame. OpenGL state
+ * is saved and restored, so osg::State stays in sync. The callback calls
+ * the previous final draw callback of the camera afterwards.
+ */
+class ProgressiveRefinement::AccumulationCallback : public Camera::DrawCallback
+{
+public:
+
+   AccumulationCallback( ProgressiveRefinement *refinement, Camera::DrawCallback *nested )
+      : _refinement( refinement ), _nested( nested )  {}
+
+   virtual void operator()( RenderInfo &renderInfo ) const
+   {
+      ref_ptr< ProgressiveRefinement > refinement;
+      if( _refinement.lock( refinement ) && refinement->_drawMode != DRAW_FRAME )
+         accumulate( renderInfo, refinement->_drawMode, refinement->_frameSample );
+
+      if( _nested.valid() )
+         (*_nested)( renderInfo );
+   }
+
+protected:
+
+   struct ContextData {
+      GLuint fbo;
+      GLuint frameTexture;
+      GLuint accumulationTexture;
+      int width;
+      int height;
+      bool valid;
+      ContextData() : fbo( 0 ), frameTexture( 0 ), accumulationTexture( 0 ),
+                      width( 0 ), height( 0 ), valid( false )  {}
+   };
+
+   void accumulate( RenderInfo &renderInfo, DrawMode mode, int sample ) const;
+   static bool resize( ContextData &cd, unsigned int contextID, const FBOExtensions *fboExt,
+                       int width, int height, GLint prevFbo );
+   static GLuint createTexture( GLint internalFormat, GLenum format, int width, int height );
+   static void drawQuad();
+
+   observer_ptr< ProgressiveRefinement > _refinement;
+   ref_ptr< Camera::DrawCallback > _nested;
+   mutable buffered_object< ContextData > _contextData;
+};
+
+
+void ProgressiveRefinement::AccumulationCallback::accumulate( RenderInfo &renderInfo,
+                                                               DrawMode mode, int sample ) const
+{
+   State *state = renderInfo.getState();
+   unsigned int contextID = state->getContextID();
+   const Viewport *viewport = renderInfo.getCurrentCamera()->getViewport();
+   if( !viewport )
+      return;
+   int x = int( viewport->x() );
+   int y = int( viewport->y() );
+   int w = int( viewport->width() );
+   int h = int( viewport->height() );
+   if( w <= 0 || h <= 0 )
+      return;
+
+   const FBOExtensions *fboExt = FBOExtensions::instance( contextID, true );
+   if( !fboExt || !fboExt->isSupported() )
+      return;
+
+   // nothing accumulated for the new viewport size
+   ContextData &cd = _contextData[ contextID ];
+   bool sizeChanged = cd.width != w || cd.height != h;
+   if( sizeChanged && mode != ACCUMULATE )
+      return;
+
+   // leave the state tracked by osg::State in a known condition
+   state->setActiveTextureUnit( 0 );
+   state->setClientActiveTextureUnit( 0 );
+   state->disableAllVertexArrays();
+   GL2Extensions *gl2Ext = GL2Extensions::Get( contextID, true );
+   if( gl2Ext->isGlslSupported() ) {
+      gl2Ext->glUseProgram( 0 );
+      state->setLastAppliedProgramObject( NULL );
+   }
+
+   GLint prevFbo = 0;
+   glGetIntegerv( GL_FRAMEBUFFER_BINDING_EXT, &prevFbo );
+   glPushAttrib( GL_ALL_ATTRIB_BITS );
+   glMatrixMode( GL_PROJECTION );
+   glPushMatrix();
+   glLoadIdentity();
+   glOrtho( 0., 1., 0., 1., -1., 1. );
+   glMatrixMode( GL_TEXTURE );
+   glPushMatrix();
+   glLoadIdentity();
+   glMatrixMode( GL_MODELVIEW );
+   glPushMatrix();
+   glLoadIdentity();
+
+   // (re)create the buffers, the frame is the first sample then
+   if( sizeChanged ) {
+      cd.valid = resize( cd, contextID, fboExt, w, h, prevFbo );
+      sample = 0;
+   }
+
+   if( cd.valid ) {
+
+      // plain textured quads
+      int numUnits = Texture::getExtensions( contextID, true )->numTextureUnits();
+      for( int i=numUnits-1; i>=0; i-- ) {
+         state->setActiveTextureUnit( i );
+         glDisable( GL_TEXTURE_1D );
+         glDisable( GL_TEXTURE_2D );
+         glDisable( GL_TEXTURE_3D );
+         glDisable( GL_TEXTURE_CUBE_MAP );
+         glDisable( GL_TEXTURE_GEN_S );
+         glDisable( GL_TEXTURE_GEN_T );
+         glDisable( GL_TEXTURE_GEN_R );
+         glDisable( GL_TEXTURE_GEN_Q );
+      }
+      glEnable( GL_TEXTURE_2D );
+      glTexEnvi( GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE );
+      glDisable( GL_LIGHTING );
+      glDisable( GL_DEPTH_TEST );
+      glDisable( GL_STENCIL_TEST );
+      glDisable( GL_ALPHA_TEST );
+      glDisable( GL_CULL_FACE );
+      glDisable( GL_FOG );
+      glDisable( GL_SCISSOR_TEST );
+      glPolygonMode( GL_FRONT_AND_BACK, GL_FILL );
+      glColorMask( GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE );
+      glDepthMask( GL_FALSE );
+
+      if( mode == ACCUMULATE ) {
+
+         // copy the rendered frame
+         glBindTexture( GL_TEXTURE_2D, cd.frameTexture );
+         glCopyTexSubImage2D( GL_TEXTURE_2D, 0, 0, 0, x, y, w, h );
+
+         // running average: accumulated * (1 - 1/n) + frame * 1/n
+         fboExt->glBindFramebuffer( GL_FRAMEBUFFER_EXT, cd.fbo );
+         glViewport( 0, 0, w, h );
+         if( sample == 0 )
+            glDisable( GL_BLEND );
+         else {
+            glEnable( GL_BLEND );
+            glBlendFunc( GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA );
+         }
+         glColor4f( 1.f, 1.f, 1.f, 1.f / float( sample + 1 ) );
+         drawQuad();
+         fboExt->glBindFramebuffer( GL_FRAMEBUFFER_EXT, prevFbo );
+      }
+
+      // display the accumulated image
+      glViewport( x, y, w, h );
+      glDisable( GL_BLEND );
+      glColor4f( 1.f, 1.f, 1.f, 1.f );
+      glBindTexture( GL_TEXTURE_2D, cd.accumulationTexture );
+      drawQuad();
+
+      state->setActiveTextureUnit( 0 );
+   }
+
+   glMatrixMode( GL_MODELVIEW );
+   glPopMatrix();
+   glMatrixMode( GL_TEXTURE );
+   glPopMatrix();
+   glMatrixMode( GL_PROJECTION );
+   glPopMatrix();
+   glPopAttrib();
+}
+
+
+/**
+ * Creates the frame and accumulation textures and the framebuffer object
+ * of the given size. Floating point accumulation texture is used when supported,
+ * as 8-bit channels lose the precision of the running average quickly.
+ * The method expects the texture state to be saved by the caller.
+ */
+bool ProgressiveRefinement::AccumulationCallback::resize( ContextData &cd, unsigned int contextID,
+      const FBOExtensions *fboExt, int width, int height, GLint prevFbo )
+{
+   if( cd.frameTexture )
+      glDeleteTextures( 1, &cd.frameTexture );
+   if( cd.accumulationTexture )
+      glDeleteTextures( 1, &cd.accumulationTexture );
+   if( !cd.fbo )
+      fboExt->glGenFramebuffers( 1, &cd.fbo );
+   cd.width = width;
+   cd.height = height;
+
+   cd.frameTexture = createTexture( GL_RGB8, GL_RGB, width, height );
+   bool floatSupported = isGLExtensionSupported( contextID, "GL_ARB_texture_float" );
+   cd.accumulationTexture = createTexture( floatSupported ? GL_RGBA16F_ARB : GL_RGBA8,
+                                           GL_RGBA, width, height );
+
+   fboExt->glBindFramebuffer( GL_FRAMEBUFFER_EXT, cd.fbo );
+   fboExt->glFramebufferTexture2D( GL_FRAMEBUFFER_EXT, GL_COLOR_ATTACHMENT0_EXT,
+                                   GL_TEXTURE_2D, cd.accumulationTexture, 0 );
+   GLenum status = fboExt->glCheckFramebufferStatus( GL_FRAMEBUFFER_EXT );
+   fboExt->glBindFramebuffer( GL_FRAMEBUFFER_EXT, prevFbo );
+
+   if( status != GL_FRAMEBUFFER_COMPLETE_EXT ) {
+      notify( WARN ) << "ProgressiveRefinement: Accumulation framebuffer is not complete "
+                        "(status 0x" << std::hex << status << std::dec << ")." << std::endl;
+      return false;
+   }
+   return true;
+}
+
+
+GLuint ProgressiveRefinement::AccumulationCallback::createTexture( GLint internalFormat, GLenum format,
+                                                                    int width, int height )
+{
+   GLuint texture;
+   glGenTextures( 1, &texture );
+   glBindTexture( GL_TEXTURE_2D, texture );
+   glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST );
+   glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST );
+   glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+   glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+   glTexImage2D( GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, NULL );
+   return texture;
+}
+
+
+void ProgressiveRefinement::AccumulationCallback::drawQuad()
+{
+   glBegin( GL_QUADS );
+   glTexCoord2f( 0.f, 0.f );  glVertex2f( 0.f, 0.f );
+   glTexCoord2f( 1.f, 0.f );  glVertex2f( 1.f, 0.f );
+   glTexCoord2f( 1.f, 1.f );  glVertex2f( 1.f, 1.f );
+   glTexCoord2f( 0.f, 1.f );  glVertex2f( 0.f, 1.f );
+   glEnd();
+}
+
+
+
+ProgressiveRefinement::ProgressiveRefinement()
+   : _enabled( false ),
+     _numSamples( 16 ),
+     _nextSample( 0 ),
+     _drawMode( DRAW_FRAME ),
+     _frameSample( 0 ),
+     _jittered( false ),
+     _lastViewMatrixValid( false )
+{
+}
+
+
+ProgressiveRefinement::~ProgressiveRefinement()
+{
+   restoreProjection();
+}
+
+
+/**
+ * Installs the accumulation as the final draw callback of the camera.
+ * The previous final draw callback is called after the accumulation.
+ * The object has to be installed as event handler of the camera's view as well.
+ */
+void ProgressiveRefinement::install( Camera *camera )
+{
+   _camera = camera;
+   camera->setFinalDrawCallback( new AccumulationCallback( this, camera->getFinalDrawCallback() ) );
+}
+
+
+/**
+ * Enables or disables the refinement. The jittered projection
+ * is restored immediately and a new frame is requested.
+ */
+void ProgressiveRefinement::setEnabled( bool on )
+{
+   if( _enabled == on )
+      return;
+
+   _enabled = on;
+   _nextSample = 0;
+   _drawMode = DRAW_FRAME;
+   _lastViewMatrixValid = false;
+   restoreProjection();
+
+   ref_ptr< Camera > camera;
+   if( _camera.lock( camera ) ) {
+      osgViewer::View *view = dynamic_cast< osgViewer::View* >( camera->getView() );
+      if( view )
+         view->requestRedraw();
+   }
+}
+
+
+/**
+ * Sets the number of accumulated samples (1 to 256, default 16).
+ * The refinement is restarted.
+ */
+void ProgressiveRefinement::setNumSamples( int numSamples )
+{
+   _numSamples = numSamples < 1 ? 1 : numSamples > maxSamples ? maxSamples : numSamples;
+   _nextSample = 0;
+}
+
+
+/**
+ * Sets the controller whose lowered quality suspends the refinement.
+ */
+void ProgressiveRefinement::setQualityController( AdaptiveQualityController *controller )
+{
+   _qualityController = controller;
+}
+
+
+void ProgressiveRefinement::restoreProjection()
+{
+   ref_ptr< Camera > camera;
+   if( _jittered && _camera.lock( camera ) )
+      camera->setProjectionMatrix( _baseProjection );
+   _jittered = false;
+}
+
+
+// radical inverse of the index in the given base
+static double halton( int index, int base )
+{
+   double r = 0.;
+   double f = 1.;
+   for( int i=index; i>0; i/=base ) {
+      f /= base;
+      r += f * ( i % base );
+   }
+   return r;
+}
+
+
+/**
+ * Returns the subpixel offset of the sample (in pixels, -0.5 to 0.5).
+ *
+ * The first sample is not jittered, so the image does not move when the refinement starts.
+ * The other samples follow Halton (2,3) sequence that covers the pixel evenly
+ * for any number of samples.
+ */
+Vec2d ProgressiveRefinement::getSampleOffset( int sample )
+{
+   if( sample == 0 )
+      return Vec2d( 0., 0. );
+   return Vec2d( halton( sample, 2 ) - 0.5, halton( sample, 3 ) - 0.5 );
+}
+
+
+/**
+ * Per-frame processing. It detects whether the camera is still
+ * and jitters the projection of the next sample.
+ */
+bool ProgressiveRefinement::handle( const GUIEventAdapter &ea, GUIActionAdapter &aa )
+{
+   if( ea.getEventType() != GUIEventAdapter::FRAME || !_enabled )
+      return false;
+
+   ref_ptr< Camera > camera;
+   if( !_camera.lock( camera ) || !camera->getViewport() )
+      return false;
+
+   // projection set by the application (the jittered one is ours)
+   const Matrixd &projection = camera->getProjectionMatrix();
+   bool projectionChanged = false;
+   if( !_jittered || projection != _jitteredProjection ) {
+      projectionChanged = projection != _baseProjection;
+      _baseProjection = projection;
+      _jittered = false;
+   }
+
+   // the camera is still if neither view nor projection changed
+   // and the rendering is in full quality
+   const Matrixd &viewMatrix = camera->getViewMatrix();
+   bool still = _lastViewMatrixValid && viewMatrix == _lastViewMatrix && !projectionChanged;
+   _lastViewMatrix = viewMatrix;
+   _lastViewMatrixValid = true;
+   ref_ptr< AdaptiveQualityController > qualityController;
+   if( _qualityController.lock( qualityController ) &&
+       qualityController->getLevel() != AdaptiveQualityController::FULL_QUALITY )
+      still = false;
+
+   if( !still ) {
+
+      // render normally and request one more frame
+      // that starts the refinement when the camera stops
+      _nextSample = 0;
+      _drawMode = DRAW_FRAME;
+      restoreProjection();
+      aa.requestRedraw();
+
+   } else
+   if( _nextSample < _numSamples ) {
+
+      // jitter the projection by subpixel offset
+      _frameSample = _nextSample++;
+      _drawMode = ACCUMULATE;
+      Vec2d offset = getSampleOffset( _frameSample );
+      const Viewport *viewport = camera->getViewport();
+      _jitteredProjection = _baseProjection *
+            Matrixd::translate( 2. * offset.x() / viewport->width(),
+                                2. * offset.y() / viewport->height(), 0. );
+      camera->setProjectionMatrix( _jitteredProjection );
+      _jittered = true;
+
+      // continue until the sample target is reached
+      if( _nextSample < _numSamples )
+         aa.requestRedraw();
+
+   } else {
+
+      // refinement completed, display the accumulated image
+      _drawMode = DISPLAY_ACCUMULATED;
+      restoreProjection();
+
+   }
+
+   return false;
+}
@@ -0,0 +1,92 @@
+/**
+ * @file
+ * ProgressiveRefinement class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef PROGRESSIVE_REFINEMENT_H
+#define PROGRESSIVE_REFINEMENT_H
+
+#include <osg/Matrixd>
+#include <osg/Vec2d>
+#include <osg/observer_ptr>
+#include <osgGA/GUIEventHandler>
+
+namespace osg {
+   class Camera;
+};
+class AdaptiveQualityController;
+
+
+/**
+ * ProgressiveRefinement anti-aliases the image while the camera does not move.
+ *
+ * When the camera stops, each following frame is rendered with the projection
+ * jittered by a subpixel offset and the frames are accumulated (averaged)
+ * in an offscreen buffer (framebuffer object) until the number of samples is reached.
+ * The accumulated image is displayed instead of the rendered frame. The refinement
+ * is restarted by any change of the view or projection and it is not performed
+ * while AdaptiveQualityController renders in lowered quality.
+ *
+ * The object is installed as the event handler of the view (see install()).
+ * It expects that the drawing of the frame is finished before the event traversal
+ * of the next frame, i.e. any but DrawThreadPerContext threading model.
+ */
+class ProgressiveRefinement : public osgGA::GUIEventHandler
+{
+   typedef osgGA::GUIEventHandler inherited;
+
+public:
+
+   ProgressiveRefinement();
+
+   void install( osg::Camera *camera );
+
+   virtual bool handle( const osgGA::GUIEventAdapter &ea, osgGA::GUIActionAdapter &aa );
+
+   void setEnabled( bool on );
+   inline bool isEnabled() const;
+   void setNumSamples( int numSamples );
+   inline int getNumSamples() const;
+   inline int getNumAccumulatedSamples() const;
+   void setQualityController( AdaptiveQualityController *controller );
+
+protected:
+
+   virtual ~ProgressiveRefinement();
+
+   void restoreProjection();
+   static osg::Vec2d getSampleOffset( int sample );
+
+   class AccumulationCallback;
+   friend class AccumulationCallback;
+
+   enum DrawMode { DRAW_FRAME, ACCUMULATE, DISPLAY_ACCUMULATED };
+
+   osg::observer_ptr< osg::Camera > _camera;
+   osg::observer_ptr< AdaptiveQualityController > _qualityController;
+   bool _enabled;
+   int _numSamples;
+   int _nextSample;
+   DrawMode _drawMode;
+   int _frameSample;
+   bool _jittered;
+   osg::Matrixd _baseProjection;
+   osg::Matrixd _jitteredProjection;
+   osg::Matrixd _lastViewMatrix;
+   bool _lastViewMatrixValid;
+
+};
+
+
+//
+//  inline methods
+//
+
+inline bool ProgressiveRefinement::isEnabled() const  { return _enabled; }
+inline int ProgressiveRefinement::getNumSamples() const  { return _numSamples; }
+inline int ProgressiveRefinement::getNumAccumulatedSamples() const  { return _nextSample; }
+
+
+#endif /* PROGRESSIVE_REFINEMENT_H */
@@ -0,0 +1,254 @@
+/**
+ * @file
+ * SceneCache class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osg/Node>
+#include <osg/Texture>
+#include <osgDB/FileNameUtils>
+#include <osgDB/FileUtils>
+#include <osgDB/ReadFile>
+#include <osgDB/WriteFile>
+#include <QDesktopServices>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QThread>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
+#include "SceneCache.h"
+#include "MappedFile.h"
+#include "StateSetVisitor.h"
+
+using namespace std;
+using namespace osg;
+
+
+
+/**
+ * Returns the cache directory. The directory is created if it does not exist.
+ */
+std::string SceneCache::getDirectory()
+{
+   QString dir = QDesktopServices::storageLocation( QDesktopServices::CacheLocation );
+   if( dir.isEmpty() )
+      dir = QDir::tempPath();
+   dir = QDir::fromNativeSeparators( dir ) + "/scenes";
+   QDir().mkpath( dir );
+   return dir.toUtf8().data();
+}
+
+
+/**
+ * Returns the name of the cache file for the key.
+ */
+std::string SceneCache::getFileName( ContentHash::Value key )
+{
+   return getDirectory() + "/" + getKeyString( key ) + ".osgb";
+}
+
+
+/**
+ * Returns the key as 16-digit hexadecimal string.
+ */
+std::string SceneCache::getKeyString( ContentHash::Value key )
+{
+   char s[17];
+   sprintf( s, "%016llx", key );
+   return s;
+}
+
+
+/**
+ * Reads the scene stored under the key.
+ * Returns NULL if the cache does not contain the scene.
+ */
+ref_ptr< Node > SceneCache::read( ContentHash::Value key )
+{
+   string fileName = getFileName( key );
+   if( !osgDB::fileExists( fileName ) )
+      return NULL;
+
+   return osgDB::readNodeFile( fileName );
+}
+
+
+/**
+ * Stores the scene under the key.
+ *
+ * The scene is written into a temporary file first that is renamed
+ * afterwards. Thus, concurrently running application instances
+ * never read partially written file.
+ */
+bool SceneCache::write( ContentHash::Value key, Node *scene )
+{
+   string fileName = getFileName( key );
+   QString tmpName = QString::fromUtf8( ( getDirectory() + "/" + getKeyString( key ) ).c_str() ) +
+                     ".tmp" + QString::number( quintptr( QThread::currentThreadId() ) ) + ".osgb";
+
+   // write scene including image data
+   ref_ptr< osgDB::Options > options = new osgDB::Options( "WriteImageHint=IncludeData" );
+   if( !osgDB::writeNodeFile( *scene, tmpName.toUtf8().data(), options ) ) {
+      QFile::remove( tmpName );
+      return false;
+   }
+
+   // move to the final name
+   QString finalName = QString::fromUtf8( fileName.c_str() );
+   QFile::remove( finalName );
+   if( !QFile::rename( tmpName, finalName ) ) {
+      QFile::remove( tmpName );
+      return false;
+   }
+
+   return true;
+}
+
+
+// returns the canonical name of the existing file, relative names are resolved
+// against the directory, empty string is returned for nonexistent files
+static string resolveFile( const string &name, const QDir &dir )
+{
+   QFileInfo info( dir, QString::fromUtf8( name.c_str() ) );
+   if( !info.isFile() )
+      return string();
+   return info.canonicalFilePath().toUtf8().data();
+}
+
+
+// text model formats whose references are scanned recursively
+static bool isScannedFormat( const string &fileName )
+{
+   string ext = osgDB::getLowerCaseFileExtension( fileName );
+   return ext == "iv" || ext == "ivx" || ext == "ivl" || ext == "wrl" ||
+          ext == "obj" || ext == "mtl" || ext == "osg" || ext == "osgt";
+}
+
+
+static bool scanFile( const string &fileName, set< string > &files )
+{
+   MappedFile f;
+   if( !f.open( fileName ) )
+      return false;
+   const char *data = f.getData();
+   size_t size = f.getSize();
+
+   // binary files can not be scanned
+   if( memchr( data, 0, size ) != NULL )
+      return false;
+
+   // every quoted string and every word (Inventor strings
+   // do not need to be quoted) naming an existing file is a reference
+   QDir dir = QFileInfo( QString::fromUtf8( fileName.c_str() ) ).absoluteDir();
+   size_t i = 0;
+   while( i < size )
+   {
+      char c = data[i];
+      if( isspace( (unsigned char)c ) || c == ',' || c == '[' || c == ']' ||
+          c == '{' || c == '}' ) {
+         i++;
+         continue;
+      }
+
+      // skip comments
+      if( c == '#' ) {
+         while( i < size && data[i] != '\n' )  i++;
+         continue;
+      }
+
+      size_t start, end;
+      if( c == '"' ) {
+         start = ++i;
+         while( i < size && data[i] != '"' && data[i] != '\n' )  i++;
+         end = i++;
+      } else {
+         start = i;
+         while( i < size && !isspace( (unsigned char)data[i] ) && data[i] != ',' &&
+                data[i] != '[' && data[i] != ']' && data[i] != '{' && data[i] != '}' )  i++;
+         end = i;
+
+         // numbers are never file names (this avoids file system
+         // queries for the bulk of the geometry data)
+         if( isdigit( (unsigned char)c ) || c == '-' || c == '+' || c == '.' )
+            continue;
+      }
+
+      // file names contain a dot
+      if( end == start || end - start > 1024 ||
+          memchr( data + start, '.', end - start ) == NULL )
+         continue;
+
+      string name = resolveFile( string( data + start, end - start ), dir );
+      if( name.empty() || !files.insert( name ).second )
+         continue;
+      if( isScannedFormat( name ) && !scanFile( name, files ) )
+         return false;
+   }
+
+   return true;
+}
+
+
+/**
+ * Finds the files referenced by the model file, including the files
+ * referenced by the referenced model files. The canonical file names
+ * are inserted into files.
+ *
+ * Returns false if the model can not be scanned. This is the case of binary
+ * and unknown formats whose references can not be found.
+ */
+bool SceneCache::findReferencedFiles( const string &modelFileName, set< string > &files )
+{
+   if( !isScannedFormat( modelFileName ) )
+      return false;
+   return scanFile( modelFileName, files );
+}
+
+
+// collects the file names of the images used by the scene
+class ImageFileCollector : public StateSetVisitor
+{
+public:
+   virtual void apply( StateSet &ss )
+   {
+      const StateSet::TextureAttributeList &tal = ss.getTextureAttributeList();
+      for( unsigned int unit=0; unit<tal.size(); unit++ ) {
+         Texture *t = dynamic_cast< Texture* >( ss.getTextureAttribute( unit, StateAttribute::TEXTURE ) );
+         if( t == NULL )
+            continue;
+         for( unsigned int i=0; i<t->getNumImages(); i++ ) {
+            Image *image = t->getImage( i );
+            if( image && !image->getFileName().empty() )
+               fileNames.insert( image->getFileName() );
+         }
+      }
+   }
+
+   set< string > fileNames;
+};
+
+
+/**
+ * Returns true if all the image files used by the scene are among the files,
+ * typically the files found by findReferencedFiles().
+ * Image names that do not resolve to any file are considered not among the files.
+ */
+bool SceneCache::checkImageFiles( Node *scene, const string &modelFileName,
+                                  const set< string > &files )
+{
+   ImageFileCollector collector;
+   scene->accept( collector );
+
+   QDir dir = QFileInfo( QString::fromUtf8( modelFileName.c_str() ) ).absoluteDir();
+   for( set< string >::iterator it = collector.fileNames.begin();
+        it != collector.fileNames.end(); it++ )
+   {
+      string name = resolveFile( *it, dir );
+      if( name.empty() || files.find( name ) == files.end() )
+         return false;
+   }
+   return true;
+}
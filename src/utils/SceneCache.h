@@ -0,0 +1,59 @@
+/**
+ * @file
+ * SceneCache class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef SCENE_CACHE_H
+#define SCENE_CACHE_H
+
+#include <osg/ref_ptr>
+#include <set>
+#include <string>
+#include "ContentHash.h"
+
+namespace osg {
+   class Node;
+}
+
+
+/**
+ * Disk cache of prepared scenes.
+ *
+ * The scenes are stored as OSG binary files (.osgb) named by the key
+ * in the cache directory. The key is expected to be derived from the content
+ * of the model file and from everything else that influences the scene
+ * preparation, such as application build. Thus, the stale entries
+ * are never read and no invalidation is required.
+ *
+ * Images are stored inside the cache files. Therefore, the cached scene
+ * does not depend on the texture files that may be stored
+ * in temporary directories or inside of zip archives.
+ *
+ * Models that are not zip archives may refer to textures and included
+ * files outside of the model file. findReferencedFiles() finds them,
+ * so their time stamps can become part of the key, and checkImageFiles()
+ * verifies that the loaded scene does not use any other image file.
+ * The scenes that fail the checks must not be cached.
+ */
+class SceneCache
+{
+public:
+
+   static std::string getDirectory();
+   static std::string getFileName( ContentHash::Value key );
+   static std::string getKeyString( ContentHash::Value key );
+
+   static osg::ref_ptr< osg::Node > read( ContentHash::Value key );
+   static bool write( ContentHash::Value key, osg::Node *scene );
+
+   static bool findReferencedFiles( const std::string &modelFileName,
+                                    std::set< std::string > &files );
+   static bool checkImageFiles( osg::Node *scene, const std::string &modelFileName,
+                                const std::set< std::string > &files );
+
+};
+
+
+#endif /* SCENE_CACHE_H */
@@ -0,0 +1,369 @@
+/**
+ * @file
+ * SceneHashVisitor class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osg/Geode>
+#include <osg/Geometry>
+#include <osg/LightSource>
+#include <osg/LOD>
+#include <osg/Switch>
+#include <osg/Texture>
+#include <osg/Transform>
+#include <osgDB/Registry>
+#include <sstream>
+#include "utils/SceneHashVisitor.h"
+
+using namespace osg;
+using namespace std;
+
+
+
+SceneHashVisitor::SceneHashVisitor()
+   : NodeVisitor( NODE_VISITOR, TRAVERSE_ALL_CHILDREN )
+{
+   // osgb serializer is used for hashing of state attributes
+   // (images are referenced by file names and hashed separately)
+   _osgbWriter = osgDB::Registry::instance()->getReaderWriterForExtension( "osgb" );
+   _osgbOptions = new osgDB::Options( "WriteImageHint=UseExternal" );
+}
+
+
+/**
+ * Computes the hash of the node. The children are hashed first.
+ */
+void SceneHashVisitor::apply( Node& node )
+{
+   // already hashed?
+   if( _nodeHashes.find( &node ) != _nodeHashes.end() )
+      return;
+
+   // hash children first
+   traverse( node );
+
+   // node type and common parameters
+   ContentHash h;
+   h.add( node.libraryName() );
+   h.add( node.className() );
+   h.add( node.getName() );
+   h.add( node.getNodeMask() );
+   h.add( getStateSetHash( node.getStateSet() ) );
+   if( node.getUserDataContainer() )
+      h.add( getObjectHash( node.getUserDataContainer() ) );
+   bool light = false;
+
+   // Transform
+   const Transform *t = node.asTransform();
+   if( t ) {
+      Matrix m;
+      t->computeLocalToWorldMatrix( m, NULL );
+      h.add( m );
+      h.add( t->getReferenceFrame() );
+   }
+
+   // LightSource
+   const LightSource *ls = dynamic_cast< const LightSource* >( &node );
+   if( ls ) {
+      light = true;
+      h.add( getObjectHash( ls->getLight() ) );
+      h.add( ls->getReferenceFrame() );
+   }
+
+   // Switch
+   const Switch *sw = dynamic_cast< const Switch* >( &node );
+   if( sw )
+      for( unsigned int i=0, c=sw->getNumChildren(); i<c; i++ )
+         h.add( sw->getValue( i ) );
+
+   // LOD
+   const LOD *lod = dynamic_cast< const LOD* >( &node );
+   if( lod ) {
+      h.add( lod->getCenterMode() );
+      h.add( lod->getCenter() );
+      h.add( lod->getRangeMode() );
+      for( unsigned int i=0, c=lod->getNumRanges(); i<c; i++ ) {
+         h.add( lod->getMinRange( i ) );
+         h.add( lod->getMaxRange( i ) );
+      }
+   }
+
+   // Geode
+   const Geode *geode = node.asGeode();
+   if( geode )
+      for( unsigned int i=0, c=geode->getNumDrawables(); i<c; i++ )
+         h.add( getDrawableHash( geode->getDrawable( i ) ) );
+
+   // children
+   const Group *group = node.asGroup();
+   if( group ) {
+      h.add( group->getNumChildren() );
+      for( unsigned int i=0, c=group->getNumChildren(); i<c; i++ ) {
+         const Node *child = group->getChild( i );
+         h.add( _nodeHashes[ child ] );
+         if( _lightNodes.find( child ) != _lightNodes.end() )
+            light = true;
+      }
+   }
+
+   _nodeHashes[ &node ] = h.get();
+   if( light )
+      _lightNodes.insert( &node );
+}
+
+
+/**
+ * Returns the hash of already visited node.
+ * Returns false if the node was not visited by the visitor.
+ */
+bool SceneHashVisitor::getHash( const Node *node, Value &hash ) const
+{
+   map< const Node*, Value >::const_iterator it = _nodeHashes.find( node );
+   if( it == _nodeHashes.end() )
+      return false;
+   hash = it->second;
+   return true;
+}
+
+
+/**
+ * Returns true if the node or any node in its subgraph is LightSource.
+ */
+bool SceneHashVisitor::containsLight( const Node *node ) const
+{
+   return _lightNodes.find( node ) != _lightNodes.end();
+}
+
+
+SceneHashVisitor::Value SceneHashVisitor::getStateSetHash( const StateSet *ss )
+{
+   // NULL StateSet
+   if( !ss )
+      return 0;
+
+   // memoized value
+   ObjectHashes::iterator it = _objectHashes.find( ss );
+   if( it != _objectHashes.end() )
+      return it->second;
+
+   ContentHash h;
+
+   // modes
+   const StateSet::ModeList &ml = ss->getModeList();
+   for( StateSet::ModeList::const_iterator mit = ml.begin(); mit != ml.end(); mit++ ) {
+      h.add( mit->first );
+      h.add( mit->second );
+   }
+
+   // attributes
+   const StateSet::AttributeList &al = ss->getAttributeList();
+   for( StateSet::AttributeList::const_iterator ait = al.begin(); ait != al.end(); ait++ ) {
+      h.add( ait->first.first );
+      h.add( ait->first.second );
+      h.add( getObjectHash( ait->second.first.get() ) );
+      addImages( h, ait->second.first.get() );
+      h.add( ait->second.second );
+   }
+
+   // texture modes
+   const StateSet::TextureModeList &tml = ss->getTextureModeList();
+   for( unsigned int unit=0; unit<tml.size(); unit++ )
+      for( StateSet::ModeList::const_iterator mit = tml[unit].begin(); mit != tml[unit].end(); mit++ ) {
+         h.add( unit );
+         h.add( mit->first );
+         h.add( mit->second );
+      }
+
+   // texture attributes
+   const StateSet::TextureAttributeList &tal = ss->getTextureAttributeList();
+   for( unsigned int unit=0; unit<tal.size(); unit++ )
+      for( StateSet::AttributeList::const_iterator ait = tal[unit].begin(); ait != tal[unit].end(); ait++ ) {
+         h.add( unit );
+         h.add( ait->first.first );
+         h.add( ait->first.second );
+         h.add( getObjectHash( ait->second.first.get() ) );
+         addImages( h, ait->second.first.get() );
+         h.add( ait->second.second );
+      }
+
+   // uniforms
+   const StateSet::UniformList &ul = ss->getUniformList();
+   for( StateSet::UniformList::const_iterator uit = ul.begin(); uit != ul.end(); uit++ ) {
+      h.add( uit->first );
+      h.add( getObjectHash( uit->second.first.get() ) );
+      h.add( uit->second.second );
+   }
+
+   // render bin details
+   h.add( ss->getRenderingHint() );
+   h.add( ss->getRenderBinMode() );
+   h.add( ss->getBinNumber() );
+   h.add( ss->getBinName() );
+   h.add( ss->getNestRenderBins() );
+
+   return _objectHashes[ ss ] = h.get();
+}
+
+
+SceneHashVisitor::Value SceneHashVisitor::getDrawableHash( const Drawable *drawable )
+{
+   // memoized value
+   ObjectHashes::iterator it = _objectHashes.find( drawable );
+   if( it != _objectHashes.end() )
+      return it->second;
+
+   // non-Geometry drawables are hashed through their serialization
+   const Geometry *g = drawable->asGeometry();
+   if( !g )
+      return getObjectHash( drawable );
+
+   ContentHash h;
+   h.add( g->className() );
+   h.add( getStateSetHash( g->getStateSet() ) );
+   h.add( getGeometryDataHash( g ) );
+
+   return _objectHashes[ drawable ] = h.get();
+}
+
+
+/**
+ * Returns the hash of the arrays and primitive sets of the Geometry.
+ * Unlike getDrawableHash(), the StateSet is not included.
+ */
+SceneHashVisitor::Value SceneHashVisitor::getGeometryDataHash( const Geometry *g )
+{
+   // memoized value
+   ObjectHashes::iterator it = _geometryDataHashes.find( g );
+   if( it != _geometryDataHashes.end() )
+      return it->second;
+
+   ContentHash h;
+
+   // arrays
+   addArray( h, g->getVertexArray() );
+   addArray( h, g->getNormalArray() );
+   h.add( g->getNormalBinding() );
+   addArray( h, g->getColorArray() );
+   h.add( g->getColorBinding() );
+   addArray( h, g->getSecondaryColorArray() );
+   h.add( g->getSecondaryColorBinding() );
+   addArray( h, g->getFogCoordArray() );
+   h.add( g->getFogCoordBinding() );
+   for( unsigned int i=0, c=g->getNumTexCoordArrays(); i<c; i++ ) {
+      h.add( i );
+      addArray( h, g->getTexCoordArray( i ) );
+   }
+   for( unsigned int i=0, c=g->getNumVertexAttribArrays(); i<c; i++ ) {
+      h.add( i );
+      addArray( h, g->getVertexAttribArray( i ) );
+      h.add( g->getVertexAttribBinding( i ) );
+   }
+
+   // primitive sets
+   for( unsigned int i=0, c=g->getNumPrimitiveSets(); i<c; i++ ) {
+      const PrimitiveSet *ps = g->getPrimitiveSet( i );
+      h.add( ps->getType() );
+      h.add( ps->getMode() );
+      h.add( ps->getNumInstances() );
+      const DrawArrayLengths *dal = dynamic_cast< const DrawArrayLengths* >( ps );
+      if( dal ) {
+         h.add( dal->getFirst() );
+         if( !dal->empty() )
+            h.add( &dal->front(), dal->size() * sizeof( GLsizei ) );
+      }
+      else
+         if( ps->getDrawElements() )
+            h.add( ps->getDataPointer(), ps->getTotalDataSize() );
+         else {
+            h.add( ps->getNumIndices() );
+            if( ps->getNumIndices() > 0 )
+               h.add( ps->index( 0 ) );
+         }
+   }
+
+   return _geometryDataHashes[ g ] = h.get();
+}
+
+
+/**
+ * Hashes the object through its osgb serialization.
+ * If the object can not be serialized, the hash is based on the object address,
+ * so the object is never considered equal to another object.
+ */
+SceneHashVisitor::Value SceneHashVisitor::getObjectHash( const Object *obj )
+{
+   if( !obj )
+      return 0;
+
+   // memoized value
+   ObjectHashes::iterator it = _objectHashes.find( obj );
+   if( it != _objectHashes.end() )
+      return it->second;
+
+   ContentHash h;
+   h.add( obj->libraryName() );
+   h.add( obj->className() );
+
+   stringstream s;
+   if( _osgbWriter &&
+       _osgbWriter->writeObject( *obj, s, _osgbOptions.get() ).success() )
+   {
+      string data = s.str();
+      h.add( data );
+   }
+   else
+      h.add( obj );
+
+   return _objectHashes[ obj ] = h.get();
+}
+
+
+void SceneHashVisitor::addArray( ContentHash &h, const Array *a )
+{
+   if( !a ) {
+      h.add( 0 );
+      return;
+   }
+
+   h.add( a->getType() );
+   h.add( a->getDataSize() );
+   h.add( a->getNumElements() );
+   h.add( a->getNormalize() );
+   h.add( a->getDataPointer(), a->getTotalDataSize() );
+}
+
+
+/**
+ * Hashes the image data of textures, as osgb serialization
+ * stores just image file names.
+ */
+void SceneHashVisitor::addImages( ContentHash &h, const StateAttribute *a )
+{
+   const Texture *t = dynamic_cast< const Texture* >( a );
+   if( !t )
+      return;
+
+   for( unsigned int i=0, c=t->getNumImages(); i<c; i++ ) {
+      const Image *image = t->getImage( i );
+      if( !image )
+         continue;
+
+      // memoized value
+      ObjectHashes::iterator it = _objectHashes.find( image );
+      if( it != _objectHashes.end() ) {
+         h.add( it->second );
+         continue;
+      }
+
+      ContentHash ih;
+      ih.add( image->s() );
+      ih.add( image->t() );
+      ih.add( image->r() );
+      ih.add( image->getPixelFormat() );
+      ih.add( image->getDataType() );
+      if( image->data() )
+         ih.add( image->data(), image->getTotalSizeInBytesIncludingMipmaps() );
+      h.add( _objectHashes[ image ] = ih.get() );
+   }
+}
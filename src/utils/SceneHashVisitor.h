@@ -0,0 +1,74 @@
+/**
+ * @file
+ * SceneHashVisitor class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef SCENE_HASH_VISITOR_H
+#define SCENE_HASH_VISITOR_H
+
+#include <osg/NodeVisitor>
+#include <osgDB/Options>
+#include <map>
+#include <set>
+#include "utils/ContentHash.h"
+
+namespace osg {
+   class Geometry;
+}
+namespace osgDB {
+   class ReaderWriter;
+}
+
+
+/**
+ * The visitor computes structural hash of each node in the scene graph.
+ *
+ * The hash of a node covers the node type and its parameters,
+ * its StateSet, its Drawables including vertex arrays and primitive sets,
+ * and the hashes of all its children. Thus, two subgraphs with the same hash
+ * are considered identical. State attributes and drawables other than
+ * Geometry are hashed through their osgb serialization. Hashes are memoized,
+ * so multi-parented subgraphs and shared StateSets are processed only once.
+ */
+class SceneHashVisitor : public osg::NodeVisitor
+{
+public:
+
+   typedef ContentHash::Value Value;
+
+   SceneHashVisitor();
+
+   META_NodeVisitor( "Lexolights", "SceneHashVisitor" )
+
+   virtual void apply( osg::Node& node );
+
+   bool getHash( const osg::Node *node, Value &hash ) const;
+   bool containsLight( const osg::Node *node ) const;
+
+   Value getStateSetHash( const osg::StateSet *ss );
+   Value getDrawableHash( const osg::Drawable *drawable );
+   Value getGeometryDataHash( const osg::Geometry *g );
+   Value getObjectHash( const osg::Object *obj );
+
+protected:
+
+   void addArray( ContentHash &h, const osg::Array *a );
+   void addImages( ContentHash &h, const osg::StateAttribute *a );
+
+   std::map< const osg::Node*, Value > _nodeHashes;
+   std::set< const osg::Node*> _lightNodes;
+
+   // objects are referenced to keep the memoized addresses valid
+   typedef std::map< osg::ref_ptr< const osg::Object >, Value > ObjectHashes;
+   ObjectHashes _objectHashes;
+   ObjectHashes _geometryDataHashes;
+
+   osgDB::ReaderWriter *_osgbWriter;
+   osg::ref_ptr< osgDB::Options > _osgbOptions;
+
+};
+
+
+#endif /* SCENE_HASH_VISITOR_H */
@@ -0,0 +1,103 @@
+/**
+ * @file
+ * SceneOptimizer class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osg/Timer>
+#include <osgUtil/Optimizer>
+#include "utils/SceneOptimizer.h"
+#include "utils/SceneStatsVisitor.h"
+
+using namespace osg;
+using namespace osgUtil;
+
+
+
+SceneOptimizer::SceneOptimizer( Preset preset )
+   : _preset( preset ),
+     _time( 0. ),
+     _drawCallsBefore( 0 ),
+     _drawCallsAfter( 0 ),
+     _trianglesBefore( 0 ),
+     _trianglesAfter( 0 )
+{
+}
+
+
+/**
+ * Returns osgUtil::Optimizer options of the preset.
+ */
+unsigned int SceneOptimizer::getOptimizerOptions( Preset preset )
+{
+   switch( preset ) {
+      case FAST:
+         return Optimizer::SHARE_DUPLICATE_STATE |
+                Optimizer::MERGE_GEODES |
+                Optimizer::MERGE_GEOMETRY;
+      case FULL:
+         return Optimizer::SHARE_DUPLICATE_STATE |
+                Optimizer::REMOVE_REDUNDANT_NODES |
+                Optimizer::FLATTEN_STATIC_TRANSFORMS |
+                Optimizer::MERGE_GEODES |
+                Optimizer::MERGE_GEOMETRY |
+                Optimizer::INDEX_MESH |
+                Optimizer::VERTEX_POSTTRANSFORM |
+                Optimizer::VERTEX_PRETRANSFORM;
+      default:
+         return 0;
+   }
+}
+
+
+/**
+ * Converts the preset name ("none", "fast" or "full") to Preset.
+ * Returns false for unknown names.
+ */
+bool SceneOptimizer::parsePreset( const std::string &name, Preset &preset )
+{
+   if( name == "none" )  preset = NONE;
+   else if( name == "fast" )  preset = FAST;
+   else if( name == "full" )  preset = FULL;
+   else  return false;
+   return true;
+}
+
+
+const char* SceneOptimizer::getPresetName( Preset preset )
+{
+   switch( preset ) {
+      case FAST: return "fast";
+      case FULL: return "full";
+      default:   return "none";
+   }
+}
+
+
+/**
+ * Optimizes the scene in place. The statistics are collected before
+ * and after the optimization, the time does not include the statistics.
+ */
+void SceneOptimizer::optimize( Node *scene )
+{
+   if( _preset == NONE || !scene )
+      return;
+
+   SceneStatsVisitor stats;
+   scene->accept( stats );
+   stats.totalUpStats();
+   _drawCallsBefore = stats.getNumDrawCalls();
+   _trianglesBefore = stats.getNumTriangles();
+
+   Timer time;
+   Optimizer optimizer;
+   optimizer.optimize( scene, getOptimizerOptions( _preset ) );
+   _time = time.time_m();
+
+   stats.reset();
+   scene->accept( stats );
+   stats.totalUpStats();
+   _drawCallsAfter = stats.getNumDrawCalls();
+   _trianglesAfter = stats.getNumTriangles();
+}
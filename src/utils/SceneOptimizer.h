@@ -0,0 +1,75 @@
+/**
+ * @file
+ * SceneOptimizer class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef SCENE_OPTIMIZER_H
+#define SCENE_OPTIMIZER_H
+
+#include <osg/Node>
+#include <string>
+
+
+/**
+ * SceneOptimizer runs osgUtil::Optimizer on the loaded scene
+ * with the set of optimizations given by the preset.
+ *
+ * FAST preset shares duplicate StateSets and merges Geodes and Geometries
+ * sharing the state. It removes most of the draw calls of the models made
+ * of many small shapes while it takes little time.
+ *
+ * FULL preset additionally removes redundant nodes, flattens static transforms,
+ * converts the geometry to indexed triangles and reorders the vertices
+ * for the post-transform and pre-transform vertex caches.
+ *
+ * The draw calls and triangles before and after the optimization are counted
+ * by SceneStatsVisitor.
+ */
+class SceneOptimizer
+{
+public:
+
+   enum Preset { NONE = 0, FAST, FULL };
+
+   SceneOptimizer( Preset preset );
+
+   void optimize( osg::Node *scene );
+
+   inline Preset getPreset() const;
+   inline double getTime() const;
+   inline unsigned int getDrawCallsBefore() const;
+   inline unsigned int getDrawCallsAfter() const;
+   inline unsigned int getTrianglesBefore() const;
+   inline unsigned int getTrianglesAfter() const;
+
+   static unsigned int getOptimizerOptions( Preset preset );
+   static bool parsePreset( const std::string &name, Preset &preset );
+   static const char* getPresetName( Preset preset );
+
+protected:
+
+   Preset _preset;
+   double _time;
+   unsigned int _drawCallsBefore;
+   unsigned int _drawCallsAfter;
+   unsigned int _trianglesBefore;
+   unsigned int _trianglesAfter;
+
+};
+
+
+//
+//  inline methods
+//
+
+inline SceneOptimizer::Preset SceneOptimizer::getPreset() const  { return _preset; }
+inline double SceneOptimizer::getTime() const  { return _time; }
+inline unsigned int SceneOptimizer::getDrawCallsBefore() const  { return _drawCallsBefore; }
+inline unsigned int SceneOptimizer::getDrawCallsAfter() const  { return _drawCallsAfter; }
+inline unsigned int SceneOptimizer::getTrianglesBefore() const  { return _trianglesBefore; }
+inline unsigned int SceneOptimizer::getTrianglesAfter() const  { return _trianglesAfter; }
+
+
+#endif /* SCENE_OPTIMIZER_H */
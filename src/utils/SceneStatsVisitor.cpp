@@ -0,0 +1,150 @@
+/**
+ * @file
+ * SceneStatsVisitor class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osg/LightSource>
+#include "utils/SceneStatsVisitor.h"
+#include "utils/GeometryDeduplicator.h"
+#include "utils/ParallelKdTreeBuilder.h"
+
+using namespace osg;
+
+
+
+SceneStatsVisitor::SceneStatsVisitor()
+   : _numInstancedLightSources( 0 ),
+     _numInstancedTextures( 0 ),
+     _numInstancedShaderPrograms( 0 ),
+     _kdTreeMemory( 0 )
+{
+}
+
+
+void SceneStatsVisitor::reset()
+{
+   inherited::reset();
+
+   _numInstancedLightSources = 0;
+   _numInstancedTextures = 0;
+   _numInstancedShaderPrograms = 0;
+   _lightSourceSet.clear();
+   _textureSet.clear();
+   _shaderProgramSet.clear();
+   _kdTreeSet.clear();
+   _kdTreeMemory = 0;
+   _drawableInstances.clear();
+}
+
+
+void SceneStatsVisitor::apply( StateSet &ss )
+{
+   inherited::apply( ss );
+
+   // Textures
+   int c = ss.getNumTextureAttributeLists();
+   for( int i=0; i<c; i++ )
+   {
+      Texture *t = dynamic_cast< Texture* >( ss.getTextureAttribute( i, StateAttribute::TEXTURE ) );
+      if( t )
+      {
+         ++_numInstancedTextures;
+         _textureSet.insert( t );
+      }
+   }
+
+   // shader programs
+   Program *p = dynamic_cast< Program* >( ss.getAttribute( StateAttribute::PROGRAM ) );
+   if( p )
+   {
+      ++_numInstancedShaderPrograms;
+      _shaderProgramSet.insert( p );
+   }
+}
+
+
+void SceneStatsVisitor::apply( Drawable &drawable )
+{
+   inherited::apply( drawable );
+   _drawableInstances[ &drawable ]++;
+
+   // KdTrees
+   // (the shape may be just being set by lazy KdTree building)
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( ParallelKdTreeBuilder::getShapeMutex() );
+   KdTree *kdTree = dynamic_cast< KdTree* >( drawable.getShape() );
+   if( kdTree && _kdTreeSet.insert( kdTree ).second )
+      _kdTreeMemory += ParallelKdTreeBuilder::getMemoryUsage( kdTree );
+}
+
+
+void SceneStatsVisitor::apply( LightSource &node )
+{
+   if( node.getStateSet() )
+   {
+      apply( *node.getStateSet() );
+   }
+
+   ++_numInstancedLightSources;
+   _lightSourceSet.insert( &node );
+   traverse( node );
+}
+
+
+/**
+ * Returns the number of instanced triangles (separated, in strips and in fans).
+ */
+unsigned int SceneStatsVisitor::getNumTriangles() const
+{
+   osgUtil::Statistics::PrimitiveCountMap &m =
+         const_cast< osgUtil::Statistics& >( _instancedStats ).getPrimitiveCountMap();
+   return m[GL_TRIANGLES] + m[GL_TRIANGLE_STRIP] + m[GL_TRIANGLE_FAN];
+}
+
+
+/**
+ * Returns the number of instanced primitive sets.
+ * Each of them is rendered by a single draw call.
+ */
+unsigned int SceneStatsVisitor::getNumDrawCalls() const
+{
+   const osgUtil::Statistics::PrimitiveValueMap &m =
+         const_cast< osgUtil::Statistics& >( _instancedStats ).getPrimitiveValueMap();
+   unsigned int n = 0;
+   for( osgUtil::Statistics::PrimitiveValueMap::const_iterator it = m.begin(); it != m.end(); it++ )
+      n += it->second.first;
+   return n;
+}
+
+
+/**
+ * Returns the number of unique drawables that are instanced more than once.
+ */
+unsigned int SceneStatsVisitor::getNumSharedDrawables() const
+{
+   unsigned int n = 0;
+   for( std::map< Drawable*, unsigned int >::const_iterator it = _drawableInstances.begin();
+        it != _drawableInstances.end(); it++ )
+      if( it->second > 1 )
+         n++;
+   return n;
+}
+
+
+/**
+ * Returns the memory in bytes that would be needed by the separate copies
+ * of the shared geometries (see GeometryDeduplicator).
+ */
+unsigned long long SceneStatsVisitor::getMemorySavedBySharing() const
+{
+   unsigned long long size = 0;
+   for( std::map< Drawable*, unsigned int >::const_iterator it = _drawableInstances.begin();
+        it != _drawableInstances.end(); it++ )
+   {
+      const Geometry *g = it->first->asGeometry();
+      if( g && it->second > 1 )
+         size += ( it->second - 1 ) * GeometryDeduplicator::getMemoryUsage( g );
+   }
+   return size;
+}
@@ -0,0 +1,56 @@
+/**
+ * @file
+ * SceneStatsVisitor class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef SCENE_STATS_VISITOR_H
+#define SCENE_STATS_VISITOR_H
+
+#include <osg/KdTree>
+#include <osg/Program>
+#include <osg/Texture>
+#include <osgUtil/Statistics>
+#include <map>
+#include <set>
+
+
+/**
+ * StatsVisitor collecting also lights, textures, shader programs and KdTrees.
+ *
+ * It is used by SceneInfoDialog and for the reports of scene processing
+ * (see SceneOptimizer). Call totalUpStats() after the traversal.
+ */
+class SceneStatsVisitor : public osgUtil::StatsVisitor
+{
+   typedef osgUtil::StatsVisitor inherited;
+
+public:
+
+   SceneStatsVisitor();
+
+   virtual void reset();
+
+   virtual void apply( osg::StateSet &ss );
+   virtual void apply( osg::Drawable &drawable );
+   virtual void apply( osg::LightSource &node );
+
+   unsigned int getNumTriangles() const;
+   unsigned int getNumDrawCalls() const;
+   unsigned int getNumSharedDrawables() const;
+   unsigned long long getMemorySavedBySharing() const;
+
+   unsigned int _numInstancedLightSources;
+   unsigned int _numInstancedTextures;
+   unsigned int _numInstancedShaderPrograms;
+   NodeSet _lightSourceSet;
+   std::set< osg::Texture* > _textureSet;
+   std::set< osg::Program* > _shaderProgramSet;
+   std::set< osg::KdTree* > _kdTreeSet;
+   unsigned long long _kdTreeMemory;
+   std::map< osg::Drawable*, unsigned int > _drawableInstances;
+};
+
+
+#endif /* SCENE_STATS_VISITOR_H */
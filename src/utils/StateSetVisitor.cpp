@@ -24,6 +24,9 @@ void StateSetVisitor::apply( Drawable& drawable )
 
 void StateSetVisitor::apply( Node& node )
 {
+   if( isCanceled() )
+      return;
+
    StateSet *ss = node.getStateSet();
    if( ss )
       apply( *ss );
@@ -34,6 +37,9 @@ void StateSetVisitor::apply( Node& node )
 
 void StateSetVisitor::apply( Geode& geode )
 {
+   if( isCanceled() )
+      return;
+
    StateSet *ss = geode.getStateSet();
    if( ss )
       apply( *ss );
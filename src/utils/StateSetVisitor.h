@@ -10,6 +10,7 @@
 #define STATE_SET_VISITOR_H
 
 #include <osg/NodeVisitor>
+#include "utils/CancellationToken.h"
 
 
 class StateSetVisitor : public osg::NodeVisitor
@@ -28,6 +29,14 @@ public:
     virtual void apply( osg::Node& node );
     virtual void apply( osg::Geode& geode );
 
+    // the traversal stops when the token is canceled
+    inline void setCancellationToken( CancellationToken *token )  { _cancellationToken = token; }
+    inline bool isCanceled() const  { return _cancellationToken.valid() && _cancellationToken->isCanceled(); }
+
+protected:
+
+    osg::ref_ptr< CancellationToken > _cancellationToken;
+
 };
 
 
@@ -0,0 +1,99 @@
+/**
+ * @file
+ * StateSetVisitorPipeline class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osg/Drawable>
+#include "utils/StateSetVisitorPipeline.h"
+
+using namespace osg;
+
+
+
+StateSetVisitorPipeline::StateSetVisitorPipeline()
+   : inherited()
+{
+}
+
+
+/**
+ * Appends the step to the pipeline. The name is used for the timing reports.
+ */
+void StateSetVisitorPipeline::addStep( StateSetVisitor *step, const std::string &name )
+{
+   Step s;
+   s.visitor = step;
+   s.name = name;
+   s.ticks = 0;
+   _steps.push_back( s );
+}
+
+
+/**
+ * Returns the time spent in the step i in milliseconds.
+ */
+double StateSetVisitorPipeline::getStepTime( unsigned int i ) const
+{
+   return Timer::instance()->delta_m( 0, _steps[i].ticks );
+}
+
+
+/**
+ * Returns the time spent in all the steps in milliseconds.
+ */
+double StateSetVisitorPipeline::getTotalStepTime() const
+{
+   Timer_t ticks = 0;
+   for( unsigned int i=0; i<_steps.size(); i++ )
+      ticks += _steps[i].ticks;
+   return Timer::instance()->delta_m( 0, ticks );
+}
+
+
+/**
+ * Forgets the visited StateSets and Drawables and resets the step times.
+ * The steps are reset as well.
+ */
+void StateSetVisitorPipeline::reset()
+{
+   inherited::reset();
+
+   _visitedStateSets.clear();
+   _visitedDrawables.clear();
+   for( unsigned int i=0; i<_steps.size(); i++ ) {
+      _steps[i].visitor->reset();
+      _steps[i].ticks = 0;
+   }
+}
+
+
+void StateSetVisitorPipeline::apply( StateSet& stateSet )
+{
+   if( !_visitedStateSets.insert( &stateSet ).second )
+      return;
+
+   Timer *timer = Timer::instance();
+   for( unsigned int i=0; i<_steps.size(); i++ ) {
+      Timer_t t = timer->tick();
+      _steps[i].visitor->apply( stateSet );
+      _steps[i].ticks += timer->tick() - t;
+   }
+}
+
+
+void StateSetVisitorPipeline::apply( Drawable& drawable )
+{
+   if( !_visitedDrawables.insert( &drawable ).second )
+      return;
+
+   // each step processes the drawable as it would do in its own traversal
+   // (by default, StateSetVisitor processes the drawable's StateSet)
+   Timer *timer = Timer::instance();
+   for( unsigned int i=0; i<_steps.size(); i++ ) {
+      Timer_t t = timer->tick();
+      _steps[i].visitor->apply( drawable );
+      _steps[i].ticks += timer->tick() - t;
+   }
+}
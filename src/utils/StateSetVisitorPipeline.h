@@ -0,0 +1,76 @@
+/**
+ * @file
+ * StateSetVisitorPipeline class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef STATE_SET_VISITOR_PIPELINE_H
+#define STATE_SET_VISITOR_PIPELINE_H
+
+#include <osg/Timer>
+#include <set>
+#include <string>
+#include <vector>
+#include "utils/StateSetVisitor.h"
+
+
+/**
+ * StateSetVisitorPipeline runs multiple StateSetVisitors in a single traversal.
+ *
+ * Each StateSet and Drawable of the scene is passed to all the steps
+ * in the order they were added. The steps are applied to each node StateSet
+ * and each Drawable only once, even if they are shared by many nodes.
+ * The time spent in each step is measured and can be read
+ * by getStepTime(). The rest of the traversal time is the traversal
+ * overhead shared by all the steps.
+ *
+ * The steps that depend on the results of the whole traversal
+ * have to be run by another traversal.
+ */
+class StateSetVisitorPipeline : public StateSetVisitor
+{
+   typedef StateSetVisitor inherited;
+
+public:
+
+   StateSetVisitorPipeline();
+
+   META_NodeVisitor( "Lexolights", "StateSetVisitorPipeline" )
+
+   void addStep( StateSetVisitor *step, const std::string &name );
+   inline unsigned int getNumSteps() const;
+   inline StateSetVisitor* getStep( unsigned int i ) const;
+   inline const std::string& getStepName( unsigned int i ) const;
+   double getStepTime( unsigned int i ) const;
+   double getTotalStepTime() const;
+
+   virtual void reset();
+
+   virtual void apply( osg::StateSet& stateSet );
+   virtual void apply( osg::Drawable& drawable );
+
+protected:
+
+   struct Step {
+      osg::ref_ptr< StateSetVisitor > visitor;
+      std::string name;
+      osg::Timer_t ticks;
+   };
+   std::vector< Step > _steps;
+   std::set< osg::StateSet* > _visitedStateSets;
+   std::set< osg::Drawable* > _visitedDrawables;
+
+};
+
+
+//
+//  inline methods
+//
+
+inline unsigned int StateSetVisitorPipeline::getNumSteps() const  { return (unsigned int)( _steps.size() ); }
+inline StateSetVisitor* StateSetVisitorPipeline::getStep( unsigned int i ) const  { return _steps[i].visitor.get(); }
+inline const std::string& StateSetVisitorPipeline::getStepName( unsigned int i ) const  { return _steps[i].name; }
+
+
+#endif /* STATE_SET_VISITOR_PIPELINE_H */
@@ -10,14 +10,17 @@
 #include <QString>
 #if defined(__WIN32__) || defined(_WIN32)
 # include <windows.h>
+# include <psapi.h>
 #else
 # include <X11/Xlib.h>
 # include <X11/extensions/xf86vmode.h>
 # include <GL/glx.h>
+# include <unistd.h>
 # define WINAPI
 #endif
 #include <GL/gl.h>
 #include <cassert>
+#include <cstdio>
 #include <osg/Version>
 #include "SysInfo.h"
 #include "utils/Log.h"
@@ -869,3 +872,37 @@ QString SysInfo::getGraphicsDriverInfo()
    return r;
 
 }
+
+
+/**
+ * Returns the resident memory (working set) of the process in bytes.
+ * Returns 0 if it is not supported on the system.
+ */
+unsigned long long SysInfo::getResidentMemory()
+{
+#if defined(__WIN32__) || defined(_WIN32)
+
+   PROCESS_MEMORY_COUNTERS pmc;
+   if( !GetProcessMemoryInfo( GetCurrentProcess(), &pmc, sizeof( pmc ) ) )
+      return 0;
+   return pmc.WorkingSetSize;
+
+#elif defined(__linux__)
+
+   // the second value of statm is the number of resident pages
+   FILE *f = fopen( "/proc/self/statm", "r" );
+   if( !f )
+      return 0;
+   unsigned long size, resident;
+   int n = fscanf( f, "%lu %lu", &size, &resident );
+   fclose( f );
+   if( n != 2 )
+      return 0;
+   return (unsigned long long)( resident ) * sysconf( _SC_PAGESIZE );
+
+#else
+
+   return 0;
+
+#endif
+}
@@ -34,6 +34,8 @@ namespace SysInfo {
    QString getQtCompileVersion();
    QString getLibInfo();
    QString getGraphicsDriverInfo();
+
+   unsigned long long getResidentMemory();
 }
 
 
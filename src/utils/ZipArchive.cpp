@@ -0,0 +1,789 @@
+/**
+ * @file
+ * ZipArchive class implementation.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#include <osg/Notify>
+#include <osgDB/ConvertUTF>
+#include <osgDB/FileNameUtils>
+#include <istream>
+#include <streambuf>
+#include <vector>
+#include <QAtomicInt>
+#include <QDir>
+#include <QFile>
+#include <QRunnable>
+#include <QThread>
+#include <QThreadPool>
+#include "ZipArchive.h"
+
+using namespace std;
+using namespace osg;
+using namespace osgDB;
+
+
+ZipArchive::MountMap ZipArchive::_mounted;
+OpenThreads::Mutex ZipArchive::_mountMutex;
+
+
+
+/**
+ * Converts UTF-8 file name to the string accepted by minizip's fopen.
+ */
+static string systemFileName( const string &fileName )
+{
+#if defined(__WIN32__) || defined(_WIN32)
+   return convertStringFromUTF8toCurrentCodePage( fileName );
+#else
+   return fileName;
+#endif
+}
+
+
+
+/**
+ * Stream buffer decompressing single zip entry.
+ *
+ * It owns its unzFile handle, so more entries (or the same entry)
+ * can be read by more threads in parallel. The data are decompressed
+ * into the buffer of ZipArchive::streamBufferSize bytes.
+ * Seeking forward is performed by decompression of the skipped data,
+ * seeking backward restarts the decompression from the beginning of the entry.
+ */
+class ZipEntryStreamBuf : public streambuf
+{
+public:
+
+   ZipEntryStreamBuf( const string &zipFileName, const string &password,
+                      const ZipArchive::Entry &entry )
+      : _password( password ),
+        _entry( entry ),
+        _buffer( ZipArchive::streamBufferSize ),
+        _bufferStart( 0 ),
+        _opened( false )
+   {
+      _handle = unzOpen( systemFileName( zipFileName ).c_str() );
+      if( _handle )
+         reopen();
+   }
+
+   virtual ~ZipEntryStreamBuf()
+   {
+      if( _handle ) {
+         if( _opened )
+            unzCloseCurrentFile( _handle );
+         unzClose( _handle );
+      }
+   }
+
+   inline bool isOpen() const  { return _opened; }
+
+protected:
+
+   bool reopen()
+   {
+      if( _opened ) {
+         unzCloseCurrentFile( _handle );
+         _opened = false;
+      }
+
+      char *b = &_buffer[0];
+      setg( b, b, b );
+      _bufferStart = 0;
+
+      if( unzGoToFilePos64( _handle, &_entry.pos ) != UNZ_OK )
+         return false;
+      int e = _password.empty() ? unzOpenCurrentFile( _handle )
+                                : unzOpenCurrentFilePassword( _handle, _password.c_str() );
+      _opened = ( e == UNZ_OK );
+      return _opened;
+   }
+
+   virtual int_type underflow()
+   {
+      if( gptr() < egptr() )
+         return traits_type::to_int_type( *gptr() );
+      if( !_opened )
+         return traits_type::eof();
+
+      // decompress next chunk
+      _bufferStart += egptr() - eback();
+      int n = unzReadCurrentFile( _handle, &_buffer[0], unsigned( _buffer.size() ) );
+      if( n <= 0 ) {
+         if( n < 0 )
+            OSG_WARN << "ZipArchive: Error when decompressing '" << _entry.name << "'." << endl;
+         char *e = &_buffer[0];
+         setg( e, e, e );
+         return traits_type::eof();
+      }
+
+      char *b = &_buffer[0];
+      setg( b, b, b + n );
+      return traits_type::to_int_type( *b );
+   }
+
+   virtual pos_type seekoff( off_type off, ios_base::seekdir dir, ios_base::openmode which )
+   {
+      unsigned long long current = _bufferStart + ( gptr() - eback() );
+      if( dir == ios_base::cur && off == 0 )
+         return pos_type( off_type( current ) );
+
+      off_type target;
+      switch( dir ) {
+         case ios_base::beg: target = off; break;
+         case ios_base::cur: target = off_type( current ) + off; break;
+         case ios_base::end: target = off_type( _entry.uncompressedSize ) + off; break;
+         default: return pos_type( off_type( -1 ) );
+      }
+      return seekpos( pos_type( target ), which );
+   }
+
+   virtual pos_type seekpos( pos_type pos, ios_base::openmode which )
+   {
+      off_type target = off_type( pos );
+      if( !( which & ios_base::in ) || target < 0 ||
+          (unsigned long long)( target ) > _entry.uncompressedSize )
+         return pos_type( off_type( -1 ) );
+
+      // seeking backward => decompress from the beginning
+      if( (unsigned long long)( target ) < _bufferStart )
+         if( !reopen() )
+            return pos_type( off_type( -1 ) );
+
+      // decompress until the target position is in the buffer
+      while( true ) {
+         unsigned long long end = _bufferStart + ( egptr() - eback() );
+         if( (unsigned long long)( target ) <= end ) {
+            setg( eback(), eback() + size_t( target - _bufferStart ), egptr() );
+            return pos;
+         }
+         setg( eback(), egptr(), egptr() );
+         if( traits_type::eq_int_type( underflow(), traits_type::eof() ) )
+            return pos_type( off_type( -1 ) );
+      }
+   }
+
+   unzFile _handle;
+   string _password;
+   ZipArchive::Entry _entry;
+   vector< char > _buffer;
+   unsigned long long _bufferStart;  // position of _buffer[0] inside the uncompressed entry
+   bool _opened;
+};
+
+
+/**
+ * Input stream owning its ZipEntryStreamBuf.
+ */
+class ZipEntryStream : public istream
+{
+public:
+   ZipEntryStream( const string &zipFileName, const string &password,
+                   const ZipArchive::Entry &entry )
+      : istream( NULL ),
+        _buf( zipFileName, password, entry )
+   {
+      rdbuf( &_buf );
+      if( !_buf.isOpen() )
+         setstate( ios_base::failbit );
+   }
+
+protected:
+   ZipEntryStreamBuf _buf;
+};
+
+
+
+/**
+ * Stream buffer reading entry data decompressed into memory by loadToMemory().
+ */
+class MemoryEntryStreamBuf : public streambuf
+{
+public:
+
+   MemoryEntryStreamBuf( Referenced *owner, vector< char > &data )
+      : _owner( owner )
+   {
+      char *b = data.empty() ? NULL : &data[0];
+      setg( b, b, b + data.size() );
+   }
+
+protected:
+
+   virtual pos_type seekoff( off_type off, ios_base::seekdir dir, ios_base::openmode which )
+   {
+      off_type target;
+      switch( dir ) {
+         case ios_base::beg: target = off; break;
+         case ios_base::cur: target = off_type( gptr() - eback() ) + off; break;
+         case ios_base::end: target = off_type( egptr() - eback() ) + off; break;
+         default: return pos_type( off_type( -1 ) );
+      }
+      return seekpos( pos_type( target ), which );
+   }
+
+   virtual pos_type seekpos( pos_type pos, ios_base::openmode which )
+   {
+      off_type target = off_type( pos );
+      if( !( which & ios_base::in ) || target < 0 || target > off_type( egptr() - eback() ) )
+         return pos_type( off_type( -1 ) );
+      setg( eback(), eback() + size_t( target ), egptr() );
+      return pos;
+   }
+
+   ref_ptr< Referenced > _owner;  // keeps the data alive
+};
+
+
+/**
+ * Input stream owning its MemoryEntryStreamBuf.
+ */
+class MemoryEntryStream : public istream
+{
+public:
+   MemoryEntryStream( Referenced *owner, vector< char > &data )
+      : istream( NULL ),
+        _buf( owner, data )
+   {
+      rdbuf( &_buf );
+   }
+
+protected:
+   MemoryEntryStreamBuf _buf;
+};
+
+
+
+/**
+ * Worker decompressing the archive entries.
+ *
+ * Each worker opens its own unzFile handle and takes
+ * the entries one by one from the shared list until the list is exhausted.
+ * The entries are decompressed through the buffer of ZipArchive::streamBufferSize
+ * bytes either into the files in the directory or into the memory.
+ */
+class ZipArchive::DecompressTask : public QRunnable
+{
+public:
+
+   DecompressTask( const ZipArchive *archive, const vector< const Entry* > &entries,
+                   const string *directory, vector< ref_ptr< MemoryData > > *memory,
+                   QAtomicInt *nextEntry, QAtomicInt *numErrors )
+      : _archive( archive ), _entries( entries ), _directory( directory ), _memory( memory ),
+        _nextEntry( nextEntry ), _numErrors( numErrors )  {}
+
+   virtual void run()
+   {
+      unzFile handle = unzOpen( systemFileName( _archive->getFileName() ).c_str() );
+      if( !handle ) {
+         OSG_WARN << "ZipArchive: Can not open file '" << _archive->getFileName() << "'." << endl;
+         _numErrors->fetchAndAddOrdered( 1 );
+         return;
+      }
+
+      vector< char > buffer( streamBufferSize );
+      while( true ) {
+         int i = _nextEntry->fetchAndAddOrdered( 1 );
+         if( i >= int( _entries.size() ) )
+            break;
+         if( !decompress( handle, *_entries[i], buffer, i ) ) {
+            OSG_WARN << "ZipArchive: Error when decompressing '" << _entries[i]->name
+                     << "' from '" << _archive->getFileName() << "'." << endl;
+            _numErrors->fetchAndAddOrdered( 1 );
+         }
+      }
+
+      unzClose( handle );
+   }
+
+protected:
+
+   bool decompress( unzFile handle, const Entry &entry, vector< char > &buffer, int index )
+   {
+      // open entry
+      if( unzGoToFilePos64( handle, &entry.pos ) != UNZ_OK )
+         return false;
+      const string &password = _archive->getPassword();
+      int e = password.empty() ? unzOpenCurrentFile( handle )
+                               : unzOpenCurrentFilePassword( handle, password.c_str() );
+      if( e != UNZ_OK )
+         return false;
+
+      // open output file
+      // (QFile expects '/' as separator on all platforms)
+      QFile file;
+      MemoryData *memory = NULL;
+      if( _directory ) {
+         QString path = QString::fromUtf8( ( *_directory + '/' + entry.name ).c_str() );
+         QDir().mkpath( path.section( '/', 0, -2 ) );
+         file.setFileName( path );
+         if( !file.open( QIODevice::WriteOnly ) ) {
+            unzCloseCurrentFile( handle );
+            return false;
+         }
+      } else {
+         memory = new MemoryData;
+         memory->data.reserve( size_t( entry.uncompressedSize ) );
+         (*_memory)[index] = memory;
+      }
+
+      // decompress
+      bool ok = true;
+      while( true ) {
+         int n = unzReadCurrentFile( handle, &buffer[0], unsigned( buffer.size() ) );
+         if( n < 0 )
+            ok = false;
+         if( n <= 0 )
+            break;
+         if( memory )
+            memory->data.insert( memory->data.end(), buffer.begin(), buffer.begin() + n );
+         else
+            if( file.write( &buffer[0], n ) != n ) {
+               ok = false;
+               break;
+            }
+      }
+
+      if( unzCloseCurrentFile( handle ) != UNZ_OK )  // returns UNZ_CRCERROR on damaged data
+         ok = false;
+      return ok;
+   }
+
+   const ZipArchive *_archive;
+   const vector< const Entry* > &_entries;
+   const string *_directory;
+   vector< ref_ptr< MemoryData > > *_memory;
+   QAtomicInt *_nextEntry;
+   QAtomicInt *_numErrors;
+};
+
+
+
+ZipArchive::ZipArchive()
+   : _isOpen( false )
+{
+}
+
+
+ZipArchive::~ZipArchive()
+{
+   unmount();
+}
+
+
+/**
+ * Opens the archive and reads its central directory.
+ *
+ * fileName is expected in UTF-8 encoding. The password is used
+ * for decompression of encrypted entries.
+ */
+bool ZipArchive::open( const std::string &fileName, const std::string &password )
+{
+   close();
+
+   unzFile handle = unzOpen( systemFileName( fileName ).c_str() );
+   if( !handle ) {
+      OSG_WARN << "ZipArchive: Can not open file '" << fileName << "'." << endl;
+      return false;
+   }
+
+   int e = unzGoToFirstFile( handle );
+   while( e == UNZ_OK ) {
+
+      // get file info and file name
+      unz_file_info64 fileInfo;
+      e = unzGetCurrentFileInfo64( handle, &fileInfo, NULL, 0, NULL, 0, NULL, 0 );
+      if( e != UNZ_OK )
+         break;
+      vector< char > nameBuf( fileInfo.size_filename + 1 );  // +1 because of terminating character '\0'
+      e = unzGetCurrentFileInfo64( handle, &fileInfo, &nameBuf[0], uLong( nameBuf.size() ), NULL, 0, NULL, 0 );
+      if( e != UNZ_OK )
+         break;
+
+      // if bit 11 (dec value 2048) of general purpose flag is set, file names are in UTF-8 encoding,
+      // otherwise local char set is used
+      Entry entry;
+      if( fileInfo.flag & 2048 )
+         entry.name = &nameBuf[0];
+      else
+         entry.name = convertStringFromCurrentCodePageToUTF8( &nameBuf[0] );
+      entry.name = convertFileNameToUnixStyle( entry.name );
+      entry.compressedSize = fileInfo.compressed_size;
+      entry.uncompressedSize = fileInfo.uncompressed_size;
+
+      // store file entries (directories are skipped)
+      if( !entry.name.empty() && entry.name[ entry.name.size()-1 ] != '/' ) {
+         e = unzGetFilePos64( handle, &entry.pos );
+         if( e != UNZ_OK )
+            break;
+         _entries[ normalizeName( entry.name ) ] = entry;
+      }
+
+      e = unzGoToNextFile( handle );
+   }
+   unzClose( handle );
+
+   if( e != UNZ_END_OF_LIST_OF_FILE ) {
+      OSG_WARN << "ZipArchive: Error when reading central directory of '" << fileName << "'." << endl;
+      _entries.clear();
+      return false;
+   }
+
+   _fileName = fileName;
+   _password = password;
+   _isOpen = true;
+   return true;
+}
+
+
+/**
+ * Unmounts the archive and forgets its entries.
+ */
+void ZipArchive::close()
+{
+   unmount();
+   _memoryStore.clear();
+   _entries.clear();
+   _fileName.clear();
+   _password.clear();
+   _isOpen = false;
+}
+
+
+/**
+ * Returns the entry of the given name or NULL if the archive does not contain it.
+ * The name is compared case-insensitively.
+ */
+const ZipArchive::Entry* ZipArchive::findEntry( const std::string &name ) const
+{
+   EntryMap::const_iterator it = _entries.find( normalizeName( name ) );
+   return it != _entries.end() ? &it->second : NULL;
+}
+
+
+/**
+ * Returns the stream of the decompressed entry data.
+ *
+ * The caller is responsible for the deletion of the stream.
+ * The stream has failbit set if the entry can not be opened.
+ */
+std::istream* ZipArchive::openEntry( const Entry &entry ) const
+{
+   // entries loaded by loadToMemory()
+   if( !_memoryStore.empty() ) {
+      MemoryStore::const_iterator it = _memoryStore.find( normalizeName( entry.name ) );
+      if( it != _memoryStore.end() )
+         return new MemoryEntryStream( it->second.get(), it->second->data );
+   }
+
+   return new ZipEntryStream( _fileName, _password, entry );
+}
+
+
+/**
+ * Returns the total size of all the entries after decompression.
+ */
+unsigned long long ZipArchive::getUncompressedSize() const
+{
+   unsigned long long size = 0;
+   for( EntryMap::const_iterator it = _entries.begin(); it != _entries.end(); it++ )
+      size += it->second.uncompressedSize;
+   return size;
+}
+
+
+/**
+ * Extracts all the entries into the directory using numThreads worker threads.
+ *
+ * The directory structure of the archive is recreated in the directory.
+ * If numThreads is zero or negative, number of threads is given by the number of CPU cores.
+ */
+bool ZipArchive::extractTo( const std::string &directory, int numThreads )
+{
+   return decompressAll( &directory, NULL, numThreads );
+}
+
+
+/**
+ * Decompresses all the entries into the memory using numThreads worker threads.
+ *
+ * The entries are served from the memory by openEntry() afterwards.
+ * The memory is released by releaseMemory() or close().
+ * If numThreads is zero or negative, number of threads is given by the number of CPU cores.
+ */
+bool ZipArchive::loadToMemory( int numThreads )
+{
+   vector< ref_ptr< MemoryData > > memory;
+   bool r = decompressAll( NULL, &memory, numThreads );
+   if( !r )
+      return false;
+
+   // note: the map has the same order as the entry list given to decompressAll()
+   int i = 0;
+   for( EntryMap::const_iterator it = _entries.begin(); it != _entries.end(); it++, i++ )
+      _memoryStore[ it->first ] = memory[i];
+   return true;
+}
+
+
+void ZipArchive::releaseMemory()
+{
+   _memoryStore.clear();
+}
+
+
+bool ZipArchive::decompressAll( const std::string *directory, vector< ref_ptr< MemoryData > > *memory,
+                                int numThreads )
+{
+   if( !_isOpen )
+      return false;
+
+   // list of entries
+   vector< const Entry* > entries;
+   entries.reserve( _entries.size() );
+   for( EntryMap::const_iterator it = _entries.begin(); it != _entries.end(); it++ )
+      entries.push_back( &it->second );
+   if( memory )
+      memory->resize( entries.size() );
+   if( entries.empty() )
+      return true;
+
+   // number of threads
+   if( numThreads <= 0 )
+      numThreads = QThread::idealThreadCount();
+   if( numThreads > int( entries.size() ) )
+      numThreads = int( entries.size() );
+   if( numThreads < 1 )
+      numThreads = 1;
+
+   // decompress on the worker pool
+   QAtomicInt nextEntry( 0 );
+   QAtomicInt numErrors( 0 );
+   QThreadPool pool;
+   pool.setMaxThreadCount( numThreads );
+   for( int i=0; i<numThreads; i++ )
+      pool.start( new DecompressTask( this, entries, directory, memory, &nextEntry, &numErrors ) );
+   pool.waitForDone();
+
+   return numErrors == 0;
+}
+
+
+/**
+ * Makes the content of the archive available to osgDB
+ * under the path of the archive file.
+ */
+void ZipArchive::mount()
+{
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _mountMutex );
+
+   // install read file callback
+   static bool callbackInstalled = false;
+   if( !callbackInstalled ) {
+      Registry *r = Registry::instance();
+      r->setReadFileCallback( new ReadFileCallback( r->getReadFileCallback() ) );
+      callbackInstalled = true;
+   }
+
+   _virtualRoot = normalizeName( _fileName );
+   _mounted[ _virtualRoot ] = this;
+}
+
+
+void ZipArchive::unmount()
+{
+   if( _virtualRoot.empty() )
+      return;
+
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _mountMutex );
+   MountMap::iterator it = _mounted.find( _virtualRoot );
+   if( it != _mounted.end() ) {
+      ref_ptr< ZipArchive > a;
+      if( !it->second.lock( a ) || a == this )
+         _mounted.erase( it );
+   }
+   _virtualRoot.clear();
+}
+
+
+/**
+ * Returns the path of the entry as seen by osgDB when the archive is mounted.
+ */
+std::string ZipArchive::getVirtualPath( const Entry &entry ) const
+{
+   return convertFileNameToUnixStyle( _fileName ) + '/' + entry.name;
+}
+
+
+/**
+ * Looks for the path in the mounted archives.
+ *
+ * Returns true if the path points to a file in a mounted archive.
+ * In that case, archive and entry are set.
+ */
+bool ZipArchive::findMounted( const std::string &path, ref_ptr< ZipArchive > &archive, const Entry* &entry )
+{
+   string name = normalizeName( path );
+
+   OpenThreads::ScopedLock< OpenThreads::Mutex > lock( _mountMutex );
+   for( MountMap::const_iterator it = _mounted.begin(); it != _mounted.end(); it++ ) {
+
+      const string &root = it->first;
+      if( name.size() <= root.size() + 1 || name.compare( 0, root.size(), root ) != 0 ||
+          name[ root.size() ] != '/' )
+         continue;
+
+      ref_ptr< ZipArchive > a;
+      if( !it->second.lock( a ) )
+         continue;
+
+      EntryMap::const_iterator e = a->_entries.find( name.substr( root.size() + 1 ) );
+      if( e == a->_entries.end() )
+         continue;
+
+      archive = a;
+      entry = &e->second;
+      return true;
+   }
+
+   return false;
+}
+
+
+/**
+ * Returns the name in the form used for the lookup of entries.
+ *
+ * The name is converted to unix style, "." and ".." are resolved
+ * and the name is converted to lower case as the archives are usually
+ * created on case-insensitive file systems.
+ */
+std::string ZipArchive::normalizeName( const std::string &name )
+{
+   string s = convertToLowerCase( convertFileNameToUnixStyle( name ) );
+
+   vector< string > parts;
+   string::size_type start = 0;
+   while( start <= s.size() ) {
+      string::size_type end = s.find( '/', start );
+      if( end == string::npos )
+         end = s.size();
+      string part = s.substr( start, end - start );
+      if( part == ".." && !parts.empty() && parts.back() != ".." && !parts.back().empty() )
+         parts.pop_back();
+      else if( part != "." && !( part.empty() && !parts.empty() ) )
+         parts.push_back( part );
+      start = end + 1;
+   }
+
+   string r;
+   for( vector< string >::const_iterator it = parts.begin(); it != parts.end(); it++ ) {
+      if( it != parts.begin() )
+         r += '/';
+      r += *it;
+   }
+   return r;
+}
+
+
+
+ZipArchive::ReadFileCallback::ReadFileCallback( osgDB::ReadFileCallback *previous )
+   : _previous( previous )
+{
+}
+
+
+ReaderWriter::ReadResult ZipArchive::ReadFileCallback::readObject( const std::string &fileName, const Options *options )
+{
+   bool found;
+   ReaderWriter::ReadResult r = readFromArchive( OBJECT, fileName, options, found );
+   if( found )
+      return r;
+   return _previous.valid() ? _previous->readObject( fileName, options )
+                            : osgDB::ReadFileCallback::readObject( fileName, options );
+}
+
+
+ReaderWriter::ReadResult ZipArchive::ReadFileCallback::readImage( const std::string &fileName, const Options *options )
+{
+   bool found;
+   ReaderWriter::ReadResult r = readFromArchive( IMAGE, fileName, options, found );
+   if( found )
+      return r;
+   return _previous.valid() ? _previous->readImage( fileName, options )
+                            : osgDB::ReadFileCallback::readImage( fileName, options );
+}
+
+
+ReaderWriter::ReadResult ZipArchive::ReadFileCallback::readNode( const std::string &fileName, const Options *options )
+{
+   bool found;
+   ReaderWriter::ReadResult r = readFromArchive( NODE, fileName, options, found );
+   if( found )
+      return r;
+   return _previous.valid() ? _previous->readNode( fileName, options )
+                            : osgDB::ReadFileCallback::readNode( fileName, options );
+}
+
+
+/**
+ * Reads the file from a mounted archive.
+ *
+ * The file is passed to the stream reading method of the ReaderWriter
+ * for the file extension. found is set to false if the file is not
+ * inside of any mounted archive.
+ */
+ReaderWriter::ReadResult ZipArchive::ReadFileCallback::readFromArchive( Type type, const std::string &fileName,
+                                                                        const Options *options, bool &found )
+{
+   // list of paths to look at
+   vector< string > paths;
+   paths.push_back( fileName );
+   if( !isAbsolutePath( fileName ) ) {
+      if( options )
+         for( FilePathList::const_iterator it = options->getDatabasePathList().begin();
+              it != options->getDatabasePathList().end(); it++ )
+            paths.push_back( *it + '/' + fileName );
+      const FilePathList &dataPaths = Registry::instance()->getDataFilePathList();
+      for( FilePathList::const_iterator it = dataPaths.begin(); it != dataPaths.end(); it++ )
+         paths.push_back( *it + '/' + fileName );
+   }
+
+   // find the file
+   ref_ptr< ZipArchive > archive;
+   const Entry *entry = NULL;
+   found = false;
+   for( vector< string >::const_iterator it = paths.begin(); it != paths.end() && !found; it++ )
+      found = findMounted( *it, archive, entry );
+   if( !found )
+      return ReaderWriter::ReadResult::FILE_NOT_FOUND;
+
+   // get ReaderWriter
+   string ext = getLowerCaseFileExtension( entry->name );
+   ReaderWriter *rw = Registry::instance()->getReaderWriterForExtension( ext );
+   if( !rw )
+      return ReaderWriter::ReadResult( "Warning: Could not find plugin to read file '" + entry->name +
+                                       "' from archive '" + archive->getFileName() + "'." );
+
+   // nested files are searched relative to the read file
+   string virtualPath = archive->getVirtualPath( *entry );
+   ref_ptr< Options > myOptions = options ? new Options( *options ) : new Options;
+   myOptions->getDatabasePathList().push_front( getFilePath( virtualPath ) );
+
+   // read from stream
+   istream *s = archive->openEntry( *entry );
+   ReaderWriter::ReadResult r( ReaderWriter::ReadResult::ERROR_IN_READING_FILE );
+   if( !s->fail() )
+      switch( type ) {
+         case OBJECT: r = rw->readObject( *s, myOptions ); break;
+         case IMAGE:  r = rw->readImage( *s, myOptions ); break;
+         case NODE:   r = rw->readNode( *s, myOptions ); break;
+      }
+   delete s;
+
+   if( r.validImage() )
+      r.getImage()->setFileName( virtualPath );
+
+   return r;
+}
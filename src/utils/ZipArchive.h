@@ -0,0 +1,147 @@
+/**
+ * @file
+ * ZipArchive class header.
+ *
+ * @author PCJohn (Jan Pečiva)
+ */
+
+#ifndef ZIP_ARCHIVE_H
+#define ZIP_ARCHIVE_H
+
+#include <osg/Referenced>
+#include <osg/observer_ptr>
+#include <osgDB/Registry>
+#include <OpenThreads/Mutex>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+#include "minizip/unzip.h"
+
+
+/**
+ * Read-only access to the content of zip archive.
+ *
+ * open() reads the central directory of the archive only.
+ * The entries are decompressed on demand by the streams returned
+ * from openEntry(). Each stream uses its own unzFile handle
+ * and fixed-size buffer, so multiple entries may be read
+ * concurrently and no entry is ever held in the memory as a whole.
+ *
+ * Alternatively, all entries can be decompressed at once by extractTo()
+ * or loadToMemory() that distribute the entries among the worker threads.
+ *
+ * When mounted, the archive appears to osgDB as a directory
+ * of the same name as the archive file, e.g. the texture wood.png
+ * inside /data/model.ivz is available as /data/model.ivz/wood.png.
+ * The files are served by ZipArchive::ReadFileCallback
+ * that is installed in osgDB::Registry by the first mount().
+ */
+class ZipArchive : public osg::Referenced
+{
+public:
+
+   struct Entry {
+      std::string name;  // in UTF-8, '/' used as separator
+      unz64_file_pos pos;
+      unsigned long long compressedSize;
+      unsigned long long uncompressedSize;
+   };
+   typedef std::map< std::string, Entry > EntryMap;
+
+   ZipArchive();
+
+   bool open( const std::string &fileName, const std::string &password = "" );
+   void close();
+   inline bool isOpen() const;
+   inline const std::string& getFileName() const;
+   inline const std::string& getPassword() const;
+
+   inline const EntryMap& getEntries() const;
+   const Entry* findEntry( const std::string &name ) const;
+   std::istream* openEntry( const Entry &entry ) const;
+   unsigned long long getUncompressedSize() const;
+
+   bool extractTo( const std::string &directory, int numThreads = 0 );
+   bool loadToMemory( int numThreads = 0 );
+   void releaseMemory();
+
+   void mount();
+   void unmount();
+   std::string getVirtualPath( const Entry &entry ) const;
+   static bool findMounted( const std::string &path,
+                            osg::ref_ptr< ZipArchive > &archive, const Entry* &entry );
+
+   static std::string normalizeName( const std::string &name );
+
+   class ReadFileCallback;
+
+   static const unsigned int streamBufferSize = 64*1024;
+
+protected:
+
+   virtual ~ZipArchive();
+
+   struct MemoryData : public osg::Referenced {
+      std::vector< char > data;
+   };
+   typedef std::map< std::string, osg::ref_ptr< MemoryData > > MemoryStore;
+   class DecompressTask;
+   bool decompressAll( const std::string *directory, std::vector< osg::ref_ptr< MemoryData > > *memory,
+                       int numThreads );
+
+   std::string _fileName;
+   std::string _password;
+   std::string _virtualRoot;
+   EntryMap _entries;
+   MemoryStore _memoryStore;
+   bool _isOpen;
+
+   typedef std::map< std::string, osg::observer_ptr< ZipArchive > > MountMap;
+   static MountMap _mounted;
+   static OpenThreads::Mutex _mountMutex;
+
+};
+
+
+/**
+ * osgDB::ReadFileCallback that reads the files from mounted archives.
+ *
+ * The file name is looked up in the mounted archives, first as it is,
+ * then relative to the database paths of the read options and of the registry.
+ * Files not found in any archive are passed to the previously installed
+ * callback or to the default osgDB implementation.
+ */
+class ZipArchive::ReadFileCallback : public osgDB::ReadFileCallback
+{
+public:
+
+   ReadFileCallback( osgDB::ReadFileCallback *previous );
+
+   virtual osgDB::ReaderWriter::ReadResult readObject( const std::string &fileName, const osgDB::Options *options );
+   virtual osgDB::ReaderWriter::ReadResult readImage( const std::string &fileName, const osgDB::Options *options );
+   virtual osgDB::ReaderWriter::ReadResult readNode( const std::string &fileName, const osgDB::Options *options );
+
+protected:
+
+   enum Type { OBJECT, IMAGE, NODE };
+   osgDB::ReaderWriter::ReadResult readFromArchive( Type type, const std::string &fileName,
+                                                     const osgDB::Options *options, bool &found );
+
+   osg::ref_ptr< osgDB::ReadFileCallback > _previous;
+
+};
+
+
+
+//
+//  inline methods
+//
+
+inline bool ZipArchive::isOpen() const  { return _isOpen; }
+inline const std::string& ZipArchive::getFileName() const  { return _fileName; }
+inline const std::string& ZipArchive::getPassword() const  { return _password; }
+inline const ZipArchive::EntryMap& ZipArchive::getEntries() const  { return _entries; }
+
+
+#endif /* ZIP_ARCHIVE_H */